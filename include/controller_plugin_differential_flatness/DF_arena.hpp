@@ -0,0 +1,96 @@
+#ifndef __DF_ARENA_H__
+#define __DF_ARENA_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+
+namespace controller_plugin_differential_flatness {
+
+struct Arena_stats {
+  size_t capacity         = 0;  // bytes of the buffer
+  bool locked             = false;
+  size_t high_water       = 0;  // bytes of the buffer handed to the pools so far
+  size_t in_use           = 0;  // bytes held by the containers
+  size_t in_use_max       = 0;
+  uint64_t allocations    = 0;
+  uint64_t heap_fallbacks = 0;  // allocations served by the global heap instead
+  size_t heap_bytes       = 0;
+};
+
+/**
+ * Memory resource backing every container the plugin owns.
+ *
+ * reserve() maps one buffer, optionally locks it, and faults in all its pages. Allocations are
+ * then served by a synchronized pool over it, which recycles freed blocks, so containers
+ * resized at run time keep reusing the same pages and the global allocator is never reached in
+ * steady state.
+ * Allocations before reserve() or once the buffer is exhausted fall back to the global heap
+ * and are counted, a non-zero heap_fallbacks after initialization means the arena is too small.
+ */
+class Arena : public std::pmr::memory_resource {
+public:
+  // Blocks up to this size are recycled by the pool, larger ones are carved once from the buffer.
+  // Pools take chunks of many blocks at once, so large blocks pooled would reserve several times
+  // their size: the black box rings are carved instead
+  static constexpr size_t kLargestPoolBlock = 64 * 1024;
+
+  Arena() = default;
+  ~Arena() override;
+
+  Arena(const Arena &)            = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  /**
+   * Map and prefault _bytes, and lock them with _lock. Only once, later calls fail. A failed
+   * lock leaves the arena usable but unlocked, returns false and names RLIMIT_MEMLOCK in _error
+   */
+  bool reserve(const size_t _bytes, const bool _lock, std::string &_error);
+
+  Arena_stats stats() const;
+  std::string report() const;
+
+private:
+  // Counts what the pool takes from the buffer, its high water mark as it never gives it back
+  class Buffer : public std::pmr::memory_resource {
+  public:
+    std::optional<std::pmr::monotonic_buffer_resource> monotonic;
+    std::atomic<size_t> used{0};
+
+  private:
+    void *do_allocate(size_t _bytes, size_t _alignment) override;
+    void do_deallocate(void *, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &_other) const noexcept override {
+      return this == &_other;
+    }
+  };
+
+  void *do_allocate(size_t _bytes, size_t _alignment) override;
+  void do_deallocate(void *_ptr, size_t _bytes, size_t _alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource &_other) const noexcept override {
+    return this == &_other;
+  }
+
+  bool owns(const void *_ptr) const {
+    return _ptr >= data_ && static_cast<const char *>(_ptr) < data_ + capacity_;
+  }
+
+  char *data_      = nullptr;
+  size_t capacity_ = 0;
+  bool locked_     = false;
+  Buffer buffer_;
+  std::optional<std::pmr::synchronized_pool_resource> pool_;
+
+  std::atomic<size_t> in_use_{0};
+  std::atomic<size_t> in_use_max_{0};
+  std::atomic<uint64_t> allocations_{0};
+  std::atomic<uint64_t> heap_fallbacks_{0};
+  std::atomic<size_t> heap_bytes_{0};
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef __DF_BLACK_BOX_H__
+#define __DF_BLACK_BOX_H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace controller_plugin_differential_flatness {
+
+struct Black_box_config {
+  // Default of directory, kept out of the string so a default config does not allocate
+  static constexpr const char *kDefaultDirectory = "/tmp/df_black_box";
+
+  bool enable           = false;
+  std::string directory = "";     // empty writes to kDefaultDirectory
+  double pre_trigger    = 5.0;    // [s] kept before the trigger
+  double post_trigger   = 2.0;    // [s] kept after the trigger
+  double max_rate       = 500.0;  // [Hz] control rate the windows are sized for
+  double attitude_error = 0.5;    // [rad] norm of E_rot, non-positive disables the trigger
+  double state_timeout  = 0.1;    // [s] state age, non-positive disables the trigger
+  bool on_saturation    = true;   // max_thrust or a positive min_thrust hit
+  bool on_non_finite    = true;   // non-finite state, reference or command
+
+  bool operator==(const Black_box_config &_other) const {
+    return enable == _other.enable && directory == _other.directory &&
+           pre_trigger == _other.pre_trigger && post_trigger == _other.post_trigger &&
+           max_rate == _other.max_rate && attitude_error == _other.attitude_error &&
+           state_timeout == _other.state_timeout && on_saturation == _other.on_saturation &&
+           on_non_finite == _other.on_non_finite;
+  }
+  bool operator!=(const Black_box_config &_other) const { return !(*this == _other); }
+
+  const char *directoryPath() const {
+    return directory.empty() ? kDefaultDirectory : directory.c_str();
+  }
+};
+
+/** One full rate control tick, in float to keep the windows small */
+struct Black_box_record {
+  uint64_t tick    = 0;
+  int64_t stamp_ns = 0;
+  float position[3];
+  float velocity[3];
+  float attitude[4];  // x, y, z, w
+  float ref_position[3];
+  float ref_velocity[3];
+  float ref_acceleration[3];
+  float ref_yaw;
+  float desired_force[3];
+  float attitude_error[3];
+  float rates[3];
+  float thrust;
+  uint32_t triggers = 0;  // BlackBox::Trigger bits raised on this tick
+};
+
+/**
+ * Anomaly triggered flight recorder.
+ *
+ * The control tick writes every record into a preallocated ring holding pre_trigger +
+ * post_trigger seconds at max_rate. The first record with a trigger bit starts a capture;
+ * post_trigger seconds later the ring is frozen and recording continues in a second one. A
+ * background thread writes the frozen window as CSV to directory and hands the ring back.
+ * The tick only copies a record and flips an atomic, it never allocates nor touches a file.
+ * When both rings are waiting for the disk, ticks are counted as skipped instead of blocking.
+ */
+class BlackBox {
+public:
+  enum Trigger : uint32_t {
+    ATTITUDE_ERROR    = 1u << 0,
+    THRUST_SATURATION = 1u << 1,
+    STALE_STATE       = 1u << 2,
+    NON_FINITE        = 1u << 3,
+    MANUAL            = 1u << 4,
+  };
+
+  /** The rings are allocated from _memory */
+  explicit BlackBox(std::pmr::memory_resource *_memory = std::pmr::get_default_resource())
+      : memory_(_memory), storages_(_memory) {}
+  ~BlackBox() { stop(); }
+
+  BlackBox(const BlackBox &)            = delete;
+  BlackBox &operator=(const BlackBox &) = delete;
+
+  /** Apply a new configuration, reallocating the rings and restarting the writer if needed */
+  void configure(const Black_box_config &_config);
+
+  /** Bytes _config takes from a pooled memory resource, 0 when disabled */
+  static size_t memoryBytes(const Black_box_config &_config);
+
+  bool enabled() const { return running_.load(std::memory_order_relaxed); }
+
+  /** Hot path, wait-free. Only valid while enabled() */
+  void record(const Black_box_record &_record);
+
+  /** Number of windows written to disk so far */
+  uint64_t written() const { return written_.load(); }
+
+  std::string report() const;
+
+  /** Comma separated names of the _triggers bits */
+  static std::string triggerNames(const uint32_t _triggers);
+
+private:
+  enum Ring_state : int { FREE = 0, FILLING, FULL };
+
+  struct Ring {
+    explicit Ring(std::pmr::memory_resource *_memory) : records(_memory) {}
+
+    std::pmr::vector<Black_box_record> records;
+    size_t head           = 0;  // next slot to write
+    size_t count          = 0;
+    size_t post_count     = 0;  // records since the trigger
+    int64_t trigger_ns    = 0;
+    uint64_t trigger_tick = 0;
+    uint32_t triggers     = 0;
+    std::atomic<int> state{FREE};
+  };
+
+  // Everything record() touches, immutable once published but for the tick side fields
+  struct Storage {
+    explicit Storage(std::pmr::memory_resource *_memory)
+        : rings{Ring(_memory), Ring(_memory)} {}
+
+    size_t capacity = 0;
+    int64_t pre_ns  = 0;
+    int64_t post_ns = 0;
+    Ring rings[2];
+    int active     = 0;  // ring being filled, -1 while both wait for the disk
+    bool capturing = false;
+  };
+
+  static size_t ringCapacity(const Black_box_config &_config);
+
+  void start();
+  void stop();
+  void run();
+  void freeze(Storage &_storage);
+  void write(const Storage &_storage, const Ring &_ring);
+
+  Black_box_config config_;  // written under stats_mutex_, read by report()
+  std::pmr::memory_resource *memory_;
+  // Published to the tick through storage_. Replaced ones are kept until destruction, as the
+  // telemetry queue, so a record() racing a configure() stays valid
+  std::pmr::vector<std::unique_ptr<Storage>> storages_;
+  std::atomic<Storage *> storage_{nullptr};
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+
+  std::atomic<uint64_t> captures_{0};
+  std::atomic<uint64_t> skipped_{0};  // ticks not recorded, both rings waiting for the disk
+  std::atomic<uint64_t> written_{0};
+  std::atomic<uint64_t> write_errors_{0};
+
+  mutable std::mutex stats_mutex_;  // writer thread and configure() vs report(), not the tick
+  std::string last_file_;
+  uint32_t last_triggers_ = 0;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
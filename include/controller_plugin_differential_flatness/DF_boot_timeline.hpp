@@ -0,0 +1,108 @@
+#ifndef __DF_BOOT_TIMELINE_H__
+#define __DF_BOOT_TIMELINE_H__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "DF_cpu_budget.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+/**
+ * Startup critical path of the plugin, from construction to the first valid command.
+ *
+ * Each stage keeps the CLOCK_MONOTONIC time it was first reached, later calls are ignored, so
+ * the hot path only pays an atomic load once booted. The report lists the stages in time
+ * order and the one the first command waited for last, the one to shorten.
+ */
+class BootTimeline {
+public:
+  enum Stage : int {
+    CONSTRUCTED = 0,
+    INITIALIZE_BEGIN,
+    PARAMETER_CACHE_LOADED,
+    INITIALIZE_END,
+    PARAMETERS_READ,
+    SET_MODE_BEGIN,
+    SET_MODE_END,
+    FIRST_STATE,
+    FIRST_REFERENCE,
+    FIRST_COMMAND,
+    N_STAGES,
+  };
+
+  static constexpr std::array<const char *, N_STAGES> kStageNames = {
+      "constructed",
+      "initialize_begin",
+      "parameter_cache_loaded",
+      "initialize_end",
+      "parameters_read",
+      "set_mode_begin",
+      "set_mode_end",
+      "first_state",
+      "first_reference",
+      "first_command",
+  };
+
+  BootTimeline() { mark(CONSTRUCTED); }
+
+  void mark(const Stage _stage) {
+    if (stamps_[_stage].load(std::memory_order_relaxed) != 0) return;
+    uint64_t expected = 0;
+    stamps_[_stage].compare_exchange_strong(expected, CpuBudget::wallNs(),
+                                            std::memory_order_relaxed);
+  }
+
+  bool reached(const Stage _stage) const {
+    return stamps_[_stage].load(std::memory_order_relaxed) != 0;
+  }
+
+  /** Time from construction to _stage, 0 if not reached yet */
+  uint64_t sinceConstructionNs(const Stage _stage) const {
+    const uint64_t stamp = stamps_[_stage].load(std::memory_order_relaxed);
+    return stamp ? stamp - stamps_[CONSTRUCTED].load(std::memory_order_relaxed) : 0;
+  }
+
+  std::string report() const {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "boot:\n";
+    ss << "  stages_ms:\n";
+    // The enum has the expected order, the report has the actual one
+    std::array<Stage, N_STAGES> order;
+    int n = 0;
+    for (int i = 0; i < N_STAGES; i++) {
+      if (reached(static_cast<Stage>(i))) order[n++] = static_cast<Stage>(i);
+    }
+    std::stable_sort(order.begin(), order.begin() + n, [this](const Stage _a, const Stage _b) {
+      return sinceConstructionNs(_a) < sinceConstructionNs(_b);
+    });
+    for (int k = 0; k < n; k++) {
+      ss << "    " << kStageNames[order[k]] << ": " << sinceConstructionNs(order[k]) * 1e-6
+         << "\n";
+    }
+    if (reached(INITIALIZE_END)) {
+      ss << "  initialize_ms: "
+         << (sinceConstructionNs(INITIALIZE_END) - sinceConstructionNs(INITIALIZE_BEGIN)) * 1e-6
+         << "\n";
+    }
+    if (reached(FIRST_COMMAND)) {
+      ss << "  time_to_first_command_ms: " << sinceConstructionNs(FIRST_COMMAND) * 1e-6 << "\n";
+      // The last stage before the first command is what it was waiting for
+      ss << "  waited_for: " << (n > 1 ? kStageNames[order[n - 2]] : "none") << "\n";
+    }
+    return ss.str();
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, N_STAGES> stamps_{};
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef __DF_CHAINABLE_CONTROLLER_H__
+#define __DF_CHAINABLE_CONTROLLER_H__
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <controller_interface/chainable_controller_interface.hpp>
+#include <hardware_interface/types/hardware_interface_return_values.hpp>
+#include <rclcpp/rclcpp.hpp>
+#include <rclcpp_lifecycle/state.hpp>
+#include <realtime_tools/realtime_buffer.h>
+
+#include "DF_control_law.hpp"
+#include "as2_msgs/msg/trajectory_point.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+/**
+ * ros2_control deployment of the differential flatness law.
+ *
+ * Runs ControlLaw inside the controller_manager real-time loop: it reads the vehicle state
+ * interfaces and writes body rate and thrust command interfaces directly, without crossing
+ * the middleware. The trajectory reference is exported as reference interfaces, so a
+ * trajectory controller can be chained in front of it, or taken from the ~/reference topic
+ * when it is not chained.
+ *
+ * Interfaces, with <vehicle> given by the vehicle_name parameter:
+ *  - state: <vehicle>/position.{x,y,z}, <vehicle>/velocity.{x,y,z} (odom frame),
+ *           <vehicle>/orientation.{x,y,z,w}
+ *  - command: <vehicle>/rate.{x,y,z} (body FLU), <vehicle>/thrust
+ *  - reference: <controller>/position.{x,y,z}, velocity.{x,y,z}, acceleration.{x,y,z}, yaw
+ *
+ * Gains and limits use the same parameter names as the as2 plugin.
+ */
+class DFChainableController : public controller_interface::ChainableControllerInterface {
+public:
+  DFChainableController() = default;
+
+  controller_interface::CallbackReturn on_init() override;
+
+  controller_interface::InterfaceConfiguration command_interface_configuration() const override;
+  controller_interface::InterfaceConfiguration state_interface_configuration() const override;
+
+  controller_interface::CallbackReturn on_configure(
+      const rclcpp_lifecycle::State &previous_state) override;
+  controller_interface::CallbackReturn on_activate(
+      const rclcpp_lifecycle::State &previous_state) override;
+  controller_interface::CallbackReturn on_deactivate(
+      const rclcpp_lifecycle::State &previous_state) override;
+
+  controller_interface::return_type update_reference_from_subscribers() override;
+  controller_interface::return_type update_and_write_commands(
+      const rclcpp::Time &time,
+      const rclcpp::Duration &period) override;
+
+  /** Law instance, exposed for inspection from tests and diagnostics */
+  const ControlLaw &controlLaw() const { return control_law_; }
+
+protected:
+  std::vector<hardware_interface::CommandInterface> on_export_reference_interfaces() override;
+  bool on_set_chained_mode(bool chained_mode) override;
+
+private:
+  enum State_index { PX, PY, PZ, VX, VY, VZ, QX, QY, QZ, QW, N_STATES };
+  enum Command_index { RATE_X, RATE_Y, RATE_Z, THRUST, N_COMMANDS };
+  enum Reference_index { RPX, RPY, RPZ, RVX, RVY, RVZ, RAX, RAY, RAZ, RYAW, N_REFERENCES };
+
+  static constexpr std::array<const char *, N_STATES> state_names_ = {
+      "position.x",    "position.y",    "position.z",    "velocity.x",    "velocity.y",
+      "velocity.z",    "orientation.x", "orientation.y", "orientation.z", "orientation.w"};
+  static constexpr std::array<const char *, N_COMMANDS> command_names_ = {"rate.x", "rate.y",
+                                                                          "rate.z", "thrust"};
+  static constexpr std::array<const char *, N_REFERENCES> reference_names_ = {
+      "position.x",     "position.y",     "position.z",     "velocity.x",     "velocity.y",
+      "velocity.z",     "acceleration.x", "acceleration.y", "acceleration.z", "yaw"};
+
+  void readParameters();
+  void holdCurrentPosition();
+
+  std::string vehicle_name_ = "uav";
+  ControlLaw control_law_;
+  UAV_state uav_state_;
+  UAV_reference control_ref_;
+
+  using ReferenceMsg = as2_msgs::msg::TrajectoryPoint;
+  rclcpp::Subscription<ReferenceMsg>::SharedPtr reference_sub_;
+  // Written by the subscription, read by the real-time loop when not chained
+  realtime_tools::RealtimeBuffer<std::shared_ptr<ReferenceMsg>> reference_buffer_;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
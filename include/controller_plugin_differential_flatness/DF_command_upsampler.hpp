@@ -0,0 +1,137 @@
+#ifndef __DF_COMMAND_UPSAMPLER_H__
+#define __DF_COMMAND_UPSAMPLER_H__
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace controller_plugin_differential_flatness {
+
+struct Upsampling_config {
+  bool enable         = false;
+  double compute_rate = 250.0;  // [Hz] full control law, the output keeps the tick rate
+  int order           = 1;      // force extrapolation: 0 hold, 1 linear, 2 quadratic
+
+  bool operator==(const Upsampling_config &_other) const {
+    return enable == _other.enable && compute_rate == _other.compute_rate &&
+           order == _other.order;
+  }
+  bool operator!=(const Upsampling_config &_other) const { return !(*this == _other); }
+};
+
+struct Upsampling_stats {
+  uint64_t full_ticks      = 0;
+  uint64_t upsampled_ticks = 0;
+  uint64_t full_ns         = 0;    // wall time of the ticks of each kind
+  uint64_t upsampled_ns    = 0;
+  uint64_t predictions     = 0;    // full ticks that had a prediction to compare against
+  double force_error_sq    = 0.0;  // [N^2] sum of |extrapolated - computed force|^2
+  double force_error_max   = 0.0;  // [N]
+};
+
+/**
+ * Output stage that runs the full control law at compute_rate and fills the ticks in between.
+ *
+ * On the intermediate ticks the desired force of the last full ticks is extrapolated with a
+ * polynomial of the configured order, and only the attitude stage runs on it with the latest
+ * attitude, so the rates keep closing the attitude loop at the output rate. Time is the sum
+ * of the tick dts. Every full tick compares the extrapolation with the force it computes, the
+ * tracking cost reported next to the CPU time of both kinds of ticks.
+ */
+class CommandUpsampler {
+public:
+  static constexpr int kMaxOrder = 2;
+
+  void configure(const Upsampling_config &_config) {
+    config_       = _config;
+    config_.order = std::clamp(config_.order, 0, kMaxOrder);
+    period_       = 1.0 / std::max(config_.compute_rate, 1e-3);
+    stats_        = Upsampling_stats();
+    reset();
+  }
+
+  const Upsampling_config &config() const { return config_; }
+  bool enabled() const { return config_.enable; }
+  const Upsampling_stats &stats() const { return stats_; }
+
+  /** Drop the force history, e.g. after a mode change. The next tick is a full one */
+  void reset() {
+    samples_       = 0;
+    since_compute_ = 0.0;
+  }
+
+  /**
+   * Advance by _dt. Returns true when this tick must run the full law, with _compute_dt the
+   * time since the previous full tick, to be used as its dt.
+   */
+  bool step(const double _dt, double &_compute_dt) {
+    t_ += _dt;
+    since_compute_ += _dt;
+    // Half an output tick of slack, so the compute ticks do not beat against the output ones
+    if (samples_ > 0 && since_compute_ + 0.5 * _dt < period_) {
+      return false;
+    }
+    _compute_dt    = samples_ > 0 ? since_compute_ : _dt;
+    since_compute_ = 0.0;
+    return true;
+  }
+
+  /** Force computed by the full tick of the current step */
+  void push(const Eigen::Vector3d &_force) {
+    if (samples_ > 0) {
+      const double error = (extrapolate() - _force).norm();
+      stats_.predictions++;
+      stats_.force_error_sq += error * error;
+      stats_.force_error_max = std::max(stats_.force_error_max, error);
+    }
+    for (int i = kMaxOrder; i > 0; i--) {
+      times_[i]  = times_[i - 1];
+      forces_[i] = forces_[i - 1];
+    }
+    times_[0]  = t_;
+    forces_[0] = _force;
+    samples_   = std::min(samples_ + 1, kMaxOrder + 1);
+  }
+
+  /** Desired force at the current step, Lagrange extrapolation of the last full ticks */
+  Eigen::Vector3d extrapolate() const {
+    const int n = std::min(config_.order, samples_ - 1) + 1;
+
+    Eigen::Vector3d force = Eigen::Vector3d::Zero();
+    for (int i = 0; i < n; i++) {
+      double weight = 1.0;
+      for (int j = 0; j < n; j++) {
+        if (j != i) weight *= (t_ - times_[j]) / (times_[i] - times_[j]);
+      }
+      force += weight * forces_[i];
+    }
+    return force;
+  }
+
+  void addTiming(const bool _full, const uint64_t _ns) {
+    if (_full) {
+      stats_.full_ticks++;
+      stats_.full_ns += _ns;
+    } else {
+      stats_.upsampled_ticks++;
+      stats_.upsampled_ns += _ns;
+    }
+  }
+
+private:
+  Upsampling_config config_;
+  double period_        = 1.0 / 250.0;
+  double t_             = 0.0;
+  double since_compute_ = 0.0;
+  int samples_          = 0;
+
+  // Last full ticks, most recent first
+  double times_[kMaxOrder + 1] = {0.0, 0.0, 0.0};
+  Eigen::Vector3d forces_[kMaxOrder + 1];
+  Upsampling_stats stats_;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
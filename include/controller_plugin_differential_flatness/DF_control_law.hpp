@@ -0,0 +1,112 @@
+#ifndef __DF_CONTROL_LAW_H__
+#define __DF_CONTROL_LAW_H__
+
+#include <Eigen/Dense>
+#include <tf2/LinearMath/Matrix3x3.h>
+#include <tf2/LinearMath/Quaternion.h>
+#include <memory>
+
+#include "DF_mpc.hpp"
+#include "DF_residual_model.hpp"
+#include "DF_sanitizer.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+struct UAV_state {
+  Eigen::Vector3d position       = Eigen::Vector3d::Zero();
+  Eigen::Vector3d velocity       = Eigen::Vector3d::Zero();
+  tf2::Quaternion attitude_state = tf2::Quaternion::getIdentity();
+};
+
+struct UAV_reference {
+  Eigen::Vector3d position     = Eigen::Vector3d::Zero();
+  Eigen::Vector3d velocity     = Eigen::Vector3d::Zero();
+  Eigen::Vector3d acceleration = Eigen::Vector3d::Zero();
+  double yaw                   = 0.0;
+};
+
+struct Acro_command {
+  Eigen::Vector3d PQR = Eigen::Vector3d::Zero();
+  double thrust       = 0.0;
+};
+
+struct Control_internals {
+  Eigen::Vector3d position_error = Eigen::Vector3d::Zero();
+  Eigen::Vector3d velocity_error = Eigen::Vector3d::Zero();
+  Eigen::Vector3d desired_force  = Eigen::Vector3d::Zero();
+  Eigen::Matrix3d R_des          = Eigen::Matrix3d::Identity();
+  Eigen::Vector3d E_rot          = Eigen::Vector3d::Zero();
+  uint64_t mpc_solve_ns          = 0;  // 0 when the MPC is disabled
+  uint64_t mpc_iterations        = 0;
+  Eigen::Vector3d residual_force = Eigen::Vector3d::Zero();
+};
+
+// Gain matrices are diagonal, only the diagonals are stored
+struct Control_gains {
+  Eigen::Vector3d kp     = Eigen::Vector3d::Zero();
+  Eigen::Vector3d ki     = Eigen::Vector3d::Zero();
+  Eigen::Vector3d kd     = Eigen::Vector3d::Zero();
+  Eigen::Vector3d kp_ang = Eigen::Vector3d::Zero();
+  double mass            = 0.0;
+  double antiwindup_cte  = 0.0;
+};
+
+/**
+ * Differential flatness control law: position PID to desired force, then attitude error to
+ * body rates and collective thrust. It has no middleware dependency, so several instances
+ * (active, shadow) can run side by side.
+ *
+ * With an mpc set, the PD and feedforward terms of the force come from the translational
+ * MPC instead, constrained to the accelerations the thrust and tilt limits allow. Its dense
+ * matrices are 16 KB, so it is only allocated by the owners that enable it, and copies of
+ * the law copy it. A residual_model, owned by the caller, adds its learned force on top.
+ */
+class ControlLaw {
+public:
+  Control_gains gains;
+  Sanitizer sanitizer;
+  std::unique_ptr<TranslationalMpc> mpc;  // null while the MPC is disabled
+  ResidualModel *residual_model   = nullptr;
+  Eigen::Vector3d accum_pos_error = Eigen::Vector3d::Zero();
+  Control_internals internals;
+
+  inline static const Eigen::Vector3d gravitational_accel = Eigen::Vector3d(0, 0, -9.81);
+
+  ControlLaw() = default;
+  ControlLaw(const ControlLaw &_other) { *this = _other; }
+  ControlLaw &operator=(const ControlLaw &_other);
+  ControlLaw(ControlLaw &&)            = default;
+  ControlLaw &operator=(ControlLaw &&) = default;
+
+  Eigen::Vector3d getForce(const double &_dt,
+                           const Eigen::Vector3d &_pos_state,
+                           const Eigen::Vector3d &_vel_state,
+                           const Eigen::Vector3d &_pos_reference,
+                           const Eigen::Vector3d &_vel_reference,
+                           const Eigen::Vector3d &_acc_reference);
+
+  Acro_command computeTrajectoryControl(const double &_dt,
+                                        const Eigen::Vector3d &_pos_state,
+                                        const Eigen::Vector3d &_vel_state,
+                                        const tf2::Quaternion &_attitude_state,
+                                        const Eigen::Vector3d &_pos_reference,
+                                        const Eigen::Vector3d &_vel_reference,
+                                        const Eigen::Vector3d &_acc_reference,
+                                        const double &_yaw_angle_reference);
+
+  /**
+   * Attitude stage of computeTrajectoryControl(): rates and thrust that realize
+   * _desired_force from the given attitude. Without the position loop it is cheap enough to
+   * run on every attitude sample, with a held or extrapolated force.
+   */
+  Acro_command computeAttitudeControl(const Eigen::Vector3d &_desired_force,
+                                      const tf2::Quaternion &_attitude_state,
+                                      const double &_yaw_angle_reference);
+
+private:
+  void mpcAccelerationBounds(Eigen::Vector3d &_min, Eigen::Vector3d &_max) const;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
@@ -4,36 +4,78 @@
 
 #include <rclcpp/logging.hpp>
 #include <rclcpp/rclcpp.hpp>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <memory_resource>
+#include <mutex>
+#include <std_srvs/srv/trigger.hpp>
+#include <string_view>
 #include <vector>
 
 #include "as2_core/utils/frame_utils.hpp"
 #include "as2_core/utils/tf_utils.hpp"
 #include "as2_msgs/msg/thrust.hpp"
 #include "as2_msgs/msg/trajectory_point.hpp"
+#include "DF_arena.hpp"
+#include "DF_black_box.hpp"
+#include "DF_boot_timeline.hpp"
+#include "DF_command_upsampler.hpp"
+#include "DF_control_law.hpp"
+#include "DF_cpu_budget.hpp"
+#include "DF_formation.hpp"
+#include "DF_parameter_cache.hpp"
+#include "DF_phase_lock.hpp"
+#include "DF_publish_offload.hpp"
+#include "DF_shadow.hpp"
+#include "DF_state_arbiter.hpp"
+#include "DF_state_transfer.hpp"
+#include "DF_telemetry.hpp"
+#include "DF_tick_source.hpp"
+#include "DF_trajectory_file.hpp"
 #include "controller_plugin_base/controller_base.hpp"
+#include "triple_buffer.hpp"
 
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 #include <geometry_msgs/msg/pose_stamped.hpp>
 #include <geometry_msgs/msg/twist_stamped.hpp>
+#include <nav_msgs/msg/odometry.hpp>
 
 namespace controller_plugin_differential_flatness {
 
-struct UAV_state {
-  Eigen::Vector3d position       = Eigen::Vector3d::Zero();
-  Eigen::Vector3d velocity       = Eigen::Vector3d::Zero();
-  tf2::Quaternion attitude_state = tf2::Quaternion::getIdentity();
+struct Controller_snapshot {
+  uint64_t tick = 0;
+  builtin_interfaces::msg::Time stamp;
+  UAV_state uav_state;
+  UAV_reference control_ref;
+  Eigen::Vector3d kp              = Eigen::Vector3d::Zero();
+  Eigen::Vector3d ki              = Eigen::Vector3d::Zero();
+  Eigen::Vector3d kd              = Eigen::Vector3d::Zero();
+  Eigen::Vector3d kp_ang          = Eigen::Vector3d::Zero();
+  Eigen::Vector3d accum_pos_error = Eigen::Vector3d::Zero();
+  Control_internals internals;
+  Acro_command command;
+  Sanitation_stats sanitation;
+  bool mpc_enabled = false;
+  Mpc_stats mpc;
+  bool residual_model_active = false;
+  Residual_model_stats residual_model;
+  bool upsampling_enabled = false;
+  Upsampling_stats upsampling;
 };
 
-struct UAV_reference {
-  Eigen::Vector3d position     = Eigen::Vector3d::Zero();
-  Eigen::Vector3d velocity     = Eigen::Vector3d::Zero();
-  Eigen::Vector3d acceleration = Eigen::Vector3d::Zero();
-  double yaw                   = 0.0;
-};
-
-struct Acro_command {
-  Eigen::Vector3d PQR = Eigen::Vector3d::Zero();
-  double thrust       = 0.0;
+/**
+ * Preferred callback group topology. The host may attach its callbacks to these groups and
+ * spin the node with a multi-threaded executor:
+ *  - ingestion: reentrant, state and reference subscriptions (updateState, updateReference).
+ *  - control: mutually exclusive, the control timer (computeOutput).
+ *  - diagnostics: mutually exclusive, parameters and plugin services. Intended to be the low
+ *    priority one, e.g. spun by a separate executor on a low priority thread.
+ */
+struct Callback_topology {
+  rclcpp::CallbackGroup::SharedPtr ingestion;
+  rclcpp::CallbackGroup::SharedPtr control;
+  rclcpp::CallbackGroup::SharedPtr diagnostics;
 };
 
 struct Control_flags {
@@ -42,7 +84,16 @@ struct Control_flags {
   bool ref_received    = false;
 };
 
-class Plugin : public controller_plugin_base::ControllerBase {
+/** Result of a tick of the internal tick source, see Plugin::startTickSource() */
+using Tick_output_callback = std::function<void(
+    bool, const geometry_msgs::msg::TwistStamped &, const as2_msgs::msg::Thrust &)>;
+
+class Plugin : public controller_plugin_base::ControllerBase, public StateTransfer {
+  // Backs the containers below, sized by ownInitialize(). Declared first so it outlives them
+  Arena arena_;
+  // Stamps the startup critical path, from here to the first command
+  BootTimeline boot_;
+
   UAV_state uav_state_;
   UAV_reference control_ref_;
   Acro_command control_command_;
@@ -52,22 +103,102 @@ class Plugin : public controller_plugin_base::ControllerBase {
   as2_msgs::msg::ControlMode control_mode_in_;
   as2_msgs::msg::ControlMode control_mode_out_;
 
-  Eigen::Matrix3d Kp_{Eigen::Matrix3d::Zero()};
-  Eigen::Matrix3d Kd_{Eigen::Matrix3d::Zero()};
-  Eigen::Matrix3d Ki_{Eigen::Matrix3d::Zero()};
-  Eigen::Matrix3d Kp_ang_mat_{Eigen::Matrix3d::Zero()};
-
-  Eigen::Vector3d accum_pos_error_{Eigen::Vector3d::Zero()};
-
-  double mass_;
-  double antiwindup_cte_ = 0.0;
-
-  std::string odom_frame_id_      = "odom";
-  std::string base_link_frame_id_ = "base_link";
-
-  const Eigen::Vector3d gravitational_accel_ = Eigen::Vector3d(0, 0, -9.81);
-
-  const std::vector<std::string> parameters_list_ = {
+  ControlLaw control_law_;
+  Mpc_config mpc_config_;
+
+  // Full law at upsampling.compute_rate, attitude stage only on the ticks in between
+  Upsampling_config upsampling_config_;
+  CommandUpsampler upsampler_;
+
+  // Learned residual force, control_law_.residual_model points to it unless bypassed
+  Residual_model_config residual_model_config_;
+  std::unique_ptr<ResidualModel> residual_model_;
+
+  // Written by the control tick, read by the snapshot service
+  TripleBuffer<Controller_snapshot> snapshot_buffer_;
+  uint64_t tick_count_ = 0;
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr snapshot_srv_;
+
+  CpuBudget cpu_budget_;
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr cpu_budget_srv_;
+
+  Telemetry_config telemetry_config_;
+  TelemetryStream telemetry_;
+
+  Shadow_config shadow_config_;
+  ShadowController shadow_;
+
+  // Redundant state sources. When enabled, updateState() is the "host" source and each
+  // state_arbitration.sources topic is another one; the control tick applies the selected one
+  StateArbiter state_arbiter_;
+  int host_source_      = -1;
+  int applied_source_   = -1;
+  uint64_t applied_seq_ = 0;
+  std::pmr::vector<std::pmr::string> state_source_topics_{&arena_};
+  // Indexed by source id, empty for the host and for removed sources
+  std::pmr::vector<rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr> state_source_subs_{
+      StateArbiter::kMaxSources, &arena_};
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr state_sources_srv_;
+
+  // Arrival phase of updateState() against the control tick, see nextTickDelay()
+  PhaseLock phase_lock_;
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr phase_lock_srv_;
+
+  // Onboard trajectory playback. While it plays the reference comes from the mapped file and
+  // updateReference() is ignored
+  std::pmr::string playback_path_{&arena_};
+  TrajectoryFile playback_file_;
+  bool playback_active_      = false;
+  int64_t playback_start_ns_ = 0;
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr start_playback_srv_;
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr stop_playback_srv_;
+
+  // Shared formation reference. While enabled the reference is the formation one plus the
+  // offset of this vehicle, evaluated on each tick, and updateReference() is ignored
+  FormationReference formation_;
+  std::pmr::string formation_topic_{&arena_};  // subscribed one
+  rclcpp::Subscription<as2_msgs::msg::TrajectoryPoint>::SharedPtr formation_sub_;
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr formation_srv_;
+
+  // Synthetic control ticks run once the parameters are read, before the first real one,
+  // see warmUp()
+  int warm_up_ticks_ = 200;
+  bool warmed_up_    = false;
+
+  // Anomaly triggered capture of the full rate records. Triggers fire on the rising edge of
+  // their condition, the previous levels and sanitizer counters are kept for that
+  Black_box_config black_box_config_;
+  BlackBox black_box_{&arena_};
+  Sanitation_stats black_box_sanitation_;
+  uint32_t black_box_levels_ = 0;
+  bool black_box_manual_     = false;
+  uint64_t last_state_ns_    = 0;  // wall clock of the last applied state
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr trigger_black_box_srv_;
+
+  // Achieved period of computeOutput(), whoever drives it, and the optional internal tick
+  // source on absolute deadlines, see startTickSource()
+  PeriodMonitor tick_period_;
+  Tick_source_config tick_source_config_;
+  TickSource tick_source_;
+  Tick_output_callback tick_output_;
+  int64_t tick_origin_ns_ = 0;  // deadline handed over by importState(), used by the next start
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr tick_source_srv_;
+
+  // With publish_offload.enable the tick source queues its commands and tick_output_ runs on
+  // the publisher thread instead
+  Publish_offload_config publish_offload_config_;
+  PublishOffload publish_offload_;
+
+  Callback_topology callback_topology_;
+  // Entry points may run concurrently when the host uses the callback topology. It is only
+  // held while the plugin state is touched, never while waiting on the middleware
+  std::mutex control_mutex_;
+
+  std::pmr::string odom_frame_id_{"odom", &arena_};
+  std::pmr::string base_link_frame_id_{"base_link", &arena_};
+
+  // Shared by all the instances, each one only keeps a bitmask of the pending ones
+  static constexpr std::array<std::string_view, 15> parameters_list_ = {
       "mass",
       "trajectory_control.antiwindup_cte",
       "trajectory_control.alpha",
@@ -84,11 +215,21 @@ class Plugin : public controller_plugin_base::ControllerBase {
       "trajectory_control.pitch_control.kp",
       "trajectory_control.yaw_control.kp",
   };
-  std::vector<std::string> parameters_to_read_{parameters_list_};  // copy mutable
+  uint16_t parameters_to_read_ = (1u << parameters_list_.size()) - 1;
+
+  // Last value read of each parameters_list_ entry, persisted to parameter_cache.file once all
+  // of them are read, and applied from it by the next ownInitialize(). Tracked apart from
+  // parameters_to_read_, which importState() clears without any value
+  std::pmr::string parameter_cache_path_{&arena_};
+  std::array<double, parameters_list_.size()> parameter_values_{};
+  uint16_t parameter_values_missing_ = (1u << parameters_list_.size()) - 1;
+  std::array<double, parameters_list_.size()> cached_values_{};  // as last loaded or saved
+  std::string parameter_cache_status_ = "disabled";
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr boot_srv_;
 
 public:
   Plugin(){};
-  ~Plugin(){};
+  ~Plugin() { stopTickSource(); };
 
   /** Virtual functions from ControllerBase */
   void ownInitialize() override;
@@ -109,15 +250,56 @@ public:
   void reset() override;
 
   // IMPORTANT: this is the frame_id of the desired pose and twist
-  std::string getDesiredPoseFrameId() override { return odom_frame_id_; }
-  std::string getDesiredTwistFrameId() override { return odom_frame_id_; }
+  std::string getDesiredPoseFrameId() override { return std::string(odom_frame_id_); }
+  std::string getDesiredTwistFrameId() override { return std::string(odom_frame_id_); }
+
+  const Callback_topology &getCallbackTopology() const { return callback_topology_; }
+  const BootTimeline &getBootTimeline() const { return boot_; }
+
+  /**
+   * Delay until the next control tick, for hosts that re-arm a one-shot control timer after
+   * each computeOutput(). With phase_lock.enable it is the nominal period shifted to fire
+   * just after new state lands, otherwise the measured nominal period. The tick source
+   * applies the same shift to its own deadlines.
+   */
+  std::chrono::nanoseconds nextTickDelay();
+
+  /**
+   * Run the control path on synthetic inputs, so the first real ticks do not pay for page
+   * faults, cold caches, lazy symbol binding and the first clock and logger calls. The
+   * controller state is left untouched. warm_up.ticks of them already run once, when all the
+   * required parameters are first read. Hosts may call it again, e.g. before arming.
+   * _ticks < 0 uses warm_up.ticks.
+   */
+  void warmUp(const int _ticks = -1);
+
+  /**
+   * Drive computeOutput() from an internal thread on absolute CLOCK_MONOTONIC deadlines at
+   * tick_source.rate, instead of a host timer, with the true elapsed time as dt.
+   * _on_output gets the result of every tick, e.g. to publish it, on the tick thread or, with
+   * publish_offload.enable, on a publisher thread fed by a wait-free queue. Hosts using it
+   * must not call computeOutput() themselves. publish_offload has no effect without it.
+   */
+  void startTickSource(Tick_output_callback _on_output);
+  void stopTickSource();
+
+  /**
+   * Hot reload, see StateTransfer. The host loads and initializes the new instance ahead, warm
+   * up included, stops driving the old one and, between two ticks, imports the export of the
+   * old one into the new one: gains, state, references, mode and flags, so the new one outputs
+   * from its first tick. The integrator is reset by every tick, so it is not carried over, see
+   * Controller_state. Tick source hosts stop the old source before the export
+   * and start the new one after the import, it keeps the phase of the old one.
+   */
+  std::vector<uint8_t> exportState() override;
+  bool importState(const std::vector<uint8_t> &_state, std::string &_error) override;
 
   rcl_interfaces::msg::SetParametersResult parametersCallback(
       const std::vector<rclcpp::Parameter> &parameters);
 
 private:
   /** Controller especific functions */
-  bool checkParamList(const std::string &param, std::vector<std::string> &_params_list);
+  bool checkParamList(const rclcpp::Parameter &_param, uint16_t &_params_to_read);
 
   void updateDFParameter(std::string _parameter_name, const rclcpp::Parameter &_param);
 
@@ -125,27 +307,53 @@ private:
   void resetReferences();
   void resetCommands();
 
+  void applyState(const State_sample &_sample);
+  void selectStateSource();
+  void subscribeStateSources();
+  void stateSourceCallback(const int _source, const nav_msgs::msg::Odometry::SharedPtr _msg);
+
+  void setupMpc();
+  bool computeUpsampled(const double _dt, double &_compute_dt);
+  bool loadResidualModel(std::string &_error);
+  void runWarmUp(const int _ticks);
+  bool loadPlaybackFile(std::string &_error);
+  void samplePlayback();
+  void importControllerState(const Controller_state &_state);
+  void pushGainParameters(const Controller_state &_state);
+  void subscribeFormation();
+  void formationCallback(const as2_msgs::msg::TrajectoryPoint::SharedPtr _msg);
+  void sampleFormation();
+
+  void publishSnapshot();
+  void pushTelemetry();
+  void pushShadow(const double _dt, const Eigen::Vector3d &_accum_pos_error);
+  void pushBlackBox();
+  void snapshotServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                               std_srvs::srv::Trigger::Response::SharedPtr response);
+  void cpuBudgetServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                std_srvs::srv::Trigger::Response::SharedPtr response);
+  void phaseLockServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                std_srvs::srv::Trigger::Response::SharedPtr response);
+  void stateSourcesServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                   std_srvs::srv::Trigger::Response::SharedPtr response);
+  void startPlaybackServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                    std_srvs::srv::Trigger::Response::SharedPtr response);
+  void stopPlaybackServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                   std_srvs::srv::Trigger::Response::SharedPtr response);
+  void triggerBlackBoxServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                      std_srvs::srv::Trigger::Response::SharedPtr response);
+  void tickSourceServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                 std_srvs::srv::Trigger::Response::SharedPtr response);
+  void formationServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                std_srvs::srv::Trigger::Response::SharedPtr response);
+  void bootServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                           std_srvs::srv::Trigger::Response::SharedPtr response);
+
   void computeActions(geometry_msgs::msg::PoseStamped &pose,
                       geometry_msgs::msg::TwistStamped &twist,
                       as2_msgs::msg::Thrust &thrust);
 
   bool getOutput(geometry_msgs::msg::TwistStamped &twist_msg, as2_msgs::msg::Thrust &thrust_msg);
-
-  Eigen::Vector3d getForce(const double &_dt,
-                           const Eigen::Vector3d &_pos_state,
-                           const Eigen::Vector3d &_vel_state,
-                           const Eigen::Vector3d &_pos_reference,
-                           const Eigen::Vector3d &_vel_reference,
-                           const Eigen::Vector3d &_acc_reference);
-
-  Acro_command computeTrajectoryControl(const double &_dt,
-                                        const Eigen::Vector3d &_pos_state,
-                                        const Eigen::Vector3d &_vel_state,
-                                        const tf2::Quaternion &_attitude_state,
-                                        const Eigen::Vector3d &_pos_reference,
-                                        const Eigen::Vector3d &_vel_reference,
-                                        const Eigen::Vector3d &_acc_reference,
-                                        const double &_yaw_angle_reference);
 };
 };  // namespace controller_plugin_differential_flatness
 
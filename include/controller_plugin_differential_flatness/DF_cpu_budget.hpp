@@ -0,0 +1,159 @@
+#ifndef __DF_CPU_BUDGET_H__
+#define __DF_CPU_BUDGET_H__
+
+#include <time.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace controller_plugin_differential_flatness {
+
+/**
+ * Per-instance CPU time accounting of the plugin entry points.
+ *
+ * Each entry point is wrapped in a Scope which measures the calling thread CPU time
+ * (CLOCK_THREAD_CPUTIME_ID), so time spent blocked or preempted is not charged, while
+ * parameter handling and logging done inside the callback are. A nested scope (e.g. reset()
+ * called from ownInitialize(), or the warm-up) is charged to its own callback and its time is
+ * taken out of the enclosing one, so every nanosecond is counted once.
+ *
+ * Only the threads that run the entry points are measured: the host executor threads and the
+ * tick source thread, whose computeOutput() calls are charged to COMPUTE_OUTPUT. The
+ * background threads of the telemetry, shadow, black box and publish offload stages are not,
+ * each one reports its own load, and neither is the host work outside of the entry points.
+ */
+class CpuBudget {
+public:
+  enum Callback : uint8_t {
+    OWN_INITIALIZE = 0,
+    UPDATE_PARAMS,
+    UPDATE_STATE,
+    UPDATE_REFERENCE,
+    SET_MODE,
+    COMPUTE_OUTPUT,
+    RESET,
+    SERVICES,
+    WARM_UP,
+    N_CALLBACKS
+  };
+
+  struct Stats {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+  };
+
+  class Scope {
+  public:
+    Scope(CpuBudget &_budget, const Callback _callback)
+        : budget_(_budget), callback_(_callback), parent_(current()), start_ns_(threadCpuNs()) {
+      current() = this;
+    }
+    ~Scope() {
+      const uint64_t elapsed = threadCpuNs() - start_ns_;
+      current()              = parent_;
+      budget_.add(callback_, elapsed - nested_ns_);
+      if (parent_) parent_->nested_ns_ += elapsed;
+    }
+
+    Scope(const Scope &)            = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    // Innermost open scope of the calling thread
+    static Scope *&current() {
+      static thread_local Scope *current = nullptr;
+      return current;
+    }
+
+    CpuBudget &budget_;
+    const Callback callback_;
+    Scope *const parent_;
+    const uint64_t start_ns_;
+    uint64_t nested_ns_ = 0;  // charged to the scopes opened inside this one
+  };
+
+  CpuBudget() : start_wall_ns_(wallNs()) {}
+
+  static uint64_t threadCpuNs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+  }
+
+  static uint64_t wallNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+  }
+
+  void add(const Callback _callback, const uint64_t _ns) {
+    Stats &stats = stats_[_callback];
+    stats.calls.fetch_add(1, std::memory_order_relaxed);
+    stats.total_ns.fetch_add(_ns, std::memory_order_relaxed);
+    // Single writer per callback type in practice, a lost max update is harmless
+    if (_ns > stats.max_ns.load(std::memory_order_relaxed)) {
+      stats.max_ns.store(_ns, std::memory_order_relaxed);
+    }
+  }
+
+  const Stats &stats(const Callback _callback) const { return stats_[_callback]; }
+
+  uint64_t totalNs() const {
+    uint64_t total = 0;
+    for (const Stats &stats : stats_) total += stats.total_ns.load(std::memory_order_relaxed);
+    return total;
+  }
+
+  /** Percent of one core used by this instance since construction */
+  double cpuPercent() const {
+    const uint64_t wall = wallNs() - start_wall_ns_;
+    return wall ? 100.0 * static_cast<double>(totalNs()) / static_cast<double>(wall) : 0.0;
+  }
+
+  /** CPU time of all the callbacks divided by the number of control ticks */
+  double cpuNsPerTick() const {
+    const uint64_t ticks = stats_[COMPUTE_OUTPUT].calls.load(std::memory_order_relaxed);
+    return ticks ? static_cast<double>(totalNs()) / static_cast<double>(ticks) : 0.0;
+  }
+
+  std::string report() const {
+    static constexpr const char *names[N_CALLBACKS] = {
+        "own_initialize",
+        "update_params",
+        "update_state",
+        "update_reference",
+        "set_mode",
+        "compute_output",
+        "reset",
+        "services",
+        "warm_up",
+    };
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "cpu_percent: " << cpuPercent() << "\n";
+    ss << "cpu_us_per_tick: " << cpuNsPerTick() * 1e-3 << "\n";
+    ss << "total_cpu_ms: " << totalNs() * 1e-6 << "\n";
+    ss << "callbacks:\n";
+    for (uint8_t i = 0; i < N_CALLBACKS; i++) {
+      const uint64_t calls = stats_[i].calls.load(std::memory_order_relaxed);
+      const uint64_t total = stats_[i].total_ns.load(std::memory_order_relaxed);
+      ss << "  " << names[i] << ": {calls: " << calls << ", total_ms: " << total * 1e-6
+         << ", mean_us: " << (calls ? total * 1e-3 / calls : 0.0)
+         << ", max_us: " << stats_[i].max_ns.load(std::memory_order_relaxed) * 1e-3 << "}\n";
+    }
+    return ss.str();
+  }
+
+private:
+  std::array<Stats, N_CALLBACKS> stats_;
+  const uint64_t start_wall_ns_;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
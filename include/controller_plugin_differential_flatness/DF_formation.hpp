@@ -0,0 +1,129 @@
+#ifndef __DF_FORMATION_H__
+#define __DF_FORMATION_H__
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "DF_control_law.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+struct Formation_config {
+  bool enable              = false;
+  std::string topic        = "";                       // shared formation reference
+  Eigen::Vector3d offset   = Eigen::Vector3d::Zero();  // [m] of this vehicle, formation frame
+  double yaw_offset        = 0.0;                      // [rad] of this vehicle heading
+  bool rotate              = true;  // the offset turns with the formation yaw, else stays ENU
+  double max_extrapolation = 0.1;   // [s] the reference is propagated to the tick, 0 disables
+};
+
+/**
+ * Reference of one vehicle of a formation, from the reference of the formation origin.
+ *
+ * The planner broadcasts a single formation reference and every vehicle adds its own offset
+ * on each tick, so the traffic does not grow with the fleet. With rotate the offset d is
+ * turned by the formation yaw, so the vehicle also gets the velocity w x d and the centripetal
+ * acceleration w x (w x d) of the turning formation, w being the yaw rate estimated from the
+ * last two samples. The yaw acceleration term is neglected. Between samples the formation
+ * reference is propagated to the tick with its velocity, acceleration and yaw rate, at most
+ * max_extrapolation seconds.
+ */
+class FormationReference {
+public:
+  Formation_config config;
+
+  void reset() {
+    formation_  = UAV_reference();
+    received_   = false;
+    yaw_rate_   = 0.0;
+    last_stamp_ = 0;
+  }
+
+  /** New formation reference stamped _stamp_ns. Older or repeated stamps are dropped */
+  void update(const UAV_reference &_formation, const int64_t _stamp_ns) {
+    if (received_ && _stamp_ns <= last_stamp_) {
+      stats_.dropped++;
+      return;
+    }
+    if (received_) {
+      const double dt = (_stamp_ns - last_stamp_) * 1e-9;
+      // A gap of several seconds says nothing of the current turn rate
+      yaw_rate_ = dt < 1.0 ? wrap(_formation.yaw - formation_.yaw) / dt : 0.0;
+    }
+    formation_  = _formation;
+    last_stamp_ = _stamp_ns;
+    received_   = true;
+    stats_.samples++;
+  }
+
+  bool received() const { return received_; }
+  /** Last formation reference, zero until received */
+  const UAV_reference &formation() const { return formation_; }
+
+  /** Reference of this vehicle at _now_ns, in the frame of the formation reference */
+  UAV_reference vehicleReference(const int64_t _now_ns) {
+    const double dt =
+        std::clamp((_now_ns - last_stamp_) * 1e-9, 0.0, std::max(config.max_extrapolation, 0.0));
+    stats_.max_extrapolation = std::max(stats_.max_extrapolation, dt);
+
+    UAV_reference origin = formation_;
+    origin.position += (formation_.velocity + 0.5 * dt * formation_.acceleration) * dt;
+    origin.velocity += formation_.acceleration * dt;
+    origin.yaw += yaw_rate_ * dt;
+
+    const double yaw = config.rotate ? origin.yaw : 0.0;
+    const double w   = config.rotate ? yaw_rate_ : 0.0;
+    const double c   = std::cos(yaw);
+    const double s   = std::sin(yaw);
+    const Eigen::Vector3d d(c * config.offset.x() - s * config.offset.y(),
+                            s * config.offset.x() + c * config.offset.y(), config.offset.z());
+
+    UAV_reference vehicle;
+    vehicle.position     = origin.position + d;
+    vehicle.velocity     = origin.velocity + w * Eigen::Vector3d(-d.y(), d.x(), 0.0);
+    vehicle.acceleration = origin.acceleration - w * w * Eigen::Vector3d(d.x(), d.y(), 0.0);
+    vehicle.yaw          = wrap(origin.yaw + config.yaw_offset);
+    return vehicle;
+  }
+
+  std::string report() const {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "formation:\n";
+    ss << "  enable: " << (config.enable ? "true" : "false") << "\n";
+    ss << "  topic: " << config.topic << "\n";
+    ss << "  offset: [" << config.offset.x() << ", " << config.offset.y() << ", "
+       << config.offset.z() << "]\n";
+    ss << "  yaw_offset: " << config.yaw_offset << "\n";
+    ss << "  received: " << (received_ ? "true" : "false") << "\n";
+    ss << "  samples: " << stats_.samples << "\n";
+    ss << "  dropped: " << stats_.dropped << "\n";
+    ss << "  yaw_rate: " << yaw_rate_ << "\n";
+    ss << "  max_extrapolation_ms: " << stats_.max_extrapolation * 1e3 << "\n";
+    return ss.str();
+  }
+
+private:
+  static double wrap(const double _angle) { return std::remainder(_angle, 2.0 * M_PI); }
+
+  UAV_reference formation_;
+  int64_t last_stamp_ = 0;
+  double yaw_rate_    = 0.0;  // [rad/s]
+  bool received_      = false;
+
+  struct Stats {
+    uint64_t samples         = 0;
+    uint64_t dropped         = 0;  // out of order or repeated stamps
+    double max_extrapolation = 0.0;
+  };
+  Stats stats_;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __DF_MPC_H__
+#define __DF_MPC_H__
+
+#include <Eigen/Dense>
+#include <cstdint>
+
+namespace controller_plugin_differential_flatness {
+
+struct Mpc_config {
+  bool enable                    = false;
+  double dt                      = 0.05;  // [s] prediction step
+  Eigen::Vector3d q_position     = Eigen::Vector3d(10.0, 10.0, 10.0);
+  Eigen::Vector3d q_velocity     = Eigen::Vector3d(1.0, 1.0, 1.0);
+  Eigen::Vector3d r_acceleration = Eigen::Vector3d(0.1, 0.1, 0.1);
+  int max_iterations             = 30;    // solver cap, bounds the solve time
+  double tolerance               = 1e-5;  // [m/s^2] step size to stop before the cap
+
+  bool operator==(const Mpc_config &_other) const {
+    return enable == _other.enable && dt == _other.dt && q_position == _other.q_position &&
+           q_velocity == _other.q_velocity && r_acceleration == _other.r_acceleration &&
+           max_iterations == _other.max_iterations && tolerance == _other.tolerance;
+  }
+  bool operator!=(const Mpc_config &_other) const { return !(*this == _other); }
+};
+
+struct Mpc_stats {
+  uint64_t solves         = 0;
+  uint64_t capped         = 0;  // solves stopped by max_iterations
+  uint64_t iterations     = 0;  // last solve
+  uint64_t solve_ns       = 0;  // last solve
+  uint64_t max_solve_ns   = 0;
+  uint64_t total_solve_ns = 0;
+};
+
+/**
+ * Model predictive control of the translational dynamics, as a replacement of the PD and
+ * feedforward terms of the force law.
+ *
+ * Each axis is a double integrator driven by the commanded acceleration, so the condensed QP
+ * splits into three independent kHorizon sized ones with box constraints on the inputs. They
+ * are solved with accelerated projected gradient (FISTA), warm started from the previous
+ * solution shifted by one step. All the matrices are fixed size and built in setup(), so
+ * solve() never allocates, and max_iterations bounds its time.
+ */
+class TranslationalMpc {
+public:
+  static constexpr int kHorizon = 20;
+
+  using Vector = Eigen::Matrix<double, kHorizon, 1>;
+  using Matrix = Eigen::Matrix<double, kHorizon, kHorizon>;
+
+  /** Build the condensed problem. Not real-time, only on configuration changes */
+  void setup(const Mpc_config &_config);
+
+  const Mpc_config &config() const { return config_; }
+  bool enabled() const { return config_.enable; }
+  const Mpc_stats &stats() const { return stats_; }
+
+  /**
+   * Acceleration to apply now, _dt after the previous solve. The reference is extrapolated
+   * over the horizon with constant acceleration, _accel_min/_accel_max bound every commanded
+   * acceleration.
+   */
+  Eigen::Vector3d solve(const double _dt,
+                        const Eigen::Vector3d &_position,
+                        const Eigen::Vector3d &_velocity,
+                        const Eigen::Vector3d &_pos_reference,
+                        const Eigen::Vector3d &_vel_reference,
+                        const Eigen::Vector3d &_acc_reference,
+                        const Eigen::Vector3d &_accel_min,
+                        const Eigen::Vector3d &_accel_max);
+
+  /** Drop the warm start, e.g. after a mode change */
+  void reset() { warm_valid_ = false; }
+
+private:
+  Mpc_config config_;
+  Mpc_stats stats_;
+
+  // Predicted positions and velocities are Phi * [p0, v0] + Gamma * U, per axis
+  Matrix gamma_p_ = Matrix::Zero();
+  Matrix gamma_v_ = Matrix::Zero();
+  Vector step_    = Vector::Zero();  // k * dt of the predicted samples, k = 1..kHorizon
+  Matrix hessian_[3]       = {Matrix::Zero(), Matrix::Zero(), Matrix::Zero()};
+  double inv_lipschitz_[3] = {0.0, 0.0, 0.0};
+
+  Eigen::Matrix<double, kHorizon, 3> solution_ = Eigen::Matrix<double, kHorizon, 3>::Zero();
+  bool warm_valid_                             = false;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
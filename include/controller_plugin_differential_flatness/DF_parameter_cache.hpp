@@ -0,0 +1,70 @@
+#ifndef __DF_PARAMETER_CACHE_H__
+#define __DF_PARAMETER_CACHE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace controller_plugin_differential_flatness {
+
+/**
+ * Persisted copy of the required parameters, so a relaunch applies them in one step from
+ * ownInitialize() instead of waiting for updateParams() to look them up one by one. Only the
+ * parameters not declared yet are taken from it, the declared ones are applied as they are.
+ *
+ * The file holds a magic, a version, a key, the values and an FNV-1a checksum of all of them.
+ * The key hashes the parameter names in order and the version, so a cache saved by a build
+ * with another parameter list is stale. A stale, truncated or corrupted file or a non-finite
+ * value rejects the whole cache, the parameters are then read the usual way.
+ * It is written and synced to a temporary file renamed over the old one, so a crash never
+ * leaves half a cache behind.
+ */
+class ParameterCache {
+public:
+  static constexpr uint32_t kMagic   = 0x43504644;  // "DFPC"
+  static constexpr uint32_t kVersion = 3;
+
+  static uint64_t fnv1a(const void *_data, const size_t _size,
+                        uint64_t _hash = 0xcbf29ce484222325ull) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(_data);
+    for (size_t i = 0; i < _size; i++) {
+      _hash = (_hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return _hash;
+  }
+
+  /** Hash of the names in order, each one terminated, so "ab","c" and "a","bc" differ */
+  template <typename Names>
+  static uint64_t namesHash(const Names &_names) {
+    uint64_t hash = fnv1a(nullptr, 0);
+    for (const auto &name : _names) {
+      hash = fnv1a(name.data(), name.size(), hash);
+      hash = fnv1a("", 1, hash);
+    }
+    return hash;
+  }
+
+  /** Key of the cache for _names, i.e. for the layout of its values in this version */
+  template <typename Names>
+  static uint64_t key(const Names &_names) {
+    const uint32_t version = kVersion;
+    return fnv1a(&version, sizeof(version), namesHash(_names));
+  }
+
+  /** Read _n values saved with _key. On failure _values is left untouched */
+  static bool load(const std::string &_path,
+                   const uint64_t _key,
+                   double *_values,
+                   const size_t _n,
+                   std::string &_error);
+
+  static bool save(const std::string &_path,
+                   const uint64_t _key,
+                   const double *_values,
+                   const size_t _n,
+                   std::string &_error);
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef __DF_PHASE_LOCK_H__
+#define __DF_PHASE_LOCK_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace controller_plugin_differential_flatness {
+
+struct Phase_lock_config {
+  bool enable          = false;
+  double target_offset = 0.0005;  // [s] desired state age when the tick fires
+  double gain          = 0.3;     // proportional gain of the loop filter
+  double integral_gain = 0.02;    // integral gain of the loop filter
+  double max_slew      = 0.1;     // maximum correction per tick, fraction of the period
+};
+
+/**
+ * Software PLL that aligns the control tick to the arrival of new state.
+ *
+ * The phase detector is the state age at each tick minus the target offset, wrapped to the
+ * shorter of the control and state periods. A PI loop filter turns it into a bounded shift
+ * of the next tick, so the tick rate stays the nominal one and only its phase moves.
+ * The tick driver applies the shift, through nextTick() or takeCorrection(). The nominal
+ * period is the driver one when it is set, otherwise it is estimated from the tick intervals
+ * with the applied shifts added back. Times are in nanoseconds of a monotonic clock.
+ */
+class PhaseLock {
+public:
+  Phase_lock_config config;
+
+  /** New state at _now_ns, _samples since the last call when a consumer skips some */
+  void onArrival(const int64_t _now_ns, const uint64_t _samples = 1) {
+    if (last_arrival_ns_ > 0 && _samples > 0) {
+      const double period = static_cast<double>(_now_ns - last_arrival_ns_) / _samples;
+      // Dropped or bursty samples must not corrupt the period estimate
+      if (state_period_ns_ <= 0.0) {
+        state_period_ns_ = period;
+      } else if (period > 0.5 * state_period_ns_ && period < 1.5 * state_period_ns_) {
+        state_period_ns_ = 0.95 * state_period_ns_ + 0.05 * period;
+      }
+    }
+    last_arrival_ns_ = _now_ns;
+  }
+
+  /** Nominal tick period of the driver, non-positive estimates it from the ticks */
+  void setNominalPeriod(const double _period_ns) {
+    nominal_period_ns_ = _period_ns;
+    if (_period_ns > 0.0) tick_period_ns_ = _period_ns;
+  }
+
+  void onTick(const int64_t _now_ns) {
+    if (nominal_period_ns_ > 0.0) {
+      tick_period_ns_ = nominal_period_ns_;
+    } else if (last_tick_ns_ > 0) {
+      const double period = static_cast<double>(_now_ns - last_tick_ns_) + applied_ns_;
+      tick_period_ns_     = tick_period_ns_ > 0.0 ? 0.95 * tick_period_ns_ + 0.05 * period : period;
+    }
+    applied_ns_   = 0.0;
+    last_tick_ns_ = _now_ns;
+    if (last_arrival_ns_ <= 0 || tick_period_ns_ <= 0.0 || state_period_ns_ <= 0.0) {
+      correction_ns_ = 0.0;
+      return;
+    }
+
+    const double age         = static_cast<double>(_now_ns - last_arrival_ns_);
+    const double wrap_period = std::min(tick_period_ns_, state_period_ns_);
+    double error             = std::fmod(age - config.target_offset * 1e9, wrap_period);
+    if (error >= 0.5 * wrap_period) error -= wrap_period;
+    if (error < -0.5 * wrap_period) error += wrap_period;
+
+    // Bounded so the tick period never moves by more than max_slew
+    const double max_correction = config.max_slew * tick_period_ns_;
+
+    if (config.enable) {
+      integral_ns_   = std::clamp(integral_ns_ + config.integral_gain * error, -max_correction,
+                                  max_correction);
+      correction_ns_ = std::clamp(config.gain * error + integral_ns_, -max_correction,
+                                  max_correction);
+    } else {
+      // Nothing winds up while disabled, enabling it starts from a clear integral
+      integral_ns_   = 0.0;
+      correction_ns_ = 0.0;
+    }
+
+    ticks_++;
+    age_sum_ns_ += age;
+    age_max_ns_       = std::max(age_max_ns_, age);
+    error_abs_avg_ns_ = 0.95 * error_abs_avg_ns_ + 0.05 * std::abs(error);
+    age_avg_ns_       = 0.95 * age_avg_ns_ + 0.05 * age;
+    locked_           = error_abs_avg_ns_ < 0.05 * wrap_period;
+  }
+
+  /** Absolute time of the next tick: the nominal period, shifted by the loop filter */
+  int64_t nextTick() {
+    applied_ns_ = correction_ns_;
+    return last_tick_ns_ + static_cast<int64_t>(tick_period_ns_ - correction_ns_);
+  }
+
+  /** How much earlier the next tick fires, for drivers on their own deadlines. 0 if disabled */
+  int64_t takeCorrection() {
+    applied_ns_ = correction_ns_;
+    return std::llround(correction_ns_);
+  }
+
+  double tickPeriod() const { return tick_period_ns_ * 1e-9; }
+  double statePeriod() const { return state_period_ns_ * 1e-9; }
+  bool locked() const { return config.enable && locked_; }
+
+  std::string report() const {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "phase_lock:\n";
+    ss << "  enabled: " << (config.enable ? "true" : "false") << "\n";
+    ss << "  locked: " << (locked() ? "true" : "false") << "\n";
+    ss << "  tick_period_ms: " << tick_period_ns_ * 1e-6 << "\n";
+    ss << "  state_period_ms: " << state_period_ns_ * 1e-6 << "\n";
+    ss << "  phase_error_ms: " << error_abs_avg_ns_ * 1e-6 << "\n";
+    ss << "  correction_ms: " << correction_ns_ * 1e-6 << "\n";
+    ss << "  state_age_ms: " << age_avg_ns_ * 1e-6 << "\n";
+    ss << "  state_age_mean_ms: " << (ticks_ ? age_sum_ns_ / ticks_ * 1e-6 : 0.0) << "\n";
+    ss << "  state_age_max_ms: " << age_max_ns_ * 1e-6 << "\n";
+    return ss.str();
+  }
+
+private:
+  int64_t last_arrival_ns_  = 0;
+  int64_t last_tick_ns_     = 0;
+  double state_period_ns_   = 0.0;
+  double tick_period_ns_    = 0.0;
+  double nominal_period_ns_ = 0.0;
+  double integral_ns_       = 0.0;
+  double correction_ns_     = 0.0;
+  double applied_ns_        = 0.0;  // correction the driver applied to the current interval
+  bool locked_              = false;
+
+  uint64_t ticks_          = 0;
+  double age_sum_ns_       = 0.0;
+  double age_max_ns_       = 0.0;
+  double age_avg_ns_       = 0.0;
+  double error_abs_avg_ns_ = 0.0;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef __DF_PUBLISH_OFFLOAD_H__
+#define __DF_PUBLISH_OFFLOAD_H__
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "spsc_queue.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+/** Only used by the internal tick source, see Plugin::startTickSource() */
+struct Publish_offload_config {
+  bool enable = false;
+  int cpu     = -1;  // core the publisher thread is pinned to, -1 leaves it floating
+
+  bool operator==(const Publish_offload_config &_other) const {
+    return enable == _other.enable && cpu == _other.cpu;
+  }
+  bool operator!=(const Publish_offload_config &_other) const { return !(*this == _other); }
+};
+
+/** Finished command of one tick, plain data so queuing it never allocates */
+struct Published_command {
+  uint64_t tick       = 0;
+  bool ok             = false;  // computeOutput() result
+  int64_t stamp_ns    = 0;      // message stamp
+  double rates[3]     = {0.0, 0.0, 0.0};
+  double thrust       = 0.0;
+  uint64_t enqueue_ns = 0;  // CLOCK_MONOTONIC
+};
+
+/**
+ * Publication of the control commands off the control tick.
+ *
+ * The tick pushes its finished command into a wait-free queue and returns. A publisher
+ * thread pops it, builds the messages and publishes them through the callback, so message
+ * serialization and middleware stalls never add to the tick latency. When the queue is full
+ * the command is dropped and counted, the tick never waits.
+ *
+ * The idle publisher sleeps on a futex. The tick only makes the wake up system call when its
+ * command lands in an empty queue while the publisher is asleep, so a burst of commands wakes
+ * it once and a busy publisher costs the tick two atomic operations. At one command per tick
+ * and a publisher keeping up, that is still one FUTEX_WAKE per tick, a small fixed cost next
+ * to the serialization and middleware calls it moves off the tick.
+ */
+class PublishOffload {
+public:
+  PublishOffload() = default;
+  ~PublishOffload() { stop(); }
+
+  PublishOffload(const PublishOffload &)            = delete;
+  PublishOffload &operator=(const PublishOffload &) = delete;
+
+  /** Start the publisher thread, restarting it if running. Commands left queued are dropped */
+  void start(const Publish_offload_config &_config,
+             std::function<void(const Published_command &)> _publish);
+  /** Publish the commands still queued and stop the publisher thread */
+  void stop();
+
+  bool enabled() const { return running_.load(std::memory_order_acquire); }
+  const Publish_offload_config &config() const { return config_; }
+
+  /** Hot path, wait-free. Only valid while enabled(), from a single producer thread */
+  void push(const Published_command &_command) {
+    if (!queue_->push(_command)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    const uint64_t depth = queue_->size();
+    if (depth > max_depth_.load(std::memory_order_relaxed)) {
+      max_depth_.store(depth, std::memory_order_relaxed);
+    }
+    // Sequentially consistent against the publisher going to sleep, see run(). With earlier
+    // commands still queued the publisher pops this one before it may sleep again
+    signal_.fetch_add(1);
+    if (depth <= 1 && sleeping_.load()) wake();
+  }
+
+  std::string report() const;
+
+private:
+  void run();
+  void wake();
+
+  using CommandQueue = SpscQueue<Published_command, 64>;
+
+  Publish_offload_config config_;
+  std::function<void(const Published_command &)> publish_;
+  // Allocated on the first start() and kept until destruction, as the telemetry queue
+  std::unique_ptr<CommandQueue> queue_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<uint32_t> signal_{0};  // futex word, bumped on every push and on stop()
+  std::atomic<bool> sleeping_{false};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> max_depth_{0};
+
+  struct Stats {
+    uint64_t published      = 0;
+    uint64_t publish_ns     = 0;  // time spent in the publish callback
+    uint64_t max_publish_ns = 0;
+    uint64_t latency_ns     = 0;  // from the push to the end of the publication
+    uint64_t max_latency_ns = 0;
+  };
+  mutable std::mutex stats_mutex_;  // publisher thread vs report(), never taken by the tick
+  Stats stats_;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
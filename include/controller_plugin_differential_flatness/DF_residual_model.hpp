@@ -0,0 +1,123 @@
+#ifndef __DF_RESIDUAL_MODEL_H__
+#define __DF_RESIDUAL_MODEL_H__
+
+#include <Eigen/Dense>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace controller_plugin_differential_flatness {
+
+struct Residual_model_config {
+  std::string file = "";  // empty disables the model
+  bool bypass      = false;
+  double budget_us = 20.0;  // per tick, an evaluation over it is dropped
+  double max_force = 0.0;   // [N] norm bound of the residual, non-positive disables it
+};
+
+struct Residual_model_stats {
+  uint64_t evaluations = 0;
+  uint64_t overruns    = 0;  // evaluations aborted by the time budget
+  uint64_t last_ns     = 0;
+  uint64_t max_ns      = 0;
+};
+
+/**
+ * Learned residual force (drag, ground effect, ...) added to the desired force.
+ *
+ * A small fixed-topology MLP evaluated in float. Inputs are the velocity, the acceleration
+ * reference and the height, normalized with the mean and scale stored in the file; the
+ * output is a world frame force in N. The weights live in one aligned buffer with every
+ * layer zero padded to kLanes floats, so each layer is a single vectorized matrix-vector
+ * product without remainder loops, and evaluate() never allocates.
+ *
+ * File layout (little endian): magic, version, number of layers, activation and the kMaxLayers
+ * + 1 layer sizes as uint32, then as float32 the input mean and scale, and the row-major
+ * weights followed by the bias of every layer.
+ */
+class ResidualModel {
+public:
+  static constexpr uint32_t kMagic    = 0x4c4d4644;  // "DFML"
+  static constexpr uint32_t kVersion  = 1;
+  static constexpr int kInputs        = 7;  // velocity, acceleration reference, height
+  static constexpr int kOutputs       = 3;
+  static constexpr int kMaxLayers     = 4;
+  static constexpr int kMaxWidth      = 128;
+  static constexpr int kLanes         = 16;  // padding, one AVX-512 or two AVX registers
+  static constexpr std::size_t kAlign = 64;
+
+  enum Activation : uint32_t { RELU = 0, TANH = 1 };
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t n_layers;
+    uint32_t activation;
+    uint32_t sizes[kMaxLayers + 1];
+  };
+
+  /** Load and validate _path. Not real-time, allocates the weight buffer */
+  bool open(const std::string &_path, std::string &_error);
+
+  bool isOpen() const { return n_layers_ > 0; }
+  const std::string &path() const { return path_; }
+  const Residual_model_stats &stats() const { return stats_; }
+
+  /** Per evaluation budget, checked after every layer */
+  void setBudget(const uint64_t _budget_ns) { budget_ns_ = _budget_ns; }
+  /** Norm bound of the output force, non-positive disables it */
+  void setMaxForce(const double _max_force) { max_force_ = _max_force; }
+
+  /**
+   * Residual force for the given features. Returns false, leaving _force untouched, when the
+   * evaluation exceeded its budget and was abandoned.
+   */
+  bool evaluate(const Eigen::Vector3d &_velocity,
+                const Eigen::Vector3d &_acc_reference,
+                const double _height,
+                Eigen::Vector3d &_force);
+
+  /** Write a model in the file layout, _sizes without padding from the input to the output */
+  static bool write(const std::string &_path,
+                    const std::vector<uint32_t> &_sizes,
+                    const Activation _activation,
+                    const std::vector<float> &_input_mean,
+                    const std::vector<float> &_input_scale,
+                    const std::vector<std::vector<float>> &_weights,
+                    const std::vector<std::vector<float>> &_biases,
+                    std::string &_error);
+
+private:
+  static int padded(const int _size) { return (_size + kLanes - 1) / kLanes * kLanes; }
+
+  struct Layer {
+    const float *weights = nullptr;  // rows x cols, row-major, both padded
+    const float *bias    = nullptr;
+    int rows             = 0;
+    int cols             = 0;
+  };
+
+  struct AlignedFree {
+    void operator()(float *_ptr) const { std::free(_ptr); }
+  };
+
+  std::unique_ptr<float[], AlignedFree> buffer_;
+  float *input_mean_  = nullptr;
+  float *input_scale_ = nullptr;
+  float *scratch_[2]  = {nullptr, nullptr};  // ping-pong activations
+  std::array<Layer, kMaxLayers> layers_;
+  int n_layers_          = 0;
+  Activation activation_ = RELU;
+  std::string path_;
+
+  uint64_t budget_ns_ = 20000;
+  double max_force_   = 0.0;
+  Residual_model_stats stats_;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
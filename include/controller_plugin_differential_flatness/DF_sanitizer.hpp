@@ -0,0 +1,114 @@
+#ifndef __DF_SANITIZER_H__
+#define __DF_SANITIZER_H__
+
+#include <Eigen/Dense>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace controller_plugin_differential_flatness {
+
+struct Sanitation_limits {
+  double max_thrust = std::numeric_limits<double>::infinity();  // [N]
+  double min_thrust = 0.0;                                       // [N]
+  double max_tilt   = M_PI;  // [rad] from world z, disabled if >= pi/2
+  double max_rate   = std::numeric_limits<double>::infinity();  // [rad/s] per axis
+};
+
+struct Sanitation_stats {
+  uint64_t non_finite_state     = 0;
+  uint64_t non_finite_reference = 0;
+  uint64_t degenerate_force     = 0;
+  uint64_t degenerate_heading   = 0;
+  uint64_t tilt_saturations     = 0;
+  uint64_t thrust_saturations   = 0;  // max_thrust or a positive min_thrust hit
+  uint64_t thrust_floor         = 0;  // negative collective clamped to a non-positive min_thrust
+  uint64_t rate_saturations     = 0;
+  uint64_t non_finite_command   = 0;
+};
+
+/**
+ * Input sanitation and output saturation for the control tick.
+ *
+ * Every check is written as a coefficient-wise select or a min/max, so the compiler emits
+ * blends and conditional moves instead of data dependent branches. Events are counted by
+ * adding the boolean result of the check.
+ */
+class Sanitizer {
+public:
+  static constexpr double kEpsilon = 1e-6;
+
+  Sanitation_limits limits;
+  Sanitation_stats stats;
+
+  /** Whole-vector select: a if keep, b otherwise */
+  static Eigen::Vector3d blend(const bool keep,
+                               const Eigen::Vector3d &a,
+                               const Eigen::Vector3d &b) {
+    return Eigen::Array<bool, 3, 1>::Constant(keep).select(a.array(), b.array()).matrix();
+  }
+
+  /** Replace the non-finite coefficients of _value with the ones of _previous */
+  static Eigen::Vector3d keepFinite(const Eigen::Vector3d &_value,
+                                    const Eigen::Vector3d &_previous,
+                                    uint64_t &_events) {
+    const auto finite = _value.array().isFinite();
+    _events += !finite.all();
+    return finite.select(_value.array(), _previous.array()).matrix();
+  }
+
+  /** Scalar version of keepFinite */
+  static double keepFinite(const double _value, const double _previous, uint64_t &_events) {
+    const bool finite = std::isfinite(_value);
+    _events += !finite;
+    return finite ? _value : _previous;
+  }
+
+  /** Normalize _value, or return _fallback if its norm is zero or non-finite */
+  static Eigen::Vector3d safeNormalized(const Eigen::Vector3d &_value,
+                                        const Eigen::Vector3d &_fallback,
+                                        uint64_t &_events) {
+    const double norm  = _value.norm();
+    const bool valid   = std::isfinite(norm) & (norm > kEpsilon);
+    const double scale = 1.0 / std::fmax(norm, kEpsilon);  // fmax drops NaN
+    _events += !valid;
+    return blend(valid, _value * scale, _fallback);
+  }
+
+  /** Shrink the horizontal part of _force so its tilt from world z is at most max_tilt */
+  Eigen::Vector3d limitTilt(const Eigen::Vector3d &_force) {
+    const bool enabled     = limits.max_tilt < M_PI_2;
+    const double fz        = std::fmax(_force.z(), kEpsilon);
+    const double horiz     = _force.head<2>().norm();
+    const double max_horiz = fz * std::tan(std::fmin(limits.max_tilt, M_PI_2 - kEpsilon));
+    const double scale     = std::fmin(1.0, max_horiz / std::fmax(horiz, kEpsilon));
+    stats.tilt_saturations += enabled & (scale < 1.0);
+    return blend(enabled, Eigen::Vector3d(_force.x() * scale, _force.y() * scale, fz), _force);
+  }
+
+  /**
+   * Clamp _thrust to [min_thrust, max_thrust], NaN gives min_thrust. With the default
+   * min_thrust of 0 a negative collective, normal in a fast descent, is not a limit being hit,
+   * so it is counted apart from the saturations
+   */
+  double saturateThrust(const double _thrust) {
+    const double saturated = std::fmin(std::fmax(_thrust, limits.min_thrust), limits.max_thrust);
+    const bool below       = _thrust < limits.min_thrust;
+    const bool floor       = limits.min_thrust <= 0.0;
+    stats.thrust_saturations += (_thrust > limits.max_thrust) | (below & !floor);
+    stats.thrust_floor += below & floor;
+    stats.non_finite_command += std::isnan(_thrust);
+    return saturated;
+  }
+
+  /** Clamp each rate to max_rate. NaN is left to keepFinite() and not counted as saturated */
+  Eigen::Vector3d saturateRates(const Eigen::Vector3d &_rates) {
+    const Eigen::Vector3d clamped = _rates.cwiseMax(-limits.max_rate).cwiseMin(limits.max_rate);
+    stats.rate_saturations += (_rates.cwiseAbs().array() > limits.max_rate).any();
+    return _rates.array().isNaN().select(_rates.array(), clamped.array()).matrix();
+  }
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
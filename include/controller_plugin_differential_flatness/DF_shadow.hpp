@@ -0,0 +1,130 @@
+#ifndef __DF_SHADOW_H__
+#define __DF_SHADOW_H__
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "DF_control_law.hpp"
+#include "spsc_queue.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+struct Shadow_config {
+  bool enable                  = false;
+  int cpu                      = -1;  // core the shadow thread is pinned to, -1 leaves it floating
+  Eigen::Vector3d kp_scale     = Eigen::Vector3d::Ones();  // shadow gains = active gains * scale
+  Eigen::Vector3d ki_scale     = Eigen::Vector3d::Ones();
+  Eigen::Vector3d kd_scale     = Eigen::Vector3d::Ones();
+  Eigen::Vector3d kp_ang_scale = Eigen::Vector3d::Ones();
+  std::string log_file         = "";  // per-tick deltas as CSV, empty disables the log
+
+  bool operator==(const Shadow_config &_other) const {
+    return enable == _other.enable && cpu == _other.cpu && kp_scale == _other.kp_scale &&
+           ki_scale == _other.ki_scale && kd_scale == _other.kd_scale &&
+           kp_ang_scale == _other.kp_ang_scale && log_file == _other.log_file;
+  }
+  bool operator!=(const Shadow_config &_other) const { return !(*this == _other); }
+};
+
+/** Everything the active tick used, so the shadow law sees exactly the same inputs */
+struct Shadow_input {
+  uint64_t tick = 0;
+  double dt     = 0.0;
+  UAV_state state;
+  UAV_reference reference;
+  Control_gains gains;
+  Sanitation_limits limits;
+  Mpc_config mpc;  // of the active law, disabled when it has no MPC
+  // Active integrator before the tick, zero while computeOutput() resets it on every tick
+  Eigen::Vector3d accum_pos_error = Eigen::Vector3d::Zero();
+  Eigen::Vector3d residual_force  = Eigen::Vector3d::Zero();  // active residual model output
+  Acro_command active;
+};
+
+/**
+ * Shadow evaluation of an alternative gain profile.
+ *
+ * The control tick only pushes its inputs and command into a wait-free queue. A background
+ * thread, optionally pinned to a spare core, runs its own ControlLaw on them and accumulates
+ * the deltas from the active command. Nothing computed here is ever actuated. The shadow
+ * integrator starts every tick from the active one, so deltas isolate the gain profile
+ * instead of accumulating integrator drift. The shadow law mirrors the active one: it runs
+ * its own MPC with the active configuration, and adds the force the active residual model
+ * produced, since the model inputs are the same for both laws.
+ *
+ * Only ticks that ran the full law are pushed, attitude only upsampled ticks are not.
+ *
+ * The idle shadow thread sleeps on a futex, as the PublishOffload publisher: the tick only
+ * makes the wake up system call when its input lands in an empty queue while it sleeps.
+ */
+class ShadowController {
+public:
+  ShadowController() = default;
+  ~ShadowController() { stop(); }
+
+  ShadowController(const ShadowController &)            = delete;
+  ShadowController &operator=(const ShadowController &) = delete;
+
+  /** Apply a new configuration, starting or restarting the background thread if needed */
+  void configure(const Shadow_config &_config);
+
+  bool enabled() const { return running_.load(std::memory_order_acquire); }
+
+  /** Hot path, wait-free. Only valid while enabled() */
+  void push(const Shadow_input &_input) {
+    if (!queue_->push(_input)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    // Sequentially consistent against the shadow thread going to sleep, see run()
+    const size_t depth = queue_->size();
+    signal_.fetch_add(1);
+    if (depth <= 1 && sleeping_.load()) wake();
+  }
+
+  std::string report() const;
+
+private:
+  void start();
+  void stop();
+  void run();
+  void wake();
+  void evaluate(const Shadow_input &_input);
+
+  using InputQueue = SpscQueue<Shadow_input, 256>;
+
+  Shadow_config config_;  // written under stats_mutex_, read by report()
+  // Allocated on the first start() and kept until destruction, published to the producer by
+  // running_ as the telemetry queue
+  std::unique_ptr<InputQueue> queue_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<uint32_t> signal_{0};  // futex word, bumped on every push and on stop()
+  std::atomic<bool> sleeping_{false};
+  std::atomic<uint64_t> dropped_{0};
+
+  // Background thread state
+  ControlLaw law_;
+  FILE *log_ = nullptr;
+
+  struct Stats {
+    uint64_t ticks           = 0;
+    double sum_thrust_delta  = 0.0;  // |shadow - active|
+    double max_thrust_delta  = 0.0;
+    double sum_rate_delta_sq = 0.0;  // ||shadow - active||^2 of PQR
+    double max_rate_delta    = 0.0;
+    uint64_t compute_ns      = 0;
+    uint64_t max_compute_ns  = 0;
+    Sanitation_stats sanitation;
+  };
+  mutable std::mutex stats_mutex_;  // shadow thread and configure() vs report(), not the tick
+  Stats stats_;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
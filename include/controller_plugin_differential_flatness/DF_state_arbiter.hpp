@@ -0,0 +1,171 @@
+#ifndef __DF_STATE_ARBITER_H__
+#define __DF_STATE_ARBITER_H__
+
+#include <Eigen/Dense>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace controller_plugin_differential_flatness {
+
+struct State_sample {
+  Eigen::Vector3d position = Eigen::Vector3d::Zero();
+  Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
+  Eigen::Vector4d attitude = Eigen::Vector4d(0, 0, 0, 1);  // x, y, z, w
+  int64_t stamp_ns         = 0;  // measurement time, arrival time if the source has no stamp
+  int64_t arrival_ns       = 0;  // reception time on CLOCK_MONOTONIC, for the phase lock
+};
+
+struct State_arbiter_config {
+  bool enable          = false;
+  double max_age       = 0.1;   // [s] older samples make the source unhealthy
+  double min_rate      = 10.0;  // [Hz] slower sources are unhealthy
+  double switch_margin = 0.01;  // [s] a candidate must be this much fresher to switch
+  double min_dwell     = 0.2;   // [s] minimum time on a source before switching again
+};
+
+/**
+ * Selection of the freshest healthy state source among a small fixed set of sources.
+ *
+ * Sources keep their latest sample, arrival time and an exponential average of their rate.
+ * select() scans the fixed array, so it is O(1) on the number of received samples, and only
+ * switches the active source when the candidate is fresher by more than switch_margin and
+ * the active one has been used for min_dwell, or when the active source becomes unhealthy.
+ */
+class StateArbiter {
+public:
+  static constexpr int kMaxSources = 4;
+
+  struct Source {
+    std::string name;
+    State_sample sample;
+    uint64_t seq            = 0;
+    int64_t last_arrival    = 0;
+    double period_avg       = 0.0;  // [ns]
+    uint64_t selected_ticks = 0;
+  };
+
+  State_arbiter_config config;
+
+  /** Register a source, returns its id or -1 if there is no room left. Ids of removed sources
+   * are reused */
+  int addSource(const std::string &_name) {
+    int free = -1;
+    for (int i = 0; i < n_sources_; i++) {
+      if (sources_[i].name == _name) return i;
+      if (free < 0 && sources_[i].name.empty()) free = i;
+    }
+    if (free >= 0) {
+      sources_[free].name = _name;
+      return free;
+    }
+    if (n_sources_ >= kMaxSources) return -1;
+    sources_[n_sources_].name = _name;
+    return n_sources_++;
+  }
+
+  /** Forget a source and its samples, so it can no longer be selected */
+  void removeSource(const int _id) {
+    sources_[_id] = Source();
+    if (active_ == _id) active_ = -1;
+  }
+
+  void update(const int _id, const State_sample &_sample, const int64_t _now_ns) {
+    Source &source = sources_[_id];
+    if (source.name.empty()) return;  // removed, a late sample must not revive it
+    if (source.last_arrival > 0) {
+      const double period = static_cast<double>(_now_ns - source.last_arrival);
+      source.period_avg   = source.period_avg > 0.0 ? 0.9 * source.period_avg + 0.1 * period
+                                                    : period;
+    }
+    source.sample          = _sample;
+    source.sample.stamp_ns = _sample.stamp_ns > 0 ? _sample.stamp_ns : _now_ns;
+    source.last_arrival    = _now_ns;
+    source.seq++;
+  }
+
+  bool healthy(const int _id, const int64_t _now_ns) const {
+    const Source &source = sources_[_id];
+    const double age     = (_now_ns - source.sample.stamp_ns) * 1e-9;
+    const double rate    = source.period_avg > 0.0 ? 1e9 / source.period_avg : 0.0;
+    return source.seq > 0 && age <= config.max_age && rate >= config.min_rate;
+  }
+
+  /** Pick the source for this tick. Returns its id, or -1 if no sample was received yet */
+  int select(const int64_t _now_ns) {
+    int freshest         = -1;
+    int freshest_healthy = -1;
+    for (int i = 0; i < n_sources_; i++) {
+      if (sources_[i].seq == 0) continue;
+      const int64_t stamp = sources_[i].sample.stamp_ns;
+      if (freshest < 0 || stamp > sources_[freshest].sample.stamp_ns) freshest = i;
+      if (healthy(i, _now_ns) &&
+          (freshest_healthy < 0 || stamp > sources_[freshest_healthy].sample.stamp_ns)) {
+        freshest_healthy = i;
+      }
+    }
+    if (freshest < 0) return -1;
+
+    if (freshest_healthy < 0) {
+      // Degraded: nothing is healthy, keep flying on the freshest sample available
+      no_healthy_ticks_++;
+      switchTo(freshest, _now_ns);
+    } else if (active_ < 0 || !healthy(active_, _now_ns)) {
+      switchTo(freshest_healthy, _now_ns);
+    } else if (freshest_healthy != active_) {
+      const int64_t margin = static_cast<int64_t>(config.switch_margin * 1e9);
+      const int64_t dwell  = static_cast<int64_t>(config.min_dwell * 1e9);
+      if (sources_[freshest_healthy].sample.stamp_ns > sources_[active_].sample.stamp_ns + margin &&
+          _now_ns - last_switch_ns_ >= dwell) {
+        switchTo(freshest_healthy, _now_ns);
+      }
+    }
+    sources_[active_].selected_ticks++;
+    return active_;
+  }
+
+  const Source &source(const int _id) const { return sources_[_id]; }
+  int numSources() const { return n_sources_; }
+
+  std::string report(const int64_t _now_ns) const {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "state_arbitration:\n";
+    ss << "  enabled: " << (config.enable ? "true" : "false") << "\n";
+    ss << "  active: " << (active_ >= 0 ? sources_[active_].name : "none") << "\n";
+    ss << "  switches: " << switches_ << "\n";
+    ss << "  no_healthy_ticks: " << no_healthy_ticks_ << "\n";
+    ss << "  sources:\n";
+    for (int i = 0; i < n_sources_; i++) {
+      const Source &source = sources_[i];
+      if (source.name.empty()) continue;
+      ss << "    " << source.name << ": {healthy: " << (healthy(i, _now_ns) ? "true" : "false")
+         << ", samples: " << source.seq
+         << ", rate_hz: " << (source.period_avg > 0.0 ? 1e9 / source.period_avg : 0.0)
+         << ", age_ms: " << (source.seq ? (_now_ns - source.sample.stamp_ns) * 1e-6 : 0.0)
+         << ", selected_ticks: " << source.selected_ticks << "}\n";
+    }
+    return ss.str();
+  }
+
+private:
+  void switchTo(const int _id, const int64_t _now_ns) {
+    if (_id == active_) return;
+    if (active_ >= 0) switches_++;
+    active_         = _id;
+    last_switch_ns_ = _now_ns;
+  }
+
+  std::array<Source, kMaxSources> sources_;
+  int n_sources_             = 0;
+  int active_                = -1;
+  int64_t last_switch_ns_    = 0;
+  uint64_t switches_         = 0;
+  uint64_t no_healthy_ticks_ = 0;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef __DF_STATE_TRANSFER_H__
+#define __DF_STATE_TRANSFER_H__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace controller_plugin_differential_flatness {
+
+/**
+ * Controller state handed over from a running instance to a newly loaded one, e.g. a new build
+ * of the plugin replacing the old one without losing the gains, references and mode.
+ * accum_pos_error is exported as it stands but not carried over: computeOutput() resets the
+ * integrator at the start of every tick, so both instances start each tick from zero.
+ *
+ * It crosses library builds as bytes: magic, version and size, then the fields. Versions only
+ * append fields, so each build reads the common prefix of the other one and keeps its own
+ * defaults for the fields it does not find.
+ */
+struct Controller_state {
+  static constexpr uint32_t kMagic   = 0x54534644;  // "DFST"
+  static constexpr uint32_t kVersion = 1;
+
+  enum Flag : uint32_t {
+    PARAMETERS_READ = 1u << 0,
+    STATE_RECEIVED  = 1u << 1,
+    REF_RECEIVED    = 1u << 2,
+    HOVER           = 1u << 3,
+  };
+
+  uint32_t magic   = kMagic;
+  uint32_t version = kVersion;
+  uint32_t size    = sizeof(Controller_state);  // bytes written by the exporting build
+  uint32_t flags   = 0;
+
+  // Version 1
+  double mass                = 0.0;
+  double antiwindup_cte      = 0.0;
+  double kp[3]               = {0.0, 0.0, 0.0};
+  double ki[3]               = {0.0, 0.0, 0.0};
+  double kd[3]               = {0.0, 0.0, 0.0};
+  double kp_ang[3]           = {0.0, 0.0, 0.0};
+  double accum_pos_error[3]  = {0.0, 0.0, 0.0};  // informational, reset by every tick
+  double position[3]         = {0.0, 0.0, 0.0};
+  double velocity[3]         = {0.0, 0.0, 0.0};
+  double attitude[4]         = {0.0, 0.0, 0.0, 1.0};  // x, y, z, w
+  double ref_position[3]     = {0.0, 0.0, 0.0};
+  double ref_velocity[3]     = {0.0, 0.0, 0.0};
+  double ref_acceleration[3] = {0.0, 0.0, 0.0};
+  double ref_yaw             = 0.0;
+  double rates[3]            = {0.0, 0.0, 0.0};  // last command
+  double thrust              = 0.0;
+  uint8_t mode_in[3]         = {0, 0, 0};  // control_mode, yaw_mode, reference_frame
+  uint8_t mode_out[3]        = {0, 0, 0};
+  uint8_t reserved[2]        = {0, 0};
+  uint64_t tick              = 0;
+  int64_t tick_deadline_ns   = 0;  // next deadline of the stopped tick source, 0 if none
+};
+
+static_assert(std::is_trivially_copyable<Controller_state>::value,
+              "Controller_state is copied as bytes");
+
+// Bytes of version 1, the oldest state any build accepts
+constexpr size_t kControllerStateMinSize =
+    offsetof(Controller_state, tick_deadline_ns) + sizeof(int64_t);
+
+inline std::vector<uint8_t> encodeControllerState(const Controller_state &_state) {
+  std::vector<uint8_t> bytes(sizeof(Controller_state));
+  Controller_state state = _state;
+  state.magic            = Controller_state::kMagic;
+  state.version          = Controller_state::kVersion;
+  state.size             = sizeof(Controller_state);
+  std::memcpy(bytes.data(), &state, sizeof(Controller_state));
+  return bytes;
+}
+
+/** Validate and read _bytes, from any version. On failure _state is left untouched */
+inline bool decodeControllerState(const std::vector<uint8_t> &_bytes,
+                                  Controller_state &_state,
+                                  std::string &_error) {
+  // magic, version and size
+  uint32_t header[3];
+  if (_bytes.size() < sizeof(header)) {
+    _error = "truncated state, " + std::to_string(_bytes.size()) + " bytes";
+    return false;
+  }
+  std::memcpy(header, _bytes.data(), sizeof(header));
+  if (header[0] != Controller_state::kMagic) {
+    _error = "not a controller state";
+    return false;
+  }
+  if (header[2] != _bytes.size() || header[2] < kControllerStateMinSize) {
+    _error = "state of version " + std::to_string(header[1]) + " has " +
+             std::to_string(_bytes.size()) + " bytes, " + std::to_string(header[2]) +
+             " declared";
+    return false;
+  }
+
+  Controller_state state;
+  std::memcpy(static_cast<void *>(&state), _bytes.data(),
+              std::min<size_t>(header[2], sizeof(Controller_state)));
+  _state = state;
+  return true;
+}
+
+/**
+ * Check the values of a decoded _state before a controller runs with them: every field
+ * finite and, with PARAMETERS_READ, a positive mass and gains a controller can run with.
+ * On failure _error names the first offending field.
+ */
+inline bool checkControllerState(const Controller_state &_state, std::string &_error) {
+  enum Bound { FINITE, NON_NEGATIVE, POSITIVE };
+  const struct {
+    const char *name;
+    const double *values;
+    size_t n;
+    Bound bound;
+  } fields[] = {
+      // Proportional gains must act, the integral and derivative ones may be off
+      {"mass", &_state.mass, 1, POSITIVE},
+      {"antiwindup_cte", &_state.antiwindup_cte, 1, NON_NEGATIVE},
+      {"kp", _state.kp, 3, POSITIVE},
+      {"ki", _state.ki, 3, NON_NEGATIVE},
+      {"kd", _state.kd, 3, NON_NEGATIVE},
+      {"kp_ang", _state.kp_ang, 3, POSITIVE},
+      {"accum_pos_error", _state.accum_pos_error, 3, FINITE},
+      {"position", _state.position, 3, FINITE},
+      {"velocity", _state.velocity, 3, FINITE},
+      {"attitude", _state.attitude, 4, FINITE},
+      {"ref_position", _state.ref_position, 3, FINITE},
+      {"ref_velocity", _state.ref_velocity, 3, FINITE},
+      {"ref_acceleration", _state.ref_acceleration, 3, FINITE},
+      {"ref_yaw", &_state.ref_yaw, 1, FINITE},
+      {"rates", _state.rates, 3, FINITE},
+      {"thrust", &_state.thrust, 1, FINITE},
+  };
+  constexpr size_t kGainFields = 6;
+
+  const auto in_bound = [](const double _value, const Bound _bound) {
+    return std::isfinite(_value) &&
+           (_bound == FINITE || _value > 0.0 || (_bound == NON_NEGATIVE && _value == 0.0));
+  };
+
+  // The gains are only taken over, so only checked, once the exporting instance read them
+  const size_t first = (_state.flags & Controller_state::PARAMETERS_READ) ? 0 : kGainFields;
+  for (size_t i = first; i < std::size(fields); i++) {
+    for (size_t j = 0; j < fields[i].n; j++) {
+      if (!in_bound(fields[i].values[j], fields[i].bound)) {
+        _error = std::string("invalid ") + fields[i].name + " in the state";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Hot reload interface, implemented by the plugin next to ControllerBase. Hosts reach it with
+ * dynamic_cast on the loaded instance, so each side runs the code of its own build and only
+ * the bytes of Controller_state cross between them.
+ */
+class StateTransfer {
+public:
+  virtual ~StateTransfer() = default;
+
+  virtual std::vector<uint8_t> exportState() = 0;
+
+  /** Take over the state of another instance. Cheap enough to run between two ticks */
+  virtual bool importState(const std::vector<uint8_t> &_state, std::string &_error) = 0;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
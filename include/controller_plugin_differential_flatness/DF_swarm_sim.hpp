@@ -0,0 +1,134 @@
+#ifndef __DF_SWARM_SIM_H__
+#define __DF_SWARM_SIM_H__
+
+#include <Eigen/Dense>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "DF_control_law.hpp"
+#include "DF_sanitizer.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+struct Swarm_config {
+  size_t vehicles = 1000;
+  int threads     = 0;     // 0 uses every hardware thread
+  double dt       = 0.01;  // [s] control and integration step
+  double mass     = 0.82;  // [kg] of the simulated vehicles, gains.mass is the controller one
+  Control_gains gains;     // shared by all the controllers
+  Sanitation_limits limits;
+  bool rotate = true;      // offsets turn with the formation yaw, as formation.rotate
+};
+
+/** Formation origin at some time, shared by all the vehicles */
+struct Swarm_origin {
+  UAV_reference reference;
+  double yaw_rate = 0.0;  // [rad/s]
+};
+
+using Swarm_trajectory = std::function<Swarm_origin(double)>;
+
+struct Swarm_vehicle {
+  Eigen::Vector3d position    = Eigen::Vector3d::Zero();
+  Eigen::Vector3d velocity    = Eigen::Vector3d::Zero();
+  Eigen::Quaterniond attitude = Eigen::Quaterniond::Identity();
+  Eigen::Vector3d rates       = Eigen::Vector3d::Zero();  // last command
+  double thrust               = 0.0;
+};
+
+struct Swarm_stats {
+  uint64_t steps            = 0;
+  uint64_t vehicle_steps    = 0;
+  uint64_t wall_ns          = 0;    // spent in run()
+  double time               = 0.0;  // [s] simulated
+  double position_error_rms = 0.0;  // [m] against the formation slots, after the last run()
+  double position_error_max = 0.0;
+};
+
+/** Allocator of cache line aligned arrays, so that slices cut on whole lines stay apart */
+template <typename T>
+struct CacheLineAllocator {
+  using value_type = T;
+  static constexpr size_t kAlignment = 64;
+
+  CacheLineAllocator() = default;
+  template <typename U>
+  CacheLineAllocator(const CacheLineAllocator<U> &) {}
+
+  T *allocate(const size_t _n) {
+    return static_cast<T *>(::operator new(_n * sizeof(T), std::align_val_t(kAlignment)));
+  }
+  void deallocate(T *_ptr, size_t) { ::operator delete(_ptr, std::align_val_t(kAlignment)); }
+
+  bool operator==(const CacheLineAllocator &) const { return true; }
+  bool operator!=(const CacheLineAllocator &) const { return false; }
+};
+
+/**
+ * Closed loop simulation of many vehicles, each one with its own flatness controller,
+ * flying a formation: a shared origin trajectory plus a per-vehicle offset, as with
+ * formation.enable.
+ *
+ * States, integrators, offsets and commands are kept as one array per scalar, so each step
+ * is a single branch free loop over the vehicles the compiler vectorizes. The loop is the
+ * same math as ControlLaw::computeTrajectoryControl() without the MPC and residual model,
+ * sanitation included, followed by a rigid body step: body rates integrated on the attitude,
+ * collective thrust along body z and gravity. Vehicles do not interact, so each thread runs
+ * all the steps of a contiguous slice of them without any synchronization in between.
+ */
+class SwarmSimulator {
+public:
+  // Vehicles per cache line. Slices are cut on multiples of it and the arrays start on a line,
+  // so no two threads write the same cache line
+  static constexpr size_t kLane = CacheLineAllocator<double>::kAlignment / sizeof(double);
+
+  explicit SwarmSimulator(const Swarm_config &_config);
+
+  size_t size() const { return config_.vehicles; }
+  const Swarm_config &config() const { return config_; }
+
+  /** Slot of _vehicle in the formation frame, and its heading from the formation yaw */
+  void setOffset(const size_t _vehicle, const Eigen::Vector3d &_offset, const double _yaw_offset);
+  /** Put every vehicle at rest, level, on its slot of _origin, and clear the integrators */
+  void resetToFormation(const Swarm_origin &_origin);
+  void setVehicle(const size_t _vehicle, const Swarm_vehicle &_state);
+  Swarm_vehicle vehicle(const size_t _vehicle) const;
+
+  /**
+   * Advance all the vehicles _steps steps. _trajectory is evaluated once per step by each
+   * thread, so it must be thread safe and deterministic.
+   */
+  void run(const int _steps, const Swarm_trajectory &_trajectory);
+
+  const Swarm_stats &stats() const { return stats_; }
+  std::string report() const;
+
+private:
+  void runSlice(const size_t _begin, const size_t _end, const int _steps,
+                const Swarm_trajectory &_trajectory);
+  void stepSlice(const size_t _begin, const size_t _end, const Swarm_origin &_origin);
+  void updateErrors(const Swarm_origin &_origin);
+
+  Swarm_config config_;
+  Swarm_stats stats_;
+  int threads_ = 1;
+
+  using Lanes = std::vector<double, CacheLineAllocator<double>>;
+
+  // One entry per vehicle, padded to a multiple of kLane
+  Lanes px_, py_, pz_;           // position
+  Lanes vx_, vy_, vz_;           // velocity
+  Lanes qw_, qx_, qy_, qz_;      // attitude
+  Lanes ix_, iy_, iz_;           // integrated position error
+  Lanes ox_, oy_, oz_;           // formation offset
+  Lanes cos_yaw_, sin_yaw_;      // of the yaw offset
+  Lanes wx_, wy_, wz_, thrust_;  // last command
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
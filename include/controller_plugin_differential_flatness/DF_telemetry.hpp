@@ -0,0 +1,103 @@
+#ifndef __DF_TELEMETRY_H__
+#define __DF_TELEMETRY_H__
+
+#include <netinet/in.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "DF_telemetry_codec.hpp"
+#include "spsc_queue.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+struct Telemetry_config {
+  bool enable            = false;
+  std::string udp_host   = "127.0.0.1";
+  int udp_port           = 14590;
+  int decimation         = 10;      // minimum samples per record
+  double max_bandwidth   = 2000.0;  // [bytes/s]
+  int max_packet_size    = 255;     // [bytes], radio MTU
+  double max_cpu_percent = 1.0;     // of one core, background thread only
+  double resolution      = 1e-3;    // quantization step of every channel
+
+  bool operator==(const Telemetry_config &_other) const {
+    return enable == _other.enable && udp_host == _other.udp_host &&
+           udp_port == _other.udp_port && decimation == _other.decimation &&
+           max_bandwidth == _other.max_bandwidth && max_packet_size == _other.max_packet_size &&
+           max_cpu_percent == _other.max_cpu_percent && resolution == _other.resolution;
+  }
+  bool operator!=(const Telemetry_config &_other) const { return !(*this == _other); }
+};
+
+/**
+ * Decimated, delta encoded telemetry for low bandwidth links.
+ *
+ * The control tick only pushes a sample into a wait-free queue. A background thread
+ * aggregates the samples (min/max/mean per window), encodes them with telemetry_codec and
+ * sends the packets over UDP. Decimation is raised when the bandwidth budget is exceeded,
+ * and the thread wake period is stretched when its CPU budget is exceeded.
+ */
+class TelemetryStream {
+public:
+  TelemetryStream() = default;
+  ~TelemetryStream() { stop(); }
+
+  TelemetryStream(const TelemetryStream &)            = delete;
+  TelemetryStream &operator=(const TelemetryStream &) = delete;
+
+  /**
+   * Apply a new configuration, starting or restarting the background thread if needed. Every
+   * start begins from an empty window and a key frame. False with _error set when the socket
+   * can not be opened or udp_host is not an IPv4 address, the stream then stays stopped
+   */
+  bool configure(const Telemetry_config &_config, std::string &_error);
+
+  bool enabled() const { return running_.load(std::memory_order_acquire); }
+
+  /** Hot path, wait-free. Only valid while enabled() */
+  void push(const Telemetry_sample &_sample) {
+    if (!queue_->push(_sample)) dropped_samples_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::string report() const;
+
+private:
+  bool start(std::string &_error);
+  void stop();
+  void run();
+  void addRecord(const Telemetry_record &_record);
+  void sendPacket();
+
+  using SampleQueue = SpscQueue<Telemetry_sample, 1024>;
+
+  Telemetry_config config_;
+  bool configured_ = false;  // config_ applied, whether it started or not
+  // Allocated on the first start() and kept until destruction, so instances that never
+  // enable telemetry do not pay for it and a push() racing a stop() stays valid. start()
+  // publishes it with the release store of running_, acquired by enabled()
+  std::unique_ptr<SampleQueue> queue_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+
+  // Background thread state
+  int socket_ = -1;
+  sockaddr_in addr_{};
+  TelemetryAggregator aggregator_;
+  telemetry_codec::PacketEncoder encoder_;
+  uint16_t seq_ = 0;
+  uint64_t window_bytes_ = 0;
+
+  std::atomic<uint64_t> dropped_samples_{0};
+  std::atomic<uint64_t> dropped_records_{0};
+  std::atomic<uint64_t> records_{0};
+  std::atomic<uint64_t> packets_{0};
+  std::atomic<uint64_t> bytes_{0};
+  std::atomic<uint32_t> decimation_{10};
+  std::atomic<uint32_t> period_ms_{20};
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
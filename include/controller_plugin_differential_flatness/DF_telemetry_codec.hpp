@@ -0,0 +1,245 @@
+#ifndef __DF_TELEMETRY_CODEC_H__
+#define __DF_TELEMETRY_CODEC_H__
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace controller_plugin_differential_flatness {
+
+constexpr uint8_t kTelemetryChannels = 16;
+
+constexpr const char *kTelemetryChannelNames[kTelemetryChannels] = {
+    "pos_error_x", "pos_error_y", "pos_error_z", "vel_error_x", "vel_error_y", "vel_error_z",
+    "force_x",     "force_y",     "force_z",     "thrust",      "p",           "q",
+    "r",           "integral_x",  "integral_y",  "integral_z"};
+
+/** One control tick worth of telemetry channels */
+struct Telemetry_sample {
+  uint32_t tick = 0;
+  std::array<float, kTelemetryChannels> values{};
+};
+
+/** Aggregation of a decimation window, preserving min, max and mean of every channel */
+struct Telemetry_record {
+  uint32_t tick  = 0;  // first tick of the window
+  uint16_t count = 0;  // number of samples aggregated
+  std::array<float, kTelemetryChannels> min{};
+  std::array<float, kTelemetryChannels> max{};
+  std::array<float, kTelemetryChannels> mean{};
+};
+
+class TelemetryAggregator {
+public:
+  /** Add a sample, returns true when a record of _decimation samples is complete */
+  bool add(const Telemetry_sample &_sample, const uint16_t _decimation) {
+    if (count_ == 0) {
+      record_.tick = _sample.tick;
+      record_.min  = _sample.values;
+      record_.max  = _sample.values;
+      sum_.fill(0.0);
+    }
+    for (uint8_t i = 0; i < kTelemetryChannels; i++) {
+      record_.min[i] = std::min(record_.min[i], _sample.values[i]);
+      record_.max[i] = std::max(record_.max[i], _sample.values[i]);
+      sum_[i] += _sample.values[i];
+    }
+    return ++count_ >= std::max<uint16_t>(_decimation, 1);
+  }
+
+  /** Complete the current window and start a new one */
+  Telemetry_record take() {
+    record_.count = count_;
+    for (uint8_t i = 0; i < kTelemetryChannels; i++) {
+      record_.mean[i] = count_ ? static_cast<float>(sum_[i] / count_) : 0.0f;
+    }
+    count_ = 0;
+    return record_;
+  }
+
+  uint16_t pending() const { return count_; }
+
+private:
+  Telemetry_record record_;
+  std::array<double, kTelemetryChannels> sum_{};
+  uint16_t count_ = 0;
+};
+
+namespace telemetry_codec {
+
+/**
+ * Packet layout (little endian):
+ *   u16 magic | u8 version | u8 n_channels | u16 seq | u16 decimation | f32 resolution |
+ *   u8 n_records | records...
+ *
+ * Each record is: varint tick delta | varint count | per channel: zigzag varint mean delta,
+ * varint (mean - min), varint (max - mean). Values are quantized with the packet resolution.
+ * The first record of a packet is delta encoded against zero, so every packet can be decoded
+ * on its own when the link drops packets.
+ */
+constexpr uint16_t kMagic    = 0xDF7E;
+constexpr uint8_t kVersion   = 1;
+constexpr size_t kHeaderSize = 13;
+constexpr size_t kMaxRecords = 255;
+
+inline void putVarint(std::vector<uint8_t> &_buffer, uint64_t _value) {
+  while (_value >= 0x80) {
+    _buffer.push_back(static_cast<uint8_t>(_value | 0x80));
+    _value >>= 7;
+  }
+  _buffer.push_back(static_cast<uint8_t>(_value));
+}
+
+inline bool getVarint(const uint8_t *&_data, const uint8_t *_end, uint64_t &_value) {
+  _value = 0;
+  for (int shift = 0; shift < 64 && _data < _end; shift += 7) {
+    const uint8_t byte = *_data++;
+    _value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+inline uint64_t zigzag(const int64_t _value) {
+  return (static_cast<uint64_t>(_value) << 1) ^ static_cast<uint64_t>(_value >> 63);
+}
+
+inline int64_t unzigzag(const uint64_t _value) {
+  return static_cast<int64_t>(_value >> 1) ^ -static_cast<int64_t>(_value & 1);
+}
+
+inline int64_t quantize(const float _value, const float _resolution) {
+  if (!std::isfinite(_value)) return 0;
+  const double q = std::round(static_cast<double>(_value) / _resolution);
+  return static_cast<int64_t>(std::clamp(q, -4.0e15, 4.0e15));
+}
+
+class PacketEncoder {
+public:
+  void begin(const uint16_t _seq, const uint16_t _decimation, const float _resolution) {
+    buffer_.clear();
+    resolution_ = _resolution;
+    n_records_  = 0;
+    prev_tick_  = 0;
+    prev_mean_.fill(0);
+
+    putU16(kMagic);
+    buffer_.push_back(kVersion);
+    buffer_.push_back(kTelemetryChannels);
+    putU16(_seq);
+    putU16(_decimation);
+    uint32_t res_bits;
+    std::memcpy(&res_bits, &_resolution, sizeof(res_bits));
+    for (int i = 0; i < 4; i++) buffer_.push_back(static_cast<uint8_t>(res_bits >> (8 * i)));
+    buffer_.push_back(0);  // n_records, patched on finish()
+  }
+
+  /** Append a record if it fits in _max_size bytes, otherwise leave the packet untouched */
+  bool add(const Telemetry_record &_record, const size_t _max_size) {
+    if (n_records_ >= kMaxRecords) return false;
+
+    const size_t rollback = buffer_.size();
+    putVarint(buffer_, static_cast<uint32_t>(_record.tick - prev_tick_));
+    putVarint(buffer_, _record.count);
+
+    std::array<int64_t, kTelemetryChannels> mean;
+    for (uint8_t i = 0; i < kTelemetryChannels; i++) {
+      mean[i]         = quantize(_record.mean[i], resolution_);
+      const int64_t a = std::max<int64_t>(0, mean[i] - quantize(_record.min[i], resolution_));
+      const int64_t b = std::max<int64_t>(0, quantize(_record.max[i], resolution_) - mean[i]);
+      putVarint(buffer_, zigzag(mean[i] - prev_mean_[i]));
+      putVarint(buffer_, static_cast<uint64_t>(a));
+      putVarint(buffer_, static_cast<uint64_t>(b));
+    }
+
+    if (buffer_.size() > _max_size) {
+      buffer_.resize(rollback);
+      return false;
+    }
+    prev_tick_ = _record.tick;
+    prev_mean_ = mean;
+    n_records_++;
+    return true;
+  }
+
+  size_t records() const { return n_records_; }
+  size_t size() const { return buffer_.size(); }
+
+  const std::vector<uint8_t> &finish() {
+    buffer_[kHeaderSize - 1] = static_cast<uint8_t>(n_records_);
+    return buffer_;
+  }
+
+private:
+  void putU16(const uint16_t _value) {
+    buffer_.push_back(static_cast<uint8_t>(_value));
+    buffer_.push_back(static_cast<uint8_t>(_value >> 8));
+  }
+
+  std::vector<uint8_t> buffer_;
+  float resolution_   = 1e-3f;
+  size_t n_records_   = 0;
+  uint32_t prev_tick_ = 0;
+  std::array<int64_t, kTelemetryChannels> prev_mean_{};
+};
+
+struct Telemetry_packet {
+  uint16_t seq        = 0;
+  uint16_t decimation = 0;
+  float resolution    = 0.0f;
+  std::vector<Telemetry_record> records;
+};
+
+inline bool decodePacket(const uint8_t *_data, const size_t _size, Telemetry_packet &_packet) {
+  if (_size < kHeaderSize) return false;
+  const uint16_t magic = static_cast<uint16_t>(_data[0] | (_data[1] << 8));
+  if (magic != kMagic || _data[2] != kVersion || _data[3] != kTelemetryChannels) return false;
+
+  _packet.seq        = static_cast<uint16_t>(_data[4] | (_data[5] << 8));
+  _packet.decimation = static_cast<uint16_t>(_data[6] | (_data[7] << 8));
+  uint32_t res_bits  = 0;
+  for (int i = 0; i < 4; i++) res_bits |= static_cast<uint32_t>(_data[8 + i]) << (8 * i);
+  std::memcpy(&_packet.resolution, &res_bits, sizeof(res_bits));
+  const uint8_t n_records = _data[12];
+
+  _packet.records.clear();
+  _packet.records.reserve(n_records);
+
+  const uint8_t *p   = _data + kHeaderSize;
+  const uint8_t *end = _data + _size;
+  uint32_t tick      = 0;
+  std::array<int64_t, kTelemetryChannels> mean{};
+  for (uint8_t r = 0; r < n_records; r++) {
+    Telemetry_record record;
+    uint64_t value;
+    if (!getVarint(p, end, value)) return false;
+    tick += static_cast<uint32_t>(value);
+    record.tick = tick;
+    if (!getVarint(p, end, value)) return false;
+    record.count = static_cast<uint16_t>(value);
+
+    for (uint8_t i = 0; i < kTelemetryChannels; i++) {
+      uint64_t delta, below, above;
+      if (!getVarint(p, end, delta) || !getVarint(p, end, below) || !getVarint(p, end, above)) {
+        return false;
+      }
+      mean[i] += unzigzag(delta);
+      record.mean[i] = static_cast<float>(mean[i] * static_cast<double>(_packet.resolution));
+      record.min[i]  = static_cast<float>((mean[i] - static_cast<int64_t>(below)) *
+                                         static_cast<double>(_packet.resolution));
+      record.max[i]  = static_cast<float>((mean[i] + static_cast<int64_t>(above)) *
+                                         static_cast<double>(_packet.resolution));
+    }
+    _packet.records.push_back(record);
+  }
+  return p == end;
+}
+
+}  // namespace telemetry_codec
+}  // namespace controller_plugin_differential_flatness
+
+#endif
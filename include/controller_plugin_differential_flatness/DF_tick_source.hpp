@@ -0,0 +1,162 @@
+#ifndef __DF_TICK_SOURCE_H__
+#define __DF_TICK_SOURCE_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "triple_buffer.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+struct Tick_source_config {
+  double rate      = 100.0;  // [Hz]
+  bool catch_up    = true;   // on overruns run the missed ticks back to back, else skip them
+  int max_catch_up = 3;      // missed ticks run back to back at most, the rest are skipped
+  int cpu          = -1;     // core the tick thread is pinned to, -1 leaves it floating
+  int priority     = 0;      // SCHED_FIFO priority, 0 keeps the default policy
+
+  bool operator==(const Tick_source_config &_other) const {
+    return rate == _other.rate && catch_up == _other.catch_up &&
+           max_catch_up == _other.max_catch_up && cpu == _other.cpu &&
+           priority == _other.priority;
+  }
+  bool operator!=(const Tick_source_config &_other) const { return !(*this == _other); }
+};
+
+struct Tick_period_stats {
+  uint64_t periods    = 0;
+  double sum_ns       = 0.0;
+  double sum_sq_ns    = 0.0;
+  double min_ns       = 0.0;
+  double max_ns       = 0.0;
+  double dt_error_sum = 0.0;  // [s] |dt - measured period|
+  double dt_error_max = 0.0;  // [s]
+};
+
+/**
+ * Achieved period of a tick, whatever drives it, and how far the dt it was given is from it.
+ * Times are in nanoseconds of CLOCK_MONOTONIC.
+ */
+class PeriodMonitor {
+public:
+  void onTick(const int64_t _now_ns, const double _dt) {
+    if (last_ns_ > 0) {
+      const double period   = static_cast<double>(_now_ns - last_ns_);
+      const double dt_error = std::abs(_dt - period * 1e-9);
+      stats_.min_ns         = stats_.periods ? std::min(stats_.min_ns, period) : period;
+      stats_.max_ns         = std::max(stats_.max_ns, period);
+      stats_.periods++;
+      stats_.sum_ns += period;
+      stats_.sum_sq_ns += period * period;
+      stats_.dt_error_sum += dt_error;
+      stats_.dt_error_max = std::max(stats_.dt_error_max, dt_error);
+    }
+    last_ns_ = _now_ns;
+  }
+
+  const Tick_period_stats &stats() const { return stats_; }
+
+  /** YAML-like lines for _stats, indented by _indent */
+  static void report(const Tick_period_stats &_stats, const char *_indent, std::ostream &_os) {
+    const double n    = static_cast<double>(std::max<uint64_t>(_stats.periods, 1));
+    const double mean = _stats.sum_ns / n;
+    const double rms  = std::sqrt(std::max(_stats.sum_sq_ns / n - mean * mean, 0.0));
+    _os << _indent << "periods: " << _stats.periods << "\n";
+    _os << _indent << "period_us_mean: " << mean * 1e-3 << "\n";
+    _os << _indent << "period_us_min: " << _stats.min_ns * 1e-3 << "\n";
+    _os << _indent << "period_us_max: " << _stats.max_ns * 1e-3 << "\n";
+    _os << _indent << "jitter_us_rms: " << rms * 1e-3 << "\n";
+    _os << _indent << "dt_error_us_mean: " << _stats.dt_error_sum * 1e6 / n << "\n";
+    _os << _indent << "dt_error_us_max: " << _stats.dt_error_max * 1e6 << "\n";
+  }
+
+private:
+  int64_t last_ns_ = 0;
+  Tick_period_stats stats_;
+};
+
+struct Tick_source_stats {
+  double nominal_ns = 0.0;
+  Tick_period_stats period;
+  uint64_t ticks          = 0;
+  uint64_t overruns       = 0;  // ticks that ended past the next deadline
+  uint64_t caught_up      = 0;  // missed deadlines run back to back
+  uint64_t skipped        = 0;  // missed deadlines dropped
+  int64_t max_latency_ns  = 0;  // wake up past the deadline
+  uint64_t compute_ns     = 0;  // time spent in the tick callback
+  uint64_t max_compute_ns = 0;
+  int64_t phase_shift_ns  = 0;  // sum of the _phase corrections applied to the deadlines
+};
+
+/**
+ * Control tick on absolute CLOCK_MONOTONIC deadlines.
+ *
+ * Deadline k is origin + k * period, computed from the tick index instead of accumulated, and
+ * waited for with clock_nanosleep(TIMER_ABSTIME), so neither wake up latency nor rounding
+ * drift the rate. Each tick gets the true elapsed time since the previous one as dt. When a
+ * tick ends past the next deadline, the missed ones either run back to back, up to
+ * max_catch_up, or are skipped to the next future deadline. An optional phase callback moves
+ * the origin of the deadlines after each tick, e.g. to follow a phase lock.
+ */
+class TickSource {
+public:
+  TickSource() = default;
+  ~TickSource() { stop(); }
+
+  TickSource(const TickSource &)            = delete;
+  TickSource &operator=(const TickSource &) = delete;
+
+  /**
+   * Start the tick thread, calling _tick(dt) on every deadline. Restarts it if running.
+   * _origin_ns, when less than a period old, is the first deadline instead of one period from
+   * now, e.g. nextDeadlineNs() of a stopped source this one replaces, so the phase is kept and
+   * no tick is lost in between. _phase, if set, is called on the tick thread after each tick
+   * and returns how many nanoseconds earlier the next deadline and all the later ones fire.
+   */
+  void start(const Tick_source_config &_config,
+             std::function<void(double)> _tick,
+             const int64_t _origin_ns          = 0,
+             std::function<int64_t()> _phase = nullptr);
+  void stop();
+
+  bool running() const { return running_.load(std::memory_order_relaxed); }
+  Tick_source_config config() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return config_;
+  }
+
+  /** Deadline the tick thread waits for. Once stopped, the first one that did not tick */
+  int64_t nextDeadlineNs() const { return next_deadline_ns_.load(std::memory_order_relaxed); }
+
+  /** Latest statistics, safe from any thread but the tick one */
+  Tick_source_stats stats();
+  std::string report();
+
+private:
+  void run();
+
+  // start() writes the config while stats() and report() read it and consume the statistics,
+  // possibly from other threads. The tick thread only reads the config it was started with
+  mutable std::mutex mutex_;
+  Tick_source_config config_;
+  std::function<void(double)> tick_;
+  std::function<int64_t()> phase_;
+  int64_t origin_ns_ = 0;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<int64_t> next_deadline_ns_{0};
+
+  // Published by the tick thread after every tick
+  TripleBuffer<Tick_source_stats> stats_buffer_;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef __DF_TRAJECTORY_FILE_H__
+#define __DF_TRAJECTORY_FILE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace controller_plugin_differential_flatness {
+
+/** One trajectory sample, stored as is in the file */
+struct Trajectory_record {
+  double t;
+  double position[3];
+  double velocity[3];
+  double acceleration[3];
+  double yaw;
+};
+static_assert(sizeof(Trajectory_record) == 11 * sizeof(double), "Trajectory_record is packed");
+
+/**
+ * Precomputed trajectory played back from a memory mapped file.
+ *
+ * Layout (native endianness): a 64 byte header followed by fixed-stride Trajectory_record
+ * samples at a constant period, so sample() finds its records by time with one division.
+ * The mapping is read only and private, its pages are the page cache ones so loading a file
+ * costs no copy. write() replaces files by rename, a mapped trajectory never changes under
+ * playback.
+ */
+class TrajectoryFile {
+public:
+  static constexpr uint32_t kMagic   = 0x52544644;  // "DFTR"
+  static constexpr uint32_t kVersion = 1;
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t n_records;
+    uint64_t record_size;
+    double t0;
+    double period;
+    uint8_t reserved[24];
+  };
+  static_assert(sizeof(Header) == 64, "TrajectoryFile header is 64 bytes");
+
+  TrajectoryFile() = default;
+  ~TrajectoryFile() { close(); }
+
+  TrajectoryFile(const TrajectoryFile &)            = delete;
+  TrajectoryFile &operator=(const TrajectoryFile &) = delete;
+  TrajectoryFile(TrajectoryFile &&_other) noexcept { swap(_other); }
+  TrajectoryFile &operator=(TrajectoryFile &&_other) noexcept {
+    swap(_other);
+    return *this;
+  }
+
+  /** Map and validate _path. On failure returns false, sets _error and stays closed */
+  bool open(const std::string &_path, std::string &_error);
+  void close();
+  void swap(TrajectoryFile &_other) noexcept;
+
+  bool isOpen() const { return records_ != nullptr; }
+  size_t size() const { return n_records_; }
+  double duration() const { return n_records_ ? (n_records_ - 1) * period_ : 0.0; }
+  const std::string &path() const { return path_; }
+
+  /**
+   * Sample at _t seconds from the trajectory start, linearly interpolated between the two
+   * neighbouring records. Times past the end return the last record. O(1)
+   */
+  Trajectory_record sample(const double _t) const;
+
+  /**
+   * Write _records, which must be sampled at a constant period, in the playback format. The
+   * file is written next to _path and renamed over it
+   */
+  static bool write(const std::string &_path,
+                    const std::vector<Trajectory_record> &_records,
+                    std::string &_error);
+
+private:
+  void *mapping_                    = nullptr;
+  size_t mapping_size_              = 0;
+  const Trajectory_record *records_ = nullptr;
+  size_t n_records_                 = 0;
+  double t0_                        = 0.0;
+  double period_                    = 0.0;
+  double inv_period_                = 0.0;
+  std::string path_;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
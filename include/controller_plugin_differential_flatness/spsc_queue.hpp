@@ -0,0 +1,70 @@
+#ifndef __DF_SPSC_QUEUE_H__
+#define __DF_SPSC_QUEUE_H__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace controller_plugin_differential_flatness {
+
+/**
+ * Bounded wait-free queue for one producer thread and one consumer thread.
+ *
+ * Capacity must be a power of two. push() fails instead of blocking when the queue is full,
+ * so the producer (the control tick) never waits on the consumer.
+ */
+template <typename T, size_t Capacity>
+class SpscQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "SpscQueue capacity must be a power of two");
+
+public:
+  bool push(const T &_value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_cache_ >= Capacity) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head - tail_cache_ >= Capacity) {
+        return false;
+      }
+    }
+    buffer_[head & kMask] = _value;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &_value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_cache_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail == head_cache_) {
+        return false;
+      }
+    }
+    _value = buffer_[tail & kMask];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Approximate number of queued elements, exact when called from either end */
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() { return Capacity; }
+
+private:
+  static constexpr size_t kMask = Capacity - 1;
+
+  std::array<T, Capacity> buffer_{};
+
+  // Producer and consumer indices live on separate cache lines
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t tail_cache_ = 0;
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t head_cache_ = 0;
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
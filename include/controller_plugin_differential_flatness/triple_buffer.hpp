@@ -0,0 +1,57 @@
+#ifndef __DF_TRIPLE_BUFFER_H__
+#define __DF_TRIPLE_BUFFER_H__
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace controller_plugin_differential_flatness {
+
+/**
+ * Lock-free single-slot "latest value" buffer for one producer and one consumer.
+ *
+ * The producer fills back() and calls publish(); the consumer calls update() and reads
+ * front(). Neither side ever blocks or waits, and the consumer always sees the last complete
+ * value written by the producer.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+  /** Producer side: buffer to be filled before calling publish() */
+  T &back() { return buffers_[back_]; }
+
+  /** Producer side: make the back buffer visible to the consumer */
+  void publish() {
+    back_ = middle_.exchange(back_ | kDirtyBit, std::memory_order_acq_rel) & kIndexMask;
+  }
+
+  /** Consumer side: fetch the latest published value. Returns false if nothing new */
+  bool update() {
+    if (!(middle_.load(std::memory_order_relaxed) & kDirtyBit)) {
+      return false;
+    }
+    front_     = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    has_value_ = true;
+    return true;
+  }
+
+  /** Consumer side: last value obtained through update() */
+  const T &front() const { return buffers_[front_]; }
+
+  /** Consumer side: true once at least one value has been received */
+  bool hasValue() const { return has_value_; }
+
+private:
+  static constexpr uint8_t kIndexMask = 0x03;
+  static constexpr uint8_t kDirtyBit  = 0x04;
+
+  std::array<T, 3> buffers_{};
+  uint8_t back_    = 0;
+  uint8_t front_   = 1;
+  bool has_value_  = false;
+  std::atomic<uint8_t> middle_{2};
+};
+
+}  // namespace controller_plugin_differential_flatness
+
+#endif
@@ -0,0 +1,169 @@
+/*!*******************************************************************************************
+ *  \file       DF_arena.cpp
+ *  \brief      Locked memory arena backing the plugin containers.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_arena.hpp"
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+namespace controller_plugin_differential_flatness {
+
+Arena::~Arena() {
+  // The containers using the arena are gone by now, its owner declares it before them
+  pool_.reset();
+  buffer_.monotonic.reset();
+  if (data_ != nullptr) {
+    if (locked_) munlock(data_, capacity_);
+    munmap(data_, capacity_);
+  }
+}
+
+bool Arena::reserve(const size_t _bytes, const bool _lock, std::string &_error) {
+  if (data_ != nullptr) {
+    _error = "arena already reserved";
+    return false;
+  }
+  void *data = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+  if (data == MAP_FAILED) {
+    _error = std::string("mmap of ") + std::to_string(_bytes) + " bytes: " + std::strerror(errno);
+    return false;
+  }
+  data_     = static_cast<char *>(data);
+  capacity_ = _bytes;
+
+  // Written, not only read, so every page gets its own frame instead of the shared zero page
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  for (size_t i = 0; i < capacity_; i += page) {
+    data_[i] = 0;
+  }
+  bool ok = true;
+  if (_lock) {
+    locked_ = mlock(data_, capacity_) == 0;
+    if (!locked_) {
+      // Almost always the limit, name it so the fix is obvious from the log
+      _error = std::string("mlock of ") + std::to_string(capacity_) +
+               " bytes: " + std::strerror(errno) + ", RLIMIT_MEMLOCK is ";
+      struct rlimit limit;
+      if (getrlimit(RLIMIT_MEMLOCK, &limit) != 0) {
+        _error += "unknown";
+      } else if (limit.rlim_cur == RLIM_INFINITY) {
+        _error += "unlimited";
+      } else {
+        _error += std::to_string(limit.rlim_cur) + " bytes";
+      }
+      _error += " (raise it with ulimit -l or grant CAP_IPC_LOCK), the arena stays unlocked";
+      ok = false;
+    }
+  }
+
+  buffer_.monotonic.emplace(data_, capacity_, std::pmr::null_memory_resource());
+  std::pmr::pool_options options;
+  options.largest_required_pool_block = kLargestPoolBlock;
+  pool_.emplace(options, &buffer_);
+  return ok;
+}
+
+void *Arena::Buffer::do_allocate(size_t _bytes, size_t _alignment) {
+  // Throws bad_alloc once the buffer is exhausted, null_memory_resource is its upstream
+  void *ptr = monotonic->allocate(_bytes, _alignment);
+  used.fetch_add(_bytes, std::memory_order_relaxed);
+  return ptr;
+}
+
+void *Arena::do_allocate(size_t _bytes, size_t _alignment) {
+  allocations_.fetch_add(1, std::memory_order_relaxed);
+  const size_t in_use = in_use_.fetch_add(_bytes, std::memory_order_relaxed) + _bytes;
+  size_t in_use_max   = in_use_max_.load(std::memory_order_relaxed);
+  while (in_use > in_use_max &&
+         !in_use_max_.compare_exchange_weak(in_use_max, in_use, std::memory_order_relaxed)) {
+  }
+
+  if (pool_) {
+    try {
+      return pool_->allocate(_bytes, _alignment);
+    } catch (const std::bad_alloc &) {
+      // Buffer exhausted, served by the heap below
+    }
+  }
+  heap_fallbacks_.fetch_add(1, std::memory_order_relaxed);
+  heap_bytes_.fetch_add(_bytes, std::memory_order_relaxed);
+  return std::pmr::new_delete_resource()->allocate(_bytes, _alignment);
+}
+
+void Arena::do_deallocate(void *_ptr, size_t _bytes, size_t _alignment) {
+  in_use_.fetch_sub(_bytes, std::memory_order_relaxed);
+  if (owns(_ptr)) {
+    pool_->deallocate(_ptr, _bytes, _alignment);
+  } else {
+    std::pmr::new_delete_resource()->deallocate(_ptr, _bytes, _alignment);
+  }
+}
+
+Arena_stats Arena::stats() const {
+  Arena_stats stats;
+  stats.capacity       = capacity_;
+  stats.locked         = locked_;
+  stats.high_water     = buffer_.used.load(std::memory_order_relaxed);
+  stats.in_use         = in_use_.load(std::memory_order_relaxed);
+  stats.in_use_max     = in_use_max_.load(std::memory_order_relaxed);
+  stats.allocations    = allocations_.load(std::memory_order_relaxed);
+  stats.heap_fallbacks = heap_fallbacks_.load(std::memory_order_relaxed);
+  stats.heap_bytes     = heap_bytes_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+std::string Arena::report() const {
+  const Arena_stats current = stats();
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(1);
+  ss << "arena:\n";
+  ss << "  capacity_kb: " << current.capacity / 1024.0 << "\n";
+  ss << "  locked: " << (current.locked ? "true" : "false") << "\n";
+  ss << "  high_water_kb: " << current.high_water / 1024.0 << "\n";
+  ss << "  high_water_percent: "
+     << (current.capacity ? 100.0 * current.high_water / current.capacity : 0.0) << "\n";
+  ss << "  in_use_kb: " << current.in_use / 1024.0 << "\n";
+  ss << "  in_use_max_kb: " << current.in_use_max / 1024.0 << "\n";
+  ss << "  allocations: " << current.allocations << "\n";
+  ss << "  heap_fallbacks: " << current.heap_fallbacks << "\n";
+  ss << "  heap_fallback_kb: " << current.heap_bytes / 1024.0 << "\n";
+  return ss.str();
+}
+
+}  // namespace controller_plugin_differential_flatness
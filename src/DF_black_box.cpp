@@ -0,0 +1,299 @@
+/*!*******************************************************************************************
+ *  \file       DF_black_box.cpp
+ *  \brief      Anomaly triggered flight recorder with asynchronous flush to disk.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_black_box.hpp"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+namespace controller_plugin_differential_flatness {
+
+constexpr uint32_t kIdlePeriodUs = 2000;
+
+/* Appends the _n channels at _values to the current CSV line */
+static void writeChannels(FILE *_file, const float *_values, const size_t _n) {
+  for (size_t k = 0; k < _n; k++) {
+    std::fprintf(_file, ",%.6g", _values[k]);
+  }
+}
+
+void BlackBox::configure(const Black_box_config &_config) {
+  if (_config == config_ && enabled() == _config.enable) {
+    return;
+  }
+  stop();
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    config_ = _config;
+  }
+  if (config_.enable) {
+    start();
+  }
+}
+
+size_t BlackBox::ringCapacity(const Black_box_config &_config) {
+  const double rate = std::max(_config.max_rate, 1.0);
+  // One spare slot per window side, so the trigger record survives a slightly fast tick
+  return static_cast<size_t>(std::ceil((_config.pre_trigger + _config.post_trigger) * rate)) +
+         2;
+}
+
+size_t BlackBox::memoryBytes(const Black_box_config &_config) {
+  if (!_config.enable) return 0;
+  // Both rings, and a page each for the bookkeeping of the resource
+  return 2 * (ringCapacity(_config) * sizeof(Black_box_record) + 4096);
+}
+
+void BlackBox::start() {
+  const int64_t pre_ns  = static_cast<int64_t>(std::max(config_.pre_trigger, 0.0) * 1e9);
+  const int64_t post_ns = static_cast<int64_t>(std::max(config_.post_trigger, 0.0) * 1e9);
+  const size_t capacity = ringCapacity(config_);
+
+  Storage *storage = storage_.load();
+  if (!storage || storage->capacity != capacity || storage->pre_ns != pre_ns ||
+      storage->post_ns != post_ns) {
+    // Value initialized, so every page of the rings is touched here and not by the tick
+    auto fresh      = std::make_unique<Storage>(memory_);
+    fresh->capacity = capacity;
+    fresh->pre_ns   = pre_ns;
+    fresh->post_ns  = post_ns;
+    for (Ring &ring : fresh->rings) {
+      ring.records.resize(capacity);
+    }
+    fresh->rings[0].state.store(FILLING);
+    storage = fresh.get();
+    storages_.push_back(std::move(fresh));
+    storage_.store(storage, std::memory_order_release);
+  }
+
+  if (::mkdir(config_.directoryPath(), 0755) != 0 && errno != EEXIST) {
+    std::fprintf(stderr, "Black box: can not create %s\n", config_.directoryPath());
+  }
+
+  running_.store(true);
+  thread_ = std::thread(&BlackBox::run, this);
+}
+
+void BlackBox::stop() {
+  running_.store(false);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void BlackBox::record(const Black_box_record &_record) {
+  Storage &s = *storage_.load(std::memory_order_acquire);
+
+  if (s.active < 0) {
+    // Both rings were frozen, resume in the first one the writer handed back
+    for (int i = 0; i < 2; i++) {
+      if (s.rings[i].state.load(std::memory_order_acquire) == FREE) {
+        s.rings[i].head  = 0;
+        s.rings[i].count = 0;
+        s.rings[i].state.store(FILLING, std::memory_order_relaxed);
+        s.active = i;
+        break;
+      }
+    }
+    if (s.active < 0) {
+      skipped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+  Ring &ring              = s.rings[s.active];
+  ring.records[ring.head] = _record;
+  ring.head               = ring.head + 1 == s.capacity ? 0 : ring.head + 1;
+  ring.count              = std::min(ring.count + 1, s.capacity);
+
+  if (!s.capturing) {
+    if (_record.triggers == 0) return;
+    s.capturing       = true;
+    ring.trigger_ns   = _record.stamp_ns;
+    ring.trigger_tick = _record.tick;
+    ring.triggers     = _record.triggers;
+    ring.post_count   = 0;
+    captures_.fetch_add(1, std::memory_order_relaxed);
+    if (s.post_ns > 0) return;
+  } else {
+    ring.triggers |= _record.triggers;
+    ring.post_count++;
+  }
+
+  // A tick faster than max_rate would start overwriting the pre-trigger window, freeze early
+  if (_record.stamp_ns - ring.trigger_ns >= s.post_ns || ring.post_count + 2 >= s.capacity) {
+    freeze(s);
+  }
+}
+
+void BlackBox::freeze(Storage &_storage) {
+  Ring &ring = _storage.rings[_storage.active];
+  ring.state.store(FULL, std::memory_order_release);
+  _storage.capturing = false;
+
+  Ring &next = _storage.rings[1 - _storage.active];
+  if (next.state.load(std::memory_order_acquire) == FREE) {
+    next.head  = 0;
+    next.count = 0;
+    next.state.store(FILLING, std::memory_order_relaxed);
+    _storage.active = 1 - _storage.active;
+  } else {
+    _storage.active = -1;
+  }
+}
+
+void BlackBox::run() {
+  Storage *storage = storage_.load(std::memory_order_acquire);
+  while (running_.load(std::memory_order_relaxed)) {
+    bool idle = true;
+    for (Ring &ring : storage->rings) {
+      if (ring.state.load(std::memory_order_acquire) == FULL) {
+        write(*storage, ring);
+        ring.state.store(FREE, std::memory_order_release);
+        idle = false;
+      }
+    }
+    if (idle) {
+      std::this_thread::sleep_for(std::chrono::microseconds(kIdlePeriodUs));
+    }
+  }
+  // A window frozen right before the stop is still written
+  for (Ring &ring : storage->rings) {
+    if (ring.state.load(std::memory_order_acquire) == FULL) {
+      write(*storage, ring);
+      ring.state.store(FREE, std::memory_order_release);
+    }
+  }
+}
+
+void BlackBox::write(const Storage &_storage, const Ring &_ring) {
+  char stamp[32];
+  const std::time_t now = std::time(nullptr);
+  std::tm local;
+  localtime_r(&now, &local);
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &local);
+
+  std::ostringstream path;
+  path << config_.directoryPath() << "/black_box_" << stamp << "_" << _ring.trigger_tick << ".csv";
+  const std::string file_path = path.str();
+
+  FILE *file = std::fopen(file_path.c_str(), "w");
+  if (!file) {
+    write_errors_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  std::fprintf(file, "# trigger_tick: %lu\n# trigger_stamp_ns: %ld\n# triggers: %s\n",
+               static_cast<unsigned long>(_ring.trigger_tick),
+               static_cast<long>(_ring.trigger_ns), triggerNames(_ring.triggers).c_str());
+  std::fprintf(file,
+               "tick,stamp_ns,triggers,px,py,pz,vx,vy,vz,qx,qy,qz,qw,ref_px,ref_py,ref_pz,"
+               "ref_vx,ref_vy,ref_vz,ref_ax,ref_ay,ref_az,ref_yaw,force_x,force_y,force_z,"
+               "e_rot_x,e_rot_y,e_rot_z,p,q,r,thrust\n");
+
+  // Oldest first, starting pre_trigger before the trigger
+  const size_t first = (_ring.head + _storage.capacity - _ring.count) % _storage.capacity;
+  for (size_t i = 0; i < _ring.count; i++) {
+    const Black_box_record &r = _ring.records[(first + i) % _storage.capacity];
+    if (r.stamp_ns < _ring.trigger_ns - _storage.pre_ns) continue;
+    std::fprintf(file, "%lu,%ld,%u", static_cast<unsigned long>(r.tick),
+                 static_cast<long>(r.stamp_ns), r.triggers);
+    // In the column order of the header
+    writeChannels(file, r.position, 3);
+    writeChannels(file, r.velocity, 3);
+    writeChannels(file, r.attitude, 4);
+    writeChannels(file, r.ref_position, 3);
+    writeChannels(file, r.ref_velocity, 3);
+    writeChannels(file, r.ref_acceleration, 3);
+    writeChannels(file, &r.ref_yaw, 1);
+    writeChannels(file, r.desired_force, 3);
+    writeChannels(file, r.attitude_error, 3);
+    writeChannels(file, r.rates, 3);
+    writeChannels(file, &r.thrust, 1);
+    std::fputc('\n', file);
+  }
+  const bool ok = std::fclose(file) == 0;
+
+  if (!ok) {
+    write_errors_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  written_.fetch_add(1);
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  last_file_     = file_path;
+  last_triggers_ = _ring.triggers;
+}
+
+std::string BlackBox::triggerNames(const uint32_t _triggers) {
+  static const char *names[] = {"attitude_error", "thrust_saturation", "stale_state",
+                                "non_finite", "manual"};
+  std::string result;
+  for (int i = 0; i < 5; i++) {
+    if (!(_triggers & (1u << i))) continue;
+    if (!result.empty()) result += ",";
+    result += names[i];
+  }
+  return result;
+}
+
+std::string BlackBox::report() const {
+  std::string last_file;
+  std::string directory;
+  uint32_t last_triggers;
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    last_file     = last_file_;
+    directory     = config_.directoryPath();
+    last_triggers = last_triggers_;
+  }
+
+  std::ostringstream ss;
+  ss << "black_box:\n";
+  ss << "  enabled: " << (enabled() ? "true" : "false") << "\n";
+  ss << "  directory: " << directory << "\n";
+  ss << "  captures: " << captures_.load() << "\n";
+  ss << "  written: " << written_.load() << "\n";
+  ss << "  write_errors: " << write_errors_.load() << "\n";
+  ss << "  skipped_ticks: " << skipped_.load() << "\n";
+  ss << "  last_file: " << last_file << "\n";
+  ss << "  last_triggers: [" << triggerNames(last_triggers) << "]\n";
+  return ss.str();
+}
+
+}  // namespace controller_plugin_differential_flatness
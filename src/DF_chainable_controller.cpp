@@ -0,0 +1,261 @@
+/*!*******************************************************************************************
+ *  \file       DF_chainable_controller.cpp
+ *  \brief      ros2_control chainable controller running the differential flatness law.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_chainable_controller.hpp"
+
+#include <cmath>
+#include <limits>
+
+namespace controller_plugin_differential_flatness {
+
+using controller_interface::CallbackReturn;
+
+static constexpr std::array<const char *, 18> parameters_list = {
+    "mass",
+    "trajectory_control.antiwindup_cte",
+    "trajectory_control.kp.x",
+    "trajectory_control.kp.y",
+    "trajectory_control.kp.z",
+    "trajectory_control.ki.x",
+    "trajectory_control.ki.y",
+    "trajectory_control.ki.z",
+    "trajectory_control.kd.x",
+    "trajectory_control.kd.y",
+    "trajectory_control.kd.z",
+    "trajectory_control.roll_control.kp",
+    "trajectory_control.pitch_control.kp",
+    "trajectory_control.yaw_control.kp",
+    "trajectory_control.limits.min_thrust",
+    "trajectory_control.limits.max_thrust",
+    "trajectory_control.limits.max_tilt",
+    "trajectory_control.limits.max_rate",
+};
+
+CallbackReturn DFChainableController::on_init() {
+  try {
+    auto_declare<std::string>("vehicle_name", vehicle_name_);
+    for (const char *name : parameters_list) {
+      auto_declare<double>(name, 0.0);
+    }
+  } catch (const std::exception &e) {
+    fprintf(stderr, "Exception thrown during init stage with message: %s \n", e.what());
+    return CallbackReturn::ERROR;
+  }
+  return CallbackReturn::SUCCESS;
+}
+
+controller_interface::InterfaceConfiguration
+DFChainableController::command_interface_configuration() const {
+  controller_interface::InterfaceConfiguration config;
+  config.type = controller_interface::interface_configuration_type::INDIVIDUAL;
+  for (const char *name : command_names_) {
+    config.names.push_back(vehicle_name_ + "/" + name);
+  }
+  return config;
+}
+
+controller_interface::InterfaceConfiguration DFChainableController::state_interface_configuration()
+    const {
+  controller_interface::InterfaceConfiguration config;
+  config.type = controller_interface::interface_configuration_type::INDIVIDUAL;
+  for (const char *name : state_names_) {
+    config.names.push_back(vehicle_name_ + "/" + name);
+  }
+  return config;
+}
+
+void DFChainableController::readParameters() {
+  auto node    = get_node();
+  auto get     = [&node](const std::string &_name) {
+    return node->get_parameter(_name).as_double();
+  };
+  auto get_xyz = [&get](const std::string &_prefix) {
+    return Eigen::Vector3d(get(_prefix + ".x"), get(_prefix + ".y"), get(_prefix + ".z"));
+  };
+
+  vehicle_name_ = node->get_parameter("vehicle_name").as_string();
+
+  Control_gains &gains = control_law_.gains;
+  gains.mass           = get("mass");
+  gains.antiwindup_cte = get("trajectory_control.antiwindup_cte");
+  gains.kp             = get_xyz("trajectory_control.kp");
+  gains.ki             = get_xyz("trajectory_control.ki");
+  gains.kd             = get_xyz("trajectory_control.kd");
+  gains.kp_ang         = Eigen::Vector3d(get("trajectory_control.roll_control.kp"),
+                                         get("trajectory_control.pitch_control.kp"),
+                                         get("trajectory_control.yaw_control.kp"));
+
+  // Non-positive values disable the max_* limits, as in the as2 plugin
+  const double inf          = std::numeric_limits<double>::infinity();
+  Sanitation_limits &limits = control_law_.sanitizer.limits;
+  const double max_thrust   = get("trajectory_control.limits.max_thrust");
+  const double max_tilt     = get("trajectory_control.limits.max_tilt");
+  const double max_rate     = get("trajectory_control.limits.max_rate");
+  limits.min_thrust         = get("trajectory_control.limits.min_thrust");
+  limits.max_thrust         = max_thrust > 0.0 ? max_thrust : inf;
+  limits.max_tilt           = max_tilt > 0.0 ? max_tilt : M_PI;
+  limits.max_rate           = max_rate > 0.0 ? max_rate : inf;
+}
+
+CallbackReturn DFChainableController::on_configure(const rclcpp_lifecycle::State &) {
+  readParameters();
+  if (control_law_.gains.mass <= 0.0) {
+    RCLCPP_ERROR(get_node()->get_logger(), "Parameter mass must be positive");
+    return CallbackReturn::ERROR;
+  }
+
+  reference_sub_ = get_node()->create_subscription<ReferenceMsg>(
+      "~/reference", rclcpp::SystemDefaultsQoS(),
+      [this](const std::shared_ptr<ReferenceMsg> _msg) { reference_buffer_.writeFromNonRT(_msg); });
+  return CallbackReturn::SUCCESS;
+}
+
+std::vector<hardware_interface::CommandInterface>
+DFChainableController::on_export_reference_interfaces() {
+  // NaN references are not set yet, the controller keeps the previous value
+  reference_interfaces_.assign(N_REFERENCES, std::numeric_limits<double>::quiet_NaN());
+
+  std::vector<hardware_interface::CommandInterface> reference_interfaces;
+  reference_interfaces.reserve(N_REFERENCES);
+  for (size_t i = 0; i < N_REFERENCES; i++) {
+    reference_interfaces.emplace_back(get_node()->get_name(), reference_names_[i],
+                                      &reference_interfaces_[i]);
+  }
+  return reference_interfaces;
+}
+
+bool DFChainableController::on_set_chained_mode(bool) { return true; }
+
+void DFChainableController::holdCurrentPosition() {
+  control_ref_.position     = uav_state_.position;
+  control_ref_.velocity     = Eigen::Vector3d::Zero();
+  control_ref_.acceleration = Eigen::Vector3d::Zero();
+
+  const tf2::Quaternion &q = uav_state_.attitude_state;
+  control_ref_.yaw         = std::atan2(2.0 * (q.w() * q.z() + q.x() * q.y()),
+                                        1.0 - 2.0 * (q.y() * q.y() + q.z() * q.z()));
+}
+
+CallbackReturn DFChainableController::on_activate(const rclcpp_lifecycle::State &) {
+  if (command_interfaces_.size() != N_COMMANDS || state_interfaces_.size() != N_STATES) {
+    RCLCPP_ERROR(get_node()->get_logger(), "Expected %d command and %d state interfaces",
+                 N_COMMANDS, N_STATES);
+    return CallbackReturn::ERROR;
+  }
+
+  const auto &s       = state_interfaces_;
+  uav_state_.position = Eigen::Vector3d(s[PX].get_value(), s[PY].get_value(), s[PZ].get_value());
+  uav_state_.velocity = Eigen::Vector3d(s[VX].get_value(), s[VY].get_value(), s[VZ].get_value());
+  uav_state_.attitude_state =
+      tf2::Quaternion(s[QX].get_value(), s[QY].get_value(), s[QZ].get_value(), s[QW].get_value());
+  holdCurrentPosition();
+
+  std::fill(reference_interfaces_.begin(), reference_interfaces_.end(),
+            std::numeric_limits<double>::quiet_NaN());
+  reference_buffer_.reset();
+  control_law_.accum_pos_error = Eigen::Vector3d::Zero();
+  return CallbackReturn::SUCCESS;
+}
+
+CallbackReturn DFChainableController::on_deactivate(const rclcpp_lifecycle::State &) {
+  reference_buffer_.reset();
+  return CallbackReturn::SUCCESS;
+}
+
+controller_interface::return_type DFChainableController::update_reference_from_subscribers() {
+  const std::shared_ptr<ReferenceMsg> msg = *reference_buffer_.readFromRT();
+  if (!msg) {
+    return controller_interface::return_type::OK;
+  }
+  reference_interfaces_[RPX]  = msg->position.x;
+  reference_interfaces_[RPY]  = msg->position.y;
+  reference_interfaces_[RPZ]  = msg->position.z;
+  reference_interfaces_[RVX]  = msg->twist.x;
+  reference_interfaces_[RVY]  = msg->twist.y;
+  reference_interfaces_[RVZ]  = msg->twist.z;
+  reference_interfaces_[RAX]  = msg->acceleration.x;
+  reference_interfaces_[RAY]  = msg->acceleration.y;
+  reference_interfaces_[RAZ]  = msg->acceleration.z;
+  reference_interfaces_[RYAW] = msg->yaw_angle;
+  return controller_interface::return_type::OK;
+}
+
+controller_interface::return_type DFChainableController::update_and_write_commands(
+    const rclcpp::Time &,
+    const rclcpp::Duration &period) {
+  // Real-time path: fixed size Eigen types only, no allocations nor locks
+  const auto &s          = state_interfaces_;
+  uint64_t &state_events = control_law_.sanitizer.stats.non_finite_state;
+  uav_state_.position    = Sanitizer::keepFinite(
+      Eigen::Vector3d(s[PX].get_value(), s[PY].get_value(), s[PZ].get_value()),
+      uav_state_.position, state_events);
+  uav_state_.velocity = Sanitizer::keepFinite(
+      Eigen::Vector3d(s[VX].get_value(), s[VY].get_value(), s[VZ].get_value()),
+      uav_state_.velocity, state_events);
+  const Eigen::Vector4d attitude(s[QX].get_value(), s[QY].get_value(), s[QZ].get_value(),
+                                 s[QW].get_value());
+  const bool attitude_finite = attitude.allFinite();
+  state_events += !attitude_finite;
+  uav_state_.attitude_state =
+      attitude_finite ? tf2::Quaternion(attitude.x(), attitude.y(), attitude.z(), attitude.w())
+                      : uav_state_.attitude_state;
+
+  // Unset (NaN) references keep their previous value and are not sanitation events
+  const auto &r             = reference_interfaces_;
+  uint64_t unset_references = 0;
+  control_ref_.position     = Sanitizer::keepFinite(Eigen::Vector3d(r[RPX], r[RPY], r[RPZ]),
+                                                    control_ref_.position, unset_references);
+  control_ref_.velocity     = Sanitizer::keepFinite(Eigen::Vector3d(r[RVX], r[RVY], r[RVZ]),
+                                                    control_ref_.velocity, unset_references);
+  control_ref_.acceleration =
+      Sanitizer::keepFinite(Eigen::Vector3d(r[RAX], r[RAY], r[RAZ]), control_ref_.acceleration,
+                            unset_references);
+  control_ref_.yaw          = Sanitizer::keepFinite(r[RYAW], control_ref_.yaw, unset_references);
+
+  // The as2 plugin restarts the integrator on every tick, keep the same law
+  control_law_.accum_pos_error = Eigen::Vector3d::Zero();
+  const Acro_command command   = control_law_.computeTrajectoryControl(
+      period.seconds(), uav_state_.position, uav_state_.velocity, uav_state_.attitude_state,
+      control_ref_.position, control_ref_.velocity, control_ref_.acceleration, control_ref_.yaw);
+
+  command_interfaces_[RATE_X].set_value(command.PQR.x());
+  command_interfaces_[RATE_Y].set_value(command.PQR.y());
+  command_interfaces_[RATE_Z].set_value(command.PQR.z());
+  command_interfaces_[THRUST].set_value(command.thrust);
+  return controller_interface::return_type::OK;
+}
+
+}  // namespace controller_plugin_differential_flatness
+
+#include <pluginlib/class_list_macros.hpp>
+PLUGINLIB_EXPORT_CLASS(controller_plugin_differential_flatness::DFChainableController,
+                       controller_interface::ChainableControllerInterface)
@@ -0,0 +1,179 @@
+/*!*******************************************************************************************
+ *  \file       DF_control_law.cpp
+ *  \brief      Differential flatness control law, independent of the middleware.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_control_law.hpp"
+
+#include <algorithm>
+
+namespace controller_plugin_differential_flatness {
+
+ControlLaw &ControlLaw::operator=(const ControlLaw &_other) {
+  if (this == &_other) return *this;
+  gains           = _other.gains;
+  sanitizer       = _other.sanitizer;
+  mpc             = _other.mpc ? std::make_unique<TranslationalMpc>(*_other.mpc) : nullptr;
+  residual_model  = _other.residual_model;
+  accum_pos_error = _other.accum_pos_error;
+  internals       = _other.internals;
+  return *this;
+}
+
+Eigen::Vector3d ControlLaw::getForce(const double &_dt,
+                                     const Eigen::Vector3d &_pos_state,
+                                     const Eigen::Vector3d &_vel_state,
+                                     const Eigen::Vector3d &_pos_reference,
+                                     const Eigen::Vector3d &_vel_reference,
+                                     const Eigen::Vector3d &_acc_reference) {
+  // Compute the error force contribution
+
+  const Eigen::Vector3d position_error = _pos_reference - _pos_state;
+  const Eigen::Vector3d velocity_error = _vel_reference - _vel_state;
+
+  internals.position_error = position_error;
+  internals.velocity_error = velocity_error;
+
+  // TODO: check if apply _dt to each constant or apply it to the whole vector each iteration
+  accum_pos_error += position_error * _dt;
+
+  for (uint8_t j = 0; j < 3; j++) {
+    double antiwindup_value = gains.antiwindup_cte / gains.ki[j];
+    accum_pos_error[j]      = std::clamp(accum_pos_error[j], -antiwindup_value, antiwindup_value);
+  }
+
+  Eigen::Vector3d desired_force;
+  if (mpc && mpc->enabled()) {
+    // The integral term is added on top as in the PID law
+    Eigen::Vector3d accel_min, accel_max;
+    mpcAccelerationBounds(accel_min, accel_max);
+    const Eigen::Vector3d accel = mpc->solve(_dt, _pos_state, _vel_state, _pos_reference,
+                                             _vel_reference, _acc_reference, accel_min, accel_max);
+    internals.mpc_solve_ns   = mpc->stats().solve_ns;
+    internals.mpc_iterations = mpc->stats().iterations;
+    desired_force =
+        gains.mass * (accel - gravitational_accel) + gains.ki.cwiseProduct(accum_pos_error);
+  } else {
+    internals.mpc_solve_ns   = 0;
+    internals.mpc_iterations = 0;
+    desired_force =
+        gains.kp.cwiseProduct(position_error) + gains.kd.cwiseProduct(velocity_error) +
+        gains.ki.cwiseProduct(accum_pos_error) - gains.mass * gravitational_accel +
+        gains.mass * _acc_reference;
+  }
+
+  // A model over its time budget contributes nothing to this tick
+  internals.residual_force = Eigen::Vector3d::Zero();
+  if (residual_model && residual_model->evaluate(_vel_state, _acc_reference, _pos_state.z(),
+                                                 internals.residual_force)) {
+    desired_force += internals.residual_force;
+  }
+
+  return desired_force;
+}
+
+void ControlLaw::mpcAccelerationBounds(Eigen::Vector3d &_min, Eigen::Vector3d &_max) const {
+  // Box inside the thrust and tilt limits: at the tilt limit the maximum thrust splits into
+  // the vertical bound and the horizontal one, shared by x and y. A disabled tilt limit
+  // splits it at 45 degrees. The exact cone is still enforced by the sanitizer afterwards
+  const Sanitation_limits &limits = sanitizer.limits;
+  const double g                  = -gravitational_accel.z();
+  const double tilt               = limits.max_tilt < M_PI_2 ? limits.max_tilt : M_PI_4;
+  const double max_acc            = limits.max_thrust / gains.mass;
+  const double horiz              = max_acc * std::sin(tilt) * M_SQRT1_2;
+
+  _min = Eigen::Vector3d(-horiz, -horiz, limits.min_thrust / gains.mass - g);
+  _max = Eigen::Vector3d(horiz, horiz, max_acc * std::cos(tilt) - g);
+}
+
+Acro_command ControlLaw::computeTrajectoryControl(const double &_dt,
+                                                  const Eigen::Vector3d &_pos_state,
+                                                  const Eigen::Vector3d &_vel_state,
+                                                  const tf2::Quaternion &_attitude_state,
+                                                  const Eigen::Vector3d &_pos_reference,
+                                                  const Eigen::Vector3d &_vel_reference,
+                                                  const Eigen::Vector3d &_acc_reference,
+                                                  const double &_yaw_angle_reference) {
+  const Eigen::Vector3d desired_force =
+      getForce(_dt, _pos_state, _vel_state, _pos_reference, _vel_reference, _acc_reference);
+  return computeAttitudeControl(desired_force, _attitude_state, _yaw_angle_reference);
+}
+
+Acro_command ControlLaw::computeAttitudeControl(const Eigen::Vector3d &_desired_force,
+                                                const tf2::Quaternion &_attitude_state,
+                                                const double &_yaw_angle_reference) {
+  const Eigen::Vector3d desired_force = sanitizer.limitTilt(_desired_force);
+
+  // Compute the desired attitude
+  const tf2::Matrix3x3 rot_matrix_tf2(_attitude_state);
+
+  Eigen::Matrix3d rot_matrix;
+  rot_matrix << rot_matrix_tf2[0][0], rot_matrix_tf2[0][1], rot_matrix_tf2[0][2],
+      rot_matrix_tf2[1][0], rot_matrix_tf2[1][1], rot_matrix_tf2[1][2], rot_matrix_tf2[2][0],
+      rot_matrix_tf2[2][1], rot_matrix_tf2[2][2];
+
+  // Near zero force falls back to a level attitude, and zb_des parallel to xc_des falls back
+  // to the reference heading's y axis, which is orthogonal to both
+  const Eigen::Vector3d xc_des(cos(_yaw_angle_reference), sin(_yaw_angle_reference), 0);
+  const Eigen::Vector3d yc_des(-sin(_yaw_angle_reference), cos(_yaw_angle_reference), 0);
+  const Eigen::Vector3d zb_des = Sanitizer::safeNormalized(desired_force, Eigen::Vector3d::UnitZ(),
+                                                           sanitizer.stats.degenerate_force);
+  const Eigen::Vector3d yb_des =
+      Sanitizer::safeNormalized(zb_des.cross(xc_des), yc_des, sanitizer.stats.degenerate_heading);
+  const Eigen::Vector3d xb_des = yb_des.cross(zb_des).normalized();
+
+  // Compute the rotation matrix desidered
+  Eigen::Matrix3d R_des;
+  R_des.col(0) = xb_des;
+  R_des.col(1) = yb_des;
+  R_des.col(2) = zb_des;
+
+  // Compute the rotation matrix error
+  const Eigen::Matrix3d Mat_e_rot =
+      (R_des.transpose() * rot_matrix - rot_matrix.transpose() * R_des);
+
+  const Eigen::Vector3d V_e_rot(Mat_e_rot(2, 1), Mat_e_rot(0, 2), Mat_e_rot(1, 0));
+  const Eigen::Vector3d E_rot = (1.0f / 2.0f) * V_e_rot;
+
+  Acro_command acro_command;
+  acro_command.thrust =
+      sanitizer.saturateThrust((float)desired_force.dot(rot_matrix.col(2).normalized()));
+  acro_command.PQR =
+      Sanitizer::keepFinite(sanitizer.saturateRates(-gains.kp_ang.cwiseProduct(E_rot)),
+                            Eigen::Vector3d::Zero(), sanitizer.stats.non_finite_command);
+
+  internals.desired_force = desired_force;
+  internals.R_des         = R_des;
+  internals.E_rot         = E_rot;
+
+  return std::move(acro_command);  // use std::move to avoid copy (force RVO)
+}
+
+}  // namespace controller_plugin_differential_flatness
@@ -37,28 +37,192 @@
 #include "DF_controller_plugin.hpp"
 #include <Eigen/src/Core/GlobalFunctions.h>
 #include <as2_core/utils/tf_utils.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <utility>
 
 namespace controller_plugin_differential_flatness {
 
+// Arena bytes of the containers other than the black box rings: frame ids, topic lists, paths
+// and the pools of the threads that allocate them
+constexpr int64_t kArenaContainerBytes = 128 * 1024;
+
+static void readVector3(const rclcpp::Parameter &_param, Eigen::Vector3d &_scale) {
+  const std::vector<double> scale = _param.get_value<std::vector<double>>();
+  if (scale.size() == 3) {
+    _scale = Eigen::Vector3d(scale[0], scale[1], scale[2]);
+  }
+}
+
 void Plugin::ownInitialize() {
-  odom_frame_id_      = as2::tf::generateTfName(node_ptr_, odom_frame_id_);
-  base_link_frame_id_ = as2::tf::generateTfName(node_ptr_, base_link_frame_id_);
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::OWN_INITIALIZE);
+  boot_.mark(BootTimeline::INITIALIZE_BEGIN);
+  // The arena is sized once, before any container grows, so its parameters are read here
+  int64_t arena_bytes = 0;
+  bool arena_lock     = false;
+  Black_box_config black_box;
+  std::string cache_path;
+  node_ptr_->get_parameter_or("arena.size", arena_bytes, int64_t{0});
+  node_ptr_->get_parameter_or("arena.lock", arena_lock, false);
+  node_ptr_->get_parameter_or("black_box.enable", black_box.enable, black_box.enable);
+  node_ptr_->get_parameter_or("black_box.pre_trigger", black_box.pre_trigger,
+                              black_box.pre_trigger);
+  node_ptr_->get_parameter_or("black_box.post_trigger", black_box.post_trigger,
+                              black_box.post_trigger);
+  node_ptr_->get_parameter_or("black_box.max_rate", black_box.max_rate, black_box.max_rate);
+  if (arena_bytes == 0) {
+    // Sized for the configuration read at start up, later growth falls back to the heap
+    arena_bytes = kArenaContainerBytes + static_cast<int64_t>(BlackBox::memoryBytes(black_box));
+  }
+  node_ptr_->get_parameter_or("parameter_cache.file", cache_path, std::string());
+  // The values already declared are applied as they are, the cache only stands in for the rest
+  std::array<double, parameters_list_.size()> declared_values{};
+  uint16_t undeclared = 0;
+  for (size_t i = 0; i < parameters_list_.size(); i++) {
+    rclcpp::Parameter param;
+    if (node_ptr_->get_parameter(std::string(parameters_list_[i]), param) &&
+        param.get_type() == rclcpp::ParameterType::PARAMETER_DOUBLE) {
+      declared_values[i] = param.as_double();
+    } else {
+      undeclared |= 1u << i;
+    }
+  }
+
+  // Prefaulting the arena and reading the cache only touch memory and disk, so they overlap
+  // with the middleware setup below, which must not grow the arena containers until the join
+  std::string arena_error;
+  std::string cache_error;
+  bool cache_loaded = false;
+  std::array<double, parameters_list_.size()> cache_values{};
+  std::thread prepare([&]() {
+    if (arena_bytes > 0 && !arena_.reserve(arena_bytes, arena_lock, arena_error)) {
+      arena_error = arena_error.empty() ? "reserve failed" : arena_error;
+    }
+    if (!cache_path.empty() && undeclared) {
+      cache_loaded =
+          ParameterCache::load(cache_path, ParameterCache::key(parameters_list_),
+                               cache_values.data(), cache_values.size(), cache_error);
+    }
+  });
+
+  callback_topology_.ingestion =
+      node_ptr_->create_callback_group(rclcpp::CallbackGroupType::Reentrant);
+  callback_topology_.control =
+      node_ptr_->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  callback_topology_.diagnostics =
+      node_ptr_->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+
+  snapshot_srv_ = node_ptr_->create_service<std_srvs::srv::Trigger>(
+      "df_controller/get_snapshot",
+      std::bind(&Plugin::snapshotServiceCallback, this, std::placeholders::_1,
+                std::placeholders::_2),
+      rmw_qos_profile_services_default, callback_topology_.diagnostics);
+  cpu_budget_srv_ = node_ptr_->create_service<std_srvs::srv::Trigger>(
+      "df_controller/get_cpu_budget",
+      std::bind(&Plugin::cpuBudgetServiceCallback, this, std::placeholders::_1,
+                std::placeholders::_2),
+      rmw_qos_profile_services_default, callback_topology_.diagnostics);
+  state_sources_srv_ = node_ptr_->create_service<std_srvs::srv::Trigger>(
+      "df_controller/get_state_sources",
+      std::bind(&Plugin::stateSourcesServiceCallback, this, std::placeholders::_1,
+                std::placeholders::_2),
+      rmw_qos_profile_services_default, callback_topology_.diagnostics);
+  phase_lock_srv_ = node_ptr_->create_service<std_srvs::srv::Trigger>(
+      "df_controller/get_phase_lock",
+      std::bind(&Plugin::phaseLockServiceCallback, this, std::placeholders::_1,
+                std::placeholders::_2),
+      rmw_qos_profile_services_default, callback_topology_.diagnostics);
+  start_playback_srv_ = node_ptr_->create_service<std_srvs::srv::Trigger>(
+      "df_controller/start_playback",
+      std::bind(&Plugin::startPlaybackServiceCallback, this, std::placeholders::_1,
+                std::placeholders::_2),
+      rmw_qos_profile_services_default, callback_topology_.diagnostics);
+  stop_playback_srv_ = node_ptr_->create_service<std_srvs::srv::Trigger>(
+      "df_controller/stop_playback",
+      std::bind(&Plugin::stopPlaybackServiceCallback, this, std::placeholders::_1,
+                std::placeholders::_2),
+      rmw_qos_profile_services_default, callback_topology_.diagnostics);
+  trigger_black_box_srv_ = node_ptr_->create_service<std_srvs::srv::Trigger>(
+      "df_controller/trigger_black_box",
+      std::bind(&Plugin::triggerBlackBoxServiceCallback, this, std::placeholders::_1,
+                std::placeholders::_2),
+      rmw_qos_profile_services_default, callback_topology_.diagnostics);
+  tick_source_srv_ = node_ptr_->create_service<std_srvs::srv::Trigger>(
+      "df_controller/get_tick_source",
+      std::bind(&Plugin::tickSourceServiceCallback, this, std::placeholders::_1,
+                std::placeholders::_2),
+      rmw_qos_profile_services_default, callback_topology_.diagnostics);
+  formation_srv_ = node_ptr_->create_service<std_srvs::srv::Trigger>(
+      "df_controller/get_formation",
+      std::bind(&Plugin::formationServiceCallback, this, std::placeholders::_1,
+                std::placeholders::_2),
+      rmw_qos_profile_services_default, callback_topology_.diagnostics);
+  boot_srv_ = node_ptr_->create_service<std_srvs::srv::Trigger>(
+      "df_controller/get_boot",
+      std::bind(&Plugin::bootServiceCallback, this, std::placeholders::_1,
+                std::placeholders::_2),
+      rmw_qos_profile_services_default, callback_topology_.diagnostics);
+  prepare.join();
+  if (!arena_error.empty()) {
+    RCLCPP_WARN(node_ptr_->get_logger(), "Arena: %s", arena_error.c_str());
+  }
+
+  odom_frame_id_      = as2::tf::generateTfName(node_ptr_, std::string(odom_frame_id_));
+  base_link_frame_id_ = as2::tf::generateTfName(node_ptr_, std::string(base_link_frame_id_));
+  host_source_        = state_arbiter_.addSource("host");
   reset();
+
+  // The declared parameters and a valid cache for the others apply all the required ones at
+  // once, so setMode() and the first command no longer wait for updateParams(). Its later
+  // values still override the cached ones
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    parameter_cache_path_ = cache_path;
+    for (size_t i = 0; i < parameters_list_.size(); i++) {
+      const bool is_declared = !(undeclared & (1u << i));
+      if (is_declared || cache_loaded) {
+        const std::string name(parameters_list_[i]);
+        updateDFParameter(
+            name, rclcpp::Parameter(name, is_declared ? declared_values[i] : cache_values[i]));
+      }
+    }
+    if (cache_loaded) {
+      cached_values_          = cache_values;
+      parameter_cache_status_ = "loaded " + cache_path;
+    } else if (!cache_path.empty() && !undeclared) {
+      parameter_cache_status_ = "not needed, all required parameters declared";
+    } else if (!cache_path.empty()) {
+      parameter_cache_status_ = "rejected, " + cache_error;
+    }
+  }
+  if (cache_loaded) {
+    boot_.mark(BootTimeline::PARAMETER_CACHE_LOADED);
+  } else if (!cache_path.empty() && undeclared) {
+    RCLCPP_WARN(node_ptr_->get_logger(), "Parameter cache: %s", cache_error.c_str());
+  }
+  boot_.mark(BootTimeline::INITIALIZE_END);
   return;
 };
 
 bool Plugin::updateParams(const std::vector<std::string> &_params_list) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::UPDATE_PARAMS);
   auto result = parametersCallback(node_ptr_->get_parameters(_params_list));
   return result.successful;
 };
 
-bool Plugin::checkParamList(const std::string &param, std::vector<std::string> &_params_list) {
-  if (find(_params_list.begin(), _params_list.end(), param) != _params_list.end()) {
-    // Remove the parameter from the list of parameters to be read
-    _params_list.erase(std::remove(_params_list.begin(), _params_list.end(), param),
-                       _params_list.end());
-  };
-  return !_params_list.size();  // Return true if the list is empty
+bool Plugin::checkParamList(const rclcpp::Parameter &_param, uint16_t &_params_to_read) {
+  for (size_t i = 0; i < parameters_list_.size(); i++) {
+    if (parameters_list_[i] == _param.get_name()) {
+      // Remove the parameter from the set of parameters to be read
+      _params_to_read &= ~(1u << i);
+      parameter_values_missing_ &= ~(1u << i);
+      parameter_values_[i] = _param.get_value<double>();
+      break;
+    }
+  }
+  return !_params_to_read;  // Return true if there are no parameters left
 };
 
 rcl_interfaces::msg::SetParametersResult Plugin::parametersCallback(
@@ -67,12 +231,176 @@ rcl_interfaces::msg::SetParametersResult Plugin::parametersCallback(
   result.successful = true;
   result.reason     = "success";
 
-  for (auto &param : parameters) {
-    updateDFParameter(param.get_name(), param);
+  Telemetry_config telemetry_config;
+  Shadow_config shadow_config;
+  Black_box_config black_box_config;
+  Tick_source_config tick_source_config;
+  Publish_offload_config publish_offload_config;
+  std::string cache_path;
+  std::array<double, parameters_list_.size()> cache_values;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    for (auto &param : parameters) {
+      updateDFParameter(param.get_name(), param);
+    }
+    if (!parameter_values_missing_ && parameter_values_ != cached_values_) {
+      cache_path   = parameter_cache_path_;
+      cache_values = parameter_values_;
+    }
+    telemetry_config       = telemetry_config_;
+    shadow_config          = shadow_config_;
+    black_box_config       = black_box_config_;
+    tick_source_config     = tick_source_config_;
+    publish_offload_config = publish_offload_config_;
+    if (upsampling_config_ != upsampler_.config()) {
+      upsampler_.configure(upsampling_config_);
+    }
+  }
+  // May join the background threads, so outside of the control lock
+  std::string telemetry_error;
+  if (!telemetry_.configure(telemetry_config, telemetry_error)) {
+    RCLCPP_ERROR(node_ptr_->get_logger(), "Telemetry: %s", telemetry_error.c_str());
+    result.successful = false;
+    result.reason     = telemetry_error;
+  }
+  shadow_.configure(shadow_config);
+  const bool black_box_was_enabled = black_box_.enabled();
+  black_box_.configure(black_box_config);
+  if (!black_box_was_enabled && black_box_.enabled()) {
+    // The edges are detected from the ticks pushed while enabled only
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    black_box_sanitation_ = control_law_.sanitizer.stats;
+    black_box_levels_     = 0;
+  }
+  if (tick_source_.running() && (tick_source_config != tick_source_.config() ||
+                                 publish_offload_config != publish_offload_.config())) {
+    startTickSource(tick_output_);
+  } else if (publish_offload_config.enable && !tick_source_.running()) {
+    RCLCPP_WARN_ONCE(node_ptr_->get_logger(),
+                     "publish_offload only applies to the tick source, it has no effect "
+                     "until the host calls startTickSource()");
+  }
+  subscribeStateSources();
+  subscribeFormation();
+  setupMpc();
+
+  std::string error;
+  if (!cache_path.empty()) {
+    // Only rewritten when a required parameter changed since the last load or save
+    std::string cache_error;
+    const bool saved =
+        ParameterCache::save(cache_path, ParameterCache::key(parameters_list_),
+                             cache_values.data(), cache_values.size(), cache_error);
+    if (!saved) {
+      RCLCPP_WARN(node_ptr_->get_logger(), "Parameter cache: %s", cache_error.c_str());
+    }
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    if (saved) cached_values_ = cache_values;
+    parameter_cache_status_ = saved ? "saved " + cache_path : "not saved, " + cache_error;
+  }
+  if (!loadPlaybackFile(error)) {
+    RCLCPP_ERROR(node_ptr_->get_logger(), "Trajectory playback: %s", error.c_str());
+    result.successful = false;
+    result.reason     = error;
+  }
+  if (!loadResidualModel(error)) {
+    RCLCPP_ERROR(node_ptr_->get_logger(), "Residual model: %s", error.c_str());
+    result.successful = false;
+    result.reason     = error;
+  }
+
+  // Once, as soon as the law is fully configured, so neither setMode() nor the first tick
+  // pay for it
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    if (flags_.parameters_read && !warmed_up_) {
+      warmed_up_ = true;
+      runWarmUp(warm_up_ticks_);
+    }
   }
   return result;
 }
 
+void Plugin::setupMpc() {
+  // The solver is only allocated while enabled. The replaced one is freed outside the lock
+  std::unique_ptr<TranslationalMpc> mpc;
+  Mpc_config config;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    if (!mpc_config_.enable) {
+      mpc.swap(control_law_.mpc);
+      return;
+    }
+    if (control_law_.mpc && mpc_config_ == control_law_.mpc->config()) return;
+    config = mpc_config_;
+  }
+  // Building the condensed problem is not real-time, so outside of the control lock
+  mpc = std::make_unique<TranslationalMpc>();
+  mpc->setup(config);
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  control_law_.mpc.swap(mpc);
+}
+
+bool Plugin::loadResidualModel(std::string &_error) {
+  Residual_model_config config;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    config = residual_model_config_;
+  }
+
+  // Reading the weights allocates, so the new model is built outside of the control lock
+  std::unique_ptr<ResidualModel> model;
+  bool ok = true;
+  if (!config.file.empty() && (!residual_model_ || residual_model_->path() != config.file)) {
+    model = std::make_unique<ResidualModel>();
+    ok    = model->open(config.file, _error);
+    if (!ok) model.reset();
+  }
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    if (model || config.file.empty()) {
+      std::swap(model, residual_model_);
+    }
+    if (residual_model_) {
+      residual_model_->setBudget(static_cast<uint64_t>(config.budget_us * 1e3));
+      residual_model_->setMaxForce(config.max_force);
+    }
+    control_law_.residual_model = config.bypass ? nullptr : residual_model_.get();
+  }
+  if (model && residual_model_) {
+    RCLCPP_INFO(node_ptr_->get_logger(), "Residual model %s loaded", config.file.c_str());
+  }
+  return ok;  // the replaced model, if any, is released here
+}
+
+bool Plugin::loadPlaybackFile(std::string &_error) {
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    if (std::string_view(playback_path_) == playback_file_.path()) return true;
+    path = playback_path_;
+  }
+
+  // Mapping and validating the file touches the disk, so outside of the control lock
+  TrajectoryFile file;
+  if (!path.empty() && !file.open(path, _error)) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    if (playback_active_) {
+      RCLCPP_WARN(node_ptr_->get_logger(), "Trajectory file changed, playback stopped");
+      playback_active_ = false;
+    }
+    playback_file_.swap(file);
+  }
+  if (!path.empty()) {
+    RCLCPP_INFO(node_ptr_->get_logger(), "Trajectory %s loaded, %zu records, %.3f s",
+                path.c_str(), playback_file_.size(), playback_file_.duration());
+  }
+  return true;  // the previous mapping, if any, is released here
+}
+
 void Plugin::updateDFParameter(std::string _parameter_name, const rclcpp::Parameter &_param) {
   std::string controller    = _parameter_name.substr(0, _parameter_name.find("."));
   std::string param_subname = _parameter_name.substr(_parameter_name.find(".") + 1);
@@ -83,39 +411,187 @@ void Plugin::updateDFParameter(std::string _parameter_name, const rclcpp::Parame
   }
 
   if (_parameter_name == "mass") {
-    mass_ = _param.get_value<double>();
+    control_law_.gains.mass = _param.get_value<double>();
   } else if (_parameter_name == "antiwindup_cte") {
-    antiwindup_cte_ = _param.get_value<double>();
+    control_law_.gains.antiwindup_cte = _param.get_value<double>();
   } else if (_parameter_name == "kp.x") {
-    Kp_(0, 0) = _param.get_value<double>();
+    control_law_.gains.kp(0) = _param.get_value<double>();
   } else if (_parameter_name == "kp.y") {
-    Kp_(1, 1) = _param.get_value<double>();
+    control_law_.gains.kp(1) = _param.get_value<double>();
   } else if (_parameter_name == "kp.z") {
-    Kp_(2, 2) = _param.get_value<double>();
+    control_law_.gains.kp(2) = _param.get_value<double>();
   } else if (_parameter_name == "ki.x") {
-    Ki_(0, 0) = _param.get_value<double>();
+    control_law_.gains.ki(0) = _param.get_value<double>();
   } else if (_parameter_name == "ki.y") {
-    Ki_(1, 1) = _param.get_value<double>();
+    control_law_.gains.ki(1) = _param.get_value<double>();
   } else if (_parameter_name == "ki.z") {
-    Ki_(2, 2) = _param.get_value<double>();
+    control_law_.gains.ki(2) = _param.get_value<double>();
   } else if (_parameter_name == "kd.x") {
-    Kd_(0, 0) = _param.get_value<double>();
+    control_law_.gains.kd(0) = _param.get_value<double>();
   } else if (_parameter_name == "kd.y") {
-    Kd_(1, 1) = _param.get_value<double>();
+    control_law_.gains.kd(1) = _param.get_value<double>();
   } else if (_parameter_name == "kd.z") {
-    Kd_(2, 2) = _param.get_value<double>();
+    control_law_.gains.kd(2) = _param.get_value<double>();
   } else if (_parameter_name == "roll_control.kp") {
-    Kp_ang_mat_(0, 0) = _param.get_value<double>();
+    control_law_.gains.kp_ang(0) = _param.get_value<double>();
   } else if (_parameter_name == "pitch_control.kp") {
-    Kp_ang_mat_(1, 1) = _param.get_value<double>();
+    control_law_.gains.kp_ang(1) = _param.get_value<double>();
   } else if (_parameter_name == "yaw_control.kp") {
-    Kp_ang_mat_(2, 2) = _param.get_value<double>();
+    control_law_.gains.kp_ang(2) = _param.get_value<double>();
+  } else if (_parameter_name == "limits.min_thrust") {
+    control_law_.sanitizer.limits.min_thrust = _param.get_value<double>();
+  } else if (_parameter_name == "limits.max_thrust") {
+    // Non-positive values disable the limit
+    const double value = _param.get_value<double>();
+    control_law_.sanitizer.limits.max_thrust =
+        value > 0.0 ? value : std::numeric_limits<double>::infinity();
+  } else if (_parameter_name == "limits.max_tilt") {
+    const double value                     = _param.get_value<double>();
+    control_law_.sanitizer.limits.max_tilt = value > 0.0 ? value : M_PI;
+  } else if (_parameter_name == "limits.max_rate") {
+    const double value = _param.get_value<double>();
+    control_law_.sanitizer.limits.max_rate =
+        value > 0.0 ? value : std::numeric_limits<double>::infinity();
+  } else if (_parameter_name == "telemetry.enable") {
+    telemetry_config_.enable = _param.get_value<bool>();
+  } else if (_parameter_name == "telemetry.udp_host") {
+    telemetry_config_.udp_host = _param.get_value<std::string>();
+  } else if (_parameter_name == "telemetry.udp_port") {
+    telemetry_config_.udp_port = _param.get_value<int>();
+  } else if (_parameter_name == "telemetry.decimation") {
+    telemetry_config_.decimation = _param.get_value<int>();
+  } else if (_parameter_name == "telemetry.max_bandwidth") {
+    telemetry_config_.max_bandwidth = _param.get_value<double>();
+  } else if (_parameter_name == "telemetry.max_packet_size") {
+    telemetry_config_.max_packet_size = _param.get_value<int>();
+  } else if (_parameter_name == "telemetry.max_cpu_percent") {
+    telemetry_config_.max_cpu_percent = _param.get_value<double>();
+  } else if (_parameter_name == "telemetry.resolution") {
+    telemetry_config_.resolution = _param.get_value<double>();
+  } else if (_parameter_name == "shadow.enable") {
+    shadow_config_.enable = _param.get_value<bool>();
+  } else if (_parameter_name == "shadow.cpu") {
+    shadow_config_.cpu = _param.get_value<int>();
+  } else if (_parameter_name == "shadow.kp_scale") {
+    readVector3(_param, shadow_config_.kp_scale);
+  } else if (_parameter_name == "shadow.ki_scale") {
+    readVector3(_param, shadow_config_.ki_scale);
+  } else if (_parameter_name == "shadow.kd_scale") {
+    readVector3(_param, shadow_config_.kd_scale);
+  } else if (_parameter_name == "shadow.kp_ang_scale") {
+    readVector3(_param, shadow_config_.kp_ang_scale);
+  } else if (_parameter_name == "shadow.log_file") {
+    shadow_config_.log_file = _param.get_value<std::string>();
+  } else if (_parameter_name == "phase_lock.enable") {
+    phase_lock_.config.enable = _param.get_value<bool>();
+  } else if (_parameter_name == "phase_lock.target_offset") {
+    phase_lock_.config.target_offset = _param.get_value<double>();
+  } else if (_parameter_name == "phase_lock.gain") {
+    phase_lock_.config.gain = _param.get_value<double>();
+  } else if (_parameter_name == "phase_lock.integral_gain") {
+    phase_lock_.config.integral_gain = _param.get_value<double>();
+  } else if (_parameter_name == "phase_lock.max_slew") {
+    phase_lock_.config.max_slew = _param.get_value<double>();
+  } else if (_parameter_name == "state_arbitration.enable") {
+    state_arbiter_.config.enable = _param.get_value<bool>();
+  } else if (_parameter_name == "state_arbitration.sources") {
+    const std::vector<std::string> topics = _param.get_value<std::vector<std::string>>();
+    state_source_topics_.assign(topics.begin(), topics.end());
+  } else if (_parameter_name == "state_arbitration.max_age") {
+    state_arbiter_.config.max_age = _param.get_value<double>();
+  } else if (_parameter_name == "state_arbitration.min_rate") {
+    state_arbiter_.config.min_rate = _param.get_value<double>();
+  } else if (_parameter_name == "state_arbitration.switch_margin") {
+    state_arbiter_.config.switch_margin = _param.get_value<double>();
+  } else if (_parameter_name == "state_arbitration.min_dwell") {
+    state_arbiter_.config.min_dwell = _param.get_value<double>();
+  } else if (_parameter_name == "mpc.enable") {
+    mpc_config_.enable = _param.get_value<bool>();
+  } else if (_parameter_name == "mpc.dt") {
+    mpc_config_.dt = _param.get_value<double>();
+  } else if (_parameter_name == "mpc.q_position") {
+    readVector3(_param, mpc_config_.q_position);
+  } else if (_parameter_name == "mpc.q_velocity") {
+    readVector3(_param, mpc_config_.q_velocity);
+  } else if (_parameter_name == "mpc.r_acceleration") {
+    readVector3(_param, mpc_config_.r_acceleration);
+  } else if (_parameter_name == "mpc.max_iterations") {
+    mpc_config_.max_iterations = _param.get_value<int>();
+  } else if (_parameter_name == "mpc.tolerance") {
+    mpc_config_.tolerance = _param.get_value<double>();
+  } else if (_parameter_name == "residual_model.file") {
+    residual_model_config_.file = _param.get_value<std::string>();
+  } else if (_parameter_name == "residual_model.bypass") {
+    residual_model_config_.bypass = _param.get_value<bool>();
+  } else if (_parameter_name == "residual_model.budget_us") {
+    residual_model_config_.budget_us = _param.get_value<double>();
+  } else if (_parameter_name == "residual_model.max_force") {
+    residual_model_config_.max_force = _param.get_value<double>();
+  } else if (_parameter_name == "formation.enable") {
+    formation_.config.enable = _param.get_value<bool>();
+  } else if (_parameter_name == "formation.topic") {
+    formation_.config.topic = _param.get_value<std::string>();
+  } else if (_parameter_name == "formation.offset") {
+    readVector3(_param, formation_.config.offset);
+  } else if (_parameter_name == "formation.yaw_offset") {
+    formation_.config.yaw_offset = _param.get_value<double>();
+  } else if (_parameter_name == "formation.rotate") {
+    formation_.config.rotate = _param.get_value<bool>();
+  } else if (_parameter_name == "formation.max_extrapolation") {
+    formation_.config.max_extrapolation = _param.get_value<double>();
+  } else if (_parameter_name == "warm_up.ticks") {
+    warm_up_ticks_ = _param.get_value<int>();
+  } else if (_parameter_name == "trajectory_playback.file") {
+    playback_path_ = _param.get_value<std::string>();
+  } else if (_parameter_name == "upsampling.enable") {
+    upsampling_config_.enable = _param.get_value<bool>();
+  } else if (_parameter_name == "upsampling.compute_rate") {
+    upsampling_config_.compute_rate = _param.get_value<double>();
+  } else if (_parameter_name == "upsampling.order") {
+    upsampling_config_.order = _param.get_value<int>();
+  } else if (_parameter_name == "tick_source.rate") {
+    tick_source_config_.rate = _param.get_value<double>();
+  } else if (_parameter_name == "tick_source.catch_up") {
+    tick_source_config_.catch_up = _param.get_value<bool>();
+  } else if (_parameter_name == "tick_source.max_catch_up") {
+    tick_source_config_.max_catch_up = _param.get_value<int>();
+  } else if (_parameter_name == "tick_source.cpu") {
+    tick_source_config_.cpu = _param.get_value<int>();
+  } else if (_parameter_name == "tick_source.priority") {
+    tick_source_config_.priority = _param.get_value<int>();
+  } else if (_parameter_name == "publish_offload.enable") {
+    publish_offload_config_.enable = _param.get_value<bool>();
+  } else if (_parameter_name == "publish_offload.cpu") {
+    publish_offload_config_.cpu = _param.get_value<int>();
+  } else if (_parameter_name == "black_box.enable") {
+    black_box_config_.enable = _param.get_value<bool>();
+  } else if (_parameter_name == "black_box.directory") {
+    black_box_config_.directory = _param.get_value<std::string>();
+  } else if (_parameter_name == "black_box.pre_trigger") {
+    black_box_config_.pre_trigger = _param.get_value<double>();
+  } else if (_parameter_name == "black_box.post_trigger") {
+    black_box_config_.post_trigger = _param.get_value<double>();
+  } else if (_parameter_name == "black_box.max_rate") {
+    black_box_config_.max_rate = _param.get_value<double>();
+  } else if (_parameter_name == "black_box.attitude_error") {
+    black_box_config_.attitude_error = _param.get_value<double>();
+  } else if (_parameter_name == "black_box.state_timeout") {
+    black_box_config_.state_timeout = _param.get_value<double>();
+  } else if (_parameter_name == "black_box.on_saturation") {
+    black_box_config_.on_saturation = _param.get_value<bool>();
+  } else if (_parameter_name == "black_box.on_non_finite") {
+    black_box_config_.on_non_finite = _param.get_value<bool>();
+  }
+  flags_.parameters_read = checkParamList(_param, parameters_to_read_);
+  if (flags_.parameters_read) {
+    boot_.mark(BootTimeline::PARAMETERS_READ);
   }
-  flags_.parameters_read = checkParamList(_param.get_name(), parameters_to_read_);
   return;
 }
 
 void Plugin::reset() {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::RESET);
+  std::lock_guard<std::mutex> lock(control_mutex_);
   resetReferences();
   resetState();
   resetCommands();
@@ -133,15 +609,18 @@ void Plugin::resetReferences() {
 }
 
 void Plugin::resetCommands() {
-  control_command_.PQR    = Eigen::Vector3d::Zero();
-  control_command_.thrust = 0.0;
-  accum_pos_error_        = Eigen::Vector3d::Zero();
+  control_command_.PQR         = Eigen::Vector3d::Zero();
+  control_command_.thrust      = 0.0;
+  control_law_.accum_pos_error = Eigen::Vector3d::Zero();
   return;
 }
 
 void Plugin::updateState(const geometry_msgs::msg::PoseStamped &pose_msg,
                          const geometry_msgs::msg::TwistStamped &twist_msg) {
-  if (pose_msg.header.frame_id != odom_frame_id_ && twist_msg.header.frame_id != odom_frame_id_) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::UPDATE_STATE);
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  const std::string_view odom_frame_id = odom_frame_id_;
+  if (pose_msg.header.frame_id != odom_frame_id && twist_msg.header.frame_id != odom_frame_id) {
     RCLCPP_ERROR(node_ptr_->get_logger(), "Pose and Twist frame_id are not desired ones");
     RCLCPP_ERROR(node_ptr_->get_logger(), "Recived: %s, %s", pose_msg.header.frame_id.c_str(),
                  twist_msg.header.frame_id.c_str());
@@ -150,14 +629,38 @@ void Plugin::updateState(const geometry_msgs::msg::PoseStamped &pose_msg,
     return;
   }
 
-  uav_state_.position =
+  State_sample sample;
+  sample.position =
       Eigen::Vector3d(pose_msg.pose.position.x, pose_msg.pose.position.y, pose_msg.pose.position.z);
-  uav_state_.velocity =
+  sample.velocity =
       Eigen::Vector3d(twist_msg.twist.linear.x, twist_msg.twist.linear.y, twist_msg.twist.linear.z);
+  sample.attitude = Eigen::Vector4d(pose_msg.pose.orientation.x, pose_msg.pose.orientation.y,
+                                    pose_msg.pose.orientation.z, pose_msg.pose.orientation.w);
+  sample.stamp_ns   = rclcpp::Time(pose_msg.header.stamp).nanoseconds();
+  sample.arrival_ns = static_cast<int64_t>(CpuBudget::wallNs());
 
+  // With the arbiter the phase lock follows the source it selects, see selectStateSource()
+  if (state_arbiter_.config.enable) {
+    state_arbiter_.update(host_source_, sample, node_ptr_->now().nanoseconds());
+    return;
+  }
+  phase_lock_.onArrival(sample.arrival_ns);
+  applyState(sample);
+  return;
+};
+
+void Plugin::applyState(const State_sample &_sample) {
+  // Non-finite coefficients keep their previous value
+  uint64_t &state_events = control_law_.sanitizer.stats.non_finite_state;
+  uav_state_.position = Sanitizer::keepFinite(_sample.position, uav_state_.position, state_events);
+  uav_state_.velocity = Sanitizer::keepFinite(_sample.velocity, uav_state_.velocity, state_events);
+
+  const Eigen::Vector4d &attitude = _sample.attitude;
+  const bool attitude_finite      = attitude.allFinite();
+  state_events += !attitude_finite;
   uav_state_.attitude_state =
-      tf2::Quaternion(pose_msg.pose.orientation.x, pose_msg.pose.orientation.y,
-                      pose_msg.pose.orientation.z, pose_msg.pose.orientation.w);
+      attitude_finite ? tf2::Quaternion(attitude.x(), attitude.y(), attitude.z(), attitude.w())
+                      : uav_state_.attitude_state;
 
   if (hover_flag_) {
     resetReferences();
@@ -166,31 +669,140 @@ void Plugin::updateState(const geometry_msgs::msg::PoseStamped &pose_msg,
   }
 
   flags_.state_received = true;
+  last_state_ns_        = CpuBudget::wallNs();
+  boot_.mark(BootTimeline::FIRST_STATE);
   return;
-};
+}
+
+void Plugin::selectStateSource() {
+  const int source = state_arbiter_.select(node_ptr_->now().nanoseconds());
+  if (source < 0) return;
+
+  // Only new samples are applied, so a stalled source does not retrigger the hover reset
+  const uint64_t seq = state_arbiter_.source(source).seq;
+  if (source == applied_source_ && seq == applied_seq_) return;
+  if (source != applied_source_ && applied_source_ >= 0) {
+    RCLCPP_WARN(node_ptr_->get_logger(), "State source switched from %s to %s",
+                state_arbiter_.source(applied_source_).name.c_str(),
+                state_arbiter_.source(source).name.c_str());
+  }
+  // Samples of the source applied between two ticks are skipped, the lock divides the
+  // interval by their count. After a switch the interval spans two sources, counted as one
+  const State_sample &sample = state_arbiter_.source(source).sample;
+  phase_lock_.onArrival(sample.arrival_ns, source == applied_source_ ? seq - applied_seq_ : 1);
+  applied_source_ = source;
+  applied_seq_    = seq;
+  applyState(sample);
+}
+
+void Plugin::subscribeStateSources() {
+  std::vector<std::string> topics;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    topics.assign(state_source_topics_.begin(), state_source_topics_.end());
+  }
+
+  // Topics no longer configured lose their subscription and their arbiter slot
+  for (size_t source = 0; source < state_source_subs_.size(); source++) {
+    if (!state_source_subs_[source]) continue;
+    {
+      std::lock_guard<std::mutex> lock(control_mutex_);
+      const std::string &name = state_arbiter_.source(source).name;
+      if (std::find(topics.begin(), topics.end(), name) != topics.end()) continue;
+      RCLCPP_INFO(node_ptr_->get_logger(), "Removing state source %s", name.c_str());
+      state_arbiter_.removeSource(source);
+      if (applied_source_ == static_cast<int>(source)) applied_source_ = -1;
+    }
+    state_source_subs_[source].reset();
+  }
+
+  rclcpp::SubscriptionOptions options;
+  options.callback_group = callback_topology_.ingestion;
+  for (const std::string &topic : topics) {
+    if (topic.empty()) continue;
+    int source;
+    {
+      std::lock_guard<std::mutex> lock(control_mutex_);
+      source = state_arbiter_.addSource(topic);
+    }
+    if (source < 0) {
+      RCLCPP_ERROR(node_ptr_->get_logger(), "Too many state sources, ignoring %s", topic.c_str());
+      continue;
+    }
+    if (source == host_source_ || state_source_subs_[source]) continue;  // already subscribed
+    state_source_subs_[source] = node_ptr_->create_subscription<nav_msgs::msg::Odometry>(
+        topic, rclcpp::SensorDataQoS(),
+        [this, source](const nav_msgs::msg::Odometry::SharedPtr _msg) {
+          stateSourceCallback(source, _msg);
+        },
+        options);
+  }
+}
+
+void Plugin::stateSourceCallback(const int _source,
+                                 const nav_msgs::msg::Odometry::SharedPtr _msg) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::UPDATE_STATE);
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  if (_msg->header.frame_id != std::string_view(odom_frame_id_)) {
+    RCLCPP_ERROR_THROTTLE(node_ptr_->get_logger(), *node_ptr_->get_clock(), 5000,
+                          "State source %s frame_id is %s, expected %s",
+                          state_arbiter_.source(_source).name.c_str(),
+                          _msg->header.frame_id.c_str(), odom_frame_id_.c_str());
+    return;
+  }
+
+  const auto &pose  = _msg->pose.pose;
+  const auto &twist = _msg->twist.twist;
+  State_sample sample;
+  sample.position = Eigen::Vector3d(pose.position.x, pose.position.y, pose.position.z);
+  sample.attitude = Eigen::Vector4d(pose.orientation.x, pose.orientation.y, pose.orientation.z,
+                                   pose.orientation.w);
+  sample.velocity = Eigen::Vector3d(twist.linear.x, twist.linear.y, twist.linear.z);
+  if (_msg->child_frame_id != std::string_view(odom_frame_id_)) {
+    // Odometry twist is expressed in child_frame_id, the controller expects it in odom
+    const Eigen::Quaterniond q(sample.attitude.w(), sample.attitude.x(), sample.attitude.y(),
+                               sample.attitude.z());
+    sample.velocity = q.normalized() * sample.velocity;
+  }
+  sample.stamp_ns   = rclcpp::Time(_msg->header.stamp).nanoseconds();
+  sample.arrival_ns = static_cast<int64_t>(CpuBudget::wallNs());
+  state_arbiter_.update(_source, sample, node_ptr_->now().nanoseconds());
+}
 
 void Plugin::updateReference(const as2_msgs::msg::TrajectoryPoint &traj_msg) {
-  if (control_mode_in_.control_mode != as2_msgs::msg::ControlMode::TRAJECTORY) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::UPDATE_REFERENCE);
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  if (control_mode_in_.control_mode != as2_msgs::msg::ControlMode::TRAJECTORY ||
+      playback_active_ || formation_.config.enable) {
     return;
   }
 
-  control_ref_.position = Eigen::Vector3d(traj_msg.position.x, traj_msg.position.y,
-                                          traj_msg.position.z);
+  // Non-finite coefficients keep their previous value
+  uint64_t &ref_events  = control_law_.sanitizer.stats.non_finite_reference;
+  control_ref_.position = Sanitizer::keepFinite(
+      Eigen::Vector3d(traj_msg.position.x, traj_msg.position.y, traj_msg.position.z),
+      control_ref_.position, ref_events);
 
-  control_ref_.velocity = Eigen::Vector3d(traj_msg.twist.x, traj_msg.twist.y,
-                                          traj_msg.twist.z);
+  control_ref_.velocity = Sanitizer::keepFinite(
+      Eigen::Vector3d(traj_msg.twist.x, traj_msg.twist.y, traj_msg.twist.z),
+      control_ref_.velocity, ref_events);
 
-  control_ref_.acceleration = Eigen::Vector3d(traj_msg.acceleration.x, traj_msg.acceleration.y,
-                                              traj_msg.acceleration.z);
+  control_ref_.acceleration = Sanitizer::keepFinite(
+      Eigen::Vector3d(traj_msg.acceleration.x, traj_msg.acceleration.y, traj_msg.acceleration.z),
+      control_ref_.acceleration, ref_events);
 
-  control_ref_.yaw = traj_msg.yaw_angle;
+  control_ref_.yaw = Sanitizer::keepFinite(traj_msg.yaw_angle, control_ref_.yaw, ref_events);
 
   flags_.ref_received = true;
+  boot_.mark(BootTimeline::FIRST_REFERENCE);
   return;
 };
 
 bool Plugin::setMode(const as2_msgs::msg::ControlMode &in_mode,
                      const as2_msgs::msg::ControlMode &out_mode) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::SET_MODE);
+  boot_.mark(BootTimeline::SET_MODE_BEGIN);
+  std::lock_guard<std::mutex> lock(control_mutex_);
   if (!flags_.parameters_read) {
     RCLCPP_WARN(node_ptr_->get_logger(), "Plugin parameters not read yet, can not set mode");
     return false;
@@ -207,16 +819,82 @@ bool Plugin::setMode(const as2_msgs::msg::ControlMode &in_mode,
 
   flags_.ref_received   = false;
   flags_.state_received = false;
+  if (control_law_.mpc) control_law_.mpc->reset();
+  upsampler_.reset();
+  formation_.reset();
+  if (playback_active_) {
+    RCLCPP_WARN(node_ptr_->get_logger(), "Control mode changed, trajectory playback stopped");
+    playback_active_ = false;
+  }
 
   control_mode_out_ = out_mode;
+
+  boot_.mark(BootTimeline::SET_MODE_END);
   return true;
 };
 
+void Plugin::warmUp(const int _ticks) {
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  runWarmUp(_ticks < 0 ? warm_up_ticks_ : _ticks);
+}
+
+void Plugin::runWarmUp(const int _ticks) {
+  if (_ticks <= 0) return;
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::WARM_UP);
+
+  // The ticks run on a copy of the configured law, so its integrator, MPC warm start and
+  // statistics are not touched. The residual model is left out, its statistics are real ones
+  ControlLaw control_law     = control_law_;
+  control_law.residual_model = nullptr;
+  const Acro_command command = control_command_;
+  geometry_msgs::msg::TwistStamped twist;
+  as2_msgs::msg::Thrust thrust;
+  auto &clk         = *node_ptr_->get_clock();
+  uint64_t first_ns = 0;
+  uint64_t last_ns  = 0;
+  tf2::Quaternion attitude;
+  for (int i = 0; i < _ticks; i++) {
+    const uint64_t start = CpuBudget::wallNs();
+    // Small excursions around a hover point, so the branches of a real flight are taken
+    const double phase = 0.1 * i;
+    const Eigen::Vector3d position(0.1 * std::sin(phase), 0.1 * std::cos(phase), 1.0);
+    const Eigen::Vector3d velocity(0.1 * std::cos(phase), -0.1 * std::sin(phase), 0.0);
+    attitude.setRPY(0.02 * std::sin(phase), 0.02 * std::cos(phase), 0.1 * phase);
+    control_command_ = control_law.computeTrajectoryControl(
+        0.01, position, velocity, attitude, Eigen::Vector3d(0.0, 0.0, 1.0),
+        Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), 0.0);
+    getOutput(twist, thrust);
+    RCLCPP_DEBUG_THROTTLE(node_ptr_->get_logger(), clk, 5000, "Warm-up tick %d", i);
+
+    last_ns = CpuBudget::wallNs() - start;
+    if (i == 0) first_ns = last_ns;
+  }
+  control_command_ = command;
+
+  RCLCPP_INFO(node_ptr_->get_logger(), "Warm-up: %d ticks, first %.1f us, last %.1f us", _ticks,
+              first_ns * 1e-3, last_ns * 1e-3);
+}
+
 bool Plugin::computeOutput(double dt,
                            geometry_msgs::msg::PoseStamped &pose,
                            geometry_msgs::msg::TwistStamped &twist,
                            as2_msgs::msg::Thrust &thrust) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::COMPUTE_OUTPUT);
+  std::lock_guard<std::mutex> lock(control_mutex_);
   auto &clk = *node_ptr_->get_clock();
+  const int64_t now_ns = static_cast<int64_t>(CpuBudget::wallNs());
+  tick_period_.onTick(now_ns, dt);
+  if (state_arbiter_.config.enable) {
+    selectStateSource();
+  }
+  // After the selection, so a sample the arbiter applies on this tick is already counted
+  phase_lock_.onTick(now_ns);
+  if (playback_active_) {
+    samplePlayback();
+  } else if (formation_.config.enable && formation_.received()) {
+    sampleFormation();
+  }
+
   if (!flags_.state_received) {
     RCLCPP_WARN_THROTTLE(node_ptr_->get_logger(), clk, 5000, "State not received yet");
     return false;
@@ -230,8 +908,11 @@ bool Plugin::computeOutput(double dt,
 
   if (!flags_.parameters_read) {
     RCLCPP_WARN_THROTTLE(node_ptr_->get_logger(), clk, 5000, "Parameters not read yet");
-    for (auto &param : parameters_to_read_) {
-      RCLCPP_WARN(node_ptr_->get_logger(), "Parameter %s not read yet", param.c_str());
+    for (size_t i = 0; i < parameters_list_.size(); i++) {
+      if (parameters_to_read_ & (1u << i)) {
+        RCLCPP_WARN(node_ptr_->get_logger(), "Parameter %s not read yet",
+                    parameters_list_[i].data());
+      }
     }
     return false;
   }
@@ -249,13 +930,20 @@ bool Plugin::computeOutput(double dt,
       break;
   }
 
+  const Eigen::Vector3d accum_pos_error = control_law_.accum_pos_error;
+  double compute_dt                     = dt;
+  bool full                             = true;  // the position loop ran on this tick
   switch (control_mode_in_.control_mode) {
     case as2_msgs::msg::ControlMode::HOVER:
     case as2_msgs::msg::ControlMode::TRAJECTORY:
-      control_command_ = computeTrajectoryControl(dt, uav_state_.position, uav_state_.velocity,
-                                                  uav_state_.attitude_state, control_ref_.position,
-                                                  control_ref_.velocity, control_ref_.acceleration,
-                                                  control_ref_.yaw);
+      if (upsampler_.enabled()) {
+        full = computeUpsampled(dt, compute_dt);
+        break;
+      }
+      control_command_ = control_law_.computeTrajectoryControl(
+          dt, uav_state_.position, uav_state_.velocity, uav_state_.attitude_state,
+          control_ref_.position, control_ref_.velocity, control_ref_.acceleration,
+          control_ref_.yaw);
       break;
     default:
       auto &clk = *node_ptr_->get_clock();
@@ -264,77 +952,338 @@ bool Plugin::computeOutput(double dt,
       break;
   }
 
+  publishSnapshot();
+  if (telemetry_.enabled()) {
+    pushTelemetry();
+  }
+  if (shadow_.enabled() && full) {
+    pushShadow(compute_dt, accum_pos_error);
+  }
+  if (black_box_.enabled()) {
+    pushBlackBox();
+  }
+  boot_.mark(BootTimeline::FIRST_COMMAND);
   return getOutput(twist, thrust);
 }
 
-Eigen::Vector3d Plugin::getForce(const double &_dt,
-                                 const Eigen::Vector3d &_pos_state,
-                                 const Eigen::Vector3d &_vel_state,
-                                 const Eigen::Vector3d &_pos_reference,
-                                 const Eigen::Vector3d &_vel_reference,
-                                 const Eigen::Vector3d &_acc_reference) {
-  // Compute the error force contribution
+bool Plugin::computeUpsampled(const double _dt, double &_compute_dt) {
+  const uint64_t start = CpuBudget::wallNs();
+  _compute_dt          = _dt;
+  const bool full      = upsampler_.step(_dt, _compute_dt);
+  if (full) {
+    control_command_ = control_law_.computeTrajectoryControl(
+        _compute_dt, uav_state_.position, uav_state_.velocity, uav_state_.attitude_state,
+        control_ref_.position, control_ref_.velocity, control_ref_.acceleration,
+        control_ref_.yaw);
+    upsampler_.push(control_law_.internals.desired_force);
+  } else {
+    // The position loop is left out, the attitude loop still runs on the latest attitude
+    control_command_ = control_law_.computeAttitudeControl(
+        upsampler_.extrapolate(), uav_state_.attitude_state, control_ref_.yaw);
+  }
+  upsampler_.addTiming(full, CpuBudget::wallNs() - start);
+  return full;
+}
+
+void Plugin::startTickSource(Tick_output_callback _on_output) {
+  Tick_source_config config;
+  Publish_offload_config offload_config;
+  int64_t origin_ns = 0;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    config          = tick_source_config_;
+    offload_config  = publish_offload_config_;
+    origin_ns       = tick_origin_ns_;
+    tick_origin_ns_ = 0;
+  }
+  stopTickSource();
+  tick_output_ = std::move(_on_output);
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    phase_lock_.setNominalPeriod(1e9 / std::max(config.rate, 1e-3));
+  }
+  // The deadlines follow the phase lock correction, always zero unless phase_lock.enable
+  auto phase = [this] {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    return phase_lock_.takeCorrection();
+  };
+
+  // The messages live in the closures, so neither thread constructs them per tick
+  geometry_msgs::msg::PoseStamped pose;
+  geometry_msgs::msg::TwistStamped twist;
+  as2_msgs::msg::Thrust thrust;
+  if (!offload_config.enable) {
+    tick_source_.start(
+        config,
+        [this, pose, twist, thrust](const double _dt) mutable {
+          const bool ok = computeOutput(_dt, pose, twist, thrust);
+          tick_output_(ok, twist, thrust);
+        },
+        origin_ns, phase);
+  } else {
+    twist.header.frame_id  = base_link_frame_id_;
+    thrust.header.frame_id = base_link_frame_id_;
+    auto publish = [this, twist, thrust](const Published_command &_command) mutable {
+      twist.header.stamp    = rclcpp::Time(_command.stamp_ns);
+      thrust.header.stamp   = twist.header.stamp;
+      twist.twist.angular.x = _command.rates[0];
+      twist.twist.angular.y = _command.rates[1];
+      twist.twist.angular.z = _command.rates[2];
+      thrust.thrust         = _command.thrust;
+      tick_output_(_command.ok, twist, thrust);
+    };
+    publish_offload_.start(offload_config, publish);
+
+    // computeOutput() still fills the messages of the tick, only their values cross to the
+    // publisher thread, which serializes and publishes its own copies
+    tick_source_.start(
+        config,
+        [this, pose, twist, thrust](const double _dt) mutable {
+          Published_command command;
+          command.ok         = computeOutput(_dt, pose, twist, thrust);
+          command.tick       = tick_count_;
+          command.stamp_ns   = rclcpp::Time(twist.header.stamp).nanoseconds();
+          command.rates[0]   = twist.twist.angular.x;
+          command.rates[1]   = twist.twist.angular.y;
+          command.rates[2]   = twist.twist.angular.z;
+          command.thrust     = thrust.thrust;
+          command.enqueue_ns = CpuBudget::wallNs();
+          publish_offload_.push(command);
+        },
+        origin_ns, phase);
+  }
+  RCLCPP_INFO(node_ptr_->get_logger(), "Tick source started at %.1f Hz, %s on overruns%s",
+              config.rate, config.catch_up ? "catch-up" : "skip",
+              offload_config.enable ? ", publishing offloaded" : "");
+}
+
+void Plugin::stopTickSource() {
+  tick_source_.stop();
+  publish_offload_.stop();
+  // A host timer drives the next ticks, its period is estimated again
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  phase_lock_.setNominalPeriod(0.0);
+}
+
+static void copyTo(const Eigen::Vector3d &_vector, double *_array) {
+  Eigen::Vector3d::Map(_array) = _vector;
+}
+
+std::vector<uint8_t> Plugin::exportState() {
+  Controller_state state;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    const Control_gains &gains = control_law_.gains;
+    state.mass                 = gains.mass;
+    state.antiwindup_cte       = gains.antiwindup_cte;
+    copyTo(gains.kp, state.kp);
+    copyTo(gains.ki, state.ki);
+    copyTo(gains.kd, state.kd);
+    copyTo(gains.kp_ang, state.kp_ang);
+    copyTo(control_law_.accum_pos_error, state.accum_pos_error);
+
+    copyTo(uav_state_.position, state.position);
+    copyTo(uav_state_.velocity, state.velocity);
+    state.attitude[0] = uav_state_.attitude_state.x();
+    state.attitude[1] = uav_state_.attitude_state.y();
+    state.attitude[2] = uav_state_.attitude_state.z();
+    state.attitude[3] = uav_state_.attitude_state.w();
+    copyTo(control_ref_.position, state.ref_position);
+    copyTo(control_ref_.velocity, state.ref_velocity);
+    copyTo(control_ref_.acceleration, state.ref_acceleration);
+    state.ref_yaw = control_ref_.yaw;
+    copyTo(control_command_.PQR, state.rates);
+    state.thrust = control_command_.thrust;
+
+    state.mode_in[0]  = control_mode_in_.control_mode;
+    state.mode_in[1]  = control_mode_in_.yaw_mode;
+    state.mode_in[2]  = control_mode_in_.reference_frame;
+    state.mode_out[0] = control_mode_out_.control_mode;
+    state.mode_out[1] = control_mode_out_.yaw_mode;
+    state.mode_out[2] = control_mode_out_.reference_frame;
+    if (flags_.parameters_read) state.flags |= Controller_state::PARAMETERS_READ;
+    if (flags_.state_received) state.flags |= Controller_state::STATE_RECEIVED;
+    if (flags_.ref_received) state.flags |= Controller_state::REF_RECEIVED;
+    if (hover_flag_) state.flags |= Controller_state::HOVER;
+    state.tick = tick_count_;
+  }
+  // Only a stopped source hands its phase over, a running one keeps ticking this instance
+  state.tick_deadline_ns = tick_source_.running() ? 0 : tick_source_.nextDeadlineNs();
+  return encodeControllerState(state);
+}
+
+bool Plugin::importState(const std::vector<uint8_t> &_state, std::string &_error) {
+  Controller_state state;
+  if (!decodeControllerState(_state, state, _error) || !checkControllerState(state, _error)) {
+    RCLCPP_ERROR(node_ptr_->get_logger(), "State import: %s", _error.c_str());
+    return false;
+  }
 
-  const Eigen::Vector3d position_error = _pos_reference - _pos_state;
-  const Eigen::Vector3d velocity_error = _vel_reference - _vel_state;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    importControllerState(state);
+  }
+  if (state.flags & Controller_state::PARAMETERS_READ) {
+    pushGainParameters(state);
+  }
+  RCLCPP_INFO(node_ptr_->get_logger(), "State of version %u imported at tick %lu",
+              state.version, static_cast<unsigned long>(state.tick));
+  return true;
+}
+
+void Plugin::importControllerState(const Controller_state &_state) {
+  if (_state.flags & Controller_state::PARAMETERS_READ) {
+    // Without them this instance keeps its own gains, the exported ones are defaults
+    Control_gains &gains = control_law_.gains;
+    gains.mass           = _state.mass;
+    gains.antiwindup_cte = _state.antiwindup_cte;
+    gains.kp             = Eigen::Map<const Eigen::Vector3d>(_state.kp);
+    gains.ki             = Eigen::Map<const Eigen::Vector3d>(_state.ki);
+    gains.kd             = Eigen::Map<const Eigen::Vector3d>(_state.kd);
+    gains.kp_ang         = Eigen::Map<const Eigen::Vector3d>(_state.kp_ang);
+  }
+  // Reset again by the next tick, see Controller_state
+  control_law_.accum_pos_error = Eigen::Map<const Eigen::Vector3d>(_state.accum_pos_error);
 
-  // TODO: check if apply _dt to each constant or apply it to the whole vector each iteration
-  accum_pos_error_ += position_error * _dt;
+  uav_state_.position       = Eigen::Map<const Eigen::Vector3d>(_state.position);
+  uav_state_.velocity       = Eigen::Map<const Eigen::Vector3d>(_state.velocity);
+  uav_state_.attitude_state = tf2::Quaternion(_state.attitude[0], _state.attitude[1],
+                                              _state.attitude[2], _state.attitude[3]);
+  control_ref_.position     = Eigen::Map<const Eigen::Vector3d>(_state.ref_position);
+  control_ref_.velocity     = Eigen::Map<const Eigen::Vector3d>(_state.ref_velocity);
+  control_ref_.acceleration = Eigen::Map<const Eigen::Vector3d>(_state.ref_acceleration);
+  control_ref_.yaw          = _state.ref_yaw;
+  control_command_.PQR      = Eigen::Map<const Eigen::Vector3d>(_state.rates);
+  control_command_.thrust   = _state.thrust;
 
-  for (uint8_t j = 0; j < 3; j++) {
-    double antiwindup_value = antiwindup_cte_ / Ki_.diagonal()[j];
-    accum_pos_error_[j]     = std::clamp(accum_pos_error_[j], -antiwindup_value, antiwindup_value);
+  control_mode_in_.control_mode     = _state.mode_in[0];
+  control_mode_in_.yaw_mode         = _state.mode_in[1];
+  control_mode_in_.reference_frame  = _state.mode_in[2];
+  control_mode_out_.control_mode    = _state.mode_out[0];
+  control_mode_out_.yaw_mode        = _state.mode_out[1];
+  control_mode_out_.reference_frame = _state.mode_out[2];
+  flags_.state_received = _state.flags & Controller_state::STATE_RECEIVED;
+  flags_.ref_received   = _state.flags & Controller_state::REF_RECEIVED;
+  hover_flag_           = _state.flags & Controller_state::HOVER;
+  if (_state.flags & Controller_state::PARAMETERS_READ) {
+    // The gains came along, the parameters this instance has not read yet are not waited for
+    flags_.parameters_read = true;
+    parameters_to_read_    = 0;
   }
+  tick_count_     = _state.tick;
+  tick_origin_ns_ = _state.tick_deadline_ns;
 
-  const Eigen::Vector3d desired_force = Kp_ * position_error + Kd_ * velocity_error +
-                                        Ki_ * accum_pos_error_ - mass_ * gravitational_accel_ +
-                                        mass_ * _acc_reference;
+  // Solver warm starts and force history belong to the old instance, rebuilt from here
+  if (control_law_.mpc) control_law_.mpc->reset();
+  upsampler_.reset();
+}
 
-  return std::move(desired_force);  // use std::move to avoid copy (force RVO)
+void Plugin::pushGainParameters(const Controller_state &_state) {
+  // The gains this instance runs with must be the ones its node declares
+  const std::pair<const char *, double> gains[] = {
+      {"mass", _state.mass},
+      {"trajectory_control.antiwindup_cte", _state.antiwindup_cte},
+      {"trajectory_control.kp.x", _state.kp[0]},
+      {"trajectory_control.kp.y", _state.kp[1]},
+      {"trajectory_control.kp.z", _state.kp[2]},
+      {"trajectory_control.ki.x", _state.ki[0]},
+      {"trajectory_control.ki.y", _state.ki[1]},
+      {"trajectory_control.ki.z", _state.ki[2]},
+      {"trajectory_control.kd.x", _state.kd[0]},
+      {"trajectory_control.kd.y", _state.kd[1]},
+      {"trajectory_control.kd.z", _state.kd[2]},
+      {"trajectory_control.roll_control.kp", _state.kp_ang[0]},
+      {"trajectory_control.pitch_control.kp", _state.kp_ang[1]},
+      {"trajectory_control.yaw_control.kp", _state.kp_ang[2]},
+  };
+  std::vector<rclcpp::Parameter> parameters;
+  for (const auto &gain : gains) {
+    if (node_ptr_->has_parameter(gain.first)) parameters.emplace_back(gain.first, gain.second);
+  }
+  // Outside the control lock, the parameter callbacks take it
+  for (const auto &result : node_ptr_->set_parameters(parameters)) {
+    if (!result.successful) {
+      RCLCPP_WARN(node_ptr_->get_logger(), "Imported gains not set as parameters: %s",
+                  result.reason.c_str());
+    }
+  }
 }
 
-Acro_command Plugin::computeTrajectoryControl(const double &_dt,
-                                              const Eigen::Vector3d &_pos_state,
-                                              const Eigen::Vector3d &_vel_state,
-                                              const tf2::Quaternion &_attitude_state,
-                                              const Eigen::Vector3d &_pos_reference,
-                                              const Eigen::Vector3d &_vel_reference,
-                                              const Eigen::Vector3d &_acc_reference,
-                                              const double &_yaw_angle_reference) {
-  Eigen::Vector3d desired_force =
-      getForce(_dt, _pos_state, _vel_state, _pos_reference, _vel_reference, _acc_reference);
+void Plugin::samplePlayback() {
+  // O(1): the record index follows from the elapsed time, no search nor upstream traffic
+  const double t = (node_ptr_->now().nanoseconds() - playback_start_ns_) * 1e-9;
 
-  // Compute the desired attitude
-  const tf2::Matrix3x3 rot_matrix_tf2(_attitude_state);
+  const Trajectory_record record = playback_file_.sample(t);
+  const bool finished            = t >= playback_file_.duration();
+  control_ref_.position          = Eigen::Map<const Eigen::Vector3d>(record.position);
+  control_ref_.velocity          = Eigen::Map<const Eigen::Vector3d>(record.velocity);
+  control_ref_.acceleration      = Eigen::Map<const Eigen::Vector3d>(record.acceleration);
+  control_ref_.yaw               = record.yaw;
+  flags_.ref_received            = true;
+  boot_.mark(BootTimeline::FIRST_REFERENCE);
 
-  Eigen::Matrix3d rot_matrix;
-  rot_matrix << rot_matrix_tf2[0][0], rot_matrix_tf2[0][1], rot_matrix_tf2[0][2],
-      rot_matrix_tf2[1][0], rot_matrix_tf2[1][1], rot_matrix_tf2[1][2], rot_matrix_tf2[2][0],
-      rot_matrix_tf2[2][1], rot_matrix_tf2[2][2];
+  if (finished) {
+    // The last position stays as the reference, at rest so the vehicle holds the final point
+    // instead of flying on with the last feed forward
+    control_ref_.velocity.setZero();
+    control_ref_.acceleration.setZero();
+    RCLCPP_INFO(node_ptr_->get_logger(), "Trajectory playback finished");
+    playback_active_ = false;
+  }
+}
 
-  const Eigen::Vector3d xc_des(cos(_yaw_angle_reference), sin(_yaw_angle_reference), 0);
-  const Eigen::Vector3d zb_des = desired_force.normalized();
-  const Eigen::Vector3d yb_des = zb_des.cross(xc_des).normalized();
-  const Eigen::Vector3d xb_des = yb_des.cross(zb_des).normalized();
+void Plugin::subscribeFormation() {
+  std::string topic;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    topic = formation_.config.enable ? formation_.config.topic : "";
+    if (std::string_view(formation_topic_) == topic) return;
+    formation_topic_ = topic;
+    formation_.reset();
+  }
+  formation_sub_.reset();
+  if (topic.empty()) return;
 
-  // Compute the rotation matrix desidered
-  Eigen::Matrix3d R_des;
-  R_des.col(0) = xb_des;
-  R_des.col(1) = yb_des;
-  R_des.col(2) = zb_des;
+  rclcpp::SubscriptionOptions options;
+  options.callback_group = callback_topology_.ingestion;
+  formation_sub_ = node_ptr_->create_subscription<as2_msgs::msg::TrajectoryPoint>(
+      topic, rclcpp::QoS(10),
+      [this](const as2_msgs::msg::TrajectoryPoint::SharedPtr _msg) { formationCallback(_msg); },
+      options);
+  RCLCPP_INFO(node_ptr_->get_logger(), "Formation reference from %s", topic.c_str());
+}
 
-  // Compute the rotation matrix error
-  const Eigen::Matrix3d Mat_e_rot =
-      (R_des.transpose() * rot_matrix - rot_matrix.transpose() * R_des);
+void Plugin::formationCallback(const as2_msgs::msg::TrajectoryPoint::SharedPtr _msg) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::UPDATE_REFERENCE);
+  int64_t stamp_ns = rclcpp::Time(_msg->header.stamp).nanoseconds();
+  if (stamp_ns == 0) stamp_ns = node_ptr_->now().nanoseconds();
 
-  const Eigen::Vector3d V_e_rot(Mat_e_rot(2, 1), Mat_e_rot(0, 2), Mat_e_rot(1, 0));
-  const Eigen::Vector3d E_rot = (1.0f / 2.0f) * V_e_rot;
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  if (control_mode_in_.control_mode != as2_msgs::msg::ControlMode::TRAJECTORY) return;
 
-  Acro_command acro_command;
-  acro_command.thrust = (float)desired_force.dot(rot_matrix.col(2).normalized());
-  acro_command.PQR    = -Kp_ang_mat_ * E_rot;
+  // Non-finite coefficients keep their previous value, as in updateReference()
+  uint64_t &ref_events          = control_law_.sanitizer.stats.non_finite_reference;
+  const UAV_reference &previous = formation_.formation();
+  UAV_reference formation;
+  formation.position = Sanitizer::keepFinite(
+      Eigen::Vector3d(_msg->position.x, _msg->position.y, _msg->position.z), previous.position,
+      ref_events);
+  formation.velocity = Sanitizer::keepFinite(
+      Eigen::Vector3d(_msg->twist.x, _msg->twist.y, _msg->twist.z), previous.velocity,
+      ref_events);
+  formation.acceleration = Sanitizer::keepFinite(
+      Eigen::Vector3d(_msg->acceleration.x, _msg->acceleration.y, _msg->acceleration.z),
+      previous.acceleration, ref_events);
+  formation.yaw = Sanitizer::keepFinite(_msg->yaw_angle, previous.yaw, ref_events);
+  formation_.update(formation, stamp_ns);
+}
 
-  return std::move(acro_command);  // use std::move to avoid copy (force RVO)
+void Plugin::sampleFormation() {
+  // O(1) per tick: the shared reference, propagated to now, plus the offset of this vehicle
+  if (control_mode_in_.control_mode != as2_msgs::msg::ControlMode::TRAJECTORY) return;
+  control_ref_        = formation_.vehicleReference(node_ptr_->now().nanoseconds());
+  flags_.ref_received = true;
+  boot_.mark(BootTimeline::FIRST_REFERENCE);
 }
 
 bool Plugin::getOutput(geometry_msgs::msg::TwistStamped &twist_msg,
@@ -351,6 +1300,333 @@ bool Plugin::getOutput(geometry_msgs::msg::TwistStamped &twist_msg,
   return true;
 };
 
+void Plugin::publishSnapshot() {
+  // Hot path: copy the terms into the free slot and swap it in, no locks nor allocations
+  Controller_snapshot &snapshot = snapshot_buffer_.back();
+  snapshot.tick                 = ++tick_count_;
+  snapshot.stamp                = node_ptr_->now();
+  snapshot.uav_state            = uav_state_;
+  snapshot.control_ref          = control_ref_;
+  snapshot.kp                   = control_law_.gains.kp;
+  snapshot.ki                   = control_law_.gains.ki;
+  snapshot.kd                   = control_law_.gains.kd;
+  snapshot.kp_ang               = control_law_.gains.kp_ang;
+  snapshot.accum_pos_error      = control_law_.accum_pos_error;
+  snapshot.internals            = control_law_.internals;
+  snapshot.command              = control_command_;
+  snapshot.sanitation           = control_law_.sanitizer.stats;
+  snapshot.mpc_enabled          = control_law_.mpc != nullptr;
+  snapshot.mpc                  = control_law_.mpc ? control_law_.mpc->stats() : Mpc_stats();
+
+  snapshot.residual_model_active = control_law_.residual_model != nullptr;
+  snapshot.residual_model        =
+      residual_model_ ? residual_model_->stats() : Residual_model_stats();
+  snapshot.upsampling_enabled = upsampler_.enabled();
+  snapshot.upsampling         = upsampler_.stats();
+  snapshot_buffer_.publish();
+}
+
+void Plugin::pushTelemetry() {
+  Telemetry_sample sample;
+  sample.tick = static_cast<uint32_t>(tick_count_);
+
+  float *values = sample.values.data();
+  Eigen::Map<Eigen::Vector3f>(values + 0)  = control_law_.internals.position_error.cast<float>();
+  Eigen::Map<Eigen::Vector3f>(values + 3)  = control_law_.internals.velocity_error.cast<float>();
+  Eigen::Map<Eigen::Vector3f>(values + 6)  = control_law_.internals.desired_force.cast<float>();
+  values[9]                                = static_cast<float>(control_command_.thrust);
+  Eigen::Map<Eigen::Vector3f>(values + 10) = control_command_.PQR.cast<float>();
+  Eigen::Map<Eigen::Vector3f>(values + 13) = control_law_.accum_pos_error.cast<float>();
+  telemetry_.push(sample);
+}
+
+void Plugin::pushShadow(const double _dt, const Eigen::Vector3d &_accum_pos_error) {
+  Shadow_input input;
+  input.tick            = tick_count_;
+  input.dt              = _dt;
+  input.state           = uav_state_;
+  input.reference       = control_ref_;
+  input.gains           = control_law_.gains;
+  input.limits          = control_law_.sanitizer.limits;
+  input.mpc             = control_law_.mpc ? control_law_.mpc->config() : Mpc_config();
+  input.accum_pos_error = _accum_pos_error;
+  input.residual_force  = control_law_.internals.residual_force;
+  input.active          = control_command_;
+  shadow_.push(input);
+}
+
+void Plugin::pushBlackBox() {
+  // Trigger levels, from values the tick already computed: a few compares, no extra math
+  const Black_box_config &config = black_box_config_;
+  const Sanitation_stats &stats  = control_law_.sanitizer.stats;
+  const Sanitation_stats &last   = black_box_sanitation_;
+  uint32_t levels                = black_box_manual_ ? BlackBox::MANUAL : 0u;
+  if (config.attitude_error > 0.0 && control_law_.internals.E_rot.squaredNorm() >
+                                         config.attitude_error * config.attitude_error) {
+    levels |= BlackBox::ATTITUDE_ERROR;
+  }
+  if (config.on_saturation && stats.thrust_saturations != last.thrust_saturations) {
+    levels |= BlackBox::THRUST_SATURATION;
+  }
+  if (config.on_non_finite && (stats.non_finite_state != last.non_finite_state ||
+                               stats.non_finite_reference != last.non_finite_reference ||
+                               stats.non_finite_command != last.non_finite_command)) {
+    levels |= BlackBox::NON_FINITE;
+  }
+  if (config.state_timeout > 0.0 &&
+      CpuBudget::wallNs() - last_state_ns_ > static_cast<uint64_t>(config.state_timeout * 1e9)) {
+    levels |= BlackBox::STALE_STATE;
+  }
+  const uint32_t raised = levels & ~black_box_levels_;
+  black_box_levels_     = levels;
+  black_box_sanitation_ = stats;
+  black_box_manual_     = false;
+
+  Black_box_record record;
+  record.tick              = tick_count_;
+  record.stamp_ns          = node_ptr_->now().nanoseconds();
+  record.triggers          = raised;
+  record.ref_yaw           = static_cast<float>(control_ref_.yaw);
+  record.thrust            = static_cast<float>(control_command_.thrust);
+  const tf2::Quaternion &q = uav_state_.attitude_state;
+  const auto &internals    = control_law_.internals;
+
+  using Map3 = Eigen::Map<Eigen::Vector3f>;
+  Map3(record.position)                        = uav_state_.position.cast<float>();
+  Map3(record.velocity)                        = uav_state_.velocity.cast<float>();
+  Eigen::Map<Eigen::Vector4f>(record.attitude) = Eigen::Vector4f(q.x(), q.y(), q.z(), q.w());
+  Map3(record.ref_position)                    = control_ref_.position.cast<float>();
+  Map3(record.ref_velocity)                    = control_ref_.velocity.cast<float>();
+  Map3(record.ref_acceleration)                = control_ref_.acceleration.cast<float>();
+  Map3(record.desired_force)                   = internals.desired_force.cast<float>();
+  Map3(record.attitude_error)                  = internals.E_rot.cast<float>();
+  Map3(record.rates)                           = control_command_.PQR.cast<float>();
+  black_box_.record(record);
+}
+
+void Plugin::snapshotServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                     std_srvs::srv::Trigger::Response::SharedPtr response) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::SERVICES);
+  (void)request;
+  snapshot_buffer_.update();
+  if (!snapshot_buffer_.hasValue()) {
+    response->success = false;
+    response->message = "No control tick computed yet";
+    return;
+  }
+
+  // Assembled here, on the service thread, from the latest complete snapshot
+  const Controller_snapshot &snapshot = snapshot_buffer_.front();
+  const Eigen::IOFormat vec_fmt(Eigen::FullPrecision, Eigen::DontAlignCols, ", ", ", ", "", "",
+                                "[", "]");
+  const tf2::Quaternion &q = snapshot.uav_state.attitude_state;
+
+  std::ostringstream ss;
+  ss << "tick: " << snapshot.tick << "\n";
+  ss << "stamp: " << snapshot.stamp.sec << "." << snapshot.stamp.nanosec << "\n";
+  ss << "state:\n";
+  ss << "  position: " << snapshot.uav_state.position.format(vec_fmt) << "\n";
+  ss << "  velocity: " << snapshot.uav_state.velocity.format(vec_fmt) << "\n";
+  ss << "  attitude: [" << q.x() << ", " << q.y() << ", " << q.z() << ", " << q.w() << "]\n";
+  ss << "reference:\n";
+  ss << "  position: " << snapshot.control_ref.position.format(vec_fmt) << "\n";
+  ss << "  velocity: " << snapshot.control_ref.velocity.format(vec_fmt) << "\n";
+  ss << "  acceleration: " << snapshot.control_ref.acceleration.format(vec_fmt) << "\n";
+  ss << "  yaw: " << snapshot.control_ref.yaw << "\n";
+  ss << "gains:\n";
+  ss << "  kp: " << snapshot.kp.format(vec_fmt) << "\n";
+  ss << "  ki: " << snapshot.ki.format(vec_fmt) << "\n";
+  ss << "  kd: " << snapshot.kd.format(vec_fmt) << "\n";
+  ss << "  kp_ang: " << snapshot.kp_ang.format(vec_fmt) << "\n";
+  ss << "accum_pos_error: " << snapshot.accum_pos_error.format(vec_fmt) << "\n";
+  ss << "desired_force: " << snapshot.internals.desired_force.format(vec_fmt) << "\n";
+  ss << "R_des: " << snapshot.internals.R_des.format(vec_fmt) << "\n";
+  ss << "E_rot: " << snapshot.internals.E_rot.format(vec_fmt) << "\n";
+  ss << "command:\n";
+  ss << "  PQR: " << snapshot.command.PQR.format(vec_fmt) << "\n";
+  ss << "  thrust: " << snapshot.command.thrust << "\n";
+  ss << "sanitation:\n";
+  ss << "  non_finite_state: " << snapshot.sanitation.non_finite_state << "\n";
+  ss << "  non_finite_reference: " << snapshot.sanitation.non_finite_reference << "\n";
+  ss << "  degenerate_force: " << snapshot.sanitation.degenerate_force << "\n";
+  ss << "  degenerate_heading: " << snapshot.sanitation.degenerate_heading << "\n";
+  ss << "  tilt_saturations: " << snapshot.sanitation.tilt_saturations << "\n";
+  ss << "  thrust_saturations: " << snapshot.sanitation.thrust_saturations << "\n";
+  ss << "  thrust_floor: " << snapshot.sanitation.thrust_floor << "\n";
+  ss << "  rate_saturations: " << snapshot.sanitation.rate_saturations << "\n";
+  ss << "  non_finite_command: " << snapshot.sanitation.non_finite_command << "\n";
+  ss << "mpc:\n";
+  ss << "  enabled: " << (snapshot.mpc_enabled ? "true" : "false") << "\n";
+  ss << "  solve_us: " << snapshot.internals.mpc_solve_ns * 1e-3 << "\n";
+  ss << "  iterations: " << snapshot.internals.mpc_iterations << "\n";
+  ss << "  solves: " << snapshot.mpc.solves << "\n";
+  ss << "  capped: " << snapshot.mpc.capped << "\n";
+  ss << "  mean_solve_us: "
+     << (snapshot.mpc.solves ? snapshot.mpc.total_solve_ns * 1e-3 / snapshot.mpc.solves : 0.0)
+     << "\n";
+  ss << "  max_solve_us: " << snapshot.mpc.max_solve_ns * 1e-3 << "\n";
+  ss << "residual_model:\n";
+  ss << "  active: " << (snapshot.residual_model_active ? "true" : "false") << "\n";
+  ss << "  force: " << snapshot.internals.residual_force.format(vec_fmt) << "\n";
+  ss << "  evaluations: " << snapshot.residual_model.evaluations << "\n";
+  ss << "  overruns: " << snapshot.residual_model.overruns << "\n";
+  ss << "  last_us: " << snapshot.residual_model.last_ns * 1e-3 << "\n";
+  ss << "  max_us: " << snapshot.residual_model.max_ns * 1e-3 << "\n";
+  // CPU saved: the upsampled ticks against what they would have cost as full ones
+  const Upsampling_stats &up = snapshot.upsampling;
+  const double full_us       = up.full_ns * 1e-3 / std::max<uint64_t>(up.full_ticks, 1);
+  const double upsampled_us  = up.upsampled_ns * 1e-3 / std::max<uint64_t>(up.upsampled_ticks, 1);
+  const double all_full_us   = full_us * (up.full_ticks + up.upsampled_ticks);
+  ss << "upsampling:\n";
+  ss << "  enabled: " << (snapshot.upsampling_enabled ? "true" : "false") << "\n";
+  ss << "  full_ticks: " << up.full_ticks << "\n";
+  ss << "  upsampled_ticks: " << up.upsampled_ticks << "\n";
+  ss << "  full_us_mean: " << full_us << "\n";
+  ss << "  upsampled_us_mean: " << upsampled_us << "\n";
+  ss << "  cpu_saved_percent: "
+     << (all_full_us > 0.0 ? 100.0 * (full_us - upsampled_us) * up.upsampled_ticks / all_full_us
+                           : 0.0)
+     << "\n";
+  ss << "  force_error_rms: "
+     << (up.predictions ? std::sqrt(up.force_error_sq / up.predictions) : 0.0) << "\n";
+  ss << "  force_error_max: " << up.force_error_max << "\n";
+  ss << telemetry_.report();
+  ss << shadow_.report();
+  ss << black_box_.report();
+  ss << arena_.report();
+
+  response->success = true;
+  response->message = ss.str();
+}
+
+void Plugin::cpuBudgetServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                      std_srvs::srv::Trigger::Response::SharedPtr response) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::SERVICES);
+  (void)request;
+  response->success = true;
+  response->message = cpu_budget_.report();
+}
+
+std::chrono::nanoseconds Plugin::nextTickDelay() {
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  const int64_t delay = phase_lock_.nextTick() - static_cast<int64_t>(CpuBudget::wallNs());
+  return std::chrono::nanoseconds(std::max<int64_t>(delay, 0));
+}
+
+void Plugin::phaseLockServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                      std_srvs::srv::Trigger::Response::SharedPtr response) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::SERVICES);
+  (void)request;
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  response->success = true;
+  response->message = phase_lock_.report();
+}
+
+void Plugin::stateSourcesServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                         std_srvs::srv::Trigger::Response::SharedPtr response) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::SERVICES);
+  (void)request;
+  const int64_t now_ns = node_ptr_->now().nanoseconds();
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  response->success = true;
+  response->message = state_arbiter_.report(now_ns);
+}
+
+void Plugin::startPlaybackServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                          std_srvs::srv::Trigger::Response::SharedPtr response) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::SERVICES);
+  (void)request;
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  if (!playback_file_.isOpen()) {
+    response->success = false;
+    response->message = "No trajectory file loaded, set trajectory_playback.file";
+    return;
+  }
+  if (control_mode_in_.control_mode != as2_msgs::msg::ControlMode::TRAJECTORY) {
+    response->success = false;
+    response->message = "Trajectory playback needs TRAJECTORY control mode";
+    return;
+  }
+
+  playback_start_ns_ = node_ptr_->now().nanoseconds();
+  playback_active_   = true;
+  response->success  = true;
+  response->message  = "Playing " + playback_file_.path() + ", " +
+                       std::to_string(playback_file_.duration()) + " s";
+}
+
+void Plugin::stopPlaybackServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                         std_srvs::srv::Trigger::Response::SharedPtr response) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::SERVICES);
+  (void)request;
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  response->success = playback_active_;
+  response->message = playback_active_ ? "Playback stopped, holding the current reference"
+                                       : "Trajectory playback not active";
+  playback_active_  = false;
+}
+
+void Plugin::tickSourceServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                       std_srvs::srv::Trigger::Response::SharedPtr response) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::SERVICES);
+  (void)request;
+  Tick_period_stats period;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    period = tick_period_.stats();
+  }
+
+  // computeOutput() as driven now, host timer or tick source, next to the tick source own view
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(3);
+  ss << "control_tick:\n";
+  ss << "  driver: " << (tick_source_.running() ? "tick_source" : "host") << "\n";
+  PeriodMonitor::report(period, "  ", ss);
+  ss << tick_source_.report();
+  ss << publish_offload_.report();
+  response->success = true;
+  response->message = ss.str();
+}
+
+void Plugin::formationServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                      std_srvs::srv::Trigger::Response::SharedPtr response) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::SERVICES);
+  (void)request;
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  response->success = true;
+  response->message = formation_.report();
+}
+
+void Plugin::bootServiceCallback(const std_srvs::srv::Trigger::Request::SharedPtr request,
+                                 std_srvs::srv::Trigger::Response::SharedPtr response) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::SERVICES);
+  (void)request;
+  std::string cache_status;
+  {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    cache_status = parameter_cache_status_;
+  }
+  response->success = true;
+  response->message = boot_.report() + "  parameter_cache: " + cache_status + "\n";
+}
+
+void Plugin::triggerBlackBoxServiceCallback(
+    const std_srvs::srv::Trigger::Request::SharedPtr request,
+    std_srvs::srv::Trigger::Response::SharedPtr response) {
+  CpuBudget::Scope cpu_scope(cpu_budget_, CpuBudget::SERVICES);
+  (void)request;
+  if (!black_box_.enabled()) {
+    response->success = false;
+    response->message = "Black box disabled, set black_box.enable";
+    return;
+  }
+  std::lock_guard<std::mutex> lock(control_mutex_);
+  black_box_manual_ = true;
+  response->success = true;
+  response->message =
+      std::string("Capture triggered, written to ") + black_box_config_.directoryPath();
+}
+
 }  // namespace controller_plugin_differential_flatness
 
 #include <pluginlib/class_list_macros.hpp>
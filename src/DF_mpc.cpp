@@ -0,0 +1,152 @@
+/*!*******************************************************************************************
+ *  \file       DF_mpc.cpp
+ *  \brief      Condensed QP model predictive control of the translational dynamics.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_mpc.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "DF_cpu_budget.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+void TranslationalMpc::setup(const Mpc_config &_config) {
+  config_ = _config;
+  stats_  = Mpc_stats();
+  reset();
+
+  // Double integrator, input held for dt: p_k = p_0 + k dt v_0 + sum_j<k dt^2 (k - j - 1/2) u_j
+  const double dt = config_.dt;
+  for (int k = 0; k < kHorizon; k++) {
+    step_(k) = (k + 1) * dt;
+    for (int j = 0; j <= k; j++) {
+      gamma_p_(k, j) = dt * dt * (k - j + 0.5);
+      gamma_v_(k, j) = dt;
+    }
+  }
+
+  for (int axis = 0; axis < 3; axis++) {
+    hessian_[axis] = config_.q_position(axis) * gamma_p_.transpose() * gamma_p_ +
+                     config_.q_velocity(axis) * gamma_v_.transpose() * gamma_v_ +
+                     config_.r_acceleration(axis) * Matrix::Identity();
+    // Gradient step of 1 / L, with L the largest eigenvalue of the Hessian
+    const Eigen::SelfAdjointEigenSolver<Matrix> eigen(hessian_[axis], Eigen::EigenvaluesOnly);
+    const double lipschitz = eigen.eigenvalues().maxCoeff();
+    inv_lipschitz_[axis]   = lipschitz > 0.0 ? 1.0 / lipschitz : 0.0;
+  }
+}
+
+Eigen::Vector3d TranslationalMpc::solve(const double _dt,
+                                        const Eigen::Vector3d &_position,
+                                        const Eigen::Vector3d &_velocity,
+                                        const Eigen::Vector3d &_pos_reference,
+                                        const Eigen::Vector3d &_vel_reference,
+                                        const Eigen::Vector3d &_acc_reference,
+                                        const Eigen::Vector3d &_accel_min,
+                                        const Eigen::Vector3d &_accel_max) {
+  const uint64_t start = CpuBudget::wallNs();
+
+  // Warm start: the previous solution advanced by the time elapsed since it was computed
+  const double shift = config_.dt > 0.0 ? std::fmax(_dt, 0.0) / config_.dt : 0.0;
+  const int whole    = static_cast<int>(shift);
+  const double frac  = shift - whole;
+
+  uint64_t iterations = 0;
+  bool capped         = false;
+  Eigen::Vector3d accel;
+  for (int axis = 0; axis < 3; axis++) {
+    const Vector lower = Vector::Constant(_accel_min(axis));
+    const Vector upper = Vector::Constant(_accel_max(axis));
+    const double a_ref = _acc_reference(axis);
+
+    // Reference extrapolated with constant acceleration
+    const Vector pos_ref = Vector::Constant(_pos_reference(axis)) + _vel_reference(axis) * step_ +
+                           0.5 * a_ref * step_.cwiseProduct(step_);
+    const Vector vel_ref = Vector::Constant(_vel_reference(axis)) + a_ref * step_;
+    const Vector gradient =
+        config_.q_position(axis) * gamma_p_.transpose() *
+            (Vector::Constant(_position(axis)) + _velocity(axis) * step_ - pos_ref) +
+        config_.q_velocity(axis) * gamma_v_.transpose() *
+            (Vector::Constant(_velocity(axis)) - vel_ref) -
+        config_.r_acceleration(axis) * Vector::Constant(a_ref);
+
+    Vector u;
+    if (warm_valid_) {
+      for (int k = 0; k < kHorizon; k++) {
+        const int a = std::min(k + whole, kHorizon - 1);
+        const int b = std::min(a + 1, kHorizon - 1);
+        u(k)        = (1.0 - frac) * solution_(a, axis) + frac * solution_(b, axis);
+      }
+    } else {
+      u = Vector::Constant(a_ref);
+    }
+    u = u.cwiseMax(lower).cwiseMin(upper);
+
+    // FISTA, projecting onto the input box every step
+    const Matrix &hessian = hessian_[axis];
+    Vector y              = u;
+    double t              = 1.0;
+    int it                = 0;
+    bool converged        = false;
+    while (it < config_.max_iterations && !converged) {
+      const Vector next =
+          (y - inv_lipschitz_[axis] * (hessian * y + gradient)).cwiseMax(lower).cwiseMin(upper);
+      const double t_next = 0.5 * (1.0 + std::sqrt(1.0 + 4.0 * t * t));
+      converged           = (next - u).cwiseAbs().maxCoeff() < config_.tolerance;
+      y                   = next + ((t - 1.0) / t_next) * (next - u);
+      u                   = next;
+      t                   = t_next;
+      it++;
+    }
+    iterations = std::max<uint64_t>(iterations, it);
+    capped |= !converged;
+
+    if (!u.allFinite()) {
+      // Never carry a poisoned warm start, fall back to the clamped feedforward
+      u = Vector::Constant(a_ref).cwiseMax(lower).cwiseMin(upper);
+    }
+    solution_.col(axis) = u;
+    accel(axis)         = u(0);
+  }
+  warm_valid_ = solution_.allFinite();
+
+  const uint64_t elapsed = CpuBudget::wallNs() - start;
+  stats_.solves++;
+  stats_.capped += capped;
+  stats_.iterations   = iterations;
+  stats_.solve_ns     = elapsed;
+  stats_.max_solve_ns = std::max(stats_.max_solve_ns, elapsed);
+  stats_.total_solve_ns += elapsed;
+  return accel;
+}
+
+}  // namespace controller_plugin_differential_flatness
@@ -0,0 +1,135 @@
+/*!*******************************************************************************************
+ *  \file       DF_parameter_cache.cpp
+ *  \brief      Persisted cache of the required controller parameters.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_parameter_cache.hpp"
+
+#include <unistd.h>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace controller_plugin_differential_flatness {
+
+namespace {
+
+struct Header {
+  uint32_t magic      = ParameterCache::kMagic;
+  uint32_t version    = ParameterCache::kVersion;
+  uint64_t key        = 0;
+  uint64_t count      = 0;
+};
+
+}  // namespace
+
+bool ParameterCache::load(const std::string &_path,
+                          const uint64_t _key,
+                          double *_values,
+                          const size_t _n,
+                          std::string &_error) {
+  FILE *file = std::fopen(_path.c_str(), "rb");
+  if (!file) {
+    _error = "cannot open " + _path + ": " + std::strerror(errno);
+    return false;
+  }
+  Header header;
+  std::vector<double> values(_n);
+  uint64_t checksum     = 0;
+  const bool has_header = std::fread(&header, sizeof(header), 1, file) == 1;
+  const bool complete   = has_header && header.count == _n &&
+                        std::fread(values.data(), sizeof(double), _n, file) == _n &&
+                        std::fread(&checksum, sizeof(checksum), 1, file) == 1 &&
+                        std::fgetc(file) == EOF;
+  std::fclose(file);
+
+  if (!has_header || header.magic != kMagic || header.version != kVersion) {
+    _error = _path + " is not a version " + std::to_string(kVersion) + " parameter cache";
+    return false;
+  }
+  if (header.key != _key) {
+    _error = _path + " is stale, saved for other parameters";
+    return false;
+  }
+  if (!complete) {
+    _error = _path + " is truncated or has " + std::to_string(header.count) + " values, " +
+             std::to_string(_n) + " expected";
+    return false;
+  }
+  if (checksum != fnv1a(values.data(), _n * sizeof(double), fnv1a(&header, sizeof(header)))) {
+    _error = _path + " is corrupted, checksum mismatch";
+    return false;
+  }
+  for (size_t i = 0; i < _n; i++) {
+    if (!std::isfinite(values[i])) {
+      _error = _path + " value " + std::to_string(i) + " is not finite";
+      return false;
+    }
+  }
+  std::memcpy(_values, values.data(), _n * sizeof(double));
+  return true;
+}
+
+bool ParameterCache::save(const std::string &_path,
+                          const uint64_t _key,
+                          const double *_values,
+                          const size_t _n,
+                          std::string &_error) {
+  Header header;
+  header.key              = _key;
+  header.count            = _n;
+  const uint64_t checksum = fnv1a(_values, _n * sizeof(double), fnv1a(&header, sizeof(header)));
+
+  const std::string tmp_path = _path + ".tmp";
+  FILE *file                 = std::fopen(tmp_path.c_str(), "wb");
+  if (!file) {
+    _error = "cannot create " + tmp_path + ": " + std::strerror(errno);
+    return false;
+  }
+  const bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       std::fwrite(_values, sizeof(double), _n, file) == _n &&
+                       std::fwrite(&checksum, sizeof(checksum), 1, file) == 1 &&
+                       std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+  if (std::fclose(file) != 0 || !written) {
+    _error = "cannot write " + tmp_path;
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  if (std::rename(tmp_path.c_str(), _path.c_str()) != 0) {
+    _error = "cannot rename " + tmp_path + ": " + std::strerror(errno);
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace controller_plugin_differential_flatness
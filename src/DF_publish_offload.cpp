@@ -0,0 +1,151 @@
+/*!*******************************************************************************************
+ *  \file       DF_publish_offload.cpp
+ *  \brief      Publication of the control commands off the control tick.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_publish_offload.hpp"
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "DF_cpu_budget.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "the futex word is a plain 32 bit integer");
+
+static uint32_t *futexWord(std::atomic<uint32_t> &_word) {
+  return reinterpret_cast<uint32_t *>(&_word);
+}
+
+void PublishOffload::start(const Publish_offload_config &_config,
+                           std::function<void(const Published_command &)> _publish) {
+  stop();
+  config_  = _config;
+  publish_ = std::move(_publish);
+  if (!queue_) {
+    queue_ = std::make_unique<CommandQueue>();
+  }
+  // Left by a producer racing the previous stop(), they belong to the previous session
+  Published_command stale;
+  while (queue_->pop(stale)) {
+  }
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_ = Stats();
+  }
+  dropped_.store(0);
+  max_depth_.store(0);
+
+  running_.store(true, std::memory_order_release);
+  thread_ = std::thread(&PublishOffload::run, this);
+  if (config_.cpu >= 0) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(config_.cpu, &cpu_set);
+    pthread_setaffinity_np(thread_.native_handle(), sizeof(cpu_set), &cpu_set);
+  }
+}
+
+void PublishOffload::stop() {
+  running_.store(false);
+  signal_.fetch_add(1);
+  wake();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void PublishOffload::wake() {
+  syscall(SYS_futex, futexWord(signal_), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+void PublishOffload::run() {
+  Published_command command;
+  while (true) {
+    if (queue_->pop(command)) {
+      const uint64_t start = CpuBudget::wallNs();
+      publish_(command);
+      const uint64_t end = CpuBudget::wallNs();
+
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+      stats_.published++;
+      stats_.publish_ns += end - start;
+      stats_.max_publish_ns = std::max(stats_.max_publish_ns, end - start);
+      stats_.latency_ns += end - command.enqueue_ns;
+      stats_.max_latency_ns = std::max(stats_.max_latency_ns, end - command.enqueue_ns);
+      continue;
+    }
+    // Stopped once the commands queued before stop() are out
+    if (!running_.load()) return;
+
+    // The signal is read before the queue is checked again: a push after the check changes
+    // it and the wait returns at once, so no wake up is lost
+    const uint32_t signal = signal_.load();
+    sleeping_.store(true);
+    if (running_.load() && queue_->size() == 0) {
+      syscall(SYS_futex, futexWord(signal_), FUTEX_WAIT_PRIVATE, signal, nullptr, nullptr, 0);
+    }
+    sleeping_.store(false);
+  }
+}
+
+std::string PublishOffload::report() const {
+  Stats stats;
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats = stats_;
+  }
+  const double published = static_cast<double>(std::max<uint64_t>(stats.published, 1));
+
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(3);
+  ss << "publish_offload:\n";
+  ss << "  enabled: " << (enabled() ? "true" : "false") << "\n";
+  ss << "  published: " << stats.published << "\n";
+  ss << "  dropped: " << dropped_.load() << "\n";
+  ss << "  queue_depth: " << (queue_ ? queue_->size() : 0) << "\n";
+  ss << "  queue_depth_max: " << max_depth_.load() << "\n";
+  ss << "  publish_us_mean: " << stats.publish_ns * 1e-3 / published << "\n";
+  ss << "  publish_us_max: " << stats.max_publish_ns * 1e-3 << "\n";
+  ss << "  latency_us_mean: " << stats.latency_ns * 1e-3 / published << "\n";
+  ss << "  latency_us_max: " << stats.max_latency_ns * 1e-3 << "\n";
+  return ss.str();
+}
+
+}  // namespace controller_plugin_differential_flatness
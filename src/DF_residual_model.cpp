@@ -0,0 +1,260 @@
+/*!*******************************************************************************************
+ *  \file       DF_residual_model.cpp
+ *  \brief      Learned residual force model evaluated inside the control tick.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_residual_model.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "DF_cpu_budget.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+using RowMatrixXf = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+bool ResidualModel::open(const std::string &_path, std::string &_error) {
+  std::ifstream file(_path, std::ios::binary);
+  if (!file) {
+    _error = "cannot open " + _path;
+    return false;
+  }
+  const std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                               std::istreambuf_iterator<char>());
+  if (data.size() < sizeof(Header)) {
+    _error = _path + " is too short for a model header";
+    return false;
+  }
+
+  Header header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kMagic || header.version != kVersion) {
+    _error = _path + " is not a version " + std::to_string(kVersion) + " residual model";
+    return false;
+  }
+  const int n_layers = static_cast<int>(header.n_layers);
+  if (n_layers < 1 || n_layers > kMaxLayers || header.activation > TANH) {
+    _error = _path + " has an unsupported topology";
+    return false;
+  }
+  if (header.sizes[0] != kInputs || header.sizes[n_layers] != kOutputs) {
+    _error = _path + " must map " + std::to_string(kInputs) + " inputs to " +
+             std::to_string(kOutputs) + " outputs";
+    return false;
+  }
+
+  // Sizes of the file and of the padded buffer, which starts with the scratch activations
+  size_t file_floats = 2 * kInputs;
+  size_t floats      = 2 * kMaxWidth + 2 * padded(kInputs);
+  for (int l = 0; l < n_layers; l++) {
+    const int in  = static_cast<int>(header.sizes[l]);
+    const int out = static_cast<int>(header.sizes[l + 1]);
+    if (out < 1 || out > kMaxWidth) {
+      _error = _path + " layer " + std::to_string(l) + " is wider than " +
+               std::to_string(kMaxWidth);
+      return false;
+    }
+    file_floats += static_cast<size_t>(out) * in + out;
+    floats += static_cast<size_t>(padded(out)) * padded(in) + padded(out);
+  }
+  if (data.size() != sizeof(Header) + file_floats * sizeof(float)) {
+    _error = _path + " size does not match its topology";
+    return false;
+  }
+  std::vector<float> values(file_floats);
+  std::memcpy(values.data(), data.data() + sizeof(Header), file_floats * sizeof(float));
+  for (const float value : values) {
+    if (!std::isfinite(value)) {
+      _error = _path + " has non-finite weights";
+      return false;
+    }
+  }
+
+  // Every block is a multiple of kLanes floats, so all of them stay kAlign aligned
+  const size_t bytes = floats * sizeof(float);
+  std::unique_ptr<float[], AlignedFree> buffer(
+      static_cast<float *>(std::aligned_alloc(kAlign, bytes)));
+  if (!buffer) {
+    _error = "cannot allocate " + std::to_string(bytes) + " bytes for " + _path;
+    return false;
+  }
+  std::memset(buffer.get(), 0, bytes);
+
+  float *cursor = buffer.get();
+  scratch_[0]   = cursor;
+  scratch_[1]   = cursor + kMaxWidth;
+  cursor += 2 * kMaxWidth;
+  input_mean_  = cursor;
+  input_scale_ = cursor + padded(kInputs);
+  cursor += 2 * padded(kInputs);
+
+  const float *source = values.data();
+  std::memcpy(input_mean_, source, kInputs * sizeof(float));
+  std::memcpy(input_scale_, source + kInputs, kInputs * sizeof(float));
+  source += 2 * kInputs;
+  for (int l = 0; l < n_layers; l++) {
+    const int in  = static_cast<int>(header.sizes[l]);
+    const int out = static_cast<int>(header.sizes[l + 1]);
+    Layer &layer  = layers_[l];
+    layer.rows    = padded(out);
+    layer.cols    = padded(in);
+
+    float *weights = cursor;
+    float *bias    = cursor + layer.rows * layer.cols;
+    for (int r = 0; r < out; r++) {
+      std::memcpy(weights + r * layer.cols, source + r * in, in * sizeof(float));
+    }
+    source += out * in;
+    std::memcpy(bias, source, out * sizeof(float));
+    source += out;
+    layer.weights = weights;
+    layer.bias    = bias;
+    cursor += layer.rows * layer.cols + layer.rows;
+  }
+
+  buffer_     = std::move(buffer);
+  n_layers_   = n_layers;
+  activation_ = static_cast<Activation>(header.activation);
+  path_       = _path;
+  stats_      = Residual_model_stats();
+  return true;
+}
+
+bool ResidualModel::evaluate(const Eigen::Vector3d &_velocity,
+                             const Eigen::Vector3d &_acc_reference,
+                             const double _height,
+                             Eigen::Vector3d &_force) {
+  const uint64_t start = CpuBudget::wallNs();
+  stats_.evaluations++;
+
+  float *input = scratch_[0];
+  input[0]     = static_cast<float>(_velocity.x());
+  input[1]     = static_cast<float>(_velocity.y());
+  input[2]     = static_cast<float>(_velocity.z());
+  input[3]     = static_cast<float>(_acc_reference.x());
+  input[4]     = static_cast<float>(_acc_reference.y());
+  input[5]     = static_cast<float>(_acc_reference.z());
+  input[6]     = static_cast<float>(_height);
+  for (int i = 0; i < kInputs; i++) {
+    input[i] = (input[i] - input_mean_[i]) * input_scale_[i];
+  }
+  // Hidden layers reuse this buffer, the input padding has to be zero again
+  std::fill(input + kInputs, input + padded(kInputs), 0.0f);
+
+  int current = 0;
+  for (int l = 0; l < n_layers_; l++) {
+    const Layer &layer = layers_[l];
+    const Eigen::Map<const RowMatrixXf, Eigen::Aligned64> weights(layer.weights, layer.rows,
+                                                                  layer.cols);
+    const Eigen::Map<const Eigen::VectorXf, Eigen::Aligned64> x(scratch_[current], layer.cols);
+    const Eigen::Map<const Eigen::VectorXf, Eigen::Aligned64> bias(layer.bias, layer.rows);
+    Eigen::Map<Eigen::VectorXf, Eigen::Aligned64> y(scratch_[1 - current], layer.rows);
+
+    y.noalias() = weights * x;
+    y += bias;
+    if (l + 1 < n_layers_) {
+      // Padding rows are zero and stay zero through both activations
+      if (activation_ == TANH) {
+        y = y.array().tanh();
+      } else {
+        y = y.cwiseMax(0.0f);
+      }
+    }
+    current = 1 - current;
+
+    stats_.last_ns = CpuBudget::wallNs() - start;
+    stats_.max_ns  = std::max(stats_.max_ns, stats_.last_ns);
+    if (stats_.last_ns > budget_ns_) {
+      stats_.overruns++;
+      return false;
+    }
+  }
+
+  const float *output = scratch_[current];
+  Eigen::Vector3d force(output[0], output[1], output[2]);
+  const double norm = force.norm();
+  if (max_force_ > 0.0 && norm > max_force_) {
+    force *= max_force_ / norm;
+  }
+  _force = force;
+  return true;
+}
+
+bool ResidualModel::write(const std::string &_path,
+                          const std::vector<uint32_t> &_sizes,
+                          const Activation _activation,
+                          const std::vector<float> &_input_mean,
+                          const std::vector<float> &_input_scale,
+                          const std::vector<std::vector<float>> &_weights,
+                          const std::vector<std::vector<float>> &_biases,
+                          std::string &_error) {
+  const size_t n_layers = _sizes.size() - 1;
+  if (_sizes.size() < 2 || n_layers > kMaxLayers || _weights.size() != n_layers ||
+      _biases.size() != n_layers || _input_mean.size() != kInputs ||
+      _input_scale.size() != kInputs) {
+    _error = "inconsistent model topology";
+    return false;
+  }
+
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic      = kMagic;
+  header.version    = kVersion;
+  header.n_layers   = static_cast<uint32_t>(n_layers);
+  header.activation = _activation;
+  std::copy(_sizes.begin(), _sizes.end(), header.sizes);
+
+  std::ofstream file(_path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(_input_mean.data()), kInputs * sizeof(float));
+  file.write(reinterpret_cast<const char *>(_input_scale.data()), kInputs * sizeof(float));
+  for (size_t l = 0; l < n_layers; l++) {
+    if (_weights[l].size() != static_cast<size_t>(_sizes[l]) * _sizes[l + 1] ||
+        _biases[l].size() != _sizes[l + 1]) {
+      _error = "layer " + std::to_string(l) + " does not match its sizes";
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(_weights[l].data()),
+               _weights[l].size() * sizeof(float));
+    file.write(reinterpret_cast<const char *>(_biases[l].data()),
+               _biases[l].size() * sizeof(float));
+  }
+  if (!file) {
+    _error = "cannot write " + _path;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace controller_plugin_differential_flatness
@@ -0,0 +1,219 @@
+/*!*******************************************************************************************
+ *  \file       DF_shadow.cpp
+ *  \brief      Shadow evaluation of an alternative gain profile on a spare core.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_shadow.hpp"
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "DF_cpu_budget.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "the futex word is a plain 32 bit integer");
+
+static uint32_t *futexWord(std::atomic<uint32_t> &_word) {
+  return reinterpret_cast<uint32_t *>(&_word);
+}
+
+void ShadowController::configure(const Shadow_config &_config) {
+  if (_config == config_ && enabled() == _config.enable) {
+    return;
+  }
+  stop();
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    config_ = _config;
+  }
+  if (config_.enable) {
+    start();
+  }
+}
+
+void ShadowController::start() {
+  if (!queue_) {
+    queue_ = std::make_unique<InputQueue>();
+  }
+  // Left by a producer racing the previous stop(), evaluated with the previous configuration
+  Shadow_input stale;
+  while (queue_->pop(stale)) {
+  }
+  if (!config_.log_file.empty()) {
+    log_ = std::fopen(config_.log_file.c_str(), "w");
+    if (log_) {
+      std::fprintf(log_,
+                   "tick,active_thrust,shadow_thrust,active_p,active_q,active_r,shadow_p,"
+                   "shadow_q,shadow_r,compute_ns\n");
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_ = Stats();
+  }
+
+  running_.store(true, std::memory_order_release);
+  thread_ = std::thread(&ShadowController::run, this);
+  if (config_.cpu >= 0) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(config_.cpu, &cpu_set);
+    pthread_setaffinity_np(thread_.native_handle(), sizeof(cpu_set), &cpu_set);
+  }
+}
+
+void ShadowController::stop() {
+  running_.store(false);
+  signal_.fetch_add(1);
+  wake();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  if (log_) {
+    std::fclose(log_);
+    log_ = nullptr;
+  }
+}
+
+void ShadowController::wake() {
+  syscall(SYS_futex, futexWord(signal_), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+void ShadowController::run() {
+  Shadow_input input;
+  while (running_.load()) {
+    while (queue_->pop(input)) {
+      evaluate(input);
+    }
+    // The signal is read before the queue is checked again: a push after the check changes
+    // it and the wait returns at once, so no wake up is lost
+    const uint32_t signal = signal_.load();
+    sleeping_.store(true);
+    if (running_.load() && queue_->size() == 0) {
+      syscall(SYS_futex, futexWord(signal_), FUTEX_WAIT_PRIVATE, signal, nullptr, nullptr, 0);
+    }
+    sleeping_.store(false);
+  }
+  if (log_) {
+    std::fflush(log_);
+  }
+}
+
+void ShadowController::evaluate(const Shadow_input &_input) {
+  // Rebuilt only when the active MPC configuration changes, off the control thread
+  if (!_input.mpc.enable) {
+    law_.mpc.reset();
+  } else if (!law_.mpc || law_.mpc->config() != _input.mpc) {
+    law_.mpc = std::make_unique<TranslationalMpc>();
+    law_.mpc->setup(_input.mpc);
+  }
+
+  const uint64_t start = CpuBudget::wallNs();
+  law_.gains.kp             = _input.gains.kp.cwiseProduct(config_.kp_scale);
+  law_.gains.ki             = _input.gains.ki.cwiseProduct(config_.ki_scale);
+  law_.gains.kd             = _input.gains.kd.cwiseProduct(config_.kd_scale);
+  law_.gains.kp_ang         = _input.gains.kp_ang.cwiseProduct(config_.kp_ang_scale);
+  law_.gains.mass           = _input.gains.mass;
+  law_.gains.antiwindup_cte = _input.gains.antiwindup_cte;
+  law_.sanitizer.limits     = _input.limits;
+  law_.accum_pos_error      = _input.accum_pos_error;
+
+  const Eigen::Vector3d force =
+      law_.getForce(_input.dt, _input.state.position, _input.state.velocity,
+                    _input.reference.position, _input.reference.velocity,
+                    _input.reference.acceleration) +
+      _input.residual_force;
+  const Acro_command command =
+      law_.computeAttitudeControl(force, _input.state.attitude_state, _input.reference.yaw);
+
+  const uint64_t compute_ns = CpuBudget::wallNs() - start;
+  const double thrust_delta = std::abs(command.thrust - _input.active.thrust);
+  const double rate_delta   = (command.PQR - _input.active.PQR).norm();
+
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.ticks++;
+    stats_.sum_thrust_delta += thrust_delta;
+    stats_.max_thrust_delta = std::max(stats_.max_thrust_delta, thrust_delta);
+    stats_.sum_rate_delta_sq += rate_delta * rate_delta;
+    stats_.max_rate_delta = std::max(stats_.max_rate_delta, rate_delta);
+    stats_.compute_ns += compute_ns;
+    stats_.max_compute_ns = std::max(stats_.max_compute_ns, compute_ns);
+    stats_.sanitation = law_.sanitizer.stats;
+  }
+
+  if (log_) {
+    std::fprintf(log_, "%lu,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%lu\n",
+                 static_cast<unsigned long>(_input.tick), _input.active.thrust, command.thrust,
+                 _input.active.PQR.x(), _input.active.PQR.y(), _input.active.PQR.z(),
+                 command.PQR.x(), command.PQR.y(), command.PQR.z(),
+                 static_cast<unsigned long>(compute_ns));
+  }
+}
+
+std::string ShadowController::report() const {
+  Stats stats;
+  int cpu;
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats = stats_;
+    cpu   = config_.cpu;
+  }
+  const double ticks = static_cast<double>(std::max<uint64_t>(stats.ticks, 1));
+
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(6);
+  ss << "shadow:\n";
+  ss << "  enabled: " << (enabled() ? "true" : "false") << "\n";
+  ss << "  cpu: " << cpu << "\n";
+  ss << "  ticks: " << stats.ticks << "\n";
+  ss << "  dropped: " << dropped_.load() << "\n";
+  ss << "  thrust_delta_mean: " << stats.sum_thrust_delta / ticks << "\n";
+  ss << "  thrust_delta_max: " << stats.max_thrust_delta << "\n";
+  ss << "  rate_delta_rms: " << std::sqrt(stats.sum_rate_delta_sq / ticks) << "\n";
+  ss << "  rate_delta_max: " << stats.max_rate_delta << "\n";
+  ss << "  compute_us_mean: " << stats.compute_ns * 1e-3 / ticks << "\n";
+  ss << "  compute_us_max: " << stats.max_compute_ns * 1e-3 << "\n";
+  ss << "  thrust_saturations: " << stats.sanitation.thrust_saturations << "\n";
+  ss << "  rate_saturations: " << stats.sanitation.rate_saturations << "\n";
+  return ss.str();
+}
+
+}  // namespace controller_plugin_differential_flatness
@@ -0,0 +1,352 @@
+/*!*******************************************************************************************
+ *  \file       DF_swarm_sim.cpp
+ *  \brief      Structure of arrays closed loop simulation of many vehicles.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_swarm_sim.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+#include "DF_cpu_budget.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+// Selects of values, unlike std::fmin, std::fmax and std::clamp they if-convert and vectorize.
+// A NaN _a gives _b, as fmin and fmax drop it, clampOf() keeps it, as std::clamp
+static inline double minOf(const double _a, const double _b) { return _a < _b ? _a : _b; }
+static inline double maxOf(const double _a, const double _b) { return _a > _b ? _a : _b; }
+static inline double clampOf(const double _v, const double _lo, const double _hi) {
+  return _v < _lo ? _lo : (_v > _hi ? _hi : _v);
+}
+
+static size_t padded(const size_t _n) {
+  return (_n + SwarmSimulator::kLane - 1) / SwarmSimulator::kLane * SwarmSimulator::kLane;
+}
+
+SwarmSimulator::SwarmSimulator(const Swarm_config &_config) : config_(_config) {
+  const size_t n = padded(config_.vehicles);
+  for (Lanes *array : {&px_, &py_, &pz_, &vx_, &vy_, &vz_, &qx_, &qy_, &qz_, &ix_, &iy_, &iz_,
+                       &ox_, &oy_, &oz_, &sin_yaw_, &wx_, &wy_, &wz_, &thrust_}) {
+    array->assign(n, 0.0);
+  }
+  qw_.assign(n, 1.0);
+  cos_yaw_.assign(n, 1.0);
+
+  const int hardware = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  const int lanes    = static_cast<int>(n / kLane);
+  threads_ = std::max(1, std::min(config_.threads > 0 ? config_.threads : hardware, lanes));
+}
+
+void SwarmSimulator::setOffset(const size_t _vehicle,
+                               const Eigen::Vector3d &_offset,
+                               const double _yaw_offset) {
+  ox_[_vehicle]      = _offset.x();
+  oy_[_vehicle]      = _offset.y();
+  oz_[_vehicle]      = _offset.z();
+  cos_yaw_[_vehicle] = std::cos(_yaw_offset);
+  sin_yaw_[_vehicle] = std::sin(_yaw_offset);
+}
+
+void SwarmSimulator::resetToFormation(const Swarm_origin &_origin) {
+  const UAV_reference &ref = _origin.reference;
+  const double c           = config_.rotate ? std::cos(ref.yaw) : 1.0;
+  const double s           = config_.rotate ? std::sin(ref.yaw) : 0.0;
+  for (size_t i = 0; i < config_.vehicles; i++) {
+    Swarm_vehicle vehicle;
+    vehicle.position = ref.position + Eigen::Vector3d(c * ox_[i] - s * oy_[i],
+                                                      s * ox_[i] + c * oy_[i], oz_[i]);
+    setVehicle(i, vehicle);
+    ix_[i] = iy_[i] = iz_[i] = 0.0;
+  }
+  stats_ = Swarm_stats();
+}
+
+void SwarmSimulator::setVehicle(const size_t _vehicle, const Swarm_vehicle &_state) {
+  px_[_vehicle]     = _state.position.x();
+  py_[_vehicle]     = _state.position.y();
+  pz_[_vehicle]     = _state.position.z();
+  vx_[_vehicle]     = _state.velocity.x();
+  vy_[_vehicle]     = _state.velocity.y();
+  vz_[_vehicle]     = _state.velocity.z();
+  qw_[_vehicle]     = _state.attitude.w();
+  qx_[_vehicle]     = _state.attitude.x();
+  qy_[_vehicle]     = _state.attitude.y();
+  qz_[_vehicle]     = _state.attitude.z();
+  wx_[_vehicle]     = _state.rates.x();
+  wy_[_vehicle]     = _state.rates.y();
+  wz_[_vehicle]     = _state.rates.z();
+  thrust_[_vehicle] = _state.thrust;
+}
+
+Swarm_vehicle SwarmSimulator::vehicle(const size_t _vehicle) const {
+  Swarm_vehicle state;
+  state.position = Eigen::Vector3d(px_[_vehicle], py_[_vehicle], pz_[_vehicle]);
+  state.velocity = Eigen::Vector3d(vx_[_vehicle], vy_[_vehicle], vz_[_vehicle]);
+  state.attitude = Eigen::Quaterniond(qw_[_vehicle], qx_[_vehicle], qy_[_vehicle], qz_[_vehicle]);
+  state.rates    = Eigen::Vector3d(wx_[_vehicle], wy_[_vehicle], wz_[_vehicle]);
+  state.thrust   = thrust_[_vehicle];
+  return state;
+}
+
+void SwarmSimulator::run(const int _steps, const Swarm_trajectory &_trajectory) {
+  if (_steps <= 0 || config_.vehicles == 0) return;
+  const uint64_t start_ns = CpuBudget::wallNs();
+
+  // Slices of whole lanes, the last one also takes the padding
+  const size_t lanes = padded(config_.vehicles) / kLane;
+  std::vector<std::thread> workers;
+  size_t begin = 0;
+  for (int k = 0; k < threads_; k++) {
+    const size_t end = (lanes * (k + 1) / threads_) * kLane;
+    if (k + 1 == threads_) {
+      runSlice(begin, end, _steps, _trajectory);
+    } else {
+      workers.emplace_back(&SwarmSimulator::runSlice, this, begin, end, _steps,
+                           std::cref(_trajectory));
+    }
+    begin = end;
+  }
+  for (std::thread &worker : workers) worker.join();
+
+  stats_.wall_ns += CpuBudget::wallNs() - start_ns;
+  stats_.steps += _steps;
+  stats_.vehicle_steps += static_cast<uint64_t>(_steps) * config_.vehicles;
+  stats_.time += _steps * config_.dt;
+  updateErrors(_trajectory(stats_.time));
+}
+
+void SwarmSimulator::runSlice(const size_t _begin,
+                              const size_t _end,
+                              const int _steps,
+                              const Swarm_trajectory &_trajectory) {
+  for (int k = 0; k < _steps; k++) {
+    stepSlice(_begin, _end, _trajectory(stats_.time + k * config_.dt));
+  }
+}
+
+void SwarmSimulator::stepSlice(const size_t _begin,
+                               const size_t _end,
+                               const Swarm_origin &_origin) {
+  // Everything shared by the vehicles is hoisted out of the loop
+  const UAV_reference &ref = _origin.reference;
+  const double c           = config_.rotate ? std::cos(ref.yaw) : 1.0;
+  const double s           = config_.rotate ? std::sin(ref.yaw) : 0.0;
+  const double w           = config_.rotate ? _origin.yaw_rate : 0.0;
+  const double cos_ref     = std::cos(ref.yaw);
+  const double sin_ref     = std::sin(ref.yaw);
+
+  const Control_gains &gains = config_.gains;
+  const double dt            = config_.dt;
+  const double m             = gains.mass;
+  const double g             = -ControlLaw::gravitational_accel.z();
+  const double aw_x          = gains.antiwindup_cte / gains.ki.x();
+  const double aw_y          = gains.antiwindup_cte / gains.ki.y();
+  const double aw_z          = gains.antiwindup_cte / gains.ki.z();
+
+  const Sanitation_limits &limits = config_.limits;
+  const double eps                = Sanitizer::kEpsilon;
+  const double inf                = std::numeric_limits<double>::infinity();
+  // A disabled tilt limit leaves the force as is: no floor on z, unit gain on x and y
+  const bool tilt_enabled      = limits.max_tilt < M_PI_2;
+  const double tan_tilt        = tilt_enabled ? std::tan(limits.max_tilt) : inf;
+  const double fz_floor        = tilt_enabled ? eps : -inf;
+  const double max_rate        = limits.max_rate;
+  const double thrust_to_accel = 1.0 / config_.mass;
+
+  double *px = px_.data(), *py = py_.data(), *pz = pz_.data();
+  double *vx = vx_.data(), *vy = vy_.data(), *vz = vz_.data();
+  double *qw = qw_.data(), *qx = qx_.data(), *qy = qy_.data(), *qz = qz_.data();
+  double *ix = ix_.data(), *iy = iy_.data(), *iz = iz_.data();
+  double *wx = wx_.data(), *wy = wy_.data(), *wz = wz_.data(), *thrust = thrust_.data();
+  const double *ox = ox_.data(), *oy = oy_.data(), *oz = oz_.data();
+  const double *cos_yaw = cos_yaw_.data(), *sin_yaw = sin_yaw_.data();
+
+  // Selects instead of branches and no calls but sqrt, so it vectorizes across vehicles. The
+  // arrays never overlap, ivdep spares the run time checks between every pair of them
+#pragma GCC ivdep
+  for (size_t i = _begin; i < _end; i++) {
+    // Reference of the slot, as FormationReference::vehicleReference()
+    const double dx  = c * ox[i] - s * oy[i];
+    const double dy  = s * ox[i] + c * oy[i];
+    const double rpx = ref.position.x() + dx;
+    const double rpy = ref.position.y() + dy;
+    const double rpz = ref.position.z() + oz[i];
+    const double rvx = ref.velocity.x() - w * dy;
+    const double rvy = ref.velocity.y() + w * dx;
+    const double rvz = ref.velocity.z();
+    const double rax = ref.acceleration.x() - w * w * dx;
+    const double ray = ref.acceleration.y() - w * w * dy;
+    const double raz = ref.acceleration.z();
+    const double cy  = cos_ref * cos_yaw[i] - sin_ref * sin_yaw[i];
+    const double sy  = sin_ref * cos_yaw[i] + cos_ref * sin_yaw[i];
+
+    // Position PID, as ControlLaw::getForce()
+    const double ex = rpx - px[i], ey = rpy - py[i], ez = rpz - pz[i];
+    ix[i]           = clampOf(ix[i] + ex * dt, -aw_x, aw_x);
+    iy[i]           = clampOf(iy[i] + ey * dt, -aw_y, aw_y);
+    iz[i]           = clampOf(iz[i] + ez * dt, -aw_z, aw_z);
+
+    double fx = gains.kp.x() * ex + gains.kd.x() * (rvx - vx[i]) + gains.ki.x() * ix[i] + m * rax;
+    double fy = gains.kp.y() * ey + gains.kd.y() * (rvy - vy[i]) + gains.ki.y() * iy[i] + m * ray;
+    double fz = gains.kp.z() * ez + gains.kd.z() * (rvz - vz[i]) + gains.ki.z() * iz[i] + m * g +
+                m * raz;
+
+    // Tilt limit, as Sanitizer::limitTilt()
+    const double fz_min    = maxOf(fz, fz_floor);
+    const double horiz     = std::sqrt(fx * fx + fy * fy);
+    const double tilt_gain = minOf(maxOf(fz_min, 0.0) * tan_tilt / maxOf(horiz, eps), 1.0);
+    fx *= tilt_gain;
+    fy *= tilt_gain;
+    fz = fz_min;
+
+    // Desired attitude, as ControlLaw::computeAttitudeControl()
+    const double f_norm  = std::sqrt(fx * fx + fy * fy + fz * fz);
+    const bool f_valid   = (f_norm > eps) & (f_norm < inf);
+    const double f_scale = 1.0 / maxOf(f_norm, eps);
+    const double zbx     = f_valid ? fx * f_scale : 0.0;
+    const double zby     = f_valid ? fy * f_scale : 0.0;
+    const double zbz     = f_valid ? fz * f_scale : 1.0;
+    // zb x xc, with xc = (cy, sy, 0)
+    const double yx      = -zbz * sy;
+    const double yy      = zbz * cy;
+    const double yz      = zbx * sy - zby * cy;
+    const double y_norm  = std::sqrt(yx * yx + yy * yy + yz * yz);
+    const bool y_valid   = (y_norm > eps) & (y_norm < inf);
+    const double y_scale = 1.0 / maxOf(y_norm, eps);
+    const double ybx     = y_valid ? yx * y_scale : -sy;
+    const double yby     = y_valid ? yy * y_scale : cy;
+    const double ybz     = y_valid ? yz * y_scale : 0.0;
+    double xbx           = yby * zbz - ybz * zby;
+    double xby           = ybz * zbx - ybx * zbz;
+    double xbz           = ybx * zby - yby * zbx;
+    const double x_norm  = std::sqrt(xbx * xbx + xby * xby + xbz * xbz);
+    xbx /= x_norm;
+    xby /= x_norm;
+    xbz /= x_norm;
+
+    // Attitude, as tf2::Matrix3x3
+    const double q_scale = 2.0 / (qx[i] * qx[i] + qy[i] * qy[i] + qz[i] * qz[i] + qw[i] * qw[i]);
+
+    const double xs = qx[i] * q_scale, ys = qy[i] * q_scale, zs = qz[i] * q_scale;
+    const double wxs = qw[i] * xs, wys = qw[i] * ys, wzs = qw[i] * zs;
+    const double xxs = qx[i] * xs, xys = qx[i] * ys, xzs = qx[i] * zs;
+    const double yys = qy[i] * ys, yzs = qy[i] * zs, zzs = qz[i] * zs;
+    const double r00 = 1.0 - (yys + zzs), r01 = xys - wzs, r02 = xzs + wys;
+    const double r10 = xys + wzs, r11 = 1.0 - (xxs + zzs), r12 = yzs - wxs;
+    const double r20 = xzs - wys, r21 = yzs + wxs, r22 = 1.0 - (xxs + yys);
+
+    // Attitude error vee(R_des^T R - R^T R_des) / 2, then rates and thrust
+    const double e0 = 0.5 * ((zbx * r01 + zby * r11 + zbz * r21) -
+                             (r02 * ybx + r12 * yby + r22 * ybz));
+    const double e1 = 0.5 * ((xbx * r02 + xby * r12 + xbz * r22) -
+                             (r00 * zbx + r10 * zby + r20 * zbz));
+    const double e2 = 0.5 * ((ybx * r00 + yby * r10 + ybz * r20) -
+                             (r01 * xbx + r11 * xby + r21 * xbz));
+    const double p  = clampOf(-gains.kp_ang.x() * e0, -max_rate, max_rate);
+    const double q  = clampOf(-gains.kp_ang.y() * e1, -max_rate, max_rate);
+    const double r  = clampOf(-gains.kp_ang.z() * e2, -max_rate, max_rate);
+    wx[i]           = std::abs(p) < inf ? p : 0.0;
+    wy[i]           = std::abs(q) < inf ? q : 0.0;
+    wz[i]           = std::abs(r) < inf ? r : 0.0;
+
+    const double z_norm    = std::sqrt(r02 * r02 + r12 * r12 + r22 * r22);
+    const float collective = static_cast<float>((fx * r02 + fy * r12 + fz * r22) / z_norm);
+    thrust[i] =
+        minOf(maxOf(static_cast<double>(collective), limits.min_thrust), limits.max_thrust);
+
+    // Rigid body step: attitude first, then thrust along the new body z
+    const double hx = 0.5 * wx[i] * dt, hy = 0.5 * wy[i] * dt, hz = 0.5 * wz[i] * dt;
+
+    double nw = qw[i] - qx[i] * hx - qy[i] * hy - qz[i] * hz;
+    double nx = qx[i] + qw[i] * hx + qy[i] * hz - qz[i] * hy;
+    double ny = qy[i] + qw[i] * hy + qz[i] * hx - qx[i] * hz;
+    double nz = qz[i] + qw[i] * hz + qx[i] * hy - qy[i] * hx;
+    const double n_scale = 1.0 / std::sqrt(nw * nw + nx * nx + ny * ny + nz * nz);
+    nw *= n_scale;
+    nx *= n_scale;
+    ny *= n_scale;
+    nz *= n_scale;
+    qw[i] = nw;
+    qx[i] = nx;
+    qy[i] = ny;
+    qz[i] = nz;
+
+    const double accel = thrust[i] * thrust_to_accel;
+    vx[i] += 2.0 * (nx * nz + nw * ny) * accel * dt;
+    vy[i] += 2.0 * (ny * nz - nw * nx) * accel * dt;
+    vz[i] += ((1.0 - 2.0 * (nx * nx + ny * ny)) * accel - g) * dt;
+    px[i] += vx[i] * dt;
+    py[i] += vy[i] * dt;
+    pz[i] += vz[i] * dt;
+  }
+}
+
+void SwarmSimulator::updateErrors(const Swarm_origin &_origin) {
+  const UAV_reference &ref = _origin.reference;
+  const double c           = config_.rotate ? std::cos(ref.yaw) : 1.0;
+  const double s           = config_.rotate ? std::sin(ref.yaw) : 0.0;
+  double sum_sq            = 0.0;
+  double max_sq            = 0.0;
+  for (size_t i = 0; i < config_.vehicles; i++) {
+    const double ex = ref.position.x() + c * ox_[i] - s * oy_[i] - px_[i];
+    const double ey = ref.position.y() + s * ox_[i] + c * oy_[i] - py_[i];
+    const double ez = ref.position.z() + oz_[i] - pz_[i];
+    const double sq = ex * ex + ey * ey + ez * ez;
+    sum_sq += sq;
+    max_sq = std::max(max_sq, sq);
+  }
+  stats_.position_error_rms = std::sqrt(sum_sq / std::max<size_t>(config_.vehicles, 1));
+  stats_.position_error_max = std::sqrt(max_sq);
+}
+
+std::string SwarmSimulator::report() const {
+  const double wall = std::max(stats_.wall_ns * 1e-9, 1e-9);
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(3);
+  ss << "swarm:\n";
+  ss << "  vehicles: " << config_.vehicles << "\n";
+  ss << "  threads: " << threads_ << "\n";
+  ss << "  steps: " << stats_.steps << "\n";
+  ss << "  simulated_s: " << stats_.time << "\n";
+  ss << "  wall_s: " << stats_.wall_ns * 1e-9 << "\n";
+  ss << "  vehicle_steps_per_s: " << std::setprecision(0) << stats_.vehicle_steps / wall
+     << std::setprecision(3) << "\n";
+  ss << "  real_time_factor: " << stats_.time / wall << "\n";
+  ss << "  position_error_rms: " << stats_.position_error_rms << "\n";
+  ss << "  position_error_max: " << stats_.position_error_max << "\n";
+  return ss.str();
+}
+
+}  // namespace controller_plugin_differential_flatness
@@ -0,0 +1,213 @@
+/*!*******************************************************************************************
+ *  \file       DF_telemetry.cpp
+ *  \brief      Decimated, delta encoded telemetry stream for constrained links.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_telemetry.hpp"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include "DF_cpu_budget.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+constexpr uint32_t kMinPeriodMs    = 20;
+constexpr uint32_t kMaxPeriodMs    = 500;
+constexpr uint32_t kMaxDecimation  = 1000;
+constexpr uint64_t kBudgetWindowNs = 1000000000ull;
+constexpr uint64_t kMaxPacketAgeNs = 1000000000ull;
+
+bool TelemetryStream::configure(const Telemetry_config &_config, std::string &_error) {
+  if (configured_ && _config == config_) {
+    return true;
+  }
+  stop();
+  config_     = _config;
+  configured_ = true;
+  return !config_.enable || start(_error);
+}
+
+bool TelemetryStream::start(std::string &_error) {
+  std::memset(&addr_, 0, sizeof(addr_));
+  addr_.sin_family = AF_INET;
+  addr_.sin_port   = htons(static_cast<uint16_t>(config_.udp_port));
+  if (inet_pton(AF_INET, config_.udp_host.c_str(), &addr_.sin_addr) != 1) {
+    _error = "udp_host " + config_.udp_host + " is not an IPv4 address";
+    return false;
+  }
+  socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (socket_ < 0) {
+    _error = std::string("cannot open the UDP socket: ") + std::strerror(errno);
+    return false;
+  }
+
+  if (!queue_) {
+    queue_ = std::make_unique<SampleQueue>();
+  }
+  // Samples and a partial window left by the previous run would open this one with a record
+  // mixing both configurations, it starts clean and its first packet is a key frame
+  Telemetry_sample stale;
+  while (queue_->pop(stale)) {
+  }
+  aggregator_   = TelemetryAggregator();
+  window_bytes_ = 0;
+  decimation_.store(std::max(config_.decimation, 1));
+  period_ms_.store(kMinPeriodMs);
+  encoder_.begin(seq_, static_cast<uint16_t>(decimation_.load()),
+                 static_cast<float>(config_.resolution));
+
+  running_.store(true, std::memory_order_release);
+  thread_ = std::thread(&TelemetryStream::run, this);
+  return true;
+}
+
+void TelemetryStream::stop() {
+  running_.store(false);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  if (socket_ >= 0) {
+    close(socket_);
+    socket_ = -1;
+  }
+}
+
+void TelemetryStream::run() {
+  uint64_t window_start   = CpuBudget::wallNs();
+  uint64_t window_cpu     = CpuBudget::threadCpuNs();
+  uint64_t packet_started = window_start;
+  const auto drain        = [&]() {
+    Telemetry_sample sample;
+    while (queue_->pop(sample)) {
+      if (aggregator_.add(sample, static_cast<uint16_t>(decimation_.load()))) {
+        if (encoder_.records() == 0) packet_started = CpuBudget::wallNs();
+        addRecord(aggregator_.take());
+      }
+    }
+  };
+
+  while (running_.load(std::memory_order_relaxed)) {
+    drain();
+
+    const uint64_t now = CpuBudget::wallNs();
+    if (encoder_.records() > 0 && now - packet_started > kMaxPacketAgeNs) {
+      sendPacket();
+    }
+
+    if (now - window_start >= kBudgetWindowNs) {
+      const double window_s = (now - window_start) * 1e-9;
+      const uint64_t cpu    = CpuBudget::threadCpuNs();
+
+      // Bandwidth budget: trade temporal resolution for bytes
+      const double bandwidth = window_bytes_ / window_s;
+      uint32_t decimation    = decimation_.load();
+      if (bandwidth > config_.max_bandwidth) {
+        decimation = std::min(decimation * 2, kMaxDecimation);
+      } else if (bandwidth < config_.max_bandwidth / 3.0 &&
+                 decimation > static_cast<uint32_t>(config_.decimation)) {
+        decimation = std::max(decimation / 2, static_cast<uint32_t>(config_.decimation));
+      }
+      decimation_.store(decimation);
+
+      // CPU budget: wake up less often, work is batched
+      const double cpu_percent = 100.0 * (cpu - window_cpu) * 1e-9 / window_s;
+      uint32_t period          = period_ms_.load();
+      if (cpu_percent > config_.max_cpu_percent) {
+        period = std::min(period * 2, kMaxPeriodMs);
+      } else if (cpu_percent < config_.max_cpu_percent / 3.0) {
+        period = std::max(period / 2, kMinPeriodMs);
+      }
+      period_ms_.store(period);
+
+      window_start  = now;
+      window_cpu    = cpu;
+      window_bytes_ = 0;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(period_ms_.load()));
+  }
+
+  // The samples queued before the stop still go out, a partial window does not
+  drain();
+  if (encoder_.records() > 0) {
+    sendPacket();
+  }
+}
+
+void TelemetryStream::addRecord(const Telemetry_record &_record) {
+  records_.fetch_add(1, std::memory_order_relaxed);
+  const size_t max_size = static_cast<size_t>(config_.max_packet_size);
+  if (encoder_.add(_record, max_size)) {
+    return;
+  }
+  if (encoder_.records() > 0) {
+    sendPacket();
+    if (encoder_.add(_record, max_size)) {
+      return;
+    }
+  }
+  // A single record does not fit in the configured packet size
+  dropped_records_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void TelemetryStream::sendPacket() {
+  const std::vector<uint8_t> &packet = encoder_.finish();
+  sendto(socket_, packet.data(), packet.size(), 0, reinterpret_cast<sockaddr *>(&addr_),
+         sizeof(addr_));
+  packets_.fetch_add(1, std::memory_order_relaxed);
+  bytes_.fetch_add(packet.size(), std::memory_order_relaxed);
+  window_bytes_ += packet.size();
+  encoder_.begin(++seq_, static_cast<uint16_t>(decimation_.load()),
+                 static_cast<float>(config_.resolution));
+}
+
+std::string TelemetryStream::report() const {
+  std::ostringstream ss;
+  ss << "telemetry:\n";
+  ss << "  enabled: " << (enabled() ? "true" : "false") << "\n";
+  ss << "  decimation: " << decimation_.load() << "\n";
+  ss << "  period_ms: " << period_ms_.load() << "\n";
+  ss << "  records: " << records_.load() << "\n";
+  ss << "  packets: " << packets_.load() << "\n";
+  ss << "  bytes: " << bytes_.load() << "\n";
+  ss << "  dropped_samples: " << dropped_samples_.load() << "\n";
+  ss << "  dropped_records: " << dropped_records_.load() << "\n";
+  return ss.str();
+}
+
+}  // namespace controller_plugin_differential_flatness
@@ -0,0 +1,184 @@
+/*!*******************************************************************************************
+ *  \file       DF_tick_source.cpp
+ *  \brief      Control tick on absolute monotonic deadlines.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_tick_source.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+
+#include "DF_cpu_budget.hpp"
+
+namespace controller_plugin_differential_flatness {
+
+void TickSource::start(const Tick_source_config &_config,
+                       std::function<void(double)> _tick,
+                       const int64_t _origin_ns,
+                       std::function<int64_t()> _phase) {
+  stop();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_ = _config;
+  }
+  tick_      = std::move(_tick);
+  phase_     = std::move(_phase);
+  origin_ns_ = _origin_ns;
+
+  running_.store(true);
+  thread_ = std::thread(&TickSource::run, this);
+  if (config_.cpu >= 0) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(config_.cpu, &cpu_set);
+    pthread_setaffinity_np(thread_.native_handle(), sizeof(cpu_set), &cpu_set);
+  }
+  if (config_.priority > 0) {
+    sched_param param{};
+    param.sched_priority = config_.priority;
+    if (pthread_setschedparam(thread_.native_handle(), SCHED_FIFO, &param) != 0) {
+      std::fprintf(stderr, "Tick source: SCHED_FIFO %d not permitted, default policy kept\n",
+                   config_.priority);
+    }
+  }
+}
+
+void TickSource::stop() {
+  running_.store(false);
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void TickSource::run() {
+  const int64_t period = std::llround(1e9 / std::max(config_.rate, 1e-3));
+  const int64_t start  = static_cast<int64_t>(CpuBudget::wallNs());
+  // A handed over deadline already past fires right away, the next ones follow its phase
+  int64_t origin = origin_ns_ > start - period ? origin_ns_ : start + period;
+
+  PeriodMonitor monitor;
+  Tick_source_stats stats;
+  stats.nominal_ns = static_cast<double>(period);
+  uint64_t k       = 0;
+  uint64_t burst   = 0;  // catch-up ticks left to run back to back
+  int64_t last_ns  = 0;
+  while (running_.load(std::memory_order_relaxed)) {
+    const int64_t deadline = origin + static_cast<int64_t>(k) * period;
+    next_deadline_ns_.store(deadline, std::memory_order_relaxed);
+    timespec ts;
+    ts.tv_sec  = deadline / 1000000000;
+    ts.tv_nsec = deadline % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+    if (!running_.load(std::memory_order_relaxed)) break;
+
+    const int64_t now = static_cast<int64_t>(CpuBudget::wallNs());
+    const double dt   = last_ns > 0 ? (now - last_ns) * 1e-9 : period * 1e-9;
+    last_ns           = now;
+    tick_(dt);
+    const int64_t end = static_cast<int64_t>(CpuBudget::wallNs());
+    monitor.onTick(now, dt);
+    stats.ticks++;
+    stats.max_latency_ns = std::max(stats.max_latency_ns, now - deadline);
+    stats.compute_ns += end - now;
+    stats.max_compute_ns = std::max<uint64_t>(stats.max_compute_ns, end - now);
+    k++;
+    if (phase_) {
+      const int64_t shift = phase_();
+      origin -= shift;
+      stats.phase_shift_ns += shift;
+    }
+
+    // Deadlines already past when the tick ends: up to max_catch_up of them fire right away,
+    // as clock_nanosleep returns at once, the others are stepped over
+    const int64_t next = origin + static_cast<int64_t>(k) * period;
+    if (burst > 0) {
+      burst--;
+    } else if (end > next) {
+      const uint64_t missed = static_cast<uint64_t>((end - next) / period) + 1;
+      const uint64_t run    = config_.catch_up
+                                  ? std::min<uint64_t>(missed, std::max(config_.max_catch_up, 0))
+                                  : 0;
+      burst = run;
+      k += missed - run;
+      stats.overruns++;
+      stats.caught_up += run;
+      stats.skipped += missed - run;
+    }
+
+    stats.period         = monitor.stats();
+    stats_buffer_.back() = stats;
+    stats_buffer_.publish();
+  }
+}
+
+Tick_source_stats TickSource::stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_buffer_.update();
+  return stats_buffer_.hasValue() ? stats_buffer_.front() : Tick_source_stats();
+}
+
+std::string TickSource::report() {
+  const Tick_source_stats current = stats();
+  Tick_source_config config;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config = config_;
+  }
+  // Drift: achieved time against the deadlines the ticks were due on, skipped ones included
+  // and moved by the phase corrections
+  const double due_ns = (current.period.periods + current.skipped) * current.nominal_ns -
+                        static_cast<double>(current.phase_shift_ns);
+
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(3);
+  ss << "tick_source:\n";
+  ss << "  running: " << (running() ? "true" : "false") << "\n";
+  ss << "  policy: " << (config.catch_up ? "catch_up" : "skip") << "\n";
+  ss << "  period_us_nominal: " << current.nominal_ns * 1e-3 << "\n";
+  PeriodMonitor::report(current.period, "  ", ss);
+  ss << "  drift_us: " << (current.period.sum_ns - due_ns) * 1e-3 << "\n";
+  ss << "  phase_shift_us: " << current.phase_shift_ns * 1e-3 << "\n";
+  ss << "  max_latency_us: " << current.max_latency_ns * 1e-3 << "\n";
+  ss << "  compute_us_mean: "
+     << current.compute_ns * 1e-3 / std::max<uint64_t>(current.ticks, 1) << "\n";
+  ss << "  compute_us_max: " << current.max_compute_ns * 1e-3 << "\n";
+  ss << "  ticks: " << current.ticks << "\n";
+  ss << "  overruns: " << current.overruns << "\n";
+  ss << "  caught_up: " << current.caught_up << "\n";
+  ss << "  skipped: " << current.skipped << "\n";
+  return ss.str();
+}
+
+}  // namespace controller_plugin_differential_flatness
@@ -0,0 +1,201 @@
+/*!*******************************************************************************************
+ *  \file       DF_trajectory_file.cpp
+ *  \brief      Memory mapped trajectory files for onboard playback.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include "DF_trajectory_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace controller_plugin_differential_flatness {
+
+// Relative tolerance of the record times against the header period
+constexpr double kPeriodTolerance = 1e-6;
+
+bool TrajectoryFile::open(const std::string &_path, std::string &_error) {
+  close();
+
+  const int fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    _error = "cannot open " + _path + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+    ::close(fd);
+    _error = _path + " is too short for a trajectory header";
+    return false;
+  }
+
+  const size_t size = static_cast<size_t>(st.st_size);
+  // MAP_POPULATE faults the whole file in now, playback ticks never page fault. Private, as
+  // nothing is ever written through it
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    _error = "cannot map " + _path + ": " + std::strerror(errno);
+    return false;
+  }
+
+  const char *bytes    = static_cast<const char *>(mapping);
+  const Header *header = reinterpret_cast<const Header *>(bytes);
+  const auto *records  = reinterpret_cast<const Trajectory_record *>(bytes + sizeof(Header));
+  _error.clear();
+  if (header->magic != kMagic || header->version != kVersion) {
+    _error = _path + " is not a version " + std::to_string(kVersion) + " trajectory file";
+  } else if (header->record_size != sizeof(Trajectory_record)) {
+    _error = _path + " has records of " + std::to_string(header->record_size) + " bytes";
+  } else if (header->n_records == 0 ||
+             header->n_records > (size - sizeof(Header)) / sizeof(Trajectory_record)) {
+    _error = _path + " is truncated or empty";
+  } else if (!(header->period > 0.0) || !std::isfinite(header->t0)) {
+    _error = _path + " has an invalid sampling period";
+  } else {
+    // Playback indexes by time, it relies on every record being where its time says
+    for (uint64_t i = 0; i < header->n_records; i++) {
+      const double expected = header->t0 + i * header->period;
+      if (std::abs(records[i].t - expected) > kPeriodTolerance * std::max(1.0, expected)) {
+        _error = _path + " record " + std::to_string(i) + " is off the sampling grid";
+        break;
+      }
+    }
+  }
+  if (!_error.empty()) {
+    munmap(mapping, size);
+    return false;
+  }
+
+  madvise(mapping, size, MADV_WILLNEED);
+  mapping_      = mapping;
+  mapping_size_ = size;
+  records_      = records;
+  n_records_    = header->n_records;
+  t0_           = header->t0;
+  period_       = header->period;
+  inv_period_   = 1.0 / header->period;
+  path_         = _path;
+  return true;
+}
+
+void TrajectoryFile::close() {
+  if (mapping_) {
+    munmap(mapping_, mapping_size_);
+  }
+  mapping_      = nullptr;
+  mapping_size_ = 0;
+  records_      = nullptr;
+  n_records_    = 0;
+  t0_           = 0.0;
+  period_       = 0.0;
+  inv_period_   = 0.0;
+  path_.clear();
+}
+
+void TrajectoryFile::swap(TrajectoryFile &_other) noexcept {
+  std::swap(mapping_, _other.mapping_);
+  std::swap(mapping_size_, _other.mapping_size_);
+  std::swap(records_, _other.records_);
+  std::swap(n_records_, _other.n_records_);
+  std::swap(t0_, _other.t0_);
+  std::swap(period_, _other.period_);
+  std::swap(inv_period_, _other.inv_period_);
+  path_.swap(_other.path_);
+}
+
+Trajectory_record TrajectoryFile::sample(const double _t) const {
+  const double position = std::max(_t * inv_period_, 0.0);
+  const size_t index    = static_cast<size_t>(position);
+  if (index + 1 >= n_records_) {
+    return records_[n_records_ - 1];
+  }
+
+  const Trajectory_record &a = records_[index];
+  const Trajectory_record &b = records_[index + 1];
+  const double alpha         = position - static_cast<double>(index);
+  Trajectory_record out;
+  out.t = t0_ + _t;
+  for (int i = 0; i < 3; i++) {
+    out.position[i]     = a.position[i] + alpha * (b.position[i] - a.position[i]);
+    out.velocity[i]     = a.velocity[i] + alpha * (b.velocity[i] - a.velocity[i]);
+    out.acceleration[i] = a.acceleration[i] + alpha * (b.acceleration[i] - a.acceleration[i]);
+  }
+  // Shortest way around, a yaw crossing +-pi must not spin the vehicle
+  const double yaw_delta = std::remainder(b.yaw - a.yaw, 2.0 * M_PI);
+  out.yaw                = std::remainder(a.yaw + alpha * yaw_delta, 2.0 * M_PI);
+  return out;
+}
+
+bool TrajectoryFile::write(const std::string &_path,
+                           const std::vector<Trajectory_record> &_records,
+                           std::string &_error) {
+  if (_records.size() < 2) {
+    _error = "a trajectory needs at least two records";
+    return false;
+  }
+
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic       = kMagic;
+  header.version     = kVersion;
+  header.n_records   = _records.size();
+  header.record_size = sizeof(Trajectory_record);
+  header.t0          = _records.front().t;
+  header.period      = (_records.back().t - _records.front().t) / (_records.size() - 1);
+
+  // Written aside and renamed over _path, so a file mapped for playback keeps its old inode
+  // and a reader never sees a partial file
+  const std::string tmp_path = _path + ".tmp" + std::to_string(getpid());
+  FILE *file                 = std::fopen(tmp_path.c_str(), "wb");
+  if (!file) {
+    _error = "cannot create " + tmp_path + ": " + std::strerror(errno);
+    return false;
+  }
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(_records.data(), sizeof(Trajectory_record), _records.size(), file) ==
+                _records.size() &&
+            std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+  ok      = std::fclose(file) == 0 && ok;
+  if (!ok || std::rename(tmp_path.c_str(), _path.c_str()) != 0) {
+    _error = "cannot write " + _path + ": " + std::strerror(errno);
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace controller_plugin_differential_flatness
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_arena.hpp"
+
+// Count every global heap allocation done by this process
+static std::atomic<size_t> allocations{0};
+
+void *operator new(std::size_t size) {
+  allocations++;
+  if (void *ptr = std::malloc(size)) return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+using controller_plugin_differential_flatness::Arena;
+using controller_plugin_differential_flatness::Arena_stats;
+
+TEST(Arena, SteadyStateNeverReachesTheHeap) {
+  Arena arena;
+  std::string error;
+  arena.reserve(1024 * 1024, false, error);
+
+  std::pmr::vector<std::pmr::string> topics(&arena);
+  std::pmr::vector<double> buffer(&arena);
+  const size_t allocations_before = allocations;
+  size_t warm_high_water          = 0;
+  for (int i = 0; i < 1000; i++) {
+    // Containers resized at run time, as reconfigurations do
+    topics.assign(4, std::pmr::string("/drone0/self_localization/odometry", &arena));
+    buffer.resize(1000 + i % 7 * 100);
+    topics.clear();
+    buffer.clear();
+    buffer.shrink_to_fit();
+    if (i == 7) warm_high_water = arena.stats().high_water;
+  }
+  EXPECT_EQ(allocations - allocations_before, 0u);
+
+  const Arena_stats stats = arena.stats();
+  EXPECT_EQ(stats.heap_fallbacks, 0u);
+  EXPECT_EQ(stats.in_use, topics.capacity() * sizeof(std::pmr::string));  // kept by clear()
+  EXPECT_GT(stats.in_use_max, 1000 * sizeof(double));
+  // Freed blocks are recycled, once every size has been seen the buffer does not grow
+  EXPECT_EQ(stats.high_water, warm_high_water);
+}
+
+TEST(Arena, ExhaustionFallsBackToTheHeap) {
+  Arena arena;
+  std::string error;
+  arena.reserve(64 * 1024, false, error);
+  {
+    std::pmr::vector<char> large(256 * 1024, 0, &arena);
+    EXPECT_EQ(arena.stats().heap_fallbacks, 1u);
+    EXPECT_EQ(arena.stats().heap_bytes, 256u * 1024);
+  }
+  EXPECT_EQ(arena.stats().in_use, 0u);
+  EXPECT_NE(arena.report().find("heap_fallbacks: 1\n"), std::string::npos);
+}
+
+TEST(Arena, AllocationsBeforeReserveAreReleasedToTheHeap) {
+  Arena arena;
+  std::pmr::string early(200, 'x', &arena);
+  std::string error;
+  ASSERT_TRUE(arena.reserve(64 * 1024, false, error)) << error;
+  EXPECT_FALSE(arena.reserve(64 * 1024, false, error));
+
+  early = std::pmr::string(300, 'y', &arena);
+  EXPECT_EQ(arena.stats().heap_fallbacks, 1u);
+  EXPECT_GT(arena.stats().high_water, 0u);
+}
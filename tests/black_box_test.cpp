@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_arena.hpp"
+#include "controller_plugin_differential_flatness/DF_black_box.hpp"
+
+using controller_plugin_differential_flatness::Arena;
+using controller_plugin_differential_flatness::Black_box_config;
+using controller_plugin_differential_flatness::Black_box_record;
+using controller_plugin_differential_flatness::BlackBox;
+
+/* 100 ms before and 50 ms after the trigger at 100 Hz */
+static Black_box_config smallWindows(const char *_name) {
+  Black_box_config config;
+  config.enable       = true;
+  config.directory    = std::string(::testing::TempDir()) + _name;
+  config.pre_trigger  = 0.1;
+  config.post_trigger = 0.05;
+  config.max_rate     = 100.0;
+  return config;
+}
+
+static Black_box_record tick(const uint64_t _tick, const uint32_t _triggers = 0) {
+  Black_box_record record;
+  record.tick     = _tick;
+  record.stamp_ns = static_cast<int64_t>(_tick) * 10000000;
+  for (float &value : record.position) value = static_cast<float>(_tick);
+  record.thrust   = 9.81f;
+  record.triggers = _triggers;
+  return record;
+}
+
+static bool waitWritten(const BlackBox &_black_box, const uint64_t _n) {
+  for (int i = 0; i < 2000 && _black_box.written() < _n; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return _black_box.written() >= _n;
+}
+
+/* Ticks of the data rows of the last written file */
+static std::vector<uint64_t> readTicks(const std::string &_report) {
+  const size_t begin      = _report.find("last_file: ") + 11;
+  const std::string path = _report.substr(begin, _report.find('\n', begin) - begin);
+  std::ifstream file(path);
+  std::vector<uint64_t> ticks;
+  std::string line;
+  std::getline(file, line);  // trigger_tick
+  std::getline(file, line);  // trigger_stamp_ns
+  std::getline(file, line);  // triggers
+  std::getline(file, line);  // columns
+  while (std::getline(file, line)) {
+    ticks.push_back(std::stoull(line.substr(0, line.find(','))));
+  }
+  std::remove(path.c_str());
+  return ticks;
+}
+
+TEST(BlackBox, NoCaptureWithoutTrigger) {
+  BlackBox black_box;
+  black_box.configure(smallWindows("black_box_quiet"));
+  ASSERT_TRUE(black_box.enabled());
+  for (uint64_t i = 0; i < 1000; i++) black_box.record(tick(i));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(black_box.written(), 0u);
+  EXPECT_NE(black_box.report().find("captures: 0"), std::string::npos);
+}
+
+TEST(BlackBox, WritesPreAndPostWindow) {
+  BlackBox black_box;
+  black_box.configure(smallWindows("black_box_window"));
+  for (uint64_t i = 0; i < 100; i++) {
+    black_box.record(tick(i, i == 50 ? BlackBox::ATTITUDE_ERROR : 0u));
+  }
+  ASSERT_TRUE(waitWritten(black_box, 1));
+
+  // 100 ms before the trigger at tick 50 and until 50 ms after it
+  const std::vector<uint64_t> ticks = readTicks(black_box.report());
+  ASSERT_EQ(ticks.size(), 16u);
+  for (size_t i = 0; i < ticks.size(); i++) {
+    EXPECT_EQ(ticks[i], 40 + i);
+  }
+}
+
+TEST(BlackBox, MergesTriggersAndKeepsRecording) {
+  BlackBox black_box;
+  black_box.configure(smallWindows("black_box_merge"));
+  for (uint64_t i = 0; i < 300; i++) {
+    uint32_t triggers = 0;
+    if (i == 50) triggers = BlackBox::THRUST_SATURATION;
+    if (i == 52) triggers = BlackBox::NON_FINITE;
+    if (i == 200) triggers = BlackBox::MANUAL;
+    black_box.record(tick(i, triggers));
+    // Leave time to the writer, the test does not exercise the busy rings
+    if (i == 60) {
+      ASSERT_TRUE(waitWritten(black_box, 1));
+      EXPECT_NE(black_box.report().find("last_triggers: [thrust_saturation,non_finite]"),
+                std::string::npos);
+    }
+  }
+  ASSERT_TRUE(waitWritten(black_box, 2));
+
+  const std::string report = black_box.report();
+  EXPECT_NE(report.find("captures: 2"), std::string::npos) << report;
+  EXPECT_NE(report.find("last_triggers: [manual]"), std::string::npos) << report;
+  EXPECT_EQ(readTicks(report).front(), 190u);
+}
+
+TEST(BlackBox, StopFlushesFrozenWindow) {
+  BlackBox black_box;
+  Black_box_config config = smallWindows("black_box_stop");
+  black_box.configure(config);
+  for (uint64_t i = 0; i < 56; i++) {
+    black_box.record(tick(i, i == 50 ? BlackBox::STALE_STATE : 0u));
+  }
+  config.enable = false;
+  black_box.configure(config);
+  EXPECT_FALSE(black_box.enabled());
+  EXPECT_EQ(black_box.written(), 1u);
+  EXPECT_EQ(readTicks(black_box.report()).size(), 16u);
+}
+
+TEST(BlackBox, RingsFitTheirMemoryBytes) {
+  // The plugin sizes its arena with memoryBytes(), the default windows must not spill over
+  Black_box_config config;
+  config.enable    = true;
+  config.directory = std::string(::testing::TempDir()) + "fit";
+  Arena arena;
+  std::string error;
+  ASSERT_TRUE(arena.reserve(BlackBox::memoryBytes(config), false, error)) << error;
+  {
+    BlackBox black_box(&arena);
+    black_box.configure(config);
+    EXPECT_TRUE(black_box.enabled());
+    EXPECT_EQ(arena.stats().heap_fallbacks, 0u) << arena.report();
+  }
+  config.enable = false;
+  EXPECT_EQ(BlackBox::memoryBytes(config), 0u);
+}
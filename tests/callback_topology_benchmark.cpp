@@ -0,0 +1,158 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "as2_core/node.hpp"
+#include "controller_plugin_differential_flatness/DF_controller_plugin.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+/* Control period jitter of the plugin while the state ingestion load rises, with every
+ * callback in the node default callback group versus the plugin callback topology. Both
+ * cases are spun by the same multi-threaded executor. */
+
+using namespace std::chrono_literals;
+using controller_plugin_differential_flatness::Plugin;
+
+static const std::vector<rclcpp::Parameter> parameters = {
+    rclcpp::Parameter("mass", 0.82),
+    rclcpp::Parameter("trajectory_control.antiwindup_cte", 1.0),
+    rclcpp::Parameter("trajectory_control.alpha", 0.1),
+    rclcpp::Parameter("trajectory_control.kp.x", 6.0),
+    rclcpp::Parameter("trajectory_control.kp.y", 6.0),
+    rclcpp::Parameter("trajectory_control.kp.z", 6.0),
+    rclcpp::Parameter("trajectory_control.ki.x", 0.005),
+    rclcpp::Parameter("trajectory_control.ki.y", 0.005),
+    rclcpp::Parameter("trajectory_control.ki.z", 0.065),
+    rclcpp::Parameter("trajectory_control.kd.x", 1.5),
+    rclcpp::Parameter("trajectory_control.kd.y", 1.5),
+    rclcpp::Parameter("trajectory_control.kd.z", 3.0),
+    rclcpp::Parameter("trajectory_control.roll_control.kp", 5.5),
+    rclcpp::Parameter("trajectory_control.pitch_control.kp", 5.5),
+    rclcpp::Parameter("trajectory_control.yaw_control.kp", 2.0),
+};
+
+constexpr auto control_period = 4ms;  // 250 Hz
+constexpr auto run_time       = 3s;
+constexpr int n_publishers    = 4;
+
+static void runScenario(benchmark::State &state, const bool use_topology) {
+  if (!rclcpp::ok()) rclcpp::init(0, nullptr);
+  const double ingestion_rate = static_cast<double>(state.range(0));  // per publisher [Hz]
+
+  rclcpp::NodeOptions options;
+  options.parameter_overrides(parameters);
+  options.automatically_declare_parameters_from_overrides(true);
+  auto node      = std::make_shared<as2::Node>("df_topology_benchmark", options);
+  auto load_node = std::make_shared<rclcpp::Node>("df_topology_benchmark_load");
+
+  Plugin plugin;
+  plugin.initialize(node.get());
+  std::vector<std::string> names;
+  for (const auto &param : parameters) names.push_back(param.get_name());
+  plugin.updateParams(names);
+  as2_msgs::msg::ControlMode mode_in, mode_out;
+  mode_in.control_mode  = as2_msgs::msg::ControlMode::HOVER;
+  mode_out.control_mode = as2_msgs::msg::ControlMode::ACRO;
+  plugin.setMode(mode_in, mode_out);
+
+  const auto &topology = plugin.getCallbackTopology();
+  rclcpp::SubscriptionOptions ingestion_options;
+  if (use_topology) ingestion_options.callback_group = topology.ingestion;
+
+  const std::string frame_id = plugin.getDesiredPoseFrameId();
+  std::vector<rclcpp::Subscription<geometry_msgs::msg::TwistStamped>::SharedPtr> subs;
+  std::vector<rclcpp::Publisher<geometry_msgs::msg::TwistStamped>::SharedPtr> pubs;
+  std::vector<rclcpp::TimerBase::SharedPtr> load_timers;
+  for (int i = 0; i < n_publishers; i++) {
+    const std::string topic = "df_topology_benchmark/state_" + std::to_string(i);
+    subs.push_back(node->create_subscription<geometry_msgs::msg::TwistStamped>(
+        topic, rclcpp::SensorDataQoS(),
+        [&plugin, &frame_id](const geometry_msgs::msg::TwistStamped::SharedPtr msg) {
+          geometry_msgs::msg::PoseStamped pose;
+          pose.header.frame_id = frame_id;
+          pose.pose.position.z = 1.0;
+          msg->header.frame_id = frame_id;
+          plugin.updateState(pose, *msg);
+        },
+        ingestion_options));
+
+    auto pub = load_node->create_publisher<geometry_msgs::msg::TwistStamped>(
+        topic, rclcpp::SensorDataQoS());
+    pubs.push_back(pub);
+    load_timers.push_back(load_node->create_wall_timer(
+        std::chrono::duration<double>(1.0 / ingestion_rate),
+        [pub]() { pub->publish(geometry_msgs::msg::TwistStamped()); }));
+  }
+
+  std::vector<double> periods_us;
+  periods_us.reserve(2 * run_time / control_period);
+  auto last_tick = std::chrono::steady_clock::time_point();
+  geometry_msgs::msg::PoseStamped pose;
+  geometry_msgs::msg::TwistStamped twist;
+  as2_msgs::msg::Thrust thrust;
+  auto control_timer = node->create_wall_timer(
+      control_period,
+      [&]() {
+        const auto now = std::chrono::steady_clock::now();
+        if (last_tick.time_since_epoch().count() != 0) {
+          periods_us.push_back(std::chrono::duration<double, std::micro>(now - last_tick).count());
+        }
+        last_tick = now;
+        plugin.computeOutput(std::chrono::duration<double>(control_period).count(), pose, twist,
+                             thrust);
+      },
+      use_topology ? topology.control : nullptr);
+
+  rclcpp::executors::MultiThreadedExecutor executor(rclcpp::ExecutorOptions(), 4);
+  executor.add_node(node);
+  rclcpp::executors::SingleThreadedExecutor load_executor;
+  load_executor.add_node(load_node);
+
+  for (auto _ : state) {
+    std::thread load_thread([&load_executor]() { load_executor.spin(); });
+    std::thread control_thread([&executor]() { executor.spin(); });
+    std::this_thread::sleep_for(run_time);
+    executor.cancel();
+    load_executor.cancel();
+    control_thread.join();
+    load_thread.join();
+  }
+
+  // Deviation of the achieved period from the nominal one
+  const double nominal = std::chrono::duration<double, std::micro>(control_period).count();
+  std::vector<double> deviation;
+  for (double period : periods_us) deviation.push_back(std::abs(period - nominal));
+  std::sort(deviation.begin(), deviation.end());
+  if (!deviation.empty()) {
+    double sum = 0.0;
+    for (double d : deviation) sum += d;
+    const size_t p99                 = static_cast<size_t>(0.99 * (deviation.size() - 1));
+    state.counters["jitter_mean_us"] = sum / deviation.size();
+    state.counters["jitter_p99_us"]  = deviation[p99];
+    state.counters["jitter_max_us"]  = deviation.back();
+  }
+  state.counters["ticks"]          = periods_us.size();
+  state.counters["ingestion_rate"] = ingestion_rate * n_publishers;
+}
+
+static void BM_JITTER_DEFAULT_GROUP(benchmark::State &state) { runScenario(state, false); }
+static void BM_JITTER_CALLBACK_TOPOLOGY(benchmark::State &state) { runScenario(state, true); }
+
+BENCHMARK(BM_JITTER_DEFAULT_GROUP)
+    ->ArgName("rate_hz")
+    ->RangeMultiplier(4)
+    ->Range(50, 12800)
+    ->Iterations(1)
+    ->UseRealTime();
+BENCHMARK(BM_JITTER_CALLBACK_TOPOLOGY)
+    ->ArgName("rate_hz")
+    ->RangeMultiplier(4)
+    ->Range(50, 12800)
+    ->Iterations(1)
+    ->UseRealTime();
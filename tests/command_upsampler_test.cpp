@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+#include "controller_plugin_differential_flatness/DF_command_upsampler.hpp"
+
+using controller_plugin_differential_flatness::CommandUpsampler;
+using controller_plugin_differential_flatness::Upsampling_config;
+
+static CommandUpsampler upsampler(const int _order) {
+  Upsampling_config config;
+  config.enable       = true;
+  config.compute_rate = 250.0;
+  config.order        = _order;
+  CommandUpsampler upsampler;
+  upsampler.configure(config);
+  return upsampler;
+}
+
+/* Force along a polynomial of the time, degree _degree */
+static Eigen::Vector3d force(const double _t, const int _degree) {
+  const double value = _degree == 1 ? 2.0 * _t : 3.0 * _t * _t - _t;
+  return Eigen::Vector3d(value, -value, 9.81 + value);
+}
+
+TEST(CommandUpsampler, FullLawAtComputeRate) {
+  CommandUpsampler up = upsampler(1);
+  double compute_dt   = 0.0;
+  int full            = 0;
+  for (int i = 0; i < 1000; i++) {
+    if (up.step(0.001, compute_dt)) {
+      full++;
+      up.push(Eigen::Vector3d::Zero());
+      // The first tick computes with its own dt, the others with the time since the last one
+      EXPECT_NEAR(compute_dt, i == 0 ? 0.001 : 0.004, 1e-9) << i;
+    }
+  }
+  EXPECT_EQ(full, 250);
+
+  // A mode change forces a full tick right away
+  up.reset();
+  EXPECT_TRUE(up.step(0.001, compute_dt));
+}
+
+TEST(CommandUpsampler, ExtrapolationIsExactForItsOrder) {
+  for (int order = 1; order <= 2; order++) {
+    CommandUpsampler up = upsampler(order);
+    double t            = 0.0;
+    double compute_dt   = 0.0;
+    int pushed          = 0;
+    for (int i = 0; i < 200; i++) {
+      t += 0.001;
+      if (up.step(0.001, compute_dt)) {
+        up.push(force(t, order));
+        pushed++;
+      } else if (pushed > order) {
+        // Once order + 1 full ticks are known
+        EXPECT_LT((up.extrapolate() - force(t, order)).norm(), 1e-9) << order << " " << i;
+      }
+    }
+  }
+}
+
+TEST(CommandUpsampler, HoldReportsTheTrackingCost) {
+  CommandUpsampler up = upsampler(0);
+  double t            = 0.0;
+  double compute_dt   = 0.0;
+  for (int i = 0; i < 100; i++) {
+    t += 0.001;
+    if (up.step(0.001, compute_dt)) {
+      up.push(force(t, 1));
+    } else {
+      const double last_full = up.stats().predictions * 0.004 + 0.001;
+      EXPECT_TRUE(up.extrapolate().isApprox(force(last_full, 1), 1e-12));
+    }
+  }
+  // A zero order hold lags a ramp of 2 N/s by one compute period on x, y and z
+  const double lag = 2.0 * 0.004 * std::sqrt(3.0);
+  EXPECT_NEAR(up.stats().force_error_max, lag, 1e-9);
+  EXPECT_EQ(up.stats().predictions, 24u);
+}
@@ -0,0 +1,359 @@
+#include <benchmark/benchmark.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "as2_core/node.hpp"
+#include "controller_plugin_differential_flatness/DF_controller_plugin.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+/* Closed loop software in the loop of the controller plugin with a simple multirotor model.
+ * It is used both as the control path benchmark and as the training workload of the profile
+ * guided build (DF_PGO=GENERATE), so it covers hover and aggressive trajectories. */
+
+using controller_plugin_differential_flatness::Plugin;
+
+static const std::vector<rclcpp::Parameter> parameters = {
+    rclcpp::Parameter("mass", 0.82),
+    rclcpp::Parameter("trajectory_control.antiwindup_cte", 1.0),
+    rclcpp::Parameter("trajectory_control.alpha", 0.1),
+    rclcpp::Parameter("trajectory_control.kp.x", 6.0),
+    rclcpp::Parameter("trajectory_control.kp.y", 6.0),
+    rclcpp::Parameter("trajectory_control.kp.z", 6.0),
+    rclcpp::Parameter("trajectory_control.ki.x", 0.005),
+    rclcpp::Parameter("trajectory_control.ki.y", 0.005),
+    rclcpp::Parameter("trajectory_control.ki.z", 0.065),
+    rclcpp::Parameter("trajectory_control.kd.x", 1.5),
+    rclcpp::Parameter("trajectory_control.kd.y", 1.5),
+    rclcpp::Parameter("trajectory_control.kd.z", 3.0),
+    rclcpp::Parameter("trajectory_control.roll_control.kp", 5.5),
+    rclcpp::Parameter("trajectory_control.pitch_control.kp", 5.5),
+    rclcpp::Parameter("trajectory_control.yaw_control.kp", 2.0),
+};
+
+enum class Trajectory { HOVER, CIRCLE, FIGURE_EIGHT };
+
+class ClosedLoopSil {
+public:
+  explicit ClosedLoopSil(Trajectory _trajectory,
+                         const std::vector<rclcpp::Parameter> &_extra_parameters = {})
+      : trajectory_(_trajectory) {
+    if (!rclcpp::ok()) rclcpp::init(0, nullptr);
+    std::vector<rclcpp::Parameter> all_parameters = parameters;
+    all_parameters.insert(all_parameters.end(), _extra_parameters.begin(),
+                          _extra_parameters.end());
+    rclcpp::NodeOptions options;
+    options.parameter_overrides(all_parameters);
+    options.automatically_declare_parameters_from_overrides(true);
+    node_ = std::make_shared<as2::Node>("df_benchmark", options);
+
+    plugin_.initialize(node_.get());
+    std::vector<std::string> names;
+    for (const auto &param : all_parameters) names.push_back(param.get_name());
+    plugin_.updateParams(names);
+
+    as2_msgs::msg::ControlMode mode_in, mode_out;
+    mode_in.control_mode     = as2_msgs::msg::ControlMode::TRAJECTORY;
+    mode_in.yaw_mode         = as2_msgs::msg::ControlMode::YAW_ANGLE;
+    mode_in.reference_frame  = as2_msgs::msg::ControlMode::LOCAL_ENU_FRAME;
+    mode_out.control_mode    = as2_msgs::msg::ControlMode::ACRO;
+    mode_out.reference_frame = as2_msgs::msg::ControlMode::BODY_FLU_FRAME;
+    plugin_.setMode(mode_in, mode_out);
+
+    pose_.header.frame_id  = plugin_.getDesiredPoseFrameId();
+    twist_.header.frame_id = plugin_.getDesiredTwistFrameId();
+  }
+
+  /** One control period: state and reference ingestion, control and vehicle model */
+  void tick() {
+    pose_.pose.position.x    = position_.x();
+    pose_.pose.position.y    = position_.y();
+    pose_.pose.position.z    = position_.z();
+    pose_.pose.orientation.x = attitude_.x();
+    pose_.pose.orientation.y = attitude_.y();
+    pose_.pose.orientation.z = attitude_.z();
+    pose_.pose.orientation.w = attitude_.w();
+    twist_.twist.linear.x    = velocity_.x();
+    twist_.twist.linear.y    = velocity_.y();
+    twist_.twist.linear.z    = velocity_.z();
+    plugin_.updateState(pose_, twist_);
+
+    reference(time_, ref_);
+    plugin_.updateReference(ref_);
+
+    plugin_.computeOutput(dt_, out_pose_, out_twist_, out_thrust_);
+    step(Eigen::Vector3d(out_twist_.twist.angular.x, out_twist_.twist.angular.y,
+                         out_twist_.twist.angular.z),
+         out_thrust_.thrust);
+    time_ += dt_;
+  }
+
+private:
+  void reference(double _t, as2_msgs::msg::TrajectoryPoint &_ref) const {
+    const double w = 2.0;
+    const double r = 2.0;
+    switch (trajectory_) {
+      case Trajectory::HOVER:
+        _ref.position.x = 0.0;
+        _ref.position.y = 0.0;
+        _ref.position.z = 1.0;
+        _ref.yaw_angle  = 0.0;
+        break;
+      case Trajectory::CIRCLE:
+        _ref.position.x     = r * std::cos(w * _t);
+        _ref.position.y     = r * std::sin(w * _t);
+        _ref.position.z     = 1.5;
+        _ref.twist.x        = -r * w * std::sin(w * _t);
+        _ref.twist.y        = r * w * std::cos(w * _t);
+        _ref.acceleration.x = -r * w * w * std::cos(w * _t);
+        _ref.acceleration.y = -r * w * w * std::sin(w * _t);
+        _ref.yaw_angle      = std::atan2(_ref.twist.y, _ref.twist.x);
+        break;
+      case Trajectory::FIGURE_EIGHT:
+        _ref.position.x     = r * std::sin(w * _t);
+        _ref.position.y     = r * std::sin(w * _t) * std::cos(w * _t);
+        _ref.position.z     = 1.5 + 0.5 * std::sin(0.5 * w * _t);
+        _ref.twist.x        = r * w * std::cos(w * _t);
+        _ref.twist.y        = r * w * std::cos(2 * w * _t);
+        _ref.twist.z        = 0.25 * w * std::cos(0.5 * w * _t);
+        _ref.acceleration.x = -r * w * w * std::sin(w * _t);
+        _ref.acceleration.y = -2 * r * w * w * std::sin(2 * w * _t);
+        _ref.acceleration.z = -0.125 * w * w * std::sin(0.5 * w * _t);
+        _ref.yaw_angle      = 0.5 * std::sin(w * _t);
+        break;
+    }
+  }
+
+  void step(const Eigen::Vector3d &_rates, double _thrust) {
+    const Eigen::Vector3d half_angle = 0.5 * _rates * dt_;
+    attitude_ = (attitude_ * Eigen::Quaterniond(1.0, half_angle.x(), half_angle.y(),
+                                                half_angle.z()))
+                    .normalized();
+    const Eigen::Vector3d accel =
+        attitude_ * Eigen::Vector3d(0, 0, _thrust / mass_) + Eigen::Vector3d(0, 0, -9.81);
+    velocity_ += accel * dt_;
+    position_ += velocity_ * dt_;
+  }
+
+  const Trajectory trajectory_;
+  const double dt_   = 0.01;
+  const double mass_ = 0.82;
+  double time_       = 0.0;
+
+  std::shared_ptr<as2::Node> node_;
+  Plugin plugin_;
+
+  Eigen::Vector3d position_    = Eigen::Vector3d(0, 0, 1);
+  Eigen::Vector3d velocity_    = Eigen::Vector3d::Zero();
+  Eigen::Quaterniond attitude_ = Eigen::Quaterniond::Identity();
+
+  geometry_msgs::msg::PoseStamped pose_;
+  geometry_msgs::msg::TwistStamped twist_;
+  as2_msgs::msg::TrajectoryPoint ref_;
+  geometry_msgs::msg::PoseStamped out_pose_;
+  geometry_msgs::msg::TwistStamped out_twist_;
+  as2_msgs::msg::Thrust out_thrust_;
+};
+
+static void BM_CLOSED_LOOP_TICK(benchmark::State &state) {
+  ClosedLoopSil sil(static_cast<Trajectory>(state.range(0)));
+  for (auto _ : state) {
+    sil.tick();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CLOSED_LOOP_TICK)
+    ->ArgName("trajectory")
+    ->Arg(static_cast<int>(Trajectory::HOVER))
+    ->Arg(static_cast<int>(Trajectory::CIRCLE))
+    ->Arg(static_cast<int>(Trajectory::FIGURE_EIGHT))
+    ->Repetitions(10)
+    ->ReportAggregatesOnly(true);
+
+// Same loop with a shadow gain profile evaluated on another core. The active tick only pays
+// for the queue push, so it should match BM_CLOSED_LOOP_TICK
+static void BM_CLOSED_LOOP_TICK_SHADOW(benchmark::State &state) {
+  ClosedLoopSil sil(static_cast<Trajectory>(state.range(0)),
+                    {rclcpp::Parameter("shadow.enable", true), rclcpp::Parameter("shadow.cpu", 1),
+                     rclcpp::Parameter("shadow.kp_scale", std::vector<double>{1.2, 1.2, 1.0})});
+  for (auto _ : state) {
+    sil.tick();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CLOSED_LOOP_TICK_SHADOW)
+    ->ArgName("trajectory")
+    ->Arg(static_cast<int>(Trajectory::HOVER))
+    ->Arg(static_cast<int>(Trajectory::CIRCLE))
+    ->Arg(static_cast<int>(Trajectory::FIGURE_EIGHT))
+    ->Repetitions(10)
+    ->ReportAggregatesOnly(true);
+
+// Cold start: every sample is a fresh process, so the first ticks see the page faults, lazy
+// symbol binding and cold caches of a real launch. The child runs the first kColdStartTicks
+// ticks and writes their latencies to a pipe. warm_up.ticks = 0 is the "before" case
+static constexpr int kColdStartTicks       = 20;
+static constexpr const char *kColdStartEnv = "DF_BENCHMARK_COLD_START";
+
+static void coldStartChild(const int _warm_up_ticks, const int _fd) {
+  ClosedLoopSil sil(Trajectory::CIRCLE, {rclcpp::Parameter("warm_up.ticks", _warm_up_ticks)});
+  std::array<double, kColdStartTicks> latencies;
+  for (double &latency : latencies) {
+    const auto start = std::chrono::steady_clock::now();
+    sil.tick();
+    latency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start)
+                  .count();
+  }
+  const ssize_t written = write(_fd, latencies.data(), sizeof(latencies));
+  rclcpp::shutdown();
+  _exit(written == sizeof(latencies) ? 0 : 1);
+}
+
+// Runs before benchmark_main when this executable is re-launched as a cold start child
+[[maybe_unused]] static const bool cold_start_child = [] {
+  const char *env = std::getenv(kColdStartEnv);
+  int warm_up_ticks, fd;
+  if (env && std::sscanf(env, "%d,%d", &warm_up_ticks, &fd) == 2) {
+    coldStartChild(warm_up_ticks, fd);
+  }
+  return false;
+}();
+
+static void BM_COLD_START_TICKS(benchmark::State &state) {
+  const int warm_up_ticks = static_cast<int>(state.range(0));
+  std::array<double, kColdStartTicks> sum{};
+  std::array<double, kColdStartTicks> max{};
+  int samples = 0;
+  for (auto _ : state) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      state.SkipWithError("pipe failed");
+      break;
+    }
+    const pid_t pid = fork();
+    if (pid == 0) {
+      close(fds[0]);
+      const std::string env = std::to_string(warm_up_ticks) + "," + std::to_string(fds[1]);
+      setenv(kColdStartEnv, env.c_str(), 1);
+      execl("/proc/self/exe", "/proc/self/exe", nullptr);
+      _exit(127);
+    }
+    close(fds[1]);
+    std::array<double, kColdStartTicks> latencies;
+    const ssize_t n = read(fds[0], latencies.data(), sizeof(latencies));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (n != sizeof(latencies) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      state.SkipWithError("cold start child failed");
+      break;
+    }
+    for (int i = 0; i < kColdStartTicks; i++) {
+      sum[i] += latencies[i];
+      max[i] = std::max(max[i], latencies[i]);
+    }
+    samples++;
+  }
+  if (samples == 0) return;
+
+  state.counters["tick_0_us"] = sum[0] / samples;
+  state.counters["tick_1_us"] = sum[1] / samples;
+  state.counters["tick_2_us"] = sum[2] / samples;
+  state.counters["max_us"]    = *std::max_element(max.begin(), max.end());
+  double steady               = 0.0;
+  for (int i = kColdStartTicks / 2; i < kColdStartTicks; i++) steady += sum[i];
+  state.counters["steady_us"] = steady / samples / (kColdStartTicks - kColdStartTicks / 2);
+}
+BENCHMARK(BM_COLD_START_TICKS)
+    ->ArgName("warm_up_ticks")
+    ->Arg(0)
+    ->Arg(200)
+    ->Iterations(20)
+    ->Unit(benchmark::kMillisecond);
+
+// Time to first command of a fresh instance, as stamped by its boot timeline. Without the
+// parameter cache the host must run updateParams() before setMode() succeeds, with it the
+// parameters are applied by initialize() and updateParams() runs after the first command
+static void BM_TIME_TO_FIRST_COMMAND(benchmark::State &state) {
+  using controller_plugin_differential_flatness::BootTimeline;
+  const bool use_cache         = state.range(0) != 0;
+  const std::string cache_path = "/tmp/df_benchmark_parameter_cache.bin";
+  std::remove(cache_path.c_str());
+  if (!rclcpp::ok()) rclcpp::init(0, nullptr);
+
+  std::vector<rclcpp::Parameter> all_parameters = parameters;
+  all_parameters.push_back(rclcpp::Parameter("parameter_cache.file", use_cache ? cache_path : ""));
+  all_parameters.push_back(rclcpp::Parameter("warm_up.ticks", 0));
+  std::vector<std::string> names;
+  for (const auto &param : all_parameters) names.push_back(param.get_name());
+  rclcpp::NodeOptions options;
+  options.parameter_overrides(all_parameters);
+  options.automatically_declare_parameters_from_overrides(true);
+
+  as2_msgs::msg::ControlMode mode_in, mode_out;
+  mode_in.control_mode     = as2_msgs::msg::ControlMode::HOVER;
+  mode_out.control_mode    = as2_msgs::msg::ControlMode::ACRO;
+  mode_out.reference_frame = as2_msgs::msg::ControlMode::BODY_FLU_FRAME;
+  geometry_msgs::msg::PoseStamped pose;
+  geometry_msgs::msg::TwistStamped twist;
+  as2_msgs::msg::Thrust thrust;
+  pose.pose.position.z = 1.0;
+
+  double first_command_ms = 0.0;
+  double initialize_ms    = 0.0;
+  int samples             = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto node = std::make_shared<as2::Node>("df_benchmark_boot", options);
+    state.ResumeTiming();
+
+    auto plugin = std::make_unique<Plugin>();
+    plugin->initialize(node.get());
+    if (!plugin->setMode(mode_in, mode_out)) {
+      plugin->updateParams(names);
+      plugin->setMode(mode_in, mode_out);
+    }
+    plugin->updateState(pose, twist);
+    const bool ok = plugin->computeOutput(0.01, pose, twist, thrust);
+    // Saves the cache on the first iteration, the later instances boot from it
+    plugin->updateParams(names);
+
+    const BootTimeline &boot = plugin->getBootTimeline();
+    if (!ok || !boot.reached(BootTimeline::FIRST_COMMAND)) {
+      state.SkipWithError("no command");
+      break;
+    }
+    // The first cached iteration still boots without the file, it only writes it
+    if (use_cache == boot.reached(BootTimeline::PARAMETER_CACHE_LOADED)) {
+      first_command_ms += boot.sinceConstructionNs(BootTimeline::FIRST_COMMAND) * 1e-6;
+      initialize_ms += (boot.sinceConstructionNs(BootTimeline::INITIALIZE_END) -
+                        boot.sinceConstructionNs(BootTimeline::INITIALIZE_BEGIN)) *
+                       1e-6;
+      samples++;
+    }
+
+    state.PauseTiming();
+    plugin.reset();
+    node.reset();
+    state.ResumeTiming();
+  }
+  std::remove(cache_path.c_str());
+  if (samples == 0) return;
+  state.counters["first_command_ms"] = first_command_ms / samples;
+  state.counters["initialize_ms"]    = initialize_ms / samples;
+}
+BENCHMARK(BM_TIME_TO_FIRST_COMMAND)
+    ->ArgName("parameter_cache")
+    ->Arg(0)
+    ->Arg(1)
+    ->Iterations(50)
+    ->Unit(benchmark::kMillisecond);
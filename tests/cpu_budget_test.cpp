@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "controller_plugin_differential_flatness/DF_cpu_budget.hpp"
+
+using controller_plugin_differential_flatness::CpuBudget;
+
+/* Burn _ns of CPU time of the calling thread */
+static void spin(const uint64_t _ns) {
+  const uint64_t start = CpuBudget::threadCpuNs();
+  while (CpuBudget::threadCpuNs() - start < _ns) {
+  }
+}
+
+TEST(CpuBudget, ScopeChargesItsCallback) {
+  CpuBudget budget;
+  for (int i = 0; i < 3; i++) {
+    CpuBudget::Scope scope(budget, CpuBudget::COMPUTE_OUTPUT);
+    spin(1000000);
+  }
+  const CpuBudget::Stats &stats = budget.stats(CpuBudget::COMPUTE_OUTPUT);
+  EXPECT_EQ(stats.calls.load(), 3u);
+  EXPECT_GE(stats.total_ns.load(), 3000000u);
+  EXPECT_GE(stats.max_ns.load(), 1000000u);
+  EXPECT_LE(stats.max_ns.load(), stats.total_ns.load());
+  EXPECT_EQ(budget.stats(CpuBudget::UPDATE_STATE).calls.load(), 0u);
+  EXPECT_EQ(budget.totalNs(), stats.total_ns.load());
+  EXPECT_NEAR(budget.cpuNsPerTick(), stats.total_ns.load() / 3.0, 1.0);
+}
+
+TEST(CpuBudget, NestedScopeIsCarvedOut) {
+  CpuBudget budget;
+  {
+    CpuBudget::Scope outer(budget, CpuBudget::OWN_INITIALIZE);
+    spin(2000000);
+    {
+      CpuBudget::Scope inner(budget, CpuBudget::WARM_UP);
+      spin(20000000);
+    }
+  }
+  const uint64_t outer = budget.stats(CpuBudget::OWN_INITIALIZE).total_ns.load();
+  const uint64_t inner = budget.stats(CpuBudget::WARM_UP).total_ns.load();
+  EXPECT_GE(inner, 20000000u);
+  EXPECT_GE(outer, 2000000u);
+  // Had the inner time been charged to the outer scope too it would exceed 22 ms
+  EXPECT_LT(outer, 12000000u);
+  EXPECT_EQ(budget.totalNs(), outer + inner);
+}
+
+TEST(CpuBudget, BlockedTimeIsNotCharged) {
+  CpuBudget budget;
+  {
+    CpuBudget::Scope scope(budget, CpuBudget::SERVICES);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  EXPECT_EQ(budget.stats(CpuBudget::SERVICES).calls.load(), 1u);
+  EXPECT_LT(budget.stats(CpuBudget::SERVICES).total_ns.load(), 25000000u);
+}
+
+TEST(CpuBudget, ScopesOfOtherThreadsAreCharged) {
+  CpuBudget budget;
+  std::thread worker([&budget]() {
+    CpuBudget::Scope scope(budget, CpuBudget::COMPUTE_OUTPUT);
+    spin(1000000);
+  });
+  worker.join();
+  EXPECT_EQ(budget.stats(CpuBudget::COMPUTE_OUTPUT).calls.load(), 1u);
+  EXPECT_GE(budget.stats(CpuBudget::COMPUTE_OUTPUT).total_ns.load(), 1000000u);
+
+  const std::string report = budget.report();
+  EXPECT_NE(report.find("compute_output: {calls: 1"), std::string::npos);
+  EXPECT_NE(report.find("warm_up: {calls: 0"), std::string::npos);
+}
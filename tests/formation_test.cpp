@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+
+#include "controller_plugin_differential_flatness/DF_formation.hpp"
+
+using controller_plugin_differential_flatness::FormationReference;
+using controller_plugin_differential_flatness::UAV_reference;
+
+static constexpr int64_t kPeriodNs = 20000000;  // 50 Hz broadcast
+
+/* Formation origin turning on a circle of radius r at w rad/s, heading along the path */
+static UAV_reference circle(const double _t, const double _r = 3.0, const double _w = 0.5) {
+  UAV_reference ref;
+  ref.position     = Eigen::Vector3d(_r * std::cos(_w * _t), _r * std::sin(_w * _t), 2.0);
+  ref.velocity     = Eigen::Vector3d(-_r * _w * std::sin(_w * _t), _r * _w * std::cos(_w * _t), 0);
+  ref.acceleration = -_w * _w * Eigen::Vector3d(ref.position.x(), ref.position.y(), 0.0);
+  ref.yaw          = std::remainder(_w * _t + M_PI_2, 2.0 * M_PI);
+  return ref;
+}
+
+TEST(Formation, OffsetTurnsWithTheFormationYaw) {
+  FormationReference formation;
+  formation.config.offset     = Eigen::Vector3d(-1.0, 2.0, 0.5);
+  formation.config.yaw_offset = 0.1;
+
+  UAV_reference origin;
+  origin.position = Eigen::Vector3d(10.0, 0.0, 1.0);
+  origin.yaw      = M_PI_2;
+  formation.update(origin, kPeriodNs);
+  const UAV_reference vehicle = formation.vehicleReference(kPeriodNs);
+  // Formation x is ENU y, formation y is ENU -x
+  EXPECT_NEAR(vehicle.position.x(), 10.0 - 2.0, 1e-12);
+  EXPECT_NEAR(vehicle.position.y(), -1.0, 1e-12);
+  EXPECT_NEAR(vehicle.position.z(), 1.5, 1e-12);
+  EXPECT_NEAR(vehicle.yaw, M_PI_2 + 0.1, 1e-12);
+  EXPECT_TRUE(vehicle.velocity.isZero());
+
+  formation.config.rotate = false;
+  EXPECT_NEAR(formation.vehicleReference(kPeriodNs).position.x(), 9.0, 1e-12);
+  EXPECT_NEAR(formation.vehicleReference(kPeriodNs).position.y(), 2.0, 1e-12);
+}
+
+TEST(Formation, VehicleReferenceIsConsistentWhileTurning) {
+  // The vehicle velocity and acceleration must be the derivatives of its own position, which
+  // only holds with the rotation terms of the offset
+  FormationReference formation;
+  formation.config.offset = Eigen::Vector3d(0.0, 1.5, 0.0);
+  for (int k = 1; k <= 200; k++) {
+    formation.update(circle(k * kPeriodNs * 1e-9), k * kPeriodNs);
+  }
+  const int64_t now       = 200 * kPeriodNs;
+  const int64_t h         = 1000000;  // 1 ms, within max_extrapolation
+  const UAV_reference v0  = formation.vehicleReference(now);
+  const UAV_reference v1  = formation.vehicleReference(now + h);
+  const UAV_reference v2  = formation.vehicleReference(now + 2 * h);
+  const Eigen::Vector3d d = (v1.position - v0.position) / (h * 1e-9);
+  EXPECT_NEAR((d - v0.velocity).norm(), 0.0, 5e-3 * v0.velocity.norm());
+  const Eigen::Vector3d a = (v2.position - 2 * v1.position + v0.position) / std::pow(h * 1e-9, 2);
+  EXPECT_NEAR((a - v0.acceleration).norm(), 0.0, 0.05 * v0.acceleration.norm());
+
+  // The vehicle flies a circle of radius 3 - 1.5 inside the formation one
+  EXPECT_NEAR(Eigen::Vector2d(v0.position.x(), v0.position.y()).norm(), 1.5, 1e-6);
+  EXPECT_NEAR(v0.velocity.norm(), 1.5 * 0.5, 1e-3);
+}
+
+TEST(Formation, ExtrapolationIsBounded) {
+  FormationReference formation;
+  formation.config.max_extrapolation = 0.1;
+  UAV_reference origin;
+  origin.velocity = Eigen::Vector3d(1.0, 0.0, 0.0);
+  formation.update(origin, kPeriodNs);
+
+  EXPECT_NEAR(formation.vehicleReference(kPeriodNs + 50000000).position.x(), 0.05, 1e-12);
+  // A stalled broadcast holds the last point propagated max_extrapolation ahead
+  EXPECT_NEAR(formation.vehicleReference(kPeriodNs + 5000000000).position.x(), 0.1, 1e-12);
+  // Ticks before the sample stamp do not go back in time
+  EXPECT_NEAR(formation.vehicleReference(0).position.x(), 0.0, 1e-12);
+
+  formation.config.max_extrapolation = 0.0;
+  EXPECT_NEAR(formation.vehicleReference(kPeriodNs + 50000000).position.x(), 0.0, 1e-12);
+}
+
+TEST(Formation, DropsStaleSamplesAndWrapsTheYawRate) {
+  FormationReference formation;
+  UAV_reference origin;
+  origin.yaw = M_PI - 0.01;
+  formation.update(origin, 2 * kPeriodNs);
+  origin.yaw = -M_PI + 0.01;  // crossed +-pi turning left at 1 rad/s
+  formation.update(origin, 2 * kPeriodNs);
+  formation.update(origin, kPeriodNs);
+  EXPECT_NE(formation.report().find("dropped: 2"), std::string::npos) << formation.report();
+
+  // 0.02 rad in one period past the first sample
+  formation.update(origin, 3 * kPeriodNs);
+  formation.config.offset = Eigen::Vector3d(1.0, 0.0, 0.0);
+  const UAV_reference vehicle = formation.vehicleReference(3 * kPeriodNs);
+  // The offset points to -x, turning at +1 rad/s the vehicle moves towards -y
+  EXPECT_NEAR(vehicle.velocity.y(), -1.0, 1e-3);
+
+  formation.reset();
+  EXPECT_FALSE(formation.received());
+}
@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include "controller_plugin_differential_flatness/DF_controller_plugin.hpp"
+
+// Count every heap allocation done by this process
+static std::atomic<size_t> allocations{0};
+static std::atomic<size_t> allocated_bytes{0};
+
+void *operator new(std::size_t size) {
+  allocations++;
+  allocated_bytes += size;
+  if (void *ptr = std::malloc(size)) return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+using controller_plugin_differential_flatness::Plugin;
+
+TEST(MemoryFootprint, BytesPerInstance) {
+  std::cout << "sizeof(Plugin): " << sizeof(Plugin) << " bytes" << std::endl;
+  RecordProperty("bytes_per_instance", static_cast<int>(sizeof(Plugin)));
+}
+
+TEST(MemoryFootprint, HeapAllocationsPerConstruction) {
+  alignas(Plugin) static unsigned char storage[sizeof(Plugin)];
+
+  const size_t allocations_before = allocations;
+  const size_t bytes_before       = allocated_bytes;
+  Plugin *plugin                  = new (storage) Plugin();
+  const size_t n_allocations      = allocations - allocations_before;
+  const size_t n_bytes            = allocated_bytes - bytes_before;
+  plugin->~Plugin();
+
+  std::cout << "heap allocations per construction: " << n_allocations << " (" << n_bytes
+            << " bytes)" << std::endl;
+  RecordProperty("heap_allocations_per_instance", static_cast<int>(n_allocations));
+  RecordProperty("heap_bytes_per_instance", static_cast<int>(n_bytes));
+  EXPECT_EQ(n_allocations, 0u);
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "controller_plugin_differential_flatness/DF_control_law.hpp"
+#include "controller_plugin_differential_flatness/DF_mpc.hpp"
+
+using controller_plugin_differential_flatness::ControlLaw;
+using controller_plugin_differential_flatness::Mpc_config;
+using controller_plugin_differential_flatness::TranslationalMpc;
+
+static const Eigen::Vector3d kUnbounded =
+    Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity());
+
+/* Point mass driven by the first MPC acceleration every _dt, returns the final position */
+static Eigen::Vector3d simulate(TranslationalMpc &_mpc,
+                                const Eigen::Vector3d &_target,
+                                const Eigen::Vector3d &_accel_min,
+                                const Eigen::Vector3d &_accel_max,
+                                double &_max_abs_accel) {
+  const double dt          = 0.01;
+  Eigen::Vector3d position = Eigen::Vector3d::Zero();
+  Eigen::Vector3d velocity = Eigen::Vector3d::Zero();
+  _max_abs_accel           = 0.0;
+  for (int i = 0; i < 500; i++) {
+    const Eigen::Vector3d accel =
+        _mpc.solve(dt, position, velocity, _target, Eigen::Vector3d::Zero(),
+                   Eigen::Vector3d::Zero(), _accel_min, _accel_max);
+    _max_abs_accel = std::max(_max_abs_accel, accel.cwiseAbs().maxCoeff());
+    velocity += accel * dt;
+    position += velocity * dt;
+  }
+  return position;
+}
+
+TEST(TranslationalMpc, TracksSetpoint) {
+  TranslationalMpc mpc;
+  Mpc_config config;
+  config.enable = true;
+  mpc.setup(config);
+
+  double max_accel;
+  const Eigen::Vector3d target(1.0, -2.0, 0.5);
+  const Eigen::Vector3d position = simulate(mpc, target, -kUnbounded, kUnbounded, max_accel);
+  EXPECT_LT((position - target).norm(), 0.01);
+}
+
+TEST(TranslationalMpc, RespectsAccelerationBox) {
+  TranslationalMpc mpc;
+  Mpc_config config;
+  config.enable = true;
+  mpc.setup(config);
+
+  double max_accel;
+  const Eigen::Vector3d target(5.0, 5.0, 5.0);
+  const Eigen::Vector3d position =
+      simulate(mpc, target, -Eigen::Vector3d::Constant(2.0), Eigen::Vector3d::Constant(2.0),
+               max_accel);
+  EXPECT_LE(max_accel, 2.0 + 1e-12);
+  EXPECT_GE(max_accel, 2.0 - 1e-6);  // the bound is actually active
+  EXPECT_LT((position - target).norm(), 0.05);
+}
+
+TEST(TranslationalMpc, IterationCapBoundsTheSolve) {
+  TranslationalMpc mpc;
+  Mpc_config config;
+  config.enable         = true;
+  config.max_iterations = 3;
+  config.tolerance      = 0.0;
+  mpc.setup(config);
+
+  mpc.solve(0.01, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), Eigen::Vector3d::Ones(),
+            Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), -kUnbounded, kUnbounded);
+  EXPECT_EQ(mpc.stats().iterations, 3u);
+  EXPECT_EQ(mpc.stats().capped, 1u);
+  EXPECT_GT(mpc.stats().solve_ns, 0u);
+}
+
+TEST(TranslationalMpc, WarmStartNeedsFewerIterations) {
+  TranslationalMpc mpc;
+  Mpc_config config;
+  config.enable         = true;
+  config.max_iterations = 1000;
+  mpc.setup(config);
+
+  const Eigen::Vector3d target(1.0, 0.0, 0.0);
+  mpc.solve(0.01, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), target,
+            Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), -kUnbounded, kUnbounded);
+  const uint64_t cold = mpc.stats().iterations;
+  mpc.solve(0.0, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), target,
+            Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), -kUnbounded, kUnbounded);
+  EXPECT_LT(mpc.stats().iterations, cold / 4);
+
+  mpc.reset();
+  mpc.solve(0.0, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), target,
+            Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero(), -kUnbounded, kUnbounded);
+  EXPECT_EQ(mpc.stats().iterations, cold);
+}
+
+TEST(TranslationalMpc, ControlLawOnlyHoldsTheSolverWhenSet) {
+  // A law without MPC does not carry its matrices, a copy of one with it owns its own solver
+  EXPECT_LT(sizeof(ControlLaw), sizeof(TranslationalMpc) / 4);
+
+  ControlLaw law;
+  EXPECT_EQ(law.mpc, nullptr);
+  Mpc_config config;
+  config.enable = true;
+  law.mpc       = std::make_unique<TranslationalMpc>();
+  law.mpc->setup(config);
+
+  const ControlLaw copy = law;
+  ASSERT_NE(copy.mpc, nullptr);
+  EXPECT_NE(copy.mpc.get(), law.mpc.get());
+  EXPECT_TRUE(copy.mpc->enabled());
+}
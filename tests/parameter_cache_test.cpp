@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_parameter_cache.hpp"
+
+using controller_plugin_differential_flatness::ParameterCache;
+
+static std::string tempPath(const char *_name) {
+  return std::string(::testing::TempDir()) + _name;
+}
+
+static const std::array<std::string_view, 3> names = {"mass", "kp.x", "kp.y"};
+static const std::array<double, 3> values          = {0.82, 6.0, 5.5};
+
+static std::vector<char> readFile(const std::string &_path) {
+  std::ifstream file(_path, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(file), {});
+}
+
+static void writeFile(const std::string &_path, const std::vector<char> &_bytes) {
+  std::ofstream file(_path, std::ios::binary | std::ios::trunc);
+  file.write(_bytes.data(), _bytes.size());
+}
+
+TEST(ParameterCache, RoundTrip) {
+  const std::string path = tempPath("round_trip.cache");
+  const uint64_t hash    = ParameterCache::namesHash(names);
+  std::string error;
+  ASSERT_TRUE(ParameterCache::save(path, hash, values.data(), values.size(), error)) << error;
+
+  std::array<double, 3> loaded{};
+  ASSERT_TRUE(ParameterCache::load(path, hash, loaded.data(), loaded.size(), error)) << error;
+  EXPECT_EQ(loaded, values);
+  // Written through a temporary file, nothing is left next to the cache
+  EXPECT_EQ(std::fopen((path + ".tmp").c_str(), "rb"), nullptr);
+  std::remove(path.c_str());
+}
+
+TEST(ParameterCache, RejectsAnotherParameterList) {
+  const std::string path = tempPath("names.cache");
+  std::string error;
+  ASSERT_TRUE(ParameterCache::save(path, ParameterCache::namesHash(names), values.data(),
+                                   values.size(), error));
+
+  // Same names split differently must not collide
+  const std::array<std::string_view, 3> renamed = {"mas", "skp.x", "kp.y"};
+  EXPECT_NE(ParameterCache::namesHash(renamed), ParameterCache::namesHash(names));
+  std::array<double, 3> loaded{};
+  EXPECT_FALSE(ParameterCache::load(path, ParameterCache::namesHash(renamed), loaded.data(),
+                                    loaded.size(), error));
+  EXPECT_NE(error.find("stale"), std::string::npos) << error;
+  EXPECT_EQ(loaded, (std::array<double, 3>{}));
+  std::remove(path.c_str());
+}
+
+TEST(ParameterCache, KeyFollowsTheNamesOnly) {
+  // The values are what the cache stands in for, only another list makes it stale
+  const std::string path = tempPath("key.cache");
+  std::string error;
+  std::array<double, 3> saved = values;
+  saved[1]                    = 6.5;
+  ASSERT_TRUE(ParameterCache::save(path, ParameterCache::key(names), saved.data(), saved.size(),
+                                   error));
+
+  std::array<double, 3> loaded{};
+  ASSERT_TRUE(ParameterCache::load(path, ParameterCache::key(names), loaded.data(),
+                                   loaded.size(), error))
+      << error;
+  EXPECT_EQ(loaded, saved);
+
+  const std::array<std::string_view, 3> reordered = {"kp.x", "mass", "kp.y"};
+  loaded                                          = {};
+  EXPECT_FALSE(ParameterCache::load(path, ParameterCache::key(reordered), loaded.data(),
+                                    loaded.size(), error));
+  EXPECT_NE(error.find("stale"), std::string::npos) << error;
+  EXPECT_NE(ParameterCache::key(names), ParameterCache::namesHash(names));
+  std::remove(path.c_str());
+}
+
+TEST(ParameterCache, RejectsCorruptedAndTruncatedFiles) {
+  const std::string path = tempPath("corrupted.cache");
+  const uint64_t hash    = ParameterCache::namesHash(names);
+  std::string error;
+  ASSERT_TRUE(ParameterCache::save(path, hash, values.data(), values.size(), error));
+  const std::vector<char> bytes = readFile(path);
+  std::array<double, 3> loaded{};
+
+  // A flipped bit in a value
+  std::vector<char> corrupted = bytes;
+  corrupted[24 + 3] ^= 0x10;
+  writeFile(path, corrupted);
+  EXPECT_FALSE(ParameterCache::load(path, hash, loaded.data(), loaded.size(), error));
+  EXPECT_NE(error.find("checksum"), std::string::npos) << error;
+
+  // Cut in the middle of the values, and with trailing bytes
+  writeFile(path, std::vector<char>(bytes.begin(), bytes.begin() + 36));
+  EXPECT_FALSE(ParameterCache::load(path, hash, loaded.data(), loaded.size(), error));
+  std::vector<char> longer = bytes;
+  longer.push_back(0);
+  writeFile(path, longer);
+  EXPECT_FALSE(ParameterCache::load(path, hash, loaded.data(), loaded.size(), error));
+
+  // Fewer values than expected
+  EXPECT_FALSE(ParameterCache::load(path, hash, loaded.data(), 2, error));
+
+  // Not a cache at all
+  writeFile(path, std::vector<char>(4, 'x'));
+  EXPECT_FALSE(ParameterCache::load(path, hash, loaded.data(), loaded.size(), error));
+  EXPECT_FALSE(ParameterCache::load(tempPath("missing.cache"), hash, loaded.data(),
+                                    loaded.size(), error));
+
+  EXPECT_EQ(loaded, (std::array<double, 3>{}));
+  std::remove(path.c_str());
+}
+
+TEST(ParameterCache, RejectsNonFiniteValues) {
+  const std::string path          = tempPath("non_finite.cache");
+  const uint64_t hash             = ParameterCache::namesHash(names);
+  const std::array<double, 3> bad = {0.82, NAN, 5.5};
+  std::string error;
+  ASSERT_TRUE(ParameterCache::save(path, hash, bad.data(), bad.size(), error));
+
+  std::array<double, 3> loaded{};
+  EXPECT_FALSE(ParameterCache::load(path, hash, loaded.data(), loaded.size(), error));
+  EXPECT_NE(error.find("not finite"), std::string::npos) << error;
+  std::remove(path.c_str());
+}
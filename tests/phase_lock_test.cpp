@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+
+#include "controller_plugin_differential_flatness/DF_phase_lock.hpp"
+
+using controller_plugin_differential_flatness::PhaseLock;
+
+static constexpr int64_t ms = 1000000;
+
+/* Odometry arrives every _state_period with some jitter, the control tick is re-armed with
+ * nextTick(), or with _deadlines on absolute deadlines moved by takeCorrection() as the tick
+ * source does. Returns the mean state age seen by the last half of the ticks. */
+static double simulate(PhaseLock &_lock,
+                       const int64_t _state_period,
+                       const int64_t _tick_period,
+                       const int64_t _tick_phase,
+                       const bool _deadlines = false) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int64_t> jitter(-ms / 10, ms / 10);
+
+  int64_t next_arrival = 100 * ms;
+  int64_t next_tick    = 100 * ms + _tick_phase;
+  const int64_t end    = next_tick + 4000 * ms;
+  double age_sum       = 0.0;
+  int64_t last_arrival = 0;
+  int n_ages           = 0;
+  int64_t origin       = next_tick;
+  int64_t k            = 0;
+  if (_deadlines) _lock.setNominalPeriod(static_cast<double>(_tick_period));
+  while (next_tick < end) {
+    if (next_arrival <= next_tick) {
+      _lock.onArrival(next_arrival);
+      last_arrival = next_arrival;
+      next_arrival += _state_period + jitter(rng);
+      continue;
+    }
+    _lock.onTick(next_tick);
+    if (next_tick > end - 2000 * ms) {
+      age_sum += static_cast<double>(next_tick - last_arrival);
+      n_ages++;
+    }
+    if (_deadlines) {
+      origin -= _lock.takeCorrection();
+      next_tick = origin + ++k * _tick_period;
+      continue;
+    }
+    // Before the first estimates the tick free runs
+    const int64_t scheduled = _lock.nextTick();
+    next_tick = scheduled > next_tick ? scheduled : next_tick + _tick_period;
+  }
+  return age_sum / n_ages;
+}
+
+TEST(PhaseLock, DisabledKeepsNominalPeriod) {
+  PhaseLock lock;
+  const double age = simulate(lock, 10 * ms, 10 * ms, 7 * ms);
+  EXPECT_NEAR(lock.tickPeriod(), 0.01, 1e-4);
+  EXPECT_FALSE(lock.locked());
+  EXPECT_GT(age, 5.0 * ms);  // the initial phase offset is kept
+}
+
+TEST(PhaseLock, LocksTickJustAfterArrival) {
+  PhaseLock lock;
+  lock.config.enable        = true;
+  lock.config.target_offset = 0.0005;
+  const double age          = simulate(lock, 10 * ms, 10 * ms, 7 * ms);
+  EXPECT_TRUE(lock.locked());
+  EXPECT_NEAR(lock.tickPeriod(), 0.01, 1e-4);
+  EXPECT_LT(age, 1.0 * ms);
+}
+
+TEST(PhaseLock, LocksFasterTickToSlowerState) {
+  PhaseLock lock;
+  lock.config.enable = true;
+  simulate(lock, 20 * ms, 10 * ms, 3 * ms);
+  EXPECT_TRUE(lock.locked());
+  EXPECT_NEAR(lock.tickPeriod(), 0.01, 1e-4);
+}
+
+TEST(PhaseLock, LocksAbsoluteDeadlines) {
+  // The tick source keeps its own deadlines and only takes the corrections
+  PhaseLock lock;
+  lock.config.enable        = true;
+  lock.config.target_offset = 0.0005;
+  const double age          = simulate(lock, 10 * ms, 10 * ms, 7 * ms, true);
+  EXPECT_TRUE(lock.locked());
+  EXPECT_DOUBLE_EQ(lock.tickPeriod(), 0.01);
+  EXPECT_LT(age, 1.0 * ms);
+}
+
+TEST(PhaseLock, EnablingDoesNotApplyAWoundUpIntegral) {
+  // Left disabled far from the target, then enabled: the first correction is only the
+  // proportional term and one integral step, whatever the error was while disabled
+  PhaseLock lock;
+  simulate(lock, 10 * ms, 10 * ms, 7 * ms, true);
+  lock.config.enable = true;
+  lock.onArrival(10000 * ms);
+  lock.onTick(10000 * ms + 1500000);
+  const double error = 1.0 * ms;  // age 1.5 ms against the 0.5 ms target
+  EXPECT_EQ(lock.takeCorrection(),
+            std::llround((lock.config.gain + lock.config.integral_gain) * error));
+}
+
+TEST(PhaseLock, SkippedArrivalsKeepTheStatePeriod) {
+  // A consumer polling at half the state rate reports every second sample
+  PhaseLock lock;
+  for (int64_t k = 0; k < 50; k++) lock.onArrival(100 * ms + 20 * ms * k, 2);
+  EXPECT_NEAR(lock.statePeriod(), 0.01, 1e-6);
+}
@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "as2_core/node.hpp"
+#include "controller_plugin_differential_flatness/DF_controller_plugin.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+/* Hot reload of the plugin: a second instance takes over the state of the running one between
+ * two ticks and must output from its first tick exactly what the first one would have. */
+
+using controller_plugin_differential_flatness::Plugin;
+using controller_plugin_differential_flatness::StateTransfer;
+
+static const std::vector<rclcpp::Parameter> parameters = {
+    rclcpp::Parameter("mass", 0.82),
+    rclcpp::Parameter("trajectory_control.antiwindup_cte", 1.0),
+    rclcpp::Parameter("trajectory_control.alpha", 0.1),
+    rclcpp::Parameter("trajectory_control.kp.x", 6.0),
+    rclcpp::Parameter("trajectory_control.kp.y", 6.0),
+    rclcpp::Parameter("trajectory_control.kp.z", 6.0),
+    rclcpp::Parameter("trajectory_control.ki.x", 0.005),
+    rclcpp::Parameter("trajectory_control.ki.y", 0.005),
+    rclcpp::Parameter("trajectory_control.ki.z", 0.065),
+    rclcpp::Parameter("trajectory_control.kd.x", 1.5),
+    rclcpp::Parameter("trajectory_control.kd.y", 1.5),
+    rclcpp::Parameter("trajectory_control.kd.z", 3.0),
+    rclcpp::Parameter("trajectory_control.roll_control.kp", 5.5),
+    rclcpp::Parameter("trajectory_control.pitch_control.kp", 5.5),
+    rclcpp::Parameter("trajectory_control.yaw_control.kp", 2.0),
+    rclcpp::Parameter("warm_up.ticks", 10),
+};
+
+/* Plugin on its own node, parameters read. The instance to reload into does not set a mode */
+struct Instance {
+  explicit Instance(const std::string &_name,
+                    const bool _set_mode,
+                    const std::vector<rclcpp::Parameter> &_overrides = {}) {
+    if (!rclcpp::ok()) rclcpp::init(0, nullptr);
+    std::vector<rclcpp::Parameter> all_parameters = parameters;
+    all_parameters.insert(all_parameters.end(), _overrides.begin(), _overrides.end());
+    rclcpp::NodeOptions options;
+    options.parameter_overrides(all_parameters);
+    options.automatically_declare_parameters_from_overrides(true);
+    node = std::make_shared<as2::Node>(_name, options);
+
+    plugin.initialize(node.get());
+    std::vector<std::string> names;
+    for (const auto &param : all_parameters) names.push_back(param.get_name());
+    plugin.updateParams(names);
+    plugin.warmUp();
+    if (!_set_mode) return;
+
+    as2_msgs::msg::ControlMode mode_in, mode_out;
+    mode_in.control_mode     = as2_msgs::msg::ControlMode::TRAJECTORY;
+    mode_in.yaw_mode         = as2_msgs::msg::ControlMode::YAW_ANGLE;
+    mode_in.reference_frame  = as2_msgs::msg::ControlMode::LOCAL_ENU_FRAME;
+    mode_out.control_mode    = as2_msgs::msg::ControlMode::ACRO;
+    mode_out.reference_frame = as2_msgs::msg::ControlMode::BODY_FLU_FRAME;
+    plugin.setMode(mode_in, mode_out);
+  }
+
+  std::shared_ptr<as2::Node> node;
+  Plugin plugin;
+};
+
+/* State and circle reference at time _t, fed to _plugin */
+static void feed(Plugin &_plugin, const double _t) {
+  geometry_msgs::msg::PoseStamped pose;
+  geometry_msgs::msg::TwistStamped twist;
+  pose.header.frame_id    = _plugin.getDesiredPoseFrameId();
+  twist.header.frame_id   = _plugin.getDesiredTwistFrameId();
+  pose.pose.position.x    = 2.0 * std::cos(_t) + 0.05 * std::sin(7.0 * _t);
+  pose.pose.position.y    = 2.0 * std::sin(_t);
+  pose.pose.position.z    = 1.5;
+  pose.pose.orientation.w = 1.0;
+  twist.twist.linear.x    = -2.0 * std::sin(_t);
+  twist.twist.linear.y    = 2.0 * std::cos(_t);
+  _plugin.updateState(pose, twist);
+
+  as2_msgs::msg::TrajectoryPoint ref;
+  ref.position.x     = 2.0 * std::cos(_t);
+  ref.position.y     = 2.0 * std::sin(_t);
+  ref.position.z     = 1.5;
+  ref.twist.x        = -2.0 * std::sin(_t);
+  ref.twist.y        = 2.0 * std::cos(_t);
+  ref.acceleration.x = -2.0 * std::cos(_t);
+  ref.acceleration.y = -2.0 * std::sin(_t);
+  ref.yaw_angle      = 0.0;
+  _plugin.updateReference(ref);
+}
+
+/* Runs _reference throughout and _old until it hands over to _new at tick 300, expecting the
+ * same output on every tick */
+static void expectContinuity(Instance &_reference, Instance &_old, Instance &_new) {
+  Plugin *active = &_old.plugin;
+  geometry_msgs::msg::PoseStamped pose;
+  geometry_msgs::msg::TwistStamped twist, reference_twist;
+  as2_msgs::msg::Thrust thrust, reference_thrust;
+  const double dt = 0.01;
+  for (int i = 0; i < 600; i++) {
+    if (i == 300) {
+      std::string error;
+      StateTransfer *transfer = dynamic_cast<StateTransfer *>(&_new.plugin);
+      ASSERT_NE(transfer, nullptr);
+      ASSERT_TRUE(transfer->importState(_old.plugin.exportState(), error)) << error;
+      active = &_new.plugin;
+    }
+    feed(_reference.plugin, i * dt);
+    feed(*active, i * dt);
+    ASSERT_TRUE(_reference.plugin.computeOutput(dt, pose, reference_twist, reference_thrust));
+    // A false output is a dropped tick
+    ASSERT_TRUE(active->computeOutput(dt, pose, twist, thrust)) << "tick " << i;
+    EXPECT_NEAR(twist.twist.angular.x, reference_twist.twist.angular.x, 1e-9) << "tick " << i;
+    EXPECT_NEAR(twist.twist.angular.y, reference_twist.twist.angular.y, 1e-9) << "tick " << i;
+    EXPECT_NEAR(twist.twist.angular.z, reference_twist.twist.angular.z, 1e-9) << "tick " << i;
+    EXPECT_NEAR(thrust.thrust, reference_thrust.thrust, 1e-9) << "tick " << i;
+  }
+}
+
+TEST(PluginReload, NewInstanceContinuesTheOldOne) {
+  // reference never reloads, old hands over to new at tick 300 with different gains loaded
+  Instance reference("df_reload_reference", true);
+  Instance old_instance("df_reload_old", true);
+  Instance new_instance("df_reload_new", false,
+                        {rclcpp::Parameter("trajectory_control.kp.x", 1.0)});
+  expectContinuity(reference, old_instance, new_instance);
+  // The gains it now runs with are the ones its node declares
+  EXPECT_EQ(new_instance.node->get_parameter("trajectory_control.kp.x").as_double(), 6.0);
+}
+
+TEST(PluginReload, IntegralGainDoesNotBreakContinuity) {
+  // A large ki makes any integrator left behind or carried over show in the outputs
+  const std::vector<rclcpp::Parameter> ki = {
+      rclcpp::Parameter("trajectory_control.ki.x", 4.0),
+      rclcpp::Parameter("trajectory_control.ki.y", 4.0),
+      rclcpp::Parameter("trajectory_control.ki.z", 4.0)};
+  Instance reference("df_reload_ki_reference", true, ki);
+  Instance old_instance("df_reload_ki_old", true, ki);
+  Instance new_instance("df_reload_ki_new", false);
+  expectContinuity(reference, old_instance, new_instance);
+  EXPECT_EQ(new_instance.node->get_parameter("trajectory_control.ki.z").as_double(), 4.0);
+}
+
+TEST(PluginReload, NoTickDroppedAcrossATickSourceReload) {
+  const std::vector<rclcpp::Parameter> tick_source = {
+      rclcpp::Parameter("tick_source.rate", 200.0)};
+  Instance old_instance("df_reload_tick_old", true, tick_source);
+  Instance new_instance("df_reload_tick_new", false, tick_source);
+  feed(old_instance.plugin, 0.0);
+
+  std::mutex mutex;
+  std::vector<int64_t> outputs;
+  std::atomic<int> failed{0};
+  outputs.reserve(1024);
+  auto on_output = [&](bool _ok, const geometry_msgs::msg::TwistStamped &,
+                       const as2_msgs::msg::Thrust &) {
+    if (!_ok) failed++;
+    std::lock_guard<std::mutex> lock(mutex);
+    outputs.push_back(std::chrono::steady_clock::now().time_since_epoch().count());
+  };
+
+  old_instance.plugin.startTickSource(on_output);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  old_instance.plugin.stopTickSource();
+  std::string error;
+  ASSERT_TRUE(new_instance.plugin.importState(old_instance.plugin.exportState(), error)) << error;
+  new_instance.plugin.startTickSource(on_output);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  new_instance.plugin.stopTickSource();
+
+  // Every tick output a command and the new source ticked on the deadline the old one left.
+  // Deadlines are absolute and missed ones are caught up, so the outputs count the periods
+  // spanned; wake up latency only moves the first and last ones by a fraction of a period,
+  // while a dropped tick would leave one output short
+  EXPECT_EQ(failed.load(), 0);
+  ASSERT_GT(outputs.size(), 60u);
+  const double periods = (outputs.back() - outputs.front()) / 5e6;
+  EXPECT_EQ(static_cast<double>(outputs.size() - 1), std::round(periods)) << "a tick was dropped";
+}
@@ -1,7 +1,7 @@
 find_package(benchmark QUIET)
-if (${benckmark_FOUND})
+if (${benchmark_FOUND})
   MESSAGE(STATUS "Found Google Benchmark.")
-else (${benckmark_FOUND})
+else (${benchmark_FOUND})
   MESSAGE(STATUS "Could not find Google Benchmark.")
   include(FetchContent)
   FetchContent_Declare(
@@ -12,7 +12,7 @@ else (${benckmark_FOUND})
   FetchContent_MakeAvailable(benchmark)
 
 
-endif(${benckmark_FOUND})
+endif(${benchmark_FOUND})
 
 include(GoogleTest)
 
@@ -29,9 +29,11 @@ foreach(TEST_SOURCE ${TEST_SOURCES})
   math(EXPR final_length  "${name_length}-4") # remove .cpp of the name
   string(SUBSTRING ${_src_filename} 0 ${final_length} TEST_NAME)
   
-  add_executable(${TEST_NAME}_test ${TEST_SOURCE} ${SOURCE_CPP_FILES})
+  # Link the plugin library so the benchmarks measure the (PGO) optimized build. The swarm
+  # simulator is not part of it, so its sources are compiled in
+  add_executable(${TEST_NAME}_test ${TEST_SOURCE} ${SWARM_CPP_FILES})
   ament_target_dependencies(${TEST_NAME}_test  ${PROJECT_DEPENDENCIES})
-  target_link_libraries(${TEST_NAME}_test benchmark::benchmark )
+  target_link_libraries(${TEST_NAME}_test ${PROJECT_NAME} benchmark::benchmark_main)
 
 
   endforeach()
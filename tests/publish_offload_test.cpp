@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_cpu_budget.hpp"
+#include "controller_plugin_differential_flatness/DF_publish_offload.hpp"
+
+using controller_plugin_differential_flatness::CpuBudget;
+using controller_plugin_differential_flatness::Publish_offload_config;
+using controller_plugin_differential_flatness::Published_command;
+using controller_plugin_differential_flatness::PublishOffload;
+
+static Published_command command(const uint64_t _tick) {
+  Published_command command;
+  command.tick       = _tick;
+  command.ok         = true;
+  command.thrust     = static_cast<double>(_tick);
+  command.enqueue_ns = CpuBudget::wallNs();
+  return command;
+}
+
+static void waitFor(const std::atomic<uint64_t> &_count, const uint64_t _n) {
+  for (int i = 0; i < 2000 && _count.load() < _n; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+TEST(PublishOffload, PublishesInOrderOffTheTick) {
+  Publish_offload_config config;
+  config.enable = true;
+  std::vector<uint64_t> ticks;
+  std::atomic<uint64_t> published{0};
+  const std::thread::id tick_thread = std::this_thread::get_id();
+  bool off_tick_thread              = true;
+
+  PublishOffload offload;
+  offload.start(config, [&](const Published_command &_command) {
+    ticks.push_back(_command.tick);
+    off_tick_thread &= std::this_thread::get_id() != tick_thread;
+    published++;
+  });
+  for (uint64_t i = 0; i < 500; i++) {
+    offload.push(command(i));
+    std::this_thread::sleep_for(std::chrono::microseconds(20));
+  }
+  waitFor(published, 500);
+  offload.stop();
+
+  ASSERT_EQ(ticks.size(), 500u);
+  for (uint64_t i = 0; i < 500; i++) EXPECT_EQ(ticks[i], i);
+  EXPECT_TRUE(off_tick_thread);
+  EXPECT_NE(offload.report().find("published: 500"), std::string::npos);
+}
+
+TEST(PublishOffload, StalledPublisherDropsInsteadOfBlocking) {
+  Publish_offload_config config;
+  config.enable = true;
+  std::atomic<bool> stalled{true};
+  std::atomic<uint64_t> published{0};
+
+  PublishOffload offload;
+  offload.start(config, [&](const Published_command &) {
+    while (stalled.load()) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    published++;
+  });
+
+  // The first command blocks the publisher, 64 more fill the queue, the rest are dropped
+  uint64_t max_push_ns = 0;
+  for (uint64_t i = 0; i < 200; i++) {
+    const uint64_t start = CpuBudget::wallNs();
+    offload.push(command(i));
+    max_push_ns = std::max(max_push_ns, CpuBudget::wallNs() - start);
+    if (i == 0) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  stalled = false;
+  waitFor(published, 65);
+  offload.stop();
+
+  const std::string report = offload.report();
+  EXPECT_EQ(published.load(), 65u);
+  EXPECT_NE(report.find("dropped: 135"), std::string::npos) << report;
+  EXPECT_NE(report.find("queue_depth_max: 64"), std::string::npos) << report;
+  EXPECT_LT(max_push_ns, 1000000u);
+}
+
+TEST(PublishOffload, StopPublishesTheQueuedCommands) {
+  Publish_offload_config config;
+  config.enable = true;
+  std::atomic<bool> stalled{true};
+  std::atomic<uint64_t> published{0};
+
+  PublishOffload offload;
+  offload.start(config, [&](const Published_command &) {
+    while (stalled.load()) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    published++;
+  });
+  for (uint64_t i = 0; i < 10; i++) offload.push(command(i));
+  std::thread release([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stalled = false;
+  });
+  offload.stop();
+  release.join();
+  EXPECT_EQ(published.load(), 10u);
+
+  // The idle publisher of a new session sleeps until a push wakes it
+  offload.start(config, [&](const Published_command &) { published++; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(published.load(), 10u);
+  offload.push(command(10));
+  waitFor(published, 11);
+  offload.stop();
+  EXPECT_EQ(published.load(), 11u);
+  EXPECT_NE(offload.report().find("published: 1\n"), std::string::npos) << offload.report();
+}
@@ -0,0 +1,55 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_residual_model.hpp"
+
+/* Per tick cost of the residual force model, for two hidden layers of the given width. The
+ * control path budget is residual_model.budget_us, 20 us by default. */
+
+using controller_plugin_differential_flatness::ResidualModel;
+
+static void BM_RESIDUAL_MODEL(benchmark::State &state) {
+  const uint32_t width              = static_cast<uint32_t>(state.range(0));
+  const std::vector<uint32_t> sizes = {ResidualModel::kInputs, width, width,
+                                       ResidualModel::kOutputs};
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> dist(-0.3f, 0.3f);
+  std::vector<std::vector<float>> weights, biases;
+  for (size_t l = 0; l + 1 < sizes.size(); l++) {
+    weights.emplace_back(sizes[l] * sizes[l + 1]);
+    biases.emplace_back(sizes[l + 1]);
+    for (float &w : weights.back()) w = dist(rng);
+    for (float &b : biases.back()) b = dist(rng);
+  }
+  const std::vector<float> mean(ResidualModel::kInputs, 0.0f);
+  const std::vector<float> scale(ResidualModel::kInputs, 1.0f);
+
+  const std::string path = "/tmp/df_residual_model_benchmark.dfml";
+  std::string error;
+  ResidualModel model;
+  if (!ResidualModel::write(path, sizes, static_cast<ResidualModel::Activation>(state.range(1)),
+                            mean, scale, weights, biases, error) ||
+      !model.open(path, error)) {
+    state.SkipWithError(error.c_str());
+    return;
+  }
+  std::remove(path.c_str());
+  model.setBudget(1000000000ull);
+
+  Eigen::Vector3d velocity(1.0, 0.5, -0.2);
+  Eigen::Vector3d force;
+  for (auto _ : state) {
+    model.evaluate(velocity, Eigen::Vector3d::Zero(), 1.0, force);
+    benchmark::DoNotOptimize(force);
+    velocity.x() += 1e-6;
+  }
+  state.counters["max_us"] = model.stats().max_ns * 1e-3;
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RESIDUAL_MODEL)
+    ->ArgNames({"width", "tanh"})
+    ->ArgsProduct({{16, 32, 64, 128}, {ResidualModel::RELU, ResidualModel::TANH}});
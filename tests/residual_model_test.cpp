@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_residual_model.hpp"
+
+using controller_plugin_differential_flatness::ResidualModel;
+
+struct Mlp {
+  std::vector<uint32_t> sizes;
+  ResidualModel::Activation activation;
+  std::vector<float> mean, scale;
+  std::vector<std::vector<float>> weights, biases;
+};
+
+static Mlp randomMlp(const std::vector<uint32_t> &_sizes, ResidualModel::Activation _activation) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+  Mlp mlp{_sizes, _activation, {}, {}, {}, {}};
+  for (int i = 0; i < ResidualModel::kInputs; i++) {
+    mlp.mean.push_back(dist(rng));
+    mlp.scale.push_back(1.0f + dist(rng));
+  }
+  for (size_t l = 0; l + 1 < _sizes.size(); l++) {
+    mlp.weights.emplace_back(_sizes[l] * _sizes[l + 1]);
+    mlp.biases.emplace_back(_sizes[l + 1]);
+    for (float &w : mlp.weights.back()) w = dist(rng);
+    for (float &b : mlp.biases.back()) b = dist(rng);
+  }
+  return mlp;
+}
+
+/* Plain double precision evaluation of the same network */
+static Eigen::Vector3d reference(const Mlp &_mlp, const std::vector<double> &_input) {
+  std::vector<double> x(_input.size());
+  for (size_t i = 0; i < x.size(); i++) x[i] = (_input[i] - _mlp.mean[i]) * _mlp.scale[i];
+  for (size_t l = 0; l < _mlp.weights.size(); l++) {
+    std::vector<double> y(_mlp.sizes[l + 1]);
+    for (size_t r = 0; r < y.size(); r++) {
+      y[r] = _mlp.biases[l][r];
+      for (size_t c = 0; c < x.size(); c++) y[r] += _mlp.weights[l][r * x.size() + c] * x[c];
+      if (l + 1 < _mlp.weights.size()) {
+        y[r] = _mlp.activation == ResidualModel::TANH ? std::tanh(y[r]) : std::max(y[r], 0.0);
+      }
+    }
+    x = y;
+  }
+  return Eigen::Vector3d(x[0], x[1], x[2]);
+}
+
+static std::string save(const Mlp &_mlp, const char *_name) {
+  const std::string path = std::string(::testing::TempDir()) + _name;
+  std::string error;
+  EXPECT_TRUE(ResidualModel::write(path, _mlp.sizes, _mlp.activation, _mlp.mean, _mlp.scale,
+                                   _mlp.weights, _mlp.biases, error))
+      << error;
+  return path;
+}
+
+static void expectMatchesReference(const Mlp &_mlp, const char *_name) {
+  const std::string path = save(_mlp, _name);
+  ResidualModel model;
+  std::string error;
+  ASSERT_TRUE(model.open(path, error)) << error;
+  model.setBudget(1000000000ull);
+
+  const Eigen::Vector3d velocity(1.0, -2.0, 0.5);
+  const Eigen::Vector3d acc_reference(0.3, 0.1, -0.2);
+  const double height = 0.4;
+  Eigen::Vector3d force;
+  ASSERT_TRUE(model.evaluate(velocity, acc_reference, height, force));
+  // Twice, the scratch buffers must not leak into the next evaluation
+  ASSERT_TRUE(model.evaluate(velocity, acc_reference, height, force));
+
+  const Eigen::Vector3d expected = reference(_mlp, {1.0, -2.0, 0.5, 0.3, 0.1, -0.2, 0.4});
+  EXPECT_LT((force - expected).norm(), 1e-4) << force.transpose() << " vs " << expected.transpose();
+  std::remove(path.c_str());
+}
+
+TEST(ResidualModel, ReluMatchesReference) {
+  expectMatchesReference(randomMlp({7, 20, 3}, ResidualModel::RELU), "relu.dfml");
+}
+
+TEST(ResidualModel, TanhMatchesReference) {
+  expectMatchesReference(randomMlp({7, 32, 17, 3}, ResidualModel::TANH), "tanh.dfml");
+}
+
+TEST(ResidualModel, BudgetAndForceBound) {
+  const std::string path = save(randomMlp({7, 64, 64, 3}, ResidualModel::RELU), "bound.dfml");
+  ResidualModel model;
+  std::string error;
+  ASSERT_TRUE(model.open(path, error)) << error;
+
+  Eigen::Vector3d force = Eigen::Vector3d::Constant(42.0);
+  model.setBudget(0);
+  EXPECT_FALSE(model.evaluate(Eigen::Vector3d::Ones(), Eigen::Vector3d::Zero(), 1.0, force));
+  EXPECT_EQ(force, Eigen::Vector3d::Constant(42.0));
+  EXPECT_EQ(model.stats().overruns, 1u);
+
+  model.setBudget(1000000000ull);
+  model.setMaxForce(1e-3);
+  EXPECT_TRUE(model.evaluate(Eigen::Vector3d::Ones(), Eigen::Vector3d::Zero(), 1.0, force));
+  EXPECT_LE(force.norm(), 1e-3 + 1e-12);
+  std::remove(path.c_str());
+}
+
+TEST(ResidualModel, RejectsInvalidModels) {
+  ResidualModel model;
+  std::string error;
+  EXPECT_FALSE(model.open(std::string(::testing::TempDir()) + "missing.dfml", error));
+
+  // Wrong number of inputs
+  Mlp mlp        = randomMlp({7, 8, 3}, ResidualModel::RELU);
+  mlp.sizes      = {6, 8, 3};
+  mlp.weights[0] = std::vector<float>(6 * 8, 0.0f);
+
+  const std::string path = save(mlp, "inputs.dfml");
+  EXPECT_FALSE(model.open(path, error));
+  EXPECT_FALSE(model.isOpen());
+  std::remove(path.c_str());
+}
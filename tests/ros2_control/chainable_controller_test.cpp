@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <hardware_interface/loaned_command_interface.hpp>
+#include <hardware_interface/loaned_state_interface.hpp>
+#include <rclcpp/rclcpp.hpp>
+
+#include "controller_plugin_differential_flatness/DF_chainable_controller.hpp"
+
+using controller_plugin_differential_flatness::DFChainableController;
+
+/* Mock hardware component: owns the interface values of one multirotor and integrates a
+ * rigid body model driven by the body rate and thrust commands */
+class MockVehicle {
+public:
+  static constexpr double mass = 0.82;
+
+  MockVehicle() {
+    const char *state_names[]   = {"position.x",    "position.y",    "position.z",
+                                   "velocity.x",    "velocity.y",    "velocity.z",
+                                   "orientation.x", "orientation.y", "orientation.z",
+                                   "orientation.w"};
+    const char *command_names[] = {"rate.x", "rate.y", "rate.z", "thrust"};
+    for (size_t i = 0; i < states_.size(); i++) {
+      state_interfaces_.emplace_back("uav", state_names[i], &states_[i]);
+    }
+    for (size_t i = 0; i < commands_.size(); i++) {
+      command_interfaces_.emplace_back("uav", command_names[i], &commands_[i]);
+    }
+    states_[2] = 1.0;  // z
+    states_[9] = 1.0;  // qw
+  }
+
+  std::vector<hardware_interface::LoanedStateInterface> loanStates() {
+    std::vector<hardware_interface::LoanedStateInterface> loaned;
+    for (auto &state : state_interfaces_) loaned.emplace_back(state);
+    return loaned;
+  }
+
+  std::vector<hardware_interface::LoanedCommandInterface> loanCommands() {
+    std::vector<hardware_interface::LoanedCommandInterface> loaned;
+    for (auto &command : command_interfaces_) loaned.emplace_back(command);
+    return loaned;
+  }
+
+  void step(const double _dt) {
+    Eigen::Quaterniond attitude(states_[9], states_[6], states_[7], states_[8]);
+    const Eigen::Vector3d half_angle = 0.5 * _dt * Eigen::Vector3d(commands_[0], commands_[1],
+                                                                   commands_[2]);
+    attitude = (attitude * Eigen::Quaterniond(1.0, half_angle.x(), half_angle.y(),
+                                              half_angle.z()))
+                   .normalized();
+    const Eigen::Vector3d accel =
+        attitude * Eigen::Vector3d(0, 0, commands_[3] / mass) + Eigen::Vector3d(0, 0, -9.81);
+    for (int i = 0; i < 3; i++) {
+      states_[3 + i] += accel[i] * _dt;
+      states_[i] += states_[3 + i] * _dt;
+    }
+    states_[6] = attitude.x();
+    states_[7] = attitude.y();
+    states_[8] = attitude.z();
+    states_[9] = attitude.w();
+  }
+
+  Eigen::Vector3d position() const { return Eigen::Vector3d(states_[0], states_[1], states_[2]); }
+  double thrust() const { return commands_[3]; }
+
+private:
+  std::array<double, 10> states_{};
+  std::array<double, 4> commands_{};
+  std::vector<hardware_interface::StateInterface> state_interfaces_;
+  std::vector<hardware_interface::CommandInterface> command_interfaces_;
+};
+
+class ChainableControllerTest : public ::testing::Test {
+protected:
+  static void SetUpTestSuite() { rclcpp::init(0, nullptr); }
+  static void TearDownTestSuite() { rclcpp::shutdown(); }
+
+  void SetUp() override {
+    controller_ = std::make_unique<DFChainableController>();
+    ASSERT_EQ(controller_->init("df_controller"), controller_interface::return_type::OK);
+
+    auto node = controller_->get_node();
+    node->set_parameter(rclcpp::Parameter("mass", MockVehicle::mass));
+    node->set_parameter(rclcpp::Parameter("trajectory_control.antiwindup_cte", 1.0));
+    for (const std::string axis : {"x", "y"}) {
+      node->set_parameter(rclcpp::Parameter("trajectory_control.kp." + axis, 6.0));
+      node->set_parameter(rclcpp::Parameter("trajectory_control.ki." + axis, 0.005));
+      node->set_parameter(rclcpp::Parameter("trajectory_control.kd." + axis, 1.5));
+    }
+    node->set_parameter(rclcpp::Parameter("trajectory_control.kp.z", 6.0));
+    node->set_parameter(rclcpp::Parameter("trajectory_control.ki.z", 0.065));
+    node->set_parameter(rclcpp::Parameter("trajectory_control.kd.z", 3.0));
+    node->set_parameter(rclcpp::Parameter("trajectory_control.roll_control.kp", 5.5));
+    node->set_parameter(rclcpp::Parameter("trajectory_control.pitch_control.kp", 5.5));
+    node->set_parameter(rclcpp::Parameter("trajectory_control.yaw_control.kp", 2.0));
+
+    ASSERT_EQ(controller_->on_configure(rclcpp_lifecycle::State()),
+              controller_interface::CallbackReturn::SUCCESS);
+    reference_interfaces_ = controller_->export_reference_interfaces();
+    ASSERT_EQ(reference_interfaces_.size(), 10u);
+    controller_->assign_interfaces(vehicle_.loanCommands(), vehicle_.loanStates());
+    ASSERT_EQ(controller_->on_activate(rclcpp_lifecycle::State()),
+              controller_interface::CallbackReturn::SUCCESS);
+  }
+
+  void run(const double _duration) {
+    const rclcpp::Duration period = rclcpp::Duration::from_seconds(dt_);
+    for (double t = 0.0; t < _duration; t += dt_) {
+      ASSERT_EQ(controller_->update(rclcpp::Time(0), period),
+                controller_interface::return_type::OK);
+      vehicle_.step(dt_);
+    }
+  }
+
+  const double dt_ = 0.002;
+  MockVehicle vehicle_;
+  std::unique_ptr<DFChainableController> controller_;
+  std::vector<hardware_interface::CommandInterface> reference_interfaces_;
+};
+
+TEST_F(ChainableControllerTest, HoldsPositionOnActivation) {
+  run(2.0);
+  EXPECT_NEAR((vehicle_.position() - Eigen::Vector3d(0, 0, 1)).norm(), 0.0, 0.05);
+  EXPECT_NEAR(vehicle_.thrust(), MockVehicle::mass * 9.81, 0.1);
+}
+
+TEST_F(ChainableControllerTest, TracksChainedReference) {
+  ASSERT_TRUE(controller_->set_chained_mode(true));
+  reference_interfaces_[0].set_value(1.0);   // position.x
+  reference_interfaces_[1].set_value(-0.5);  // position.y
+  reference_interfaces_[2].set_value(2.0);   // position.z
+  run(8.0);
+  EXPECT_NEAR((vehicle_.position() - Eigen::Vector3d(1.0, -0.5, 2.0)).norm(), 0.0, 0.1);
+}
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <limits>
+
+#include "controller_plugin_differential_flatness/DF_sanitizer.hpp"
+
+using controller_plugin_differential_flatness::Sanitizer;
+
+static const double nan_value = std::numeric_limits<double>::quiet_NaN();
+
+TEST(Sanitizer, KeepFiniteReplacesOnlyBadCoefficients) {
+  uint64_t events = 0;
+  const Eigen::Vector3d previous(1.0, 2.0, 3.0);
+  const Eigen::Vector3d value(4.0, nan_value, std::numeric_limits<double>::infinity());
+  const Eigen::Vector3d result = Sanitizer::keepFinite(value, previous, events);
+  EXPECT_EQ(result, Eigen::Vector3d(4.0, 2.0, 3.0));
+  EXPECT_EQ(events, 1u);
+
+  Sanitizer::keepFinite(previous, value, events);
+  EXPECT_EQ(events, 1u);
+}
+
+TEST(Sanitizer, SafeNormalizedFallsBack) {
+  uint64_t events = 0;
+  const Eigen::Vector3d fallback = Eigen::Vector3d::UnitZ();
+  EXPECT_EQ(Sanitizer::safeNormalized(Eigen::Vector3d::Zero(), fallback, events), fallback);
+  EXPECT_EQ(Sanitizer::safeNormalized(Eigen::Vector3d(nan_value, 0, 1), fallback, events),
+            fallback);
+  EXPECT_EQ(events, 2u);
+
+  const Eigen::Vector3d result =
+      Sanitizer::safeNormalized(Eigen::Vector3d(3.0, 0.0, 4.0), fallback, events);
+  EXPECT_NEAR(result.x(), 0.6, 1e-12);
+  EXPECT_NEAR(result.z(), 0.8, 1e-12);
+  EXPECT_EQ(events, 2u);
+}
+
+TEST(Sanitizer, LimitTilt) {
+  Sanitizer sanitizer;
+  const Eigen::Vector3d force(10.0, 0.0, 1.0);
+  EXPECT_EQ(sanitizer.limitTilt(force), force);  // disabled by default
+  EXPECT_EQ(sanitizer.stats.tilt_saturations, 0u);
+
+  sanitizer.limits.max_tilt     = M_PI / 4.0;
+  const Eigen::Vector3d limited = sanitizer.limitTilt(force);
+  EXPECT_NEAR(limited.x(), 1.0, 1e-9);
+  EXPECT_NEAR(limited.z(), 1.0, 1e-9);
+  EXPECT_EQ(sanitizer.stats.tilt_saturations, 1u);
+}
+
+TEST(Sanitizer, SaturateOutputs) {
+  Sanitizer sanitizer;
+  sanitizer.limits.max_thrust = 20.0;
+  sanitizer.limits.max_rate   = 1.0;
+
+  EXPECT_EQ(sanitizer.saturateThrust(10.0), 10.0);
+  EXPECT_EQ(sanitizer.saturateThrust(30.0), 20.0);
+  EXPECT_EQ(sanitizer.saturateThrust(-1.0), 0.0);
+  EXPECT_EQ(sanitizer.saturateThrust(nan_value), 0.0);
+  // Only the max_thrust hit is a saturation, the negative collective is the zero floor
+  EXPECT_EQ(sanitizer.stats.thrust_saturations, 1u);
+  EXPECT_EQ(sanitizer.stats.thrust_floor, 1u);
+  EXPECT_EQ(sanitizer.stats.non_finite_command, 1u);
+
+  sanitizer.limits.min_thrust = 2.0;
+  EXPECT_EQ(sanitizer.saturateThrust(1.0), 2.0);
+  EXPECT_EQ(sanitizer.stats.thrust_saturations, 2u);
+  EXPECT_EQ(sanitizer.stats.thrust_floor, 1u);
+
+  EXPECT_EQ(sanitizer.saturateRates(Eigen::Vector3d(0.5, -2.0, 3.0)),
+            Eigen::Vector3d(0.5, -1.0, 1.0));
+  EXPECT_EQ(sanitizer.stats.rate_saturations, 1u);
+  // A NaN rate is a non-finite command only, counted once by keepFinite
+  const Eigen::Vector3d rates = sanitizer.saturateRates(Eigen::Vector3d(0.5, nan_value, 0.2));
+  EXPECT_EQ(sanitizer.stats.rate_saturations, 1u);
+  Sanitizer::keepFinite(rates, Eigen::Vector3d::Zero(), sanitizer.stats.non_finite_command);
+  EXPECT_EQ(sanitizer.stats.non_finite_command, 2u);
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "controller_plugin_differential_flatness/DF_shadow.hpp"
+
+using controller_plugin_differential_flatness::Acro_command;
+using controller_plugin_differential_flatness::ControlLaw;
+using controller_plugin_differential_flatness::Mpc_config;
+using controller_plugin_differential_flatness::Shadow_config;
+using controller_plugin_differential_flatness::Shadow_input;
+using controller_plugin_differential_flatness::ShadowController;
+using controller_plugin_differential_flatness::TranslationalMpc;
+
+/* Hovering half a meter below the reference, so the proportional term sets the thrust */
+static Shadow_input input() {
+  Shadow_input input;
+  input.tick                 = 1;
+  input.dt                   = 0.01;
+  input.state.position       = Eigen::Vector3d(0.0, 0.0, 0.5);
+  input.reference.position   = Eigen::Vector3d(0.0, 0.0, 1.0);
+  input.gains.kp             = Eigen::Vector3d(4.0, 4.0, 4.0);
+  input.gains.kd             = Eigen::Vector3d(2.0, 2.0, 2.0);
+  input.gains.kp_ang         = Eigen::Vector3d(5.0, 5.0, 3.0);
+  input.gains.mass           = 1.0;
+  input.gains.antiwindup_cte = 1.0;
+  input.limits.max_thrust    = 40.0;
+  input.residual_force       = Eigen::Vector3d(0.0, 0.0, 0.3);
+  return input;
+}
+
+/* Command of the active law on _input, with the residual force added as the plugin does */
+static Acro_command active(const Shadow_input &_input) {
+  ControlLaw law;
+  law.gains            = _input.gains;
+  law.sanitizer.limits = _input.limits;
+  if (_input.mpc.enable) {
+    law.mpc = std::make_unique<TranslationalMpc>();
+    law.mpc->setup(_input.mpc);
+  }
+  const Eigen::Vector3d force =
+      law.getForce(_input.dt, _input.state.position, _input.state.velocity,
+                   _input.reference.position, _input.reference.velocity,
+                   _input.reference.acceleration) +
+      _input.residual_force;
+  return law.computeAttitudeControl(force, _input.state.attitude_state, _input.reference.yaw);
+}
+
+static double reportValue(const ShadowController &_shadow, const std::string &_key) {
+  const std::string report = _shadow.report();
+  const size_t at          = report.find("  " + _key + ": ");
+  return at == std::string::npos ? NAN : std::stod(report.substr(at + _key.size() + 4));
+}
+
+static void waitForTicks(const ShadowController &_shadow, const double _ticks) {
+  for (int i = 0; i < 2000 && reportValue(_shadow, "ticks") < _ticks; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+TEST(ShadowController, ThrustDeltaFollowsTheGainDifference) {
+  Shadow_config config;
+  config.enable   = true;
+  config.kp_scale = Eigen::Vector3d(1.0, 1.0, 1.5);
+  ShadowController shadow;
+  shadow.configure(config);
+
+  Shadow_input tick = input();
+  tick.active       = active(tick);
+  shadow.push(tick);
+  waitForTicks(shadow, 1);
+
+  // Level attitude: the thrust is the vertical force, and only kp.z changes it by
+  // 0.5 * kp.z * (position error) = 0.5 * 4 * 0.5
+  EXPECT_EQ(reportValue(shadow, "ticks"), 1.0);
+  EXPECT_NEAR(reportValue(shadow, "thrust_delta_max"), 1.0, 1e-5);
+  EXPECT_NEAR(reportValue(shadow, "rate_delta_max"), 0.0, 1e-6);
+}
+
+TEST(ShadowController, SameGainsMirrorTheActiveLaw) {
+  // With unit scales the shadow must reproduce the active command, MPC and residual included
+  Shadow_config config;
+  config.enable = true;
+  ShadowController shadow;
+  shadow.configure(config);
+
+  Shadow_input tick   = input();
+  tick.mpc.enable     = true;
+  tick.state.velocity = Eigen::Vector3d(0.2, -0.1, 0.0);
+  tick.reference.yaw  = 0.3;
+  tick.active         = active(tick);
+  shadow.push(tick);
+  waitForTicks(shadow, 1);
+
+  EXPECT_NEAR(reportValue(shadow, "thrust_delta_max"), 0.0, 1e-5);
+  EXPECT_NEAR(reportValue(shadow, "rate_delta_max"), 0.0, 1e-5);
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+
+#include "controller_plugin_differential_flatness/DF_state_arbiter.hpp"
+
+using controller_plugin_differential_flatness::State_sample;
+using controller_plugin_differential_flatness::StateArbiter;
+
+static constexpr int64_t ms = 1000000;
+
+// Feed a source at _period_ms for _duration_ms, stamped with _latency_ms of delay
+static void feed(StateArbiter &_arbiter,
+                 const int _id,
+                 const int64_t _start_ms,
+                 const int64_t _duration_ms,
+                 const int64_t _period_ms,
+                 const int64_t _latency_ms) {
+  for (int64_t t = _start_ms; t < _start_ms + _duration_ms; t += _period_ms) {
+    State_sample sample;
+    sample.position.x() = static_cast<double>(_id);
+    sample.stamp_ns     = (t - _latency_ms) * ms;
+    _arbiter.update(_id, sample, t * ms);
+  }
+}
+
+TEST(StateArbiter, NoSamplesNoSelection) {
+  StateArbiter arbiter;
+  arbiter.addSource("host");
+  EXPECT_EQ(arbiter.select(0), -1);
+}
+
+TEST(StateArbiter, AddSourceIsIdempotentAndBounded) {
+  StateArbiter arbiter;
+  EXPECT_EQ(arbiter.addSource("a"), 0);
+  EXPECT_EQ(arbiter.addSource("a"), 0);
+  for (int i = 1; i < StateArbiter::kMaxSources; i++) {
+    EXPECT_EQ(arbiter.addSource("s" + std::to_string(i)), i);
+  }
+  EXPECT_EQ(arbiter.addSource("overflow"), -1);
+}
+
+TEST(StateArbiter, RemovedSourceIsNotSelectedAndItsIdIsReused) {
+  StateArbiter arbiter;
+  const int host = arbiter.addSource("host");
+  const int gone = arbiter.addSource("gone");
+  feed(arbiter, host, 0, 1000, 10, 40);
+  feed(arbiter, gone, 0, 1000, 10, 5);
+  EXPECT_EQ(arbiter.select(1000 * ms), gone);
+
+  arbiter.removeSource(gone);
+  feed(arbiter, gone, 1000, 100, 10, 0);  // late samples of the removed source are dropped
+  EXPECT_EQ(arbiter.source(gone).seq, 0u);
+  EXPECT_EQ(arbiter.select(1000 * ms), host);
+  EXPECT_EQ(arbiter.report(1000 * ms).find("gone"), std::string::npos);
+  EXPECT_EQ(arbiter.addSource("new"), gone);
+}
+
+TEST(StateArbiter, PicksFreshestHealthySource) {
+  StateArbiter arbiter;
+  const int slow_link = arbiter.addSource("slow_link");
+  const int fast_link = arbiter.addSource("fast_link");
+  feed(arbiter, slow_link, 0, 1000, 10, 40);
+  feed(arbiter, fast_link, 0, 1000, 10, 5);
+  EXPECT_EQ(arbiter.select(1000 * ms), fast_link);
+}
+
+TEST(StateArbiter, SlowSourceIsUnhealthy) {
+  StateArbiter arbiter;
+  arbiter.config.min_rate = 20.0;
+  const int slow          = arbiter.addSource("slow");
+  const int fast          = arbiter.addSource("fast");
+  feed(arbiter, slow, 0, 1000, 100, 0);  // 10 Hz, freshest stamps
+  feed(arbiter, fast, 0, 990, 10, 5);    // 100 Hz
+  EXPECT_FALSE(arbiter.healthy(slow, 1000 * ms));
+  EXPECT_TRUE(arbiter.healthy(fast, 1000 * ms));
+  EXPECT_EQ(arbiter.select(1000 * ms), fast);
+}
+
+TEST(StateArbiter, FailsOverWhenActiveSourceGoesStale) {
+  StateArbiter arbiter;
+  const int a = arbiter.addSource("a");
+  const int b = arbiter.addSource("b");
+  feed(arbiter, a, 0, 1000, 10, 1);
+  feed(arbiter, b, 0, 1000, 10, 5);
+  EXPECT_EQ(arbiter.select(1000 * ms), a);
+
+  // a stops, b keeps publishing
+  feed(arbiter, b, 1000, 200, 10, 5);
+  EXPECT_EQ(arbiter.select(1200 * ms), b);
+}
+
+TEST(StateArbiter, HysteresisAvoidsFlapping) {
+  StateArbiter arbiter;
+  arbiter.config.switch_margin = 0.01;
+  arbiter.config.min_dwell     = 0.2;
+  const int a                  = arbiter.addSource("a");
+  const int b                  = arbiter.addSource("b");
+
+  // Both sources alternate being marginally fresher, within switch_margin
+  int switches = 0;
+  int active   = -1;
+  for (int64_t t = 0; t < 2000; t += 10) {
+    const int64_t jitter = (t / 10) % 2 ? 2 : 0;
+    State_sample sample;
+    sample.stamp_ns = (t - 3 - jitter) * ms;
+    arbiter.update(a, sample, t * ms);
+    sample.stamp_ns = (t - 5 + jitter) * ms;
+    arbiter.update(b, sample, t * ms);
+    const int selected = arbiter.select(t * ms);
+    switches += t >= 100 && selected != active;  // after the rate estimates settle
+    active = selected;
+  }
+  EXPECT_EQ(switches, 0);
+}
+
+TEST(StateArbiter, DegradedModeKeepsFreshestSample) {
+  StateArbiter arbiter;
+  const int a = arbiter.addSource("a");
+  feed(arbiter, a, 0, 100, 10, 0);
+  EXPECT_FALSE(arbiter.healthy(a, 5000 * ms));
+  EXPECT_EQ(arbiter.select(5000 * ms), a);
+  EXPECT_EQ(arbiter.source(a).selected_ticks, 1u);
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_state_transfer.hpp"
+
+using controller_plugin_differential_flatness::checkControllerState;
+using controller_plugin_differential_flatness::Controller_state;
+using controller_plugin_differential_flatness::decodeControllerState;
+using controller_plugin_differential_flatness::encodeControllerState;
+using controller_plugin_differential_flatness::kControllerStateMinSize;
+
+static Controller_state sampleState() {
+  Controller_state state;
+  state.flags              = Controller_state::PARAMETERS_READ | Controller_state::STATE_RECEIVED;
+  state.mass               = 0.82;
+  state.ki[2]              = 0.065;
+  state.accum_pos_error[0] = 0.25;
+  state.attitude[2]        = 0.1;
+  state.ref_yaw            = 1.5;
+  state.mode_in[0]         = 4;
+  state.tick               = 123456;
+  return state;
+}
+
+TEST(StateTransfer, RoundTrip) {
+  const std::vector<uint8_t> bytes = encodeControllerState(sampleState());
+  Controller_state state;
+  std::string error;
+  ASSERT_TRUE(decodeControllerState(bytes, state, error)) << error;
+  EXPECT_EQ(state.version, Controller_state::kVersion);
+  EXPECT_EQ(state.flags, sampleState().flags);
+  EXPECT_EQ(state.mass, 0.82);
+  EXPECT_EQ(state.ki[2], 0.065);
+  EXPECT_EQ(state.accum_pos_error[0], 0.25);
+  EXPECT_EQ(state.attitude[2], 0.1);
+  EXPECT_EQ(state.ref_yaw, 1.5);
+  EXPECT_EQ(state.mode_in[0], 4);
+  EXPECT_EQ(state.tick, 123456u);
+}
+
+TEST(StateTransfer, RejectsForeignOrCorruptBytes) {
+  Controller_state state = sampleState();
+  std::string error;
+
+  std::vector<uint8_t> bytes = encodeControllerState(sampleState());
+  bytes[0] ^= 0xff;
+  EXPECT_FALSE(decodeControllerState(bytes, state, error));
+  EXPECT_FALSE(error.empty());
+
+  bytes = encodeControllerState(sampleState());
+  bytes.pop_back();
+  EXPECT_FALSE(decodeControllerState(bytes, state, error));
+
+  bytes.resize(4);
+  EXPECT_FALSE(decodeControllerState(bytes, state, error));
+
+  // Failed decodes leave the state untouched
+  EXPECT_EQ(state.tick, 123456u);
+}
+
+TEST(StateTransfer, ReadsOtherVersions) {
+  std::string error;
+
+  // A later build appends fields: the known prefix is read, the rest ignored
+  std::vector<uint8_t> newer = encodeControllerState(sampleState());
+  newer.resize(newer.size() + 24, 0xab);
+  const uint32_t newer_size    = newer.size();
+  const uint32_t newer_version = Controller_state::kVersion + 1;
+  std::memcpy(newer.data() + offsetof(Controller_state, size), &newer_size, sizeof(uint32_t));
+  std::memcpy(newer.data() + offsetof(Controller_state, version), &newer_version,
+              sizeof(uint32_t));
+  Controller_state state;
+  ASSERT_TRUE(decodeControllerState(newer, state, error)) << error;
+  EXPECT_EQ(state.version, newer_version);
+  EXPECT_EQ(state.tick, 123456u);
+
+  // Version 1 is the oldest accepted one
+  std::vector<uint8_t> older = encodeControllerState(sampleState());
+  older.resize(kControllerStateMinSize - 8);
+  const uint32_t older_size = older.size();
+  std::memcpy(older.data() + offsetof(Controller_state, size), &older_size, sizeof(uint32_t));
+  EXPECT_FALSE(decodeControllerState(older, state, error));
+}
+
+TEST(StateTransfer, ChecksTheValues) {
+  Controller_state state = sampleState();
+  std::string error;
+  // Gains read by the exporting instance must be usable
+  EXPECT_FALSE(checkControllerState(state, error));
+  EXPECT_NE(error.find("kp"), std::string::npos) << error;
+  for (int i = 0; i < 3; i++) state.kp[i] = state.kp_ang[i] = 1.0;
+  EXPECT_TRUE(checkControllerState(state, error)) << error;
+
+  Controller_state bad = state;
+  bad.mass             = 0.0;
+  EXPECT_FALSE(checkControllerState(bad, error));
+  bad       = state;
+  bad.kd[1] = -1.0;
+  EXPECT_FALSE(checkControllerState(bad, error));
+  bad                    = state;
+  bad.accum_pos_error[2] = NAN;
+  EXPECT_FALSE(checkControllerState(bad, error));
+  EXPECT_NE(error.find("accum_pos_error"), std::string::npos) << error;
+
+  // Without PARAMETERS_READ the gains are not taken over, only the rest is checked
+  bad       = sampleState();
+  bad.flags = Controller_state::STATE_RECEIVED;
+  EXPECT_TRUE(checkControllerState(bad, error)) << error;
+  bad.thrust = INFINITY;
+  EXPECT_FALSE(checkControllerState(bad, error));
+}
@@ -0,0 +1,49 @@
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+
+#include "controller_plugin_differential_flatness/DF_swarm_sim.hpp"
+
+/* One closed loop step of the whole formation, controller and dynamics of every vehicle. Items
+ * are vehicle steps, so the rate is comparable across fleet sizes and thread counts. */
+
+using controller_plugin_differential_flatness::Swarm_config;
+using controller_plugin_differential_flatness::Swarm_origin;
+using controller_plugin_differential_flatness::SwarmSimulator;
+
+static void BM_SWARM_STEP(benchmark::State &state) {
+  Swarm_config config;
+  config.vehicles             = static_cast<size_t>(state.range(0));
+  config.threads              = static_cast<int>(state.range(1));
+  config.gains.kp             = Eigen::Vector3d(6.0, 6.0, 6.0);
+  config.gains.ki             = Eigen::Vector3d(0.005, 0.005, 0.065);
+  config.gains.kd             = Eigen::Vector3d(1.5, 1.5, 3.0);
+  config.gains.kp_ang         = Eigen::Vector3d(5.5, 5.5, 2.0);
+  config.gains.mass           = config.mass;
+  config.gains.antiwindup_cte = 1.0;
+  config.limits.max_tilt      = 0.6;
+
+  const auto circle = [](const double _t) {
+    Swarm_origin origin;
+    origin.reference.position =
+        Eigen::Vector3d(20.0 * std::cos(0.2 * _t), 20.0 * std::sin(0.2 * _t), 10.0);
+    origin.reference.yaw = 0.2 * _t;
+    origin.yaw_rate      = 0.2;
+    return origin;
+  };
+
+  SwarmSimulator swarm(config);
+  for (size_t i = 0; i < swarm.size(); i++) {
+    swarm.setOffset(i, Eigen::Vector3d(2.0 * (i % 32), 2.0 * (i / 32), 0.0), 0.0);
+  }
+  swarm.resetToFormation(circle(0.0));
+
+  // Ten steps per iteration amortize the thread start up as a real run would
+  for (auto _ : state) swarm.run(10, circle);
+  state.SetItemsProcessed(static_cast<int64_t>(swarm.stats().vehicle_steps));
+  state.counters["real_time_factor"] = swarm.stats().time / (swarm.stats().wall_ns * 1e-9);
+}
+BENCHMARK(BM_SWARM_STEP)
+    ->ArgNames({"vehicles", "threads"})
+    ->ArgsProduct({{100, 1000, 10000}, {1, 0}})
+    ->UseRealTime();
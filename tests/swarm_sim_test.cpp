@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_control_law.hpp"
+#include "controller_plugin_differential_flatness/DF_swarm_sim.hpp"
+
+using controller_plugin_differential_flatness::Acro_command;
+using controller_plugin_differential_flatness::ControlLaw;
+using controller_plugin_differential_flatness::Swarm_config;
+using controller_plugin_differential_flatness::Swarm_origin;
+using controller_plugin_differential_flatness::Swarm_vehicle;
+using controller_plugin_differential_flatness::SwarmSimulator;
+
+static Swarm_config config(const size_t _vehicles, const int _threads) {
+  Swarm_config config;
+  config.vehicles             = _vehicles;
+  config.threads              = _threads;
+  config.gains.kp             = Eigen::Vector3d(6.0, 6.0, 8.0);
+  config.gains.ki             = Eigen::Vector3d(0.5, 0.5, 1.0);
+  config.gains.kd             = Eigen::Vector3d(3.0, 3.0, 4.0);
+  config.gains.kp_ang         = Eigen::Vector3d(5.0, 5.0, 3.0);
+  config.gains.mass           = config.mass;
+  config.gains.antiwindup_cte = 1.0;
+  config.limits.max_thrust    = 30.0;
+  config.limits.max_tilt      = 0.6;
+  config.limits.max_rate      = 6.0;
+  return config;
+}
+
+/* Formation origin turning on a circle of radius r at w rad/s, heading along the path */
+static Swarm_origin circle(const double _t, const double _r = 4.0, const double _w = 0.3) {
+  Swarm_origin origin;
+  origin.reference.position = Eigen::Vector3d(_r * std::cos(_w * _t), _r * std::sin(_w * _t), 3);
+  origin.reference.velocity =
+      Eigen::Vector3d(-_r * _w * std::sin(_w * _t), _r * _w * std::cos(_w * _t), 0.0);
+  origin.reference.acceleration =
+      -_w * _w * Eigen::Vector3d(origin.reference.position.x(), origin.reference.position.y(), 0);
+  origin.reference.yaw = std::remainder(_w * _t + M_PI_2, 2.0 * M_PI);
+  origin.yaw_rate      = _w;
+  return origin;
+}
+
+static void grid(SwarmSimulator &_swarm) {
+  for (size_t i = 0; i < _swarm.size(); i++) {
+    _swarm.setOffset(i, Eigen::Vector3d(i % 10 * 1.5, i / 10 * 1.5, 0.0), 0.05 * (i % 7));
+  }
+}
+
+TEST(SwarmSim, MatchesTheControlLaw) {
+  // Each vehicle command must be the one ControlLaw computes from the same state, the kernel
+  // is only a different layout of the same math
+  SwarmSimulator swarm(config(13, 1));
+  grid(swarm);
+  swarm.resetToFormation(circle(0.0));
+  // Start away from the slots, so every term of the law is exercised
+  for (size_t i = 0; i < swarm.size(); i++) {
+    Swarm_vehicle vehicle = swarm.vehicle(i);
+    vehicle.position += Eigen::Vector3d(0.3 * (i % 3), -0.2 * (i % 5), 0.1 * i);
+    vehicle.attitude = Eigen::Quaterniond(Eigen::AngleAxisd(0.2 * i, Eigen::Vector3d::UnitZ()));
+    swarm.setVehicle(i, vehicle);
+  }
+
+  std::vector<ControlLaw> laws(swarm.size());
+  for (ControlLaw &law : laws) {
+    law.gains            = swarm.config().gains;
+    law.sanitizer.limits = swarm.config().limits;
+  }
+
+  for (int k = 0; k < 300; k++) {
+    const double t = k * swarm.config().dt;
+    std::vector<Swarm_vehicle> before(swarm.size());
+    for (size_t i = 0; i < swarm.size(); i++) before[i] = swarm.vehicle(i);
+    swarm.run(1, [](const double _t) { return circle(_t); });
+
+    const Swarm_origin origin = circle(t);
+    const double yaw          = origin.reference.yaw;
+    for (size_t i = 0; i < swarm.size(); i++) {
+      const Eigen::Vector3d offset(i % 10 * 1.5, i / 10 * 1.5, 0.0);
+      const Eigen::Vector3d d = Eigen::AngleAxisd(yaw, Eigen::Vector3d::UnitZ()) * offset;
+      const Eigen::Vector3d w(0.0, 0.0, origin.yaw_rate);
+
+      const Eigen::Quaterniond &q = before[i].attitude;
+      const Acro_command command = laws[i].computeTrajectoryControl(
+          swarm.config().dt, before[i].position, before[i].velocity,
+          tf2::Quaternion(q.x(), q.y(), q.z(), q.w()), origin.reference.position + d,
+          origin.reference.velocity + w.cross(d),
+          origin.reference.acceleration + w.cross(w.cross(d)),
+          std::remainder(yaw + 0.05 * (i % 7), 2.0 * M_PI));
+
+      const Swarm_vehicle after = swarm.vehicle(i);
+      ASSERT_NEAR((after.rates - command.PQR).norm(), 0.0, 1e-9) << "vehicle " << i << " k " << k;
+      ASSERT_NEAR(after.thrust, command.thrust, 1e-5) << "vehicle " << i << " k " << k;
+    }
+  }
+}
+
+TEST(SwarmSim, ThreadsDoNotChangeTheResult) {
+  SwarmSimulator single(config(100, 1));
+  SwarmSimulator multi(config(100, 4));
+  for (SwarmSimulator *swarm : {&single, &multi}) {
+    grid(*swarm);
+    swarm->resetToFormation(circle(0.0));
+    Swarm_vehicle first = swarm->vehicle(0);
+    first.position.z() -= 1.0;
+    swarm->setVehicle(0, first);
+    swarm->run(200, [](const double _t) { return circle(_t); });
+  }
+  for (size_t i = 0; i < single.size(); i++) {
+    EXPECT_EQ(single.vehicle(i).position, multi.vehicle(i).position) << "vehicle " << i;
+    EXPECT_EQ(single.vehicle(i).thrust, multi.vehicle(i).thrust) << "vehicle " << i;
+  }
+  EXPECT_EQ(single.stats().vehicle_steps, 100u * 200u);
+  EXPECT_DOUBLE_EQ(single.stats().time, 2.0);
+}
+
+TEST(SwarmSim, FormationConverges) {
+  SwarmSimulator swarm(config(50, 2));
+  grid(swarm);
+  swarm.resetToFormation(circle(0.0));
+  // Every vehicle starts one meter below its slot
+  for (size_t i = 0; i < swarm.size(); i++) {
+    Swarm_vehicle vehicle = swarm.vehicle(i);
+    vehicle.position.z() -= 1.0;
+    swarm.setVehicle(i, vehicle);
+  }
+  swarm.run(1, [](const double _t) { return circle(_t); });
+  EXPECT_GT(swarm.stats().position_error_max, 0.9);
+
+  swarm.run(999, [](const double _t) { return circle(_t); });
+  EXPECT_LT(swarm.stats().position_error_rms, 0.1);
+  EXPECT_LT(swarm.stats().position_error_max, 0.2);
+  EXPECT_NE(swarm.report().find("vehicles: 50"), std::string::npos);
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+
+#include "controller_plugin_differential_flatness/DF_telemetry_codec.hpp"
+
+using namespace controller_plugin_differential_flatness;
+
+static Telemetry_sample makeSample(uint32_t tick) {
+  Telemetry_sample sample;
+  sample.tick = tick;
+  for (uint8_t i = 0; i < kTelemetryChannels; i++) {
+    sample.values[i] = 0.01f * tick + i - 0.5f * (tick % 3);
+  }
+  return sample;
+}
+
+TEST(TelemetryCodec, Varint) {
+  for (uint64_t value : {0ull, 1ull, 127ull, 128ull, 300ull, 1ull << 40}) {
+    std::vector<uint8_t> buffer;
+    telemetry_codec::putVarint(buffer, value);
+    const uint8_t *p = buffer.data();
+    uint64_t decoded;
+    ASSERT_TRUE(telemetry_codec::getVarint(p, buffer.data() + buffer.size(), decoded));
+    EXPECT_EQ(decoded, value);
+  }
+  for (int64_t value : {0ll, -1ll, 1ll, -1000ll, 1000ll}) {
+    EXPECT_EQ(telemetry_codec::unzigzag(telemetry_codec::zigzag(value)), value);
+  }
+}
+
+TEST(TelemetryCodec, AggregatorPreservesMinMaxMean) {
+  TelemetryAggregator aggregator;
+  Telemetry_sample sample;
+  const float values[] = {1.0f, -2.0f, 4.0f, 1.0f};
+  for (int i = 0; i < 4; i++) {
+    sample.tick      = 100 + i;
+    sample.values[0] = values[i];
+    EXPECT_EQ(aggregator.add(sample, 4), i == 3);
+  }
+  const Telemetry_record record = aggregator.take();
+  EXPECT_EQ(record.tick, 100u);
+  EXPECT_EQ(record.count, 4);
+  EXPECT_FLOAT_EQ(record.min[0], -2.0f);
+  EXPECT_FLOAT_EQ(record.max[0], 4.0f);
+  EXPECT_FLOAT_EQ(record.mean[0], 1.0f);
+}
+
+TEST(TelemetryCodec, PacketRoundTrip) {
+  const float resolution = 1e-3f;
+  TelemetryAggregator aggregator;
+  std::vector<Telemetry_record> records;
+  for (uint32_t tick = 0; tick < 50; tick++) {
+    if (aggregator.add(makeSample(tick), 5)) records.push_back(aggregator.take());
+  }
+
+  telemetry_codec::PacketEncoder encoder;
+  encoder.begin(7, 5, resolution);
+  size_t encoded = 0;
+  while (encoded < records.size() && encoder.add(records[encoded], 1400)) encoded++;
+  ASSERT_EQ(encoded, records.size());
+
+  const std::vector<uint8_t> &bytes = encoder.finish();
+  telemetry_codec::Telemetry_packet packet;
+  ASSERT_TRUE(telemetry_codec::decodePacket(bytes.data(), bytes.size(), packet));
+  EXPECT_EQ(packet.seq, 7);
+  EXPECT_EQ(packet.decimation, 5);
+  ASSERT_EQ(packet.records.size(), records.size());
+  for (size_t r = 0; r < records.size(); r++) {
+    EXPECT_EQ(packet.records[r].tick, records[r].tick);
+    EXPECT_EQ(packet.records[r].count, records[r].count);
+    for (uint8_t i = 0; i < kTelemetryChannels; i++) {
+      EXPECT_NEAR(packet.records[r].mean[i], records[r].mean[i], resolution);
+      EXPECT_NEAR(packet.records[r].min[i], records[r].min[i], 2 * resolution);
+      EXPECT_NEAR(packet.records[r].max[i], records[r].max[i], 2 * resolution);
+    }
+  }
+}
+
+TEST(TelemetryCodec, PacketSizeLimit) {
+  TelemetryAggregator aggregator;
+  aggregator.add(makeSample(1), 1);
+  const Telemetry_record record = aggregator.take();
+
+  telemetry_codec::PacketEncoder encoder;
+  encoder.begin(0, 1, 1e-3f);
+  const size_t header = encoder.size();
+  EXPECT_FALSE(encoder.add(record, header + 4));
+  EXPECT_EQ(encoder.size(), header);
+  EXPECT_EQ(encoder.records(), 0u);
+  EXPECT_TRUE(encoder.add(record, 255));
+}
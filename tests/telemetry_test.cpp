@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_telemetry.hpp"
+
+using namespace controller_plugin_differential_flatness;
+using telemetry_codec::Telemetry_packet;
+
+/* UDP receiver on a free loopback port */
+struct Receiver {
+  Receiver() {
+    socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(socket_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    socklen_t size = sizeof(addr);
+    getsockname(socket_fd, reinterpret_cast<sockaddr *>(&addr), &size);
+    port = ntohs(addr.sin_port);
+  }
+  ~Receiver() { close(socket_fd); }
+
+  bool receive(Telemetry_packet &_packet) {
+    pollfd pfd{socket_fd, POLLIN, 0};
+    if (poll(&pfd, 1, 3000) <= 0) return false;
+    std::vector<uint8_t> buffer(2048);
+    const ssize_t n = recv(socket_fd, buffer.data(), buffer.size(), 0);
+    return n > 0 && telemetry_codec::decodePacket(buffer.data(), n, _packet);
+  }
+
+  int socket_fd = -1;
+  int port      = 0;
+};
+
+static Telemetry_sample sample(const uint32_t _tick) {
+  Telemetry_sample sample;
+  sample.tick = _tick;
+  sample.values.fill(0.5f * _tick);
+  return sample;
+}
+
+TEST(TelemetryStream, ReportsAnInvalidHost) {
+  Telemetry_config config;
+  config.enable   = true;
+  config.udp_host = "not-an-address";
+  TelemetryStream stream;
+  std::string error;
+  EXPECT_FALSE(stream.configure(config, error));
+  EXPECT_NE(error.find("udp_host"), std::string::npos) << error;
+  EXPECT_FALSE(stream.enabled());
+
+  // Fixing the host starts it
+  config.udp_host = "127.0.0.1";
+  EXPECT_TRUE(stream.configure(config, error)) << error;
+  EXPECT_TRUE(stream.enabled());
+}
+
+TEST(TelemetryStream, RestartBeginsWithAKeyFrame) {
+  Receiver receiver;
+  Telemetry_config config;
+  config.enable     = true;
+  config.udp_port   = receiver.port;
+  config.decimation = 4;
+  TelemetryStream stream;
+  std::string error;
+  ASSERT_TRUE(stream.configure(config, error)) << error;
+
+  // Two full windows and a partial one, flushed by the restart
+  for (uint32_t tick = 1; tick <= 10; tick++) stream.push(sample(tick));
+  config.decimation = 3;
+  ASSERT_TRUE(stream.configure(config, error)) << error;
+  Telemetry_packet packet;
+  ASSERT_TRUE(receiver.receive(packet));
+  ASSERT_EQ(packet.records.size(), 2u);
+
+  // The partial window is not carried into the new run, its first record is whole and absolute
+  for (uint32_t tick = 100; tick < 103; tick++) stream.push(sample(tick));
+  config.decimation = 5;
+  ASSERT_TRUE(stream.configure(config, error)) << error;
+  ASSERT_TRUE(receiver.receive(packet));
+  ASSERT_EQ(packet.records.size(), 1u);
+  EXPECT_EQ(packet.decimation, 3u);
+  EXPECT_EQ(packet.records[0].tick, 100u);
+  EXPECT_EQ(packet.records[0].count, 3u);
+  EXPECT_NEAR(packet.records[0].mean[0], 50.5f, 1e-3);
+}
@@ -1,7 +1,8 @@
-find_package(gtest QUIET)
-if (${Gtest_FOUND})
+find_package(GTest QUIET)
+if (${GTest_FOUND})
   MESSAGE(STATUS "Found Gtest.")
-else (${Gtest_FOUND})
+  set(GTEST_MAIN_TARGET GTest::gtest_main)
+else (${GTest_FOUND})
   MESSAGE(STATUS "Could not locate Gtest.")
   include(FetchContent)
   FetchContent_Declare(
@@ -11,8 +12,9 @@ else (${Gtest_FOUND})
   # For Windows: Prevent overriding the parent project's compiler/linker settings
   set(gtest_force_shared_crt ON CACHE BOOL "" FORCE)
   FetchContent_MakeAvailable(googletest)
+  set(GTEST_MAIN_TARGET gtest_main)
 
-endif(${Gtest_FOUND})
+endif(${GTest_FOUND})
 
 include(GoogleTest)
 
@@ -20,6 +22,8 @@ enable_testing()
 # find all *.cpp files in the tests directory
 
 file(GLOB TEST_SOURCES tests/*test.cpp )
+# plugin_test.cpp is a node driving a running controller by hand, not a gtest
+list(FILTER TEST_SOURCES EXCLUDE REGEX ".*/plugin_test\\.cpp$")
 
 # create a test executable for each test file
 foreach(TEST_SOURCE ${TEST_SOURCES})
@@ -30,9 +34,9 @@ foreach(TEST_SOURCE ${TEST_SOURCES})
   string(SUBSTRING ${_src_filename} 0 ${final_length} TEST_NAME)
   
   message(STATUS ${SOURCE_CPP_FILES})
-  add_executable(${TEST_NAME}_test ${TEST_SOURCE} ${SOURCE_CPP_FILES} )
+  add_executable(${TEST_NAME}_test ${TEST_SOURCE} ${SOURCE_CPP_FILES} ${SWARM_CPP_FILES})
   ament_target_dependencies(${TEST_NAME}_test  ${PROJECT_DEPENDENCIES})
-  target_link_libraries(${TEST_NAME}_test gtest_main)
+  target_link_libraries(${TEST_NAME}_test ${PROJECT_NAME}_core ${GTEST_MAIN_TARGET})
 
   # add the test executable to the list of executables to build
   gtest_discover_tests(${TEST_NAME}_test)
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_tick_source.hpp"
+
+using controller_plugin_differential_flatness::Tick_source_config;
+using controller_plugin_differential_flatness::Tick_source_stats;
+using controller_plugin_differential_flatness::TickSource;
+
+/* Run a tick source for _ticks ticks, sleeping _stall_ms inside tick 10 */
+static Tick_source_stats runTicks(const Tick_source_config &_config,
+                                  const int _ticks,
+                                  const int _stall_ms,
+                                  std::vector<double> &_dts) {
+  _dts.reserve(_ticks + 16);
+  std::atomic<int> n{0};
+  TickSource source;
+  source.start(_config, [&](const double _dt) {
+    if (n.load() >= _ticks) return;
+    _dts.push_back(_dt);
+    if (n.fetch_add(1) == 10 && _stall_ms > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(_stall_ms));
+    }
+  });
+  while (n.load() < _ticks) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  source.stop();
+  return source.stats();
+}
+
+TEST(TickSource, DtIsTheTrueElapsedTime) {
+  Tick_source_config config;
+  config.rate = 500.0;
+  std::vector<double> dts;
+  const Tick_source_stats stats = runTicks(config, 250, 0, dts);
+
+  // dt is the measured period itself
+  EXPECT_LT(stats.period.dt_error_max, 1e-9);
+
+  // Absolute deadlines: the total time is the due one up to the wake up latency of the first
+  // and last ticks, however late the ticks in between were
+  const double due = (stats.period.periods + stats.skipped) * stats.nominal_ns;
+  EXPECT_LT(std::abs(stats.period.sum_ns - due), stats.nominal_ns + stats.max_latency_ns);
+}
+
+TEST(TickSource, SkipsMissedDeadlines) {
+  Tick_source_config config;
+  config.rate     = 200.0;
+  config.catch_up = false;
+  std::vector<double> dts;
+  const Tick_source_stats stats = runTicks(config, 30, 12, dts);
+
+  // A 12 ms stall at 5 ms misses two deadlines, the next tick waits for the third one
+  EXPECT_GE(stats.overruns, 1u);
+  EXPECT_GE(stats.skipped, 2u);
+  EXPECT_EQ(stats.caught_up, 0u);
+  EXPECT_GE(dts[11], 0.012);
+}
+
+TEST(TickSource, CatchesUpMissedDeadlines) {
+  Tick_source_config config;
+  config.rate         = 200.0;
+  config.catch_up     = true;
+  config.max_catch_up = 3;
+  std::vector<double> dts;
+  const Tick_source_stats stats = runTicks(config, 30, 12, dts);
+
+  // Both missed ticks run right after the stall, with their true, short, dt
+  EXPECT_GE(stats.caught_up, 2u);
+  EXPECT_LT(dts[12], 0.005);
+  const double due = (stats.period.periods + stats.skipped) * stats.nominal_ns;
+  EXPECT_LT(std::abs(stats.period.sum_ns - due), stats.nominal_ns + stats.max_latency_ns);
+}
+
+TEST(TickSource, HandOverKeepsThePhase) {
+  Tick_source_config config;
+  config.rate = 200.0;
+  std::vector<int64_t> stamps;
+  stamps.reserve(256);
+  auto tick = [&](const double) {
+    stamps.push_back(std::chrono::steady_clock::now().time_since_epoch().count());
+  };
+
+  // The replacing source starts on the deadline the stopped one woke up for and did not run
+  TickSource first, second;
+  first.start(config, tick);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  first.stop();
+  const size_t handed_over = stamps.size();
+  second.start(config, tick, first.nextDeadlineNs());
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  second.stop();
+
+  ASSERT_GT(handed_over, 10u);
+  ASSERT_GT(stamps.size(), handed_over + 10);
+  const int64_t gap = stamps[handed_over] - stamps[handed_over - 1];
+  // The handed over tick is at most one period plus its own wake up latency after the last one
+  EXPECT_LT(gap, 5e6 + second.stats().max_latency_ns + 1e5) << "a tick was lost in the hand over";
+  EXPECT_EQ(second.stats().skipped, 0u);
+}
+
+TEST(TickSource, PhaseCallbackShiftsTheDeadlines) {
+  Tick_source_config config;
+  config.rate = 500.0;
+  std::atomic<int> n{0};
+  TickSource source;
+  // Every deadline comes 100 us earlier than the previous one, a 1.9 ms period
+  source.start(config, [&](const double) { n++; }, 0, [] { return int64_t{100000}; });
+  while (n.load() < 200) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  source.stop();
+  const Tick_source_stats stats = source.stats();
+
+  EXPECT_EQ(stats.phase_shift_ns, static_cast<int64_t>(stats.ticks) * 100000);
+  const double due = (stats.period.periods + stats.skipped) * 1.9e6;
+  EXPECT_LT(std::abs(stats.period.sum_ns - due), stats.nominal_ns + stats.max_latency_ns);
+}
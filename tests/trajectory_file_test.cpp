@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_trajectory_file.hpp"
+
+using controller_plugin_differential_flatness::Trajectory_record;
+using controller_plugin_differential_flatness::TrajectoryFile;
+
+static std::string tempPath(const char *_name) {
+  return std::string(::testing::TempDir()) + _name;
+}
+
+/* Straight line along x at 1 m/s, sampled every 10 ms, yaw crossing +-pi */
+static std::vector<Trajectory_record> line(const size_t _n) {
+  std::vector<Trajectory_record> records(_n);
+  for (size_t i = 0; i < _n; i++) {
+    Trajectory_record &r = records[i];
+    r.t                  = 2.0 + 0.01 * i;
+    r.position[0]        = 0.01 * i;
+    r.position[2]        = 1.0;
+    r.velocity[0]        = 1.0;
+    r.yaw                = std::remainder(3.1 + 0.001 * i, 2.0 * M_PI);
+  }
+  return records;
+}
+
+TEST(TrajectoryFile, RoundTripAndInterpolation) {
+  const std::string path = tempPath("line.dftraj");
+  std::string error;
+  ASSERT_TRUE(TrajectoryFile::write(path, line(501), error)) << error;
+
+  TrajectoryFile file;
+  ASSERT_TRUE(file.open(path, error)) << error;
+  EXPECT_EQ(file.size(), 501u);
+  EXPECT_NEAR(file.duration(), 5.0, 1e-9);
+
+  const Trajectory_record r = file.sample(1.2345);
+  EXPECT_NEAR(r.t, 3.2345, 1e-9);
+  EXPECT_NEAR(r.position[0], 1.2345, 1e-9);
+  EXPECT_NEAR(r.position[2], 1.0, 1e-12);
+  EXPECT_NEAR(r.velocity[0], 1.0, 1e-12);
+
+  // Before the start and past the end clamp to the first and last records
+  EXPECT_NEAR(file.sample(-1.0).position[0], 0.0, 1e-12);
+  EXPECT_NEAR(file.sample(10.0).position[0], 5.0, 1e-9);
+  std::remove(path.c_str());
+}
+
+TEST(TrajectoryFile, YawInterpolatesAcrossPi) {
+  const std::string path = tempPath("yaw.dftraj");
+  std::string error;
+  ASSERT_TRUE(TrajectoryFile::write(path, line(201), error)) << error;
+  TrajectoryFile file;
+  ASSERT_TRUE(file.open(path, error)) << error;
+
+  for (double t = 0.0; t < 2.0; t += 0.0037) {
+    const double expected = std::remainder(3.1 + 0.1 * t, 2.0 * M_PI);
+    EXPECT_NEAR(std::remainder(file.sample(t).yaw - expected, 2.0 * M_PI), 0.0, 1e-9) << t;
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TrajectoryFile, RejectsInvalidFiles) {
+  std::string error;
+  TrajectoryFile file;
+  EXPECT_FALSE(file.open(tempPath("missing.dftraj"), error));
+  EXPECT_FALSE(file.isOpen());
+
+  // Samples off the constant period grid can not be indexed by time
+  std::vector<Trajectory_record> records = line(100);
+  records[50].t += 0.004;
+  const std::string path = tempPath("jitter.dftraj");
+  ASSERT_TRUE(TrajectoryFile::write(path, records, error)) << error;
+  EXPECT_FALSE(file.open(path, error));
+  EXPECT_NE(error.find("grid"), std::string::npos);
+
+  // Truncated: the header promises more records than the file holds
+  ASSERT_TRUE(TrajectoryFile::write(path, line(100), error)) << error;
+  ASSERT_EQ(truncate(path.c_str(), sizeof(TrajectoryFile::Header) + 10 * sizeof(Trajectory_record)),
+            0);
+  EXPECT_FALSE(file.open(path, error));
+  std::remove(path.c_str());
+}
+
+TEST(TrajectoryFile, MoveKeepsMapping) {
+  const std::string path = tempPath("move.dftraj");
+  std::string error;
+  ASSERT_TRUE(TrajectoryFile::write(path, line(11), error)) << error;
+  TrajectoryFile file;
+  ASSERT_TRUE(file.open(path, error)) << error;
+
+  TrajectoryFile moved(std::move(file));
+  EXPECT_FALSE(file.isOpen());
+  ASSERT_TRUE(moved.isOpen());
+  EXPECT_NEAR(moved.sample(0.05).position[0], 0.05, 1e-9);
+  std::remove(path.c_str());
+}
+
+TEST(TrajectoryFile, RewriteKeepsTheOpenMapping) {
+  // Playback of the old file continues untouched while a new one replaces it
+  const std::string path = tempPath("rewrite.dftraj");
+  std::string error;
+  ASSERT_TRUE(TrajectoryFile::write(path, line(101), error)) << error;
+  TrajectoryFile playing;
+  ASSERT_TRUE(playing.open(path, error)) << error;
+
+  std::vector<Trajectory_record> records = line(11);
+  for (Trajectory_record &r : records) r.position[2] = 5.0;
+  ASSERT_TRUE(TrajectoryFile::write(path, records, error)) << error;
+  EXPECT_EQ(playing.size(), 101u);
+  EXPECT_NEAR(playing.sample(0.5).position[2], 1.0, 1e-12);
+
+  TrajectoryFile replaced;
+  ASSERT_TRUE(replaced.open(path, error)) << error;
+  EXPECT_EQ(replaced.size(), 11u);
+  EXPECT_NEAR(replaced.sample(0.05).position[2], 5.0, 1e-12);
+  std::remove(path.c_str());
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include "controller_plugin_differential_flatness/triple_buffer.hpp"
+
+using controller_plugin_differential_flatness::TripleBuffer;
+
+TEST(TripleBuffer, EmptyUntilPublished) {
+  TripleBuffer<int> buffer;
+  EXPECT_FALSE(buffer.update());
+  EXPECT_FALSE(buffer.hasValue());
+
+  buffer.back() = 7;
+  buffer.publish();
+  EXPECT_TRUE(buffer.update());
+  EXPECT_TRUE(buffer.hasValue());
+  EXPECT_EQ(buffer.front(), 7);
+  EXPECT_FALSE(buffer.update());
+  EXPECT_EQ(buffer.front(), 7);
+}
+
+TEST(TripleBuffer, ConsumerGetsLatestValue) {
+  TripleBuffer<int> buffer;
+  for (int i = 0; i < 5; i++) {
+    buffer.back() = i;
+    buffer.publish();
+  }
+  EXPECT_TRUE(buffer.update());
+  EXPECT_EQ(buffer.front(), 4);
+}
+
+struct Pair {
+  long a = 0;
+  long b = 0;
+};
+
+TEST(TripleBuffer, ConcurrentReadsAreNeverTorn) {
+  TripleBuffer<Pair> buffer;
+  constexpr long n_writes = 200000;
+
+  std::thread producer([&buffer]() {
+    for (long i = 1; i <= n_writes; i++) {
+      buffer.back() = Pair{i, -i};
+      buffer.publish();
+    }
+  });
+
+  long last = 0;
+  while (last < n_writes) {
+    if (buffer.update()) {
+      const Pair &value = buffer.front();
+      ASSERT_EQ(value.a, -value.b);
+      ASSERT_GE(value.a, last);
+      last = value.a;
+    }
+  }
+  producer.join();
+}
@@ -0,0 +1,402 @@
+/*!*******************************************************************************************
+ *  \file       autopilot_loopback.cpp
+ *  \brief      Autopilot stand-in closing the loop around the controller on a single host.
+ *
+ *  Consumes the rate/thrust commands produced by the controller, integrates a simple
+ *  multirotor model and publishes the resulting pose and twist as self localization, so the
+ *  whole command path can be measured without a vehicle attached.
+ *
+ *  The controller stamps each command with the time it was computed. The loopback keeps the
+ *  publication time of its recent odometry samples and answers each sample with the first
+ *  command stamped after it, so the loop latency runs from the publication of a sample to the
+ *  first command that can have reacted to it reaching the vehicle model.
+ *
+ *  Two transports are available for the command path:
+ *    - "dds": commands are consumed directly from the actuator_command topics.
+ *    - "udp": commands are encoded in a MAVLink-style binary packet and sent through a UDP
+ *             socket on the loopback interface before reaching the vehicle model, as a
+ *             ground link or companion computer bridge would do.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <as2_msgs/msg/thrust.hpp>
+#include <geometry_msgs/msg/pose_stamped.hpp>
+#include <geometry_msgs/msg/twist_stamped.hpp>
+#include <rclcpp/rclcpp.hpp>
+#include "as2_core/names/topics.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// MAVLink-style framing of a SET_ATTITUDE_TARGET body rate + thrust setpoint
+#pragma pack(push, 1)
+struct RateThrustPacket {
+  uint8_t magic       = 0xFD;
+  uint8_t msg_id      = 82;
+  uint16_t seq        = 0;
+  int64_t stamp_ns    = 0;  // stamp of the command produced by the controller
+  int64_t sent_ns     = 0;  // when the packet left the bridge
+  float body_rates[3] = {0.0f, 0.0f, 0.0f};
+  float thrust        = 0.0f;
+};
+#pragma pack(pop)
+
+struct VehicleState {
+  Eigen::Vector3d position    = Eigen::Vector3d::Zero();
+  Eigen::Vector3d velocity    = Eigen::Vector3d::Zero();
+  Eigen::Quaterniond attitude = Eigen::Quaterniond::Identity();
+  Eigen::Vector3d rates       = Eigen::Vector3d::Zero();
+};
+
+// Publication times of the recent odometry samples, each one answered by the first command
+// computed after it
+struct OdometryRing {
+  static constexpr size_t kSize = 64;
+  std::array<int64_t, kSize> stamps_ns{};
+  std::array<bool, kSize> answered{};
+  size_t next = 0;
+
+  void push(int64_t _stamp_ns) {
+    stamps_ns[next] = _stamp_ns;
+    answered[next]  = false;
+    next            = (next + 1) % kSize;
+  }
+  // Outcome of a command stamp against the newest sample published before it: first answer,
+  // repeated answer, or no such sample. _odom_ns is set to the sample on a first answer
+  enum Match { FIRST, REPEATED, UNMATCHED };
+  Match match(int64_t _command_ns, int64_t &_odom_ns) {
+    size_t newest = kSize;
+    for (size_t i = 0; i < kSize; i++) {
+      if (stamps_ns[i] == 0 || stamps_ns[i] > _command_ns) continue;
+      if (newest == kSize || stamps_ns[i] > stamps_ns[newest]) newest = i;
+    }
+    if (newest == kSize) return UNMATCHED;
+    if (answered[newest]) return REPEATED;
+    answered[newest] = true;
+    _odom_ns         = stamps_ns[newest];
+    return FIRST;
+  }
+};
+
+struct LatencyStats {
+  std::vector<double> samples_us;
+  void add(double _us) { samples_us.push_back(_us); }
+  void clear() { samples_us.clear(); }
+  double percentile(double _p) {
+    if (samples_us.empty()) return 0.0;
+    const size_t idx = std::min(samples_us.size() - 1, (size_t)(_p * samples_us.size()));
+    std::nth_element(samples_us.begin(), samples_us.begin() + idx, samples_us.end());
+    return samples_us[idx];
+  }
+};
+
+}  // namespace
+
+class AutopilotLoopback : public rclcpp::Node {
+public:
+  AutopilotLoopback() : Node("df_autopilot_loopback") {
+    transport_     = this->declare_parameter<std::string>("transport", "dds");
+    udp_port_      = this->declare_parameter<int>("udp_port", 14580);
+    mass_          = this->declare_parameter<double>("mass", 0.82);
+    rate_tau_      = this->declare_parameter<double>("rate_time_constant", 0.02);
+    drag_          = this->declare_parameter<double>("linear_drag", 0.1);
+    sim_rate_      = this->declare_parameter<double>("sim_rate", 500.0);
+    odom_rate_     = this->declare_parameter<double>("odom_rate", 100.0);
+    odom_frame_id_ = this->declare_parameter<std::string>("odom_frame_id", "odom");
+    base_frame_id_ = this->declare_parameter<std::string>("base_frame_id", "base_link");
+
+    state_.position.z() = this->declare_parameter<double>("initial_height", 0.0);
+
+    pose_pub_ = this->create_publisher<geometry_msgs::msg::PoseStamped>(
+        as2_names::topics::self_localization::pose, as2_names::topics::self_localization::qos);
+    twist_pub_ = this->create_publisher<geometry_msgs::msg::TwistStamped>(
+        as2_names::topics::self_localization::twist, as2_names::topics::self_localization::qos);
+
+    rates_sub_ = this->create_subscription<geometry_msgs::msg::TwistStamped>(
+        as2_names::topics::actuator_command::twist, as2_names::topics::actuator_command::qos,
+        std::bind(&AutopilotLoopback::ratesCallback, this, std::placeholders::_1));
+    thrust_sub_ = this->create_subscription<as2_msgs::msg::Thrust>(
+        as2_names::topics::actuator_command::thrust, as2_names::topics::actuator_command::qos,
+        std::bind(&AutopilotLoopback::thrustCallback, this, std::placeholders::_1));
+
+    if (transport_ == "udp") {
+      openUdp();
+    } else if (transport_ != "dds") {
+      RCLCPP_WARN(this->get_logger(), "Unknown transport %s, using dds", transport_.c_str());
+      transport_ = "dds";
+    }
+
+    sim_timer_ = this->create_wall_timer(std::chrono::duration<double>(1.0 / sim_rate_),
+                                         std::bind(&AutopilotLoopback::simStep, this));
+    odom_timer_ = this->create_wall_timer(std::chrono::duration<double>(1.0 / odom_rate_),
+                                          std::bind(&AutopilotLoopback::publishOdometry, this));
+    report_timer_ = this->create_wall_timer(5s, std::bind(&AutopilotLoopback::report, this));
+
+    last_step_ = std::chrono::steady_clock::now();
+    RCLCPP_INFO(this->get_logger(), "Autopilot loopback running with %s transport",
+                transport_.c_str());
+  }
+
+  ~AutopilotLoopback() {
+    running_ = false;
+    if (udp_thread_.joinable()) udp_thread_.join();
+    if (tx_socket_ >= 0) close(tx_socket_);
+    if (rx_socket_ >= 0) close(rx_socket_);
+  }
+
+private:
+  void openUdp() {
+    rx_socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+    tx_socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+
+    std::memset(&udp_addr_, 0, sizeof(udp_addr_));
+    udp_addr_.sin_family      = AF_INET;
+    udp_addr_.sin_port        = htons(static_cast<uint16_t>(udp_port_));
+    udp_addr_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (rx_socket_ < 0 || tx_socket_ < 0 ||
+        bind(rx_socket_, reinterpret_cast<sockaddr *>(&udp_addr_), sizeof(udp_addr_)) < 0) {
+      RCLCPP_ERROR(this->get_logger(), "Could not open UDP loopback on port %d, using dds",
+                   udp_port_);
+      transport_ = "dds";
+      return;
+    }
+    udp_thread_ = std::thread(&AutopilotLoopback::udpReceiveLoop, this);
+  }
+
+  void ratesCallback(const geometry_msgs::msg::TwistStamped::SharedPtr _msg) {
+    pending_rates_ = Eigen::Vector3d(_msg->twist.angular.x, _msg->twist.angular.y,
+                                     _msg->twist.angular.z);
+  }
+
+  // The controller fills both messages in the same tick, the thrust one closes the command
+  void thrustCallback(const as2_msgs::msg::Thrust::SharedPtr _msg) {
+    const int64_t stamp_ns = rclcpp::Time(_msg->header.stamp).nanoseconds();
+    if (transport_ == "udp") {
+      RateThrustPacket packet;
+      packet.seq      = tx_seq_++;
+      packet.stamp_ns = stamp_ns;
+      packet.sent_ns  = this->now().nanoseconds();
+      for (int i = 0; i < 3; i++) packet.body_rates[i] = static_cast<float>(pending_rates_[i]);
+      packet.thrust = _msg->thrust;
+      sendto(tx_socket_, &packet, sizeof(packet), 0, reinterpret_cast<sockaddr *>(&udp_addr_),
+             sizeof(udp_addr_));
+      return;
+    }
+    applyCommand(pending_rates_, _msg->thrust, stamp_ns, 0);
+  }
+
+  void udpReceiveLoop() {
+    pollfd pfd{rx_socket_, POLLIN, 0};
+    RateThrustPacket packet;
+    while (running_) {
+      if (poll(&pfd, 1, 100) <= 0) continue;
+      const ssize_t n = recv(rx_socket_, &packet, sizeof(packet), 0);
+      if (n != sizeof(packet) || packet.magic != 0xFD || packet.msg_id != 82) {
+        bad_packets_++;
+        continue;
+      }
+      applyCommand(Eigen::Vector3d(packet.body_rates[0], packet.body_rates[1],
+                                   packet.body_rates[2]),
+                   packet.thrust, packet.stamp_ns, packet.sent_ns);
+    }
+  }
+
+  void applyCommand(const Eigen::Vector3d &_rates, double _thrust, int64_t _stamp_ns,
+                    int64_t _sent_ns) {
+    const int64_t now_ns = this->now().nanoseconds();
+    std::lock_guard<std::mutex> lock(mutex_);
+    cmd_rates_  = _rates;
+    cmd_thrust_ = _thrust;
+    commands_++;
+    command_latency_.add((now_ns - _stamp_ns) * 1e-3);
+    if (_sent_ns > 0) udp_latency_.add((now_ns - _sent_ns) * 1e-3);
+
+    // Upsampled ticks between two samples only repeat the answer to the last one
+    int64_t odom_ns = 0;
+    switch (odom_ring_.match(_stamp_ns, odom_ns)) {
+      case OdometryRing::FIRST:
+        loop_latency_.add((now_ns - odom_ns) * 1e-3);
+        break;
+      case OdometryRing::REPEATED:
+        break;
+      case OdometryRing::UNMATCHED:
+        unmatched_++;
+        break;
+    }
+  }
+
+  void simStep() {
+    const auto now  = std::chrono::steady_clock::now();
+    const double dt = std::chrono::duration<double>(now - last_step_).count();
+    last_step_      = now;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Body rates follow the command as a first order system
+    state_.rates += (cmd_rates_ - state_.rates) * std::min(1.0, dt / rate_tau_);
+
+    const Eigen::Vector3d half_angle = 0.5 * state_.rates * dt;
+    const Eigen::Quaterniond dq(1.0, half_angle.x(), half_angle.y(), half_angle.z());
+    state_.attitude = (state_.attitude * dq).normalized();
+
+    const Eigen::Vector3d thrust_force = state_.attitude * Eigen::Vector3d(0, 0, cmd_thrust_);
+    const Eigen::Vector3d accel = thrust_force / mass_ + gravity_ - drag_ * state_.velocity;
+
+    state_.velocity += accel * dt;
+    state_.position += state_.velocity * dt;
+
+    // Ground contact
+    if (state_.position.z() < 0.0) {
+      state_.position.z() = 0.0;
+      state_.velocity.z() = std::max(0.0, state_.velocity.z());
+    }
+  }
+
+  void publishOdometry() {
+    geometry_msgs::msg::PoseStamped pose;
+    geometry_msgs::msg::TwistStamped twist;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pose.pose.position.x    = state_.position.x();
+      pose.pose.position.y    = state_.position.y();
+      pose.pose.position.z    = state_.position.z();
+      pose.pose.orientation.x = state_.attitude.x();
+      pose.pose.orientation.y = state_.attitude.y();
+      pose.pose.orientation.z = state_.attitude.z();
+      pose.pose.orientation.w = state_.attitude.w();
+      twist.twist.linear.x    = state_.velocity.x();
+      twist.twist.linear.y    = state_.velocity.y();
+      twist.twist.linear.z    = state_.velocity.z();
+      twist.twist.angular.x   = state_.rates.x();
+      twist.twist.angular.y   = state_.rates.y();
+      twist.twist.angular.z   = state_.rates.z();
+    }
+
+    const rclcpp::Time stamp = this->now();
+    pose.header.stamp        = stamp;
+    pose.header.frame_id     = odom_frame_id_;
+    twist.header.stamp       = stamp;
+    twist.header.frame_id    = odom_frame_id_;
+    {
+      // Registered before publishing, the answer may arrive before publish() returns
+      std::lock_guard<std::mutex> lock(mutex_);
+      odom_ring_.push(stamp.nanoseconds());
+    }
+    pose_pub_->publish(pose);
+    twist_pub_->publish(twist);
+  }
+
+  void report() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now    = std::chrono::steady_clock::now();
+    const double span = std::chrono::duration<double>(now - last_report_).count();
+    last_report_      = now;
+
+    RCLCPP_INFO(this->get_logger(),
+                "[%s] commands: %.1f Hz | command latency us p50 %.1f p99 %.1f max %.1f | "
+                "odom->command us p50 %.1f p99 %.1f max %.1f | udp hop us p50 %.1f p99 %.1f | "
+                "unmatched commands %lu | bad packets %lu",
+                transport_.c_str(), commands_ / span, command_latency_.percentile(0.5),
+                command_latency_.percentile(0.99), command_latency_.percentile(1.0),
+                loop_latency_.percentile(0.5), loop_latency_.percentile(0.99),
+                loop_latency_.percentile(1.0), udp_latency_.percentile(0.5),
+                udp_latency_.percentile(0.99), unmatched_, bad_packets_.load());
+    commands_  = 0;
+    unmatched_ = 0;
+    command_latency_.clear();
+    loop_latency_.clear();
+    udp_latency_.clear();
+  }
+
+  std::string transport_;
+  int udp_port_;
+  double mass_;
+  double rate_tau_;
+  double drag_;
+  double sim_rate_;
+  double odom_rate_;
+  std::string odom_frame_id_;
+  std::string base_frame_id_;
+  const Eigen::Vector3d gravity_ = Eigen::Vector3d(0, 0, -9.81);
+
+  std::mutex mutex_;
+  VehicleState state_;
+  Eigen::Vector3d cmd_rates_     = Eigen::Vector3d::Zero();
+  double cmd_thrust_             = 0.0;
+  Eigen::Vector3d pending_rates_ = Eigen::Vector3d::Zero();
+  std::chrono::steady_clock::time_point last_step_;
+  std::chrono::steady_clock::time_point last_report_ = std::chrono::steady_clock::now();
+
+  uint64_t commands_  = 0;
+  uint64_t unmatched_ = 0;  // commands stamped before any recent odometry sample
+  OdometryRing odom_ring_;
+  LatencyStats command_latency_;
+  LatencyStats loop_latency_;
+  LatencyStats udp_latency_;
+
+  int rx_socket_   = -1;
+  int tx_socket_   = -1;
+  uint16_t tx_seq_ = 0;
+  sockaddr_in udp_addr_;
+  std::thread udp_thread_;
+  std::atomic<bool> running_{true};
+  std::atomic<uint64_t> bad_packets_{0};
+
+  rclcpp::Publisher<geometry_msgs::msg::PoseStamped>::SharedPtr pose_pub_;
+  rclcpp::Publisher<geometry_msgs::msg::TwistStamped>::SharedPtr twist_pub_;
+  rclcpp::Subscription<geometry_msgs::msg::TwistStamped>::SharedPtr rates_sub_;
+  rclcpp::Subscription<as2_msgs::msg::Thrust>::SharedPtr thrust_sub_;
+  rclcpp::TimerBase::SharedPtr sim_timer_;
+  rclcpp::TimerBase::SharedPtr odom_timer_;
+  rclcpp::TimerBase::SharedPtr report_timer_;
+};
+
+int main(int argc, char *argv[]) {
+  rclcpp::init(argc, argv);
+  rclcpp::spin(std::make_shared<AutopilotLoopback>());
+  rclcpp::shutdown();
+  return 0;
+}
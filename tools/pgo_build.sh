@@ -0,0 +1,64 @@
+#!/bin/bash
+# Profile guided + link time optimized build of the controller plugin.
+#
+# 1. Release build, closed loop benchmark as baseline.
+# 2. Instrumented build (DF_PGO=GENERATE), the same benchmark is the training workload
+#    (hover, circle and figure eight trajectories).
+# 3. Optimized build with the profiles and LTO (DF_PGO=USE), benchmark again.
+# The speedup of the control path is written to <workspace>/pgo_report.txt
+#
+# Usage: tools/pgo_build.sh [colcon workspace, default: current directory]
+
+set -e
+
+WS_DIR=$(realpath "${1:-.}")
+PKG=controller_plugin_differential_flatness
+BUILD_DIR=${WS_DIR}/build/${PKG}
+PROFILE_DIR=${BUILD_DIR}/pgo_profiles
+BENCHMARK=${BUILD_DIR}/controller_plugin_benchmark_test
+RESULTS_DIR=${BUILD_DIR}/pgo_results
+
+build() {
+  (cd "${WS_DIR}" && colcon build --packages-select ${PKG} \
+    --cmake-args -DCMAKE_BUILD_TYPE=Release -DDF_BUILD_BENCHMARKS=ON -DDF_PGO="$1" \
+    -DDF_PGO_PROFILE_DIR="${PROFILE_DIR}")
+}
+
+run_benchmark() {
+  "${BENCHMARK}" --benchmark_out="$1" --benchmark_out_format=json
+}
+
+mkdir -p "${RESULTS_DIR}"
+
+echo "[PGO] Baseline release build"
+build OFF
+run_benchmark "${RESULTS_DIR}/baseline.json"
+
+echo "[PGO] Instrumented build and training run"
+rm -rf "${PROFILE_DIR}"
+build GENERATE
+"${BENCHMARK}" --benchmark_repetitions=3
+
+echo "[PGO] Optimized build"
+build USE
+run_benchmark "${RESULTS_DIR}/pgo.json"
+
+python3 - "${RESULTS_DIR}/baseline.json" "${RESULTS_DIR}/pgo.json" <<'PYTHON' |
+import json
+import sys
+
+
+def medians(path):
+    with open(path) as f:
+        data = json.load(f)
+    return {b['run_name']: b['cpu_time'] for b in data['benchmarks']
+            if b.get('aggregate_name') == 'median'}
+
+
+baseline, pgo = medians(sys.argv[1]), medians(sys.argv[2])
+print('%-45s %12s %12s %8s' % ('benchmark', 'release ns', 'pgo+lto ns', 'speedup'))
+for name, base in baseline.items():
+    if name in pgo:
+        print('%-45s %12.1f %12.1f %7.2fx' % (name, base, pgo[name], base / pgo[name]))
+PYTHON
+  tee "${WS_DIR}/pgo_report.txt"
@@ -0,0 +1,92 @@
+/*!*******************************************************************************************
+ *  \file       swarm_sim.cpp
+ *  \brief      Closed loop simulation of a large formation, prints its throughput.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "controller_plugin_differential_flatness/DF_swarm_sim.hpp"
+
+using namespace controller_plugin_differential_flatness;
+
+/* A square grid formation with 2 m spacing, centered on the origin, flying a circle of 20 m at
+ * 0.2 rad/s, with the gains of config/default_controller.yaml. Every vehicle starts on its slot,
+ * 0.5 m low. */
+int main(int argc, char *argv[]) {
+  if (argc > 4) {
+    std::cerr << "Usage: " << argv[0] << " [vehicles=1000] [seconds=10] [threads=0 (all)]"
+              << std::endl;
+    return 1;
+  }
+
+  Swarm_config config;
+  config.vehicles             = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+  const double seconds        = argc > 2 ? std::atof(argv[2]) : 10.0;
+  config.threads              = argc > 3 ? std::atoi(argv[3]) : 0;
+  config.gains.kp             = Eigen::Vector3d(6.0, 6.0, 6.0);
+  config.gains.ki             = Eigen::Vector3d(0.005, 0.005, 0.065);
+  config.gains.kd             = Eigen::Vector3d(1.5, 1.5, 3.0);
+  config.gains.kp_ang         = Eigen::Vector3d(5.5, 5.5, 2.0);
+  config.gains.mass           = config.mass;
+  config.gains.antiwindup_cte = 1.0;
+
+  const auto circle = [](const double _t) {
+    const double r = 20.0, w = 0.2;
+    Swarm_origin origin;
+    origin.reference.position = Eigen::Vector3d(r * std::cos(w * _t), r * std::sin(w * _t), 10);
+    origin.reference.velocity =
+        Eigen::Vector3d(-r * w * std::sin(w * _t), r * w * std::cos(w * _t), 0.0);
+    origin.reference.acceleration = -w * w * Eigen::Vector3d(origin.reference.position.x(),
+                                                             origin.reference.position.y(), 0.0);
+    origin.reference.yaw = std::remainder(w * _t + M_PI_2, 2.0 * M_PI);
+    origin.yaw_rate      = w;
+    return origin;
+  };
+
+  SwarmSimulator swarm(config);
+  const size_t side   = static_cast<size_t>(std::ceil(std::sqrt(swarm.size())));
+  const double center = 0.5 * (side - 1.0);
+  for (size_t i = 0; i < swarm.size(); i++) {
+    const Eigen::Vector3d slot(i % side - center, i / side - center, 0.0);
+    swarm.setOffset(i, 2.0 * slot, 0.0);
+  }
+  swarm.resetToFormation(circle(0.0));
+  for (size_t i = 0; i < swarm.size(); i++) {
+    Swarm_vehicle vehicle = swarm.vehicle(i);
+    vehicle.position.z() -= 0.5;
+    swarm.setVehicle(i, vehicle);
+  }
+
+  swarm.run(static_cast<int>(std::lround(seconds / config.dt)), circle);
+  std::cout << swarm.report();
+  return 0;
+}
@@ -0,0 +1,98 @@
+/*!*******************************************************************************************
+ *  \file       telemetry_decoder.cpp
+ *  \brief      Decoder of the controller telemetry stream, prints the records as CSV.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "controller_plugin_differential_flatness/DF_telemetry_codec.hpp"
+
+using namespace controller_plugin_differential_flatness;
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <udp_port>" << std::endl;
+    return 1;
+  }
+  const int port = std::atoi(argv[1]);
+
+  const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(static_cast<uint16_t>(port));
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (sock < 0 || bind(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+    std::perror("bind");
+    return 1;
+  }
+
+  std::cout << "seq,tick,count";
+  for (const char *name : kTelemetryChannelNames) {
+    std::cout << "," << name << "_min," << name << "_max," << name << "_mean";
+  }
+  std::cout << std::endl;
+
+  uint8_t buffer[65536];
+  telemetry_codec::Telemetry_packet packet;
+  bool first        = true;
+  uint16_t last_seq = 0;
+  while (true) {
+    const ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+    if (n <= 0) continue;
+    if (!telemetry_codec::decodePacket(buffer, static_cast<size_t>(n), packet)) {
+      std::cerr << "Malformed packet of " << n << " bytes" << std::endl;
+      continue;
+    }
+    if (!first && packet.seq != static_cast<uint16_t>(last_seq + 1)) {
+      std::cerr << "Lost " << static_cast<uint16_t>(packet.seq - last_seq - 1) << " packets"
+                << std::endl;
+    }
+    first    = false;
+    last_seq = packet.seq;
+
+    for (const Telemetry_record &record : packet.records) {
+      std::cout << packet.seq << "," << record.tick << "," << record.count;
+      for (uint8_t i = 0; i < kTelemetryChannels; i++) {
+        std::cout << "," << record.min[i] << "," << record.max[i] << "," << record.mean[i];
+      }
+      std::cout << "\n";
+    }
+    std::cout.flush();
+  }
+  close(sock);
+  return 0;
+}
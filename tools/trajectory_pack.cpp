@@ -0,0 +1,91 @@
+/*!*******************************************************************************************
+ *  \file       trajectory_pack.cpp
+ *  \brief      Packs a CSV trajectory into the onboard playback format.
+ *
+ *  \copyright  Copyright (c) 2022 Universidad Politécnica de Madrid
+ *              All Rights Reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ ********************************************************************************/
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "controller_plugin_differential_flatness/DF_trajectory_file.hpp"
+
+using namespace controller_plugin_differential_flatness;
+
+/* Input: one sample per line, t,x,y,z,vx,vy,vz,ax,ay,az,yaw at a constant period. Lines that
+ * do not start with a number (headers, comments) are skipped. */
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <input.csv> <output.dftraj>" << std::endl;
+    return 1;
+  }
+
+  std::ifstream input(argv[1]);
+  if (!input) {
+    std::cerr << "Cannot open " << argv[1] << std::endl;
+    return 1;
+  }
+
+  std::vector<Trajectory_record> records;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(input, line)) {
+    line_number++;
+    Trajectory_record record;
+    double *fields = &record.t;
+    const int n    = std::sscanf(line.c_str(), "%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf",
+                                 &fields[0], &fields[1], &fields[2], &fields[3], &fields[4],
+                                 &fields[5], &fields[6], &fields[7], &fields[8], &fields[9],
+                                 &fields[10]);
+    if (n <= 0) continue;
+    if (n != 11) {
+      std::cerr << argv[1] << ":" << line_number << ": expected 11 fields" << std::endl;
+      return 1;
+    }
+    records.push_back(record);
+  }
+
+  std::string error;
+  if (!TrajectoryFile::write(argv[2], records, error)) {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+  // Reading it back checks the samples are on a constant period grid
+  TrajectoryFile check;
+  if (!check.open(argv[2], error)) {
+    std::cerr << error << std::endl;
+    std::remove(argv[2]);
+    return 1;
+  }
+  std::cout << "Packed " << check.size() << " records, " << check.duration() << " s" << std::endl;
+  return 0;
+}